@@ -0,0 +1,306 @@
+// Check and time two ways of doing the BCD add and subtract of the cpus:
+// the arithmetic which Cpu2200t.cpp and Cpu2200vp.cpp use, and looking the
+// answer up in a table, which was tried as a way to get rid of the branches
+// on the intermediate sum.  The tables give the same answer for every
+// input, but take about twice as long per op, so the cpus kept the
+// arithmetic.  See ReadMe.txt in this directory.
+//
+// usage: bcd_alu
+//
+// "make bcd-bench" builds and runs this.  The exit status is 1 if a table
+// and the arithmetic differ for any input.
+
+#include "w2200.h"
+
+#include <chrono>
+#include <cstdio>
+
+// ------------------------------------------------------------------------
+// the arithmetic, as in the cpus.  keep these in step with them.
+// ------------------------------------------------------------------------
+
+// Cpu2200t.cpp: add two BCD nibbles
+static uint8
+tDecimalAdd(uint4 a_op, uint4 b_op, int ci) noexcept
+{
+    int sum = a_op + b_op + ci; // ranges from binary 0 to 19
+    const int co = (sum > 9) ? 1 : 0;
+
+    if (co != 0) {
+        sum -= 10;
+    }
+
+    return static_cast<uint8>((co << 4) + sum);
+}
+
+
+// Cpu2200t.cpp: cy=1 effectively means no borrow; cy=0 means borrow
+static uint8
+tDecimalSub(uint4 a_op, uint4 b_op, int ci) noexcept
+{
+    const uint4 nines_comp = 9-b_op;  // form 9's complement
+
+    return tDecimalAdd(a_op, nines_comp, ci);
+}
+
+
+// Cpu2200vp.cpp: 9b result: carry out and 8b result
+static uint16
+vpDecimalAdd(int a_op, int b_op, int ci) noexcept
+{
+    const int a_op_low  = (a_op >> 0) & 0xF;
+    const int b_op_low  = (b_op >> 0) & 0xF;
+    const int a_op_high = (a_op >> 4) & 0xF;
+    const int b_op_high = (b_op >> 4) & 0xF;
+
+    int sum_low = a_op_low + b_op_low + ci; // ranges from binary 0 to 19
+    int co      = (sum_low > 9) ? 1 : 0;
+    if (co != 0) {
+        sum_low -= 10;
+    }
+
+    int sum_high = a_op_high + b_op_high + co; // ranges from binary 0 to 19
+    co           = (sum_high > 9) ? 1 : 0;
+    if (co != 0) {
+        sum_high -= 10;
+    }
+
+    return static_cast<uint16>((co << 8) + (sum_high << 4) + sum_low);
+}
+
+
+// Cpu2200vp.cpp: 9b result: carry out and 8b result
+// msb of result is new carry bit: 1=borrow, 0=no borrow
+static uint16
+vpDecimalSub(int a_op, int b_op, int ci) noexcept
+{
+    const int a_op_low  = (a_op >> 0) & 0xF;
+    const int a_op_high = (a_op >> 4) & 0xF;
+          int b_op_low  = (b_op >> 0) & 0xF;
+          int b_op_high = (b_op >> 4) & 0xF;
+
+    b_op_low  = 9 - b_op_low;
+    b_op_high = 9 - b_op_high;
+
+    int sum_low = a_op_low + b_op_low + (1-ci); // ranges from binary 0 to 19
+    int borrow;
+    if (sum_low > 9) {
+        sum_low -= 10;
+        borrow = 0;
+    } else {
+        borrow = 1;
+    }
+
+    int sum_high = a_op_high + b_op_high + (1-borrow); // ranges from binary 0 to 19
+    if (sum_high > 9) {
+        sum_high -= 10;
+        borrow = 0;
+    } else {
+        borrow = 1;
+    }
+
+    return static_cast<uint16>((borrow << 8) + (sum_high << 4) + sum_low);
+}
+
+
+// Cpu2200vp.cpp: the nibble product of M, MX and MI
+static uint8
+vpNibbleMul(int hl) noexcept
+{
+    return static_cast<uint8>(((hl >> 4) & 0xF) * (hl & 0xF));
+}
+
+// ------------------------------------------------------------------------
+// the tables.  every nibble value has an entry, as the diagnostics feed
+// the cpus digits greater than 9, and rely on the odd answers they get.
+// ------------------------------------------------------------------------
+
+// 2200T: the 5b result, indexed by (carry in, A digit, B digit)
+struct t_table_t {
+    uint8 r[2][16][16];
+
+    constexpr explicit t_table_t(bool subtract) : r() {
+        for (int ci=0; ci < 2; ci++) {
+        for (int a=0; a < 16; a++) {
+        for (int b=0; b < 16; b++) {
+            const uint4 b_op = static_cast<uint4>((subtract) ? (9-b) : b);
+            const int sum = a + b_op + ci;
+            r[ci][a][b] = static_cast<uint8>((sum > 9) ? ((1 << 4) + sum - 10)
+                                                       : sum);
+        }
+        }
+        }
+    }
+};
+
+static constexpr t_table_t t_add_tbl(false);
+static constexpr t_table_t t_sub_tbl(true);
+
+
+// VP: one digit, indexed by (carry in, A digit, B digit).  the digit may
+// be out of range if an operand wasn't a decimal digit.
+struct vp_digit_t {
+    int8  digit;
+    uint8 co;       // carry out, or borrow out when subtracting
+};
+
+struct vp_digit_table_t {
+    vp_digit_t d[2][16][16];
+
+    constexpr explicit vp_digit_table_t(bool subtract) : d() {
+        for (int ci=0; ci < 2; ci++) {
+        for (int a=0; a < 16; a++) {
+        for (int b=0; b < 16; b++) {
+            const int sum = (subtract) ? (a + (9-b) + (1-ci))
+                                       : (a + b + ci);  // ranges from -6 to 31
+            const bool over = (sum > 9);
+            d[ci][a][b].digit = static_cast<int8>((over) ? (sum - 10) : sum);
+            d[ci][a][b].co    = static_cast<uint8>((over != subtract) ? 1 : 0);
+        }
+        }
+        }
+    }
+};
+
+// VP: the 9b result of a byte, indexed by (carry in, A byte, B byte), so
+// an op is a single lookup.  at 256 KB each, these are filled in at startup.
+struct vp_byte_table_t {
+    uint16 r[2][256][256];
+
+    explicit vp_byte_table_t(const vp_digit_table_t &digits) noexcept {
+        for (int ci=0; ci < 2; ci++) {
+        for (int a=0; a < 256; a++) {
+        for (int b=0; b < 256; b++) {
+            const vp_digit_t lo = digits.d[ci   ][a & 0xF][b & 0xF];
+            const vp_digit_t hi = digits.d[lo.co][a >> 4 ][b >> 4 ];
+            r[ci][a][b] = static_cast<uint16>((hi.co << 8) + 16*hi.digit + lo.digit);
+        }
+        }
+        }
+    }
+};
+
+static constexpr vp_digit_table_t vp_add_digits(false);
+static constexpr vp_digit_table_t vp_sub_digits(true);
+static const vp_byte_table_t vp_add_tbl(vp_add_digits);
+static const vp_byte_table_t vp_sub_tbl(vp_sub_digits);
+
+
+// VP: the nibble product, indexed by the byte
+struct vp_mul_table_t {
+    uint8 p[256];
+
+    constexpr vp_mul_table_t() : p() {
+        for (int n=0; n < 256; n++) {
+            p[n] = static_cast<uint8>(((n >> 4) & 0xF) * (n & 0xF));
+        }
+    }
+};
+
+static constexpr vp_mul_table_t vp_mul_tbl;
+
+// ------------------------------------------------------------------------
+// checking and timing
+// ------------------------------------------------------------------------
+
+// compare a table to the arithmetic for every input; returns the number
+// of mismatches
+template <typename A, typename T>
+static int
+check(const char *name, int max_op, A arith, T table)
+{
+    int errors = 0;
+    for (int ci=0; ci < 2; ci++) {
+    for (int a=0; a <= max_op; a++) {
+    for (int b=0; b <= max_op; b++) {
+        if (arith(a, b, ci) != table(a, b, ci)) {
+            if (errors++ < 10) {
+                printf("%s(%X,%X,%d): %X, but the table says %X\n", name,
+                       a, b, ci, arith(a, b, ci), table(a, b, ci));
+            }
+        }
+    }
+    }
+    }
+    return errors;
+}
+
+
+// time a run of calls of fcn on pseudo-random BCD operands; returns ns
+// per call.
+// the carry in depends on the previous result, as it does when a number
+// is added a digit or byte at a time.
+template <typename F>
+static double
+timeOp(F fcn, int max_op, int carry_shift, uint32 *sink)
+{
+    // decimal digits only, as a running program would use
+    uint32 seed = 12345;
+    auto digit = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<int>((seed >> 16) % 10);
+    };
+    static uint8 ops[2][4096];
+    for (int i=0; i < 4096; i++) {
+        for (auto &op : ops) {
+            const int d = digit();
+            op[i] = static_cast<uint8>((max_op > 15) ? (16*d + digit()) : d);
+        }
+    }
+
+    const int n = 100000000;
+    uint32 acc = 0;
+    int ci = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i=0; i < n; i++) {
+        const int rslt = fcn(ops[0][i & 4095], ops[1][i & 4095], ci);
+        ci   = (rslt >> carry_shift) & 1;
+        acc += rslt;
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    *sink += acc;
+    return std::chrono::duration<double, std::nano>(stop - start).count() / n;
+}
+
+
+int
+main()
+{
+    int errors = 0;
+    errors += check("2200T add", 15,
+                    [](int a, int b, int ci) { return tDecimalAdd(a, b, ci); },
+                    [](int a, int b, int ci) { return t_add_tbl.r[ci][a][b]; });
+    errors += check("2200T sub", 15,
+                    [](int a, int b, int ci) { return tDecimalSub(a, b, ci); },
+                    [](int a, int b, int ci) { return t_sub_tbl.r[ci][a][b]; });
+    errors += check("VP add", 255,
+                    [](int a, int b, int ci) { return vpDecimalAdd(a, b, ci); },
+                    [](int a, int b, int ci) { return vp_add_tbl.r[ci][a][b]; });
+    errors += check("VP sub", 255,
+                    [](int a, int b, int ci) { return vpDecimalSub(a, b, ci); },
+                    [](int a, int b, int ci) { return vp_sub_tbl.r[ci][a][b]; });
+    errors += check("VP mul", 255,
+                    [](int a, int, int) { return vpNibbleMul(a); },
+                    [](int a, int, int) { return vp_mul_tbl.p[a]; });
+    printf("%d mismatches between the tables and the arithmetic\n", errors);
+
+    // ns per op, arithmetic then table
+    uint32 sink = 0;
+    printf("2200T add: %5.2f -> %5.2f ns/op\n",
+           timeOp([](int a, int b, int ci) { return tDecimalAdd(a, b, ci); }, 15, 4, &sink),
+           timeOp([](int a, int b, int ci) { return t_add_tbl.r[ci][a][b]; }, 15, 4, &sink));
+    printf("2200T sub: %5.2f -> %5.2f ns/op\n",
+           timeOp([](int a, int b, int ci) { return tDecimalSub(a, b, ci); }, 15, 4, &sink),
+           timeOp([](int a, int b, int ci) { return t_sub_tbl.r[ci][a][b]; }, 15, 4, &sink));
+    printf("VP add:    %5.2f -> %5.2f ns/op\n",
+           timeOp([](int a, int b, int ci) { return vpDecimalAdd(a, b, ci); }, 255, 8, &sink),
+           timeOp([](int a, int b, int ci) { return vp_add_tbl.r[ci][a][b]; }, 255, 8, &sink));
+    printf("VP sub:    %5.2f -> %5.2f ns/op\n",
+           timeOp([](int a, int b, int ci) { return vpDecimalSub(a, b, ci); }, 255, 8, &sink),
+           timeOp([](int a, int b, int ci) { return vp_sub_tbl.r[ci][a][b]; }, 255, 8, &sink));
+    printf("(%u)\n", sink);  // so the loops aren't optimized away
+
+    return (errors == 0) ? 0 : 1;
+}
+
+// vim: ts=8:et:sw=4:smarttab
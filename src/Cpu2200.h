@@ -6,6 +6,9 @@
 #include "w2200.h"
 
 class Scheduler;
+class StateReader;
+class StateWriter;
+class System2200;
 class Timer;
 
 // ============================= base class =============================
@@ -50,13 +53,30 @@ public:
     // run for ticks*100ns
     virtual int execOneOp() = 0;
 
+    // run ops until budget_ns has elapsed, or until next_event_ns has
+    // elapsed and a timer comes due.  ops which can signal other devices
+    // are run one per call so the scheduler is current when they happen.
+    // it returns the number of ns consumed; if the cpu halts, it stops early.
+    virtual int64 execFor(int64 budget_ns, int64 next_event_ns) = 0;
+
+    // number of microinstructions performed since the cpu was built.
+    // trips around an idle loop which were skipped over don't count.
+    uint64 getOpCount() const noexcept { return m_op_count; }
+
     // this is a signal that in theory any card could use to set a
     // particular status flag in a cpu register, but the only role
     // I know it is used for is when the keyboard HALT key is pressed.
     virtual void halt() noexcept = 0;
 
+    // save or restore the complete cpu state: registers, RAM, and any
+    // writable control store.  a restore must be made into a cpu of the
+    // same type and memory size; problems are reported via sr.fail().
+    virtual void saveState(StateWriter &sw) const = 0;
+    virtual void loadState(StateReader &sr) = 0;
+
 protected:
-    int m_status = CPU_HALTED;  // whether the cpu is running or halted
+    int    m_status   = CPU_HALTED;  // whether the cpu is running or halted
+    uint64 m_op_count = 0;           // microinstructions performed
 
 private:
 };
@@ -68,7 +88,8 @@ class Cpu2200t: public Cpu2200
 public:
     CANT_ASSIGN_OR_COPY_CLASS(Cpu2200t);
     // ---- see base class for description of these members: ----
-    Cpu2200t(std::shared_ptr<Scheduler> scheduler,
+    Cpu2200t(System2200 &sys,
+             std::shared_ptr<Scheduler> scheduler,
              int ramsize, int subtype);
     ~Cpu2200t() override;
     int   getCpuType() const noexcept override;
@@ -77,7 +98,10 @@ public:
     void  setDevRdy(bool ready) noexcept override;
     void  ioCardCbIbs(int data) override;
     int   execOneOp() override;  // simulate one instruction
+    int64 execFor(int64 budget_ns, int64 next_event_ns) override;
     void  halt() noexcept override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
 private:
     // ---- member functions ----
@@ -110,6 +134,7 @@ private:
 
     // ---- data members ----
 
+    System2200                 &m_sys;        // the machine we are part of
     std::shared_ptr<Scheduler>  m_scheduler;  // shared system event scheduler
     const int                   m_cpu_type;   // type cpu flavor, eg CPUTYPE_2200T
 
@@ -123,12 +148,14 @@ private:
     static const int ICSTACK_TOP  = (ICSTACK_SIZE-1);  // index of top of stack
     static const int ICSTACK_MASK = 0xF;
 
+    static const int IDLE_LOOP_NS = 40000; // longest loop checked for idling
+
     struct ucode_t {
         uint32 ucode;       // 19:0 stores raw ucode word
                             // 24:20 stores the repacked B field specifier
                             // 31:30 stores flags about required operands
         uint8  op;          // predecode: specific instruction
-        uint8  p8;          // unused
+        bool   io_op;       // predecode: op can signal devices (CIO, ST1 store)
         uint16 p16;         // predecode: instruction specific
     };
 
@@ -145,6 +172,9 @@ private:
     const int m_mem_size;       // size, in bytes
     uint8     m_ram[MAX_RAM];
 
+    // count of stores to main memory
+    uint32    m_stores = 0;
+
     // this contains the CPU state
     struct cpu2200_t {
         uint16  pc;             // working address ("pc register")
@@ -175,7 +205,8 @@ class Cpu2200vp: public Cpu2200
 public:
     CANT_ASSIGN_OR_COPY_CLASS(Cpu2200vp);
     // ---- see base class for description of these members: ----
-    Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
+    Cpu2200vp(System2200 &sys,
+              std::shared_ptr<Scheduler> scheduler,
               int ramsize, int subtype);
     ~Cpu2200vp() override;
     int   getCpuType() const noexcept override;
@@ -184,7 +215,10 @@ public:
     void  setDevRdy(bool ready) noexcept override;
     void  ioCardCbIbs(int data) override;
     int   execOneOp() override;  // simulate one instruction
+    int64 execFor(int64 budget_ns, int64 next_event_ns) override;
     void  halt() noexcept override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
     // ---- class-specific members: ----
 
@@ -212,18 +246,82 @@ private:
     void dumpRam(const std::string &filename);
 #endif
 
+    // ---- instruction execution; see the notes in Cpu2200vp.cpp ----
+
+    struct ucode_t;
+
+    // each microstore word holds a pointer to the routine which executes it
+    using uop_handler_t = int (*)(Cpu2200vp &cpu, const ucode_t *puop);
+
+    // reference interpreter: decode the word on each execution
+    int execOneOpSwitch(const ucode_t *puop);
+
+    // threaded interpreter: handler specialized for one op, carry mode,
+    // memory operation, and whether memory is banked
+    template <int OP, int CY, int DD, bool BANKED>
+    static int execUop(Cpu2200vp &cpu, const ucode_t *puop);
+
+    // the body of each op, shared by both interpreters.  DD is the
+    // predecoded D field, or -1 if the op must decode the D and C fields.
+    // BANKED=false assumes there is neither a BSR nor a bank offset.
+    template <int OP, int DD, bool BANKED>
+    int execOp(const ucode_t *puop, int a_op, int b_op, int a_op2, int b_op2);
+
+    // return the handler for the given op, carry mode, D field and banking
+    static uop_handler_t getUopHandler(int op, int cy, int dd, bool banked) noexcept;
+
+    // fill in the threaded interpreter predecode fields of a ucode word
+    void predecodeOperands(ucode_t *puop) const noexcept;
+
+    // store a result to the register at the given offset into m_cpu
+    void storeC(int c_off, int val);
+
+    // ---- translation cache; see the notes in Cpu2200vp.cpp ----
+
+    // find the straight-line run of ops starting at addr
+    void translateBlock(uint16 addr) noexcept;
+
+    // discard any block which includes addr
+    void invalidateBlocks(uint16 addr) noexcept;
+
+    // run the block starting at the current ic
+    int execBlock(int num_ops, int block_ns);
+
+    // perform the op at ic, or the block starting there if it completes
+    // within event_ns
+    int execNext(int64 event_ns);
+
+    // ---- native code generation; see the notes in Cpu2200vp.cpp ----
+
+    // compile the block starting at addr; returns false on failure
+    bool jitCompile(uint16 addr) noexcept;
+
+    // discard all compiled code
+    void jitFlush() noexcept;
+
     static const int MAX_RAM   = 8192*1024; // max # bytes of main memory
     static const int MAX_UCODE =   64*1024; // max # words in ucode store
     static const int STACKSIZE = 96; // number of entries in the return stack
 
+    static const int MAX_BLOCK_OPS = 32;   // longest block, in ops
+    static const int MAX_BLOCK_NS  = 8000; // longest block, in ns
+
+    static const int JIT_THRESHOLD  = 64;        // runs before compiling a block
+    static const int JIT_ARENA_SIZE = 4*1024*1024; // bytes of compiled code
+
+    static const int IDLE_LOOP_NS = 20000; // longest loop checked for idling
+
     // ---- data members ----
 
     const int m_cpu_subtype;
     const int m_mem_size;       // size, in bytes
+    const bool m_banked;        // memory has more than one bank, or a BSR
 
     bool                        m_has_oneshot = false; // this cpu supports timeslicing
+    System2200                 &m_sys;         // the machine we are part of
     std::shared_ptr<Scheduler>  m_scheduler;   // shared system timing scheduler object
     std::shared_ptr<Timer>      m_tmr_30ms;    // time slice 30 ms one shot
+    bool                        m_30ms_warning = false; // warned this isn't an MVP cpu
 
     struct ucode_t {
         uint32 ucode;       // raw ucode word (really 24b)
@@ -231,28 +329,54 @@ private:
         uint8  op;          // predecode: specific instruction
         uint8  p8;          // predecode: instruction specific
         uint16 p16;         // predecode: instruction specific
+        uint8  a_off[2];    // predecode: m_cpu offset of A operand (and A+1)
+        uint8  b_off[2];    // predecode: m_cpu offset of B operand (and B+1)
+        uint8  c_off[2];    // predecode: m_cpu offset of C result (and C+1)
+        bool   io_op;       // predecode: op can signal devices (CIO, SH store)
+        uop_handler_t handler;  // predecode: threaded interpreter entry
     } m_ucode[MAX_UCODE];
     int m_ucode_words;      // number of implemented words
 
+    // translation cache, indexed by the address of the first op of a block
+    using jit_fn_t = int (*)(Cpu2200vp *cpu);
+    struct block_t {
+        uint16   num_ops;   // 0=not translated yet, 1=no block starts here
+        uint16   ns;        // time to execute the whole block
+        uint16   hits;      // times run since translation
+        jit_fn_t code;      // compiled block, or nullptr
+    } m_blocks[MAX_UCODE];
+
+    // executable memory for compiled blocks
+    uint8 *m_jit_arena = nullptr;
+    int    m_jit_used  = 0;         // bytes of arena in use
+
+    // count of stores to main memory and to the control store
+    uint32 m_stores = 0;
+
     // main memory
     uint8     m_ram[MAX_RAM];
 
     // this contains the CPU state
+    // the registers which can be named by the A, B, and C fields come first
+    // so the threaded interpreter can address them with 8b offsets.
+    // sl and sh must be last, as storing to them has side effects.
     struct cpu2200vp_t {
+        uint8   reg[8];         // eight 8b file registers
         uint16  pc;             // working address ("pc register")
+        uint8   ch;             // high data memory read register
+        uint8   cl;             // low data memory read register
+        uint8   k;              // i/o data register
+        uint8   zero;           // always 0; source for dummy operands
+        uint8   sink;           // destination for discarded results
+        uint8   sl;             // low  status reg
+        uint8   sh;             // high status reg
         uint16  orig_pc;        // copy of pc at start of instruction (not always valid)
         uint16  aux[32];        // PC scratchpad
-        uint8   reg[8];         // eight 8b file registers
         uint16  ic;             // microcode instruction counter
         uint16  icstack[STACKSIZE]; // microcode subroutine stack
         int     icsp;           // icstack pointer
-        uint8   ch;             // high data memory read register
-        uint8   cl;             // low data memory read register
-        uint8   k;              // i/o data register
         uint8   ab;             // i/o address bus latch
         uint8   ab_sel;         // ab at time of last ABS
-        uint8   sh;             // high status reg
-        uint8   sl;             // low  status reg
         bool    bsr_mode;       // true=bsr register is active
         uint8   bsr;            // bank select register (microvp-2 feature)
         int     bank_offset;    // predecoded from sl
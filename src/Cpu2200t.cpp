@@ -3,11 +3,19 @@
 #include "Cpu2200.h"
 #include "IoCardKeyboard.h"
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "Ui.h"
 #include "host.h"             // for dbglog
 #include "system2200.h"
 #include "ucode_2200.h"
 
+#include <cstring>            // for memcpy, memcmp
+
+// 1=notice when the microcode is spinning in a loop which can't end until
+// some device changes state, and skip ahead to the next timer event.
+// this works the same way as it does in Cpu2200vp.cpp; see the notes there.
+#define IDLE_DETECT 1
+
 // if this is defined as 0, a few variables get initialized
 // unnecessarily, which may very slightly slow down the emulation,
 // but which will result in the compiler complaining about potentially
@@ -203,7 +211,6 @@ Cpu2200t::writeUcode(int addr, uint32 uop) noexcept
     uop &= 0x000FFFFF;  // only 20b are meaningful
 
     m_ucode[addr].ucode = uop;
-    m_ucode[addr].p8    = 0;    // default
     m_ucode[addr].p16   = 0;    // default
 
     switch (opcode1) {
@@ -377,6 +384,13 @@ Cpu2200t::writeUcode(int addr, uint32 uop) noexcept
         m_ucode[addr].op     = OP_ILLEGAL;
         m_ucode[addr].p16    = 0;
     }
+
+    // note ops which can reach other devices: CIO, and storing to ST1,
+    // which may change CPB.  see storeOperandC().
+    const int op = m_ucode[addr].op;
+    const bool xbit = ((uop >> 14) & 0x1) != 0;
+    m_ucode[addr].io_op = (op == OP_CIO)
+                       || ((op >= OP_OR) && (op <= OP_DACI) && !xbit && (c_field == 10));
 }
 
 
@@ -553,6 +567,7 @@ Cpu2200t::writeMem(uint16 addr, uint4 wr_value, int write2) noexcept
 
         const int RAMaddr = (addr >> 1);
         assert(RAMaddr < m_mem_size);
+        ++m_stores;
 
         if ((addr & 1) != 0) {
             m_ram[RAMaddr] = static_cast<uint8>((m_ram[RAMaddr] & 0x0F) | (wr_value << 4));
@@ -585,7 +600,7 @@ Cpu2200t::writeMem(uint16 addr, uint4 wr_value, int write2) noexcept
 uint4
 Cpu2200t::readSt3() const
 {
-    const int k = system2200::cpuPollIB();
+    const int k = m_sys.cpuPollIB();
     const int ib5 = (k >> 4) & 1;  // isolate bit 5
 
     return static_cast<uint4>(
@@ -605,7 +620,7 @@ Cpu2200t::setSt1(uint4 value)
     m_cpu.st1 = value;
 
     if (cpb_changed != 0) {
-        system2200::dispatchCpuBusy((m_cpu.st1 & ST1_MASK_CPB) != 0);
+        m_sys.dispatchCpuBusy((m_cpu.st1 & ST1_MASK_CPB) != 0);
     }
 }
 
@@ -671,7 +686,8 @@ Cpu2200t::storeOperandC(uint32 uop, uint4 value)
     } while (false)
 
 
-// add two BCD nibbles
+// add two BCD nibbles.  looking the answer up in a table was tried, and
+// was slower; see bench/bcd_alu.cpp.
 static uint8
 decimalAdd(uint4 a_op, uint4 b_op, int ci) noexcept
 {
@@ -731,9 +747,11 @@ decimalSub(uint4 a_op, uint4 b_op, int ci) noexcept
 // create a CPU instance.
 // ramsize should be a multiple of 4.
 // subtype selects between the flavors of the cpu
-Cpu2200t::Cpu2200t(std::shared_ptr<Scheduler> scheduler,
+Cpu2200t::Cpu2200t(System2200 &sys,
+                   std::shared_ptr<Scheduler> scheduler,
                    int ramsize, int cpu_subtype) :
     Cpu2200(),
+    m_sys(sys),
     m_scheduler(scheduler),  // unused by 2200t
     m_cpu_type(cpu_subtype),
     m_ucode_size((m_cpu_type == CPUTYPE_2200B) ? UCODE_WORDS_2200B
@@ -773,8 +791,9 @@ Cpu2200t::Cpu2200t(std::shared_ptr<Scheduler> scheduler,
     }
 
     // register for clock callback
-    clkCallback cb = std::bind(&Cpu2200t::execOneOp, this);
-    system2200::registerClockedDevice(cb);
+    clkCallback cb = [this](int64 budget_ns, int64 next_event_ns)
+                     { return Cpu2200t::execFor(budget_ns, next_event_ns); };
+    m_sys.registerClockedDevice(cb);
 
 #if 0
     // disassemble all microcode
@@ -802,8 +821,9 @@ Cpu2200t::Cpu2200t(std::shared_ptr<Scheduler> scheduler,
 // frees any allocated resources at the end of the simulation
 Cpu2200t::~Cpu2200t()
 {
-    clkCallback cb = std::bind(&Cpu2200t::execOneOp, this);
-    system2200::unregisterClockedDevice(cb);
+    clkCallback cb = [this](int64 budget_ns, int64 next_event_ns)
+                     { return Cpu2200t::execFor(budget_ns, next_event_ns); };
+    m_sys.unregisterClockedDevice(cb);
 }
 
 
@@ -899,7 +919,7 @@ Cpu2200t::ioCardCbIbs(int data)
     assert((m_cpu.st1 & ST1_MASK_CPB) == 0);
     m_cpu.k = static_cast<uint8>(data & 0xFF);
     m_cpu.st1 |= ST1_MASK_CPB;  // CPU busy; inhibit IBS
-    system2200::dispatchCpuBusy(true);  // the cpu is busy now
+    m_sys.dispatchCpuBusy(true);  // the cpu is busy now
 
     // return special status if it is a special function key
     if ((data & IoCardKeyboard::KEYCODE_SF) != 0) {
@@ -944,6 +964,77 @@ Cpu2200t::getAB() const noexcept
 }
 
 
+// the microcode and constant ROMs aren't saved as they can't change
+void
+Cpu2200t::saveState(StateWriter &sw) const
+{
+    sw.putU8(m_cpu_type);
+    sw.putU8(m_status);
+
+    sw.putU16(m_cpu.pc);
+    for (const auto aux : m_cpu.aux) {
+        sw.putU16(aux);
+    }
+    sw.putBytes(&m_cpu.reg[0], sizeof(m_cpu.reg));
+    sw.putU16(m_cpu.ic);
+    for (const auto ret : m_cpu.icstack) {
+        sw.putU16(ret);
+    }
+    sw.putI32(m_cpu.icsp);
+    sw.putU8(m_cpu.c);
+    sw.putU8(m_cpu.k);
+    sw.putU8(m_cpu.ab);
+    sw.putU8(m_cpu.ab_sel);
+    sw.putU8(m_cpu.st1);
+    sw.putU8(m_cpu.st2);
+    sw.putU8(m_cpu.st3);
+    sw.putU8(m_cpu.st4);
+    sw.putBool(m_cpu.prev_sr);
+
+    sw.putBlob(&m_ram[0], m_mem_size);
+}
+
+
+void
+Cpu2200t::loadState(StateReader &sr)
+{
+    if (sr.getU8() != m_cpu_type) {
+        sr.fail("the saved cpu is a different type");
+        return;
+    }
+    m_status = sr.getU8();
+
+    m_cpu.pc = sr.getU16();
+    for (auto &aux : m_cpu.aux) {
+        aux = sr.getU16();
+    }
+    sr.getBytes(&m_cpu.reg[0], sizeof(m_cpu.reg));
+    m_cpu.ic = sr.getU16();
+    for (auto &ret : m_cpu.icstack) {
+        ret = sr.getU16();
+    }
+    m_cpu.icsp    = sr.getI32() & ICSTACK_MASK;
+    m_cpu.c       = sr.getU8();
+    m_cpu.k       = sr.getU8();
+    m_cpu.ab      = sr.getU8();
+    m_cpu.ab_sel  = sr.getU8();
+    m_cpu.st1     = sr.getU8();
+    m_cpu.st2     = sr.getU8();
+    m_cpu.st3     = sr.getU8();
+    m_cpu.st4     = sr.getU8();
+    m_cpu.prev_sr = sr.getBool();
+
+    if (m_cpu.ic >= m_ucode_size) {
+        sr.fail("bad cpu state");
+    }
+
+    const uint8 *ram = sr.getBlob(m_mem_size);
+    if (ram != nullptr) {
+        memcpy(&m_ram[0], ram, m_mem_size);
+    }
+}
+
+
 // perform one instruction and return the number of ns the instruction took.
 // returns EXEC_ERR if we hit an illegal op.
 #define EXEC_ERR (1 << 30)
@@ -1297,7 +1388,7 @@ Cpu2200t::execOneOp()
                     }
                 }
                 //UI_info("CPU:CBS when AB=%02X, AB_SEL=%02X, K=%02X", m_cpu.ab, m_cpu.ab_sel, m_cpu.k);
-                system2200::dispatchCbsStrobe(m_cpu.k);  // control bus strobe
+                m_sys.dispatchCbsStrobe(m_cpu.k);  // control bus strobe
                 break;
 
             case 0x20: // generate -OBS
@@ -1309,7 +1400,7 @@ Cpu2200t::execOneOp()
                     }
                 }
                 //UI_info("CPU:OBS when AB=%02X, AB_SEL=%02X, K=%02X", m_cpu.ab, m_cpu.ab_sel, m_cpu.k);
-                system2200::dispatchObsStrobe(m_cpu.k);  // output data bus strobe
+                m_sys.dispatchObsStrobe(m_cpu.k);  // output data bus strobe
                 break;
 
             case 0x40: // generate -ABS
@@ -1318,9 +1409,9 @@ Cpu2200t::execOneOp()
                     dbglog("-ABS with AB=%02X\n", m_cpu.ab_sel);
                 }
                 //UI_info("CPU:ABS when AB=%02X", m_cpu.ab);
-                system2200::dispatchAbsStrobe(m_cpu.ab_sel);  // address bus strobe
+                m_sys.dispatchAbsStrobe(m_cpu.ab_sel);  // address bus strobe
                 // we might have changed card selection; tell it cpb status
-                system2200::dispatchCpuBusy((m_cpu.st1 & ST1_MASK_CPB) != 0);
+                m_sys.dispatchCpuBusy((m_cpu.st1 & ST1_MASK_CPB) != 0);
                 break;
 
             default:
@@ -1406,4 +1497,79 @@ Cpu2200t::execOneOp()
     return 1600;  // all operations take 1.6us ticks
 }
 
+
+// run ops until budget_ns has elapsed, or until next_event_ns has elapsed
+// and a timer comes due.  an op which can signal other devices only runs
+// first in a batch, and it ends the batch: the scheduler's sense of time
+// must be current when it happens, and it may start a new timer.
+// returns the number of ns consumed.
+int64
+Cpu2200t::execFor(int64 budget_ns, int64 next_event_ns)
+{
+    const int64 stop_ns = (budget_ns < next_event_ns) ? budget_ns : next_event_ns;
+    int64 done_ns = 0;
+
+#if IDLE_DETECT
+    int       loop_ic   = -1;           // where the loop we are watching starts
+    int64     loop_ns   = 0;            // when we last arrived there
+    uint32    loop_st   = 0;            // m_stores at that time
+    bool      loop_full = false;        // loop_cpu holds all of the state
+    cpu2200_t loop_cpu;                 // cpu state when we last arrived
+#endif
+
+    do {
+        const uint16 ic = m_cpu.ic;
+        const bool io_op = m_ucode[ic].io_op;
+        if (io_op && (done_ns > 0)) {
+            break;
+        }
+        const int op_ns = Cpu2200t::execOneOp();
+        if (m_status != CPU_RUNNING) {
+            break;  // illegal op
+        }
+        m_op_count++;
+        done_ns += op_ns;
+        if (io_op) {
+            break;
+        }
+#if IDLE_DETECT
+        if (m_cpu.ic <= ic) {
+            // we branched backwards; it may be to the top of a loop.
+            // the file registers and PC are compared first, as they
+            // nearly always differ in a loop doing real work.
+            const int64 trip_ns = done_ns - loop_ns;
+            if ((loop_ic < 0) || (trip_ns > IDLE_LOOP_NS)) {
+                // start watching the loop which starts here
+                loop_ic = m_cpu.ic;
+                loop_ns = done_ns;
+                loop_st = m_stores;
+                loop_full = false;
+                loop_cpu.pc = m_cpu.pc;
+                memcpy(&loop_cpu.reg[0], &m_cpu.reg[0], sizeof(m_cpu.reg));
+            } else if (m_cpu.ic == loop_ic) {
+                // we made a trip around the loop
+                const bool same_key = (loop_cpu.pc == m_cpu.pc) &&
+                    (memcmp(&loop_cpu.reg[0], &m_cpu.reg[0], sizeof(m_cpu.reg)) == 0);
+                if (same_key && loop_full && (loop_st == m_stores) &&
+                    (memcmp(&loop_cpu, &m_cpu, sizeof(m_cpu)) == 0)) {
+                    // nothing changed, so nothing will until the batch ends
+                    done_ns += ((stop_ns - done_ns) / trip_ns) * trip_ns;
+                } else if (same_key) {
+                    memcpy(&loop_cpu, &m_cpu, sizeof(m_cpu));
+                    loop_full = true;
+                } else {
+                    loop_cpu.pc = m_cpu.pc;
+                    memcpy(&loop_cpu.reg[0], &m_cpu.reg[0], sizeof(m_cpu.reg));
+                    loop_full = false;
+                }
+                loop_ns = done_ns;
+                loop_st = m_stores;
+            }
+        }
+#endif
+    } while (done_ns < stop_ns);
+
+    return done_ns;
+}
+
 // vim: ts=8:et:sw=4:smarttab
@@ -13,11 +13,54 @@
 #include "Cpu2200.h"
 #include "IoCardKeyboard.h"
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "Ui.h"
 #include "host.h"             // for dbglog
 #include "system2200.h"
 #include "ucode_2200.h"
 
+#include <algorithm>          // for std::max
+#include <cstddef>            // for offsetof
+#include <cstring>            // for memcpy, memcmp
+#include <vector>
+
+// 1=run the threaded interpreter, 0=run the reference switch interpreter.
+// see the notes at "instruction execution", below.
+#define THREADED_DISPATCH 1
+
+// 1=run straight-line runs of ops as blocks from the translation cache.
+// it requires THREADED_DISPATCH.  see the notes at "translation cache".
+#define BLOCK_CACHE 1
+
+#if BLOCK_CACHE && !THREADED_DISPATCH
+    #error "BLOCK_CACHE requires THREADED_DISPATCH"
+#endif
+
+// 1=notice when the microcode is spinning in a loop which can't end until
+// some device changes state, and skip ahead to the next timer event.
+// see the notes at "idle detection", below.
+#define IDLE_DETECT 1
+
+// 1=compile frequently run blocks to native code.  it requires BLOCK_CACHE,
+// and is possible only on x86-64 hosts using the System V calling convention.
+// it is off by default: on the benchmarks so far it is no faster than running
+// blocks from the translation cache.  "make native-check" builds it, and
+// checks that it runs the same as the interpreter.
+// see "native code generation".
+#ifndef NATIVE_CODE
+    #define NATIVE_CODE 0
+#endif
+
+#if NATIVE_CODE && BLOCK_CACHE && defined(__x86_64__) && !defined(_WIN32)
+    #define VP_JIT 1
+#else
+    #define VP_JIT 0
+#endif
+
+#if VP_JIT
+    #include <sys/mman.h>     // for mmap, mprotect
+#endif
+
 // control which functions get inlined
 // FIXME: it doesn't work, becuse static func can't access members
 #define INLINE_STORE_C 1
@@ -27,9 +70,6 @@
 static bool g_dbg_trace = false;
 #endif
 
-// give a one-time warning about a misconfigured system
-static bool g_30ms_warning = false;
-
 // if this is defined as 0, a few variables get initialized
 // unnecessarily, which may very slightly slow down the emulation,
 // but which will result in the compiler complaining about potentially
@@ -439,6 +479,9 @@ Cpu2200vp::writeUcode(uint16 addr, uint32 uop, bool force) noexcept
         m_ucode[addr].p8     = 0;
         m_ucode[addr].p16    = 0;
     }
+
+    predecodeOperands(&m_ucode[addr]);
+    invalidateBlocks(addr);
 }
 
 
@@ -540,12 +583,13 @@ Cpu2200vp::setSH(uint8 value)
                                   | ( mask & m_cpu.sh));
 
     if (cpb_changed != 0) {
-        system2200::dispatchCpuBusy((m_cpu.sh & SH_MASK_CPB) != 0);
+        m_sys.dispatchCpuBusy((m_cpu.sh & SH_MASK_CPB) != 0);
     }
 }
 
 
-// 9b result: carry out and 8b result
+// 9b result: carry out and 8b result.  looking the answer up in a table was
+// tried, and was slower; see bench/bcd_alu.cpp.
 static uint16
 decimalAdd(int a_op, int b_op, int ci) noexcept
 {
@@ -650,9 +694,11 @@ decimalSub(int a_op, int b_op, int ci) noexcept
 
 
 // addresses < 8KB always refer to bank 0.
-// otherwise, add the bank offset, and force the addr to zero if it is too big
+// otherwise, add the bank offset, and force the addr to zero if it is too big.
+// unless BANKED, the bank offset is always 0 and bsr_mode is never set.
 #define INLINE_MAP_ADDRESS(addr)                                              \
-    (  ((addr) < 8192 && !m_cpu.bsr_mode) ? (addr)                            \
+    (  (!BANKED) ? (((addr) < m_mem_size) ? (addr) : (0))                     \
+     : ((addr) < 8192 && !m_cpu.bsr_mode) ? (addr)                            \
      : ((addr) + m_cpu.bank_offset < m_mem_size) ? (m_cpu.bank_offset+(addr)) \
      : (0)                                                                    \
     )
@@ -667,7 +713,13 @@ decimalSub(int a_op, int b_op, int ci) noexcept
 #define INLINE_MEM_WRITE(addr,wr_value,write2)            \
     do {                                                  \
         int la = (addr);                                  \
-        if (la < 8192 && !m_cpu.bsr_mode) {               \
+        ++m_stores;                                       \
+        if (!BANKED) {                                    \
+            if (la < m_mem_size) {                        \
+                la ^= (write2);                           \
+                m_ram[la] = static_cast<uint8>(wr_value); \
+            }                                             \
+        } else if (la < 8192 && !m_cpu.bsr_mode) {        \
             la ^= (write2);                               \
             m_ram[la] = static_cast<uint8>(wr_value);     \
         } else if (la + m_cpu.bank_offset < m_mem_size) { \
@@ -753,11 +805,14 @@ Cpu2200vp::getHbHa(int HbHa, int a_op, int b_op) const noexcept
 // constructor
 // ramsize should be a multiple of 4.
 // subtype *must* be 2200VP, at least presently
-Cpu2200vp::Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
+Cpu2200vp::Cpu2200vp(System2200 &sys,
+                     std::shared_ptr<Scheduler> scheduler,
                      int ramsize, int cpu_subtype) :
     Cpu2200(),
     m_cpu_subtype(cpu_subtype),
     m_mem_size(ramsize),
+    m_banked((cpu_subtype == Cpu2200::CPUTYPE_MICROVP) || (ramsize > 64*1024)),
+    m_sys(sys),
     m_scheduler(scheduler)
 {
     // find which configuration options are available/legal for this CPU
@@ -773,6 +828,26 @@ Cpu2200vp::Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
     assert(cpu_cfg->ucode_size_options.size() == 1);
     m_ucode_words = cpu_cfg->ucode_size_options[0] * 1024;
     m_has_oneshot = cpu_cfg->has_oneshot;
+    if (m_has_oneshot) {
+        m_tmr_30ms = m_scheduler->createTimer([&](){ oneShot30msCallback(); },
+                                                "cpu one-shot");
+    }
+
+    // nothing has been translated yet
+    for (auto &blk : m_blocks) {
+        blk.num_ops = 0;
+        blk.ns      = 0;
+        blk.hits    = 0;
+        blk.code    = nullptr;
+    }
+#if VP_JIT
+    // it is mapped writable only while code is being copied into it
+    void * const arena = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena != MAP_FAILED) {
+        m_jit_arena = static_cast<uint8*>(arena);
+    }
+#endif
 
     // init microcode
     for (int i=0; i < MAX_UCODE; i++) {
@@ -784,8 +859,9 @@ Cpu2200vp::Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
     }
 
     // register for clock callback
-    clkCallback cb = std::bind(&Cpu2200vp::execOneOp, this);
-    system2200::registerClockedDevice(cb);
+    clkCallback cb = [this](int64 budget_ns, int64 next_event_ns)
+                     { return Cpu2200vp::execFor(budget_ns, next_event_ns); };
+    m_sys.registerClockedDevice(cb);
 
 #if 0
     // disassemble boot ROM
@@ -805,6 +881,9 @@ Cpu2200vp::Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
     m_cpu.sl  = 0x00;
     m_cpu.bsr = 0x00;
 
+    // the threaded interpreter fetches dummy operands from here
+    m_cpu.zero = 0x00;
+
     reset(true);
 }
 
@@ -812,10 +891,18 @@ Cpu2200vp::Cpu2200vp(std::shared_ptr<Scheduler> scheduler,
 // free any allocated resources at the end of time
 Cpu2200vp::~Cpu2200vp()
 {
-    clkCallback cb = std::bind(&Cpu2200vp::execOneOp, this);
-    system2200::unregisterClockedDevice(cb);
+    clkCallback cb = [this](int64 budget_ns, int64 next_event_ns)
+                     { return Cpu2200vp::execFor(budget_ns, next_event_ns); };
+    m_sys.unregisterClockedDevice(cb);
 
     reset(true);
+
+#if VP_JIT
+    if (m_jit_arena != nullptr) {
+        munmap(m_jit_arena, JIT_ARENA_SIZE);
+        m_jit_arena = nullptr;
+    }
+#endif
 }
 
 
@@ -870,7 +957,6 @@ Cpu2200vp::reset(bool hard_reset) noexcept
         } else {
             // actually, the one-shot isn't reset, but let's be safe
             m_cpu.sh &= ~SH_MASK_30MS;
-            m_tmr_30ms = nullptr;
         }
     }
 
@@ -889,7 +975,7 @@ Cpu2200vp::ioCardCbIbs(int data)
     assert((m_cpu.sh & SH_MASK_CPB) == 0);
     m_cpu.k = static_cast<uint8>(data & 0xFF);
     m_cpu.sh |= SH_MASK_CPB;    // CPU busy; inhibit IBS
-    system2200::dispatchCpuBusy(true);  // we are busy now
+    m_sys.dispatchCpuBusy(true);  // we are busy now
 
     // return special status if it is a special function key
     if ((data & IoCardKeyboard::KEYCODE_SF) != 0) {
@@ -933,272 +1019,410 @@ Cpu2200vp::getAB() const noexcept
 }
 
 
+// the control store is saved because the boot ROM loads the real microcode
+// into it.  it is saved as 24b words; the predecoded forms are rebuilt on
+// restore.  RAM is copied back rather than used in place from the mapped
+// file because the threaded interpreter and compiled blocks address m_ram
+// relative to the cpu object.
+void
+Cpu2200vp::saveState(StateWriter &sw) const
+{
+    sw.putU8(m_cpu_subtype);
+    sw.putU8(m_status);
+
+    sw.putBytes(&m_cpu.reg[0], sizeof(m_cpu.reg));
+    sw.putU16(m_cpu.pc);
+    sw.putU8(m_cpu.ch);
+    sw.putU8(m_cpu.cl);
+    sw.putU8(m_cpu.k);
+    sw.putU8(m_cpu.sl);
+    sw.putU8(m_cpu.sh);
+    sw.putU16(m_cpu.orig_pc);
+    for (const auto aux : m_cpu.aux) {
+        sw.putU16(aux);
+    }
+    sw.putU16(m_cpu.ic);
+    for (const auto ret : m_cpu.icstack) {
+        sw.putU16(ret);
+    }
+    sw.putI32(m_cpu.icsp);
+    sw.putU8(m_cpu.ab);
+    sw.putU8(m_cpu.ab_sel);
+    sw.putU8(m_cpu.bsr);
+
+    if (m_has_oneshot) {
+        m_tmr_30ms->saveState(sw);
+    }
+
+    std::vector<uint8> ucode(3*MAX_UCODE);
+    for (int i=0; i < MAX_UCODE; i++) {
+        const uint32 uop = m_ucode[i].ucode;
+        ucode[3*i+0] = static_cast<uint8>(uop >>  0);
+        ucode[3*i+1] = static_cast<uint8>(uop >>  8);
+        ucode[3*i+2] = static_cast<uint8>(uop >> 16);
+    }
+    sw.putBlob(ucode.data(), 3*MAX_UCODE);
+
+    sw.putBlob(&m_ram[0], m_mem_size);
+}
+
+
+void
+Cpu2200vp::loadState(StateReader &sr)
+{
+    if (sr.getU8() != m_cpu_subtype) {
+        sr.fail("the saved cpu is a different type");
+        return;
+    }
+    m_status = sr.getU8();
+
+    sr.getBytes(&m_cpu.reg[0], sizeof(m_cpu.reg));
+    m_cpu.pc      = sr.getU16();
+    m_cpu.ch      = sr.getU8();
+    m_cpu.cl      = sr.getU8();
+    m_cpu.k       = sr.getU8();
+    m_cpu.sl      = sr.getU8();
+    m_cpu.sh      = sr.getU8();
+    m_cpu.orig_pc = sr.getU16();
+    for (auto &aux : m_cpu.aux) {
+        aux = sr.getU16();
+    }
+    m_cpu.ic = sr.getU16();
+    for (auto &ret : m_cpu.icstack) {
+        ret = sr.getU16();
+    }
+    m_cpu.icsp   = sr.getI32();
+    m_cpu.ab     = sr.getU8();
+    m_cpu.ab_sel = sr.getU8();
+    m_cpu.bsr    = sr.getU8();
+    if ((m_cpu.icsp < 0) || (m_cpu.icsp >= STACKSIZE)) {
+        sr.fail("bad cpu state");
+        return;
+    }
+    updateBankOffset();
+
+    if (m_has_oneshot) {
+        m_tmr_30ms->loadState(sr);
+    }
+
+    const uint8 *ucode = sr.getBlob(3*MAX_UCODE);
+    if (ucode == nullptr) {
+        return;
+    }
+    for (int i=0; i < MAX_UCODE; i++) {
+        const uint32 uop = (static_cast<uint32>(ucode[3*i+0]) <<  0)
+                         | (static_cast<uint32>(ucode[3*i+1]) <<  8)
+                         | (static_cast<uint32>(ucode[3*i+2]) << 16);
+        writeUcode(static_cast<uint16>(i), uop, true);
+    }
+    for (auto &blk : m_blocks) {
+        blk.num_ops = 0;
+        blk.hits    = 0;
+        blk.code    = nullptr;
+    }
+#if VP_JIT
+    jitFlush();
+#endif
+
+    const uint8 *ram = sr.getBlob(m_mem_size);
+    if (ram != nullptr) {
+        memcpy(&m_ram[0], ram, m_mem_size);
+    }
+}
+
+
 // this callback occurs when the 30 ms timeslicing one-shot times out.
 void
 Cpu2200vp::oneShot30msCallback() noexcept
 {
     assert(m_has_oneshot);
     m_cpu.sh &= ~SH_MASK_30MS;    // one shot output falls
-    m_tmr_30ms = nullptr;         // dead timer
 }
 
 
-// perform one instruction and return the number of ns the instruction took.
-// returns EXEC_ERR if we hit an illegal op.
+// ------------------------------------------------------------------------
+// instruction execution
+//
+// There are two interpreters.  The reference interpreter, execOneOpSwitch(),
+// tests the FETCH_* flags which writeUcode() left in the upper bits of the
+// ucode word, decodes the A and B fields, then switches on the op.
+//
+// The threaded interpreter instead makes one indirect call through the
+// handler pointer which writeUcode() saved with each word.  There is one
+// handler per op, carry set/clear mode, and memory operation (D field), and
+// the A, B and C fields have been predecoded into byte offsets into m_cpu,
+// so there is nothing left to decode when the op is executed.
+//
+// Memory ops come in two flavors.  Only the MicroVP has a BSR, and only
+// configurations with more than 64 KB have more than one bank, so the other
+// systems (every VP, and small MVPs) use handlers with BANKED=false, which
+// map an address without consulting bsr_mode or bank_offset.
+//
+// Either way the operation itself is carried out by execOp<>(), so the two
+// can't drift apart.  THREADED_DISPATCH selects which one is used.
+// ------------------------------------------------------------------------
+
+// returned if we hit an illegal op
 #define EXEC_ERR (1 << 30)
+
+// every op, in op_t order
+#define FOR_EACH_OP(X)                                  \
+    X(OP_PECM)  X(OP_ILLEGAL)                           \
+    X(OP_OR)    X(OP_ORX)   X(OP_XOR)   X(OP_XORX)      \
+    X(OP_AND)   X(OP_ANDX)  X(OP_SC)    X(OP_SCX)       \
+    X(OP_DAC)   X(OP_DACX)  X(OP_DSC)   X(OP_DSCX)      \
+    X(OP_AC)    X(OP_ACX)   X(OP_M)     X(OP_MX)        \
+    X(OP_SH)    X(OP_SHX)                               \
+    X(OP_ORI)   X(OP_XORI)  X(OP_ANDI)  X(OP_AI)        \
+    X(OP_DACI)  X(OP_DSCI)  X(OP_ACI)   X(OP_MI)        \
+    X(OP_TAP)   X(OP_TPA)   X(OP_XPA)   X(OP_TPS)       \
+    X(OP_TSP)   X(OP_RCM)   X(OP_WCM)   X(OP_SR)        \
+    X(OP_CIO)   X(OP_LPI)                               \
+    X(OP_BT)    X(OP_BF)    X(OP_BEQ)   X(OP_BNE)       \
+    X(OP_BLR)   X(OP_BLRX)  X(OP_BLER)  X(OP_BLERX)     \
+    X(OP_BER)   X(OP_BNR)                               \
+    X(OP_SB)    X(OP_B)
+
+// the operands which must be fetched before executing a given op.
+// the mini ops use B only if they write memory, but fetching it
+// unconditionally is harmless.
+enum { USES_A = 0x1, USES_B = 0x2, USES_X = 0x4 };
+
+static constexpr int
+opOperands(int op) noexcept
+{
+    return (op >= OP_OR   && op <= OP_SHX)   ? ((((op - OP_OR) & 1) != 0)
+                                                     ? (USES_A | USES_B | USES_X)
+                                                     : (USES_A | USES_B))
+         : (op >= OP_ORI  && op <= OP_MI)    ? USES_B
+         : (op >= OP_TAP  && op <= OP_TSP)   ? USES_B
+         : (op == OP_SR)                     ? USES_B
+         : (op >= OP_BT   && op <= OP_BNE)   ? USES_B
+         : (op == OP_BLRX || op == OP_BLERX) ? (USES_A | USES_B | USES_X)
+         : (op >= OP_BLR  && op <= OP_BNR)   ? (USES_A | USES_B)
+                                             : 0;
+}
+
+
+// ops which may set or clear carry before fetching their operands
+static constexpr bool
+opHasCarryOp(int op) noexcept
+{
+    return (op >= OP_OR) && (op <= OP_ACX);
+}
+
+
+// ops whose D field specifies a memory read or write
+static constexpr bool
+opHasMemoryOp(int op) noexcept
+{
+    return ((op >= OP_OR)  && (op <= OP_MI))
+        || ((op >= OP_TAP) && (op <= OP_TSP))
+        ||  (op == OP_SR)
+        ||  (op == OP_LPI);
+}
+
+
+// ops which don't fall through to ic+1
+static constexpr bool
+opIsBranch(int op) noexcept
+{
+    return ((op >= OP_BT) && (op <= OP_B))
+        ||  (op == OP_SR);
+}
+
+
+// the number of results an op stores via the C field
+static constexpr int
+opNumResults(int op) noexcept
+{
+    return (op >= OP_OR  && op <= OP_SHX) ? ((((op - OP_OR) & 1) != 0) ? 2 : 1)
+         : (op >= OP_ORI && op <= OP_MI)  ? 1
+                                          : 0;
+}
+
+
+// how long each op takes.  this must agree with execOp<>();
+// it lets the length of a block be known before it is run.
+static constexpr int
+opNs(int op) noexcept
+{
+    return (op == OP_LPI)                    ? 1100
+         : (op == OP_RCM || op == OP_WCM)    ? 1600
+         : (op == OP_SR)                     ?  800
+         : (op == OP_BLRX || op == OP_BLERX) ?  800
+                                             :  600;
+}
+
+
+// fill in the threaded interpreter predecode fields of a ucode word
+void
+Cpu2200vp::predecodeOperands(ucode_t *puop) const noexcept
+{
+    static_assert(offsetof(cpu2200vp_t, sh) < 256, "m_cpu offsets must fit in 8b");
+    static_assert(offsetof(cpu2200vp_t, sh) == offsetof(cpu2200vp_t, sl) + 1,
+                  "storeC() expects sl and sh to be the last byte registers");
+
+    // PL and PH are addressed as the two bytes of pc
+    static const uint16 probe = 0x0001;
+    const bool little_endian = (*reinterpret_cast<const uint8*>(&probe) == 0x01);
+
+    const int R  = offsetof(cpu2200vp_t, reg);
+    const int PL = offsetof(cpu2200vp_t, pc) + ((little_endian) ? 0 : 1);
+    const int PH = offsetof(cpu2200vp_t, pc) + ((little_endian) ? 1 : 0);
+    const int CH = offsetof(cpu2200vp_t, ch);
+    const int CL = offsetof(cpu2200vp_t, cl);
+    const int K  = offsetof(cpu2200vp_t, k);
+    const int Z  = offsetof(cpu2200vp_t, zero);
+    const int NO = offsetof(cpu2200vp_t, sink);
+    const int SL = offsetof(cpu2200vp_t, sl);
+    const int SH = offsetof(cpu2200vp_t, sh);
+
+    // these mirror the field decoding of execOneOpSwitch().
+    // for the X ops, the second operand comes from field+1 (mod 16).
+    const int a_src[16] = { R+0, R+1, R+2, R+3, R+4, R+5, R+6, R+7,
+                            CL,  CH,  CL,  CH,  CL,  CH,  Z,   Z   };
+    const int b_src[16] = { R+0, R+1, R+2, R+3, R+4, R+5, R+6, R+7,
+                            PL,  PH,  CL,  CH,  SL,  SH,  K,   Z   };
+    const int c_dst[16] = { R+0, R+1, R+2, R+3, R+4, R+5, R+6, R+7,
+                            PL,  PH,  NO,  NO,  SL,  SH,  K,   NO  };
+
+    const uint32 uop = puop->ucode;
+    const int a_field = (uop >> 4) & 0xF;
+    const int b_field = (uop >> 0) & 0xF;
+    const int c_field = (uop >> 8) & 0xF;
+
+    for (int n=0; n < 2; n++) {
+        puop->a_off[n] = static_cast<uint8>(a_src[(a_field + n) & 0xF]);
+        puop->b_off[n] = static_cast<uint8>(b_src[(b_field + n) & 0xF]);
+        puop->c_off[n] = static_cast<uint8>(c_dst[(c_field + n) & 0xF]);
+    }
+
+    // CIO and storing to SH, which may change CPB, can reach other devices
+    puop->io_op = (puop->op == OP_CIO);
+    for (int n=0; n < opNumResults(puop->op); n++) {
+        puop->io_op |= (puop->c_off[n] == SH);
+    }
+
+    const int cy = ((uop & FETCH_CY) != 0) ? ((uop >> 14) & 3) : 0;
+    const int dd = (uop >> 12) & 3;
+    puop->handler = getUopHandler(puop->op, cy, dd, m_banked);
+}
+
+
+// store the (possibly 9b) result to the register at the given offset
+// into m_cpu.  this is the threaded interpreter's version of store_c().
+inline void
+Cpu2200vp::storeC(int c_off, int val)
+{
+    if (c_off < static_cast<int>(offsetof(cpu2200vp_t, sl))) {
+        reinterpret_cast<uint8*>(&m_cpu)[c_off] = static_cast<uint8>(val);
+    } else if (c_off == static_cast<int>(offsetof(cpu2200vp_t, sl))) {
+        setSL(static_cast<uint8>(val));
+    } else {
+        setSH(static_cast<uint8>(val));
+    }
+}
+
+
+// store the first (which=0) or second (which=1) result of an op
+// to the register selected by the C field (or C+1 for the second)
+#define STORE_RSLT(which, val)                                  \
+    do {                                                        \
+        if (DD >= 0) {                                          \
+            storeC(puop->c_off[which], (val));                  \
+        } else {                                                \
+            store_c((c_field + (which)) & 0xF, (val));          \
+        }                                                       \
+    } while (false)
+
+
+// carry out the op, given the operands it uses,
+// and return the number of ns the instruction took.
+// DD is the predecoded D field, or -1 for the reference interpreter.
+// BANKED is false if the configuration has neither a BSR nor a second bank.
+template <int OP, int DD, bool BANKED>
 int
-Cpu2200vp::execOneOp()
+Cpu2200vp::execOp(const ucode_t *puop, int a_op, int b_op, int a_op2, int b_op2)
 {
-    const ucode_t * const puop = &m_ucode[m_cpu.ic];
     const uint32 uop = puop->ucode;
 
+    // the threaded interpreter has a handler per D field value,
+    // which lets the compiler fold away the memory op decode
+    const uint32 dd_uop = (DD >= 0) ? static_cast<uint32>(DD << 12) : uop;
+
     int ns = 600;      // almost all instructions take 600 ns
 
-    int a_field, b_field, c_field, s_field, t_field, HbHa;
-    int a_op, b_op, a_op2, b_op2, imm, rslt, rslt2;
+    int c_field, s_field, t_field, HbHa;
+    int imm, rslt, rslt2;
     int idx;
     uint16 tmp16;
 
-#if defined(_DEBUG)
-    if (g_dbg_trace) {
-        static int g_num_ops = 0;
-        g_num_ops++;
-        char buff[200];
-        dumpState(true);
-        /*bool illegal =*/ dasmOneVpOp(&buff[0], m_cpu.ic, m_ucode[m_cpu.ic].ucode);
-        dbglog("cycle %5d: %s", g_num_ops, &buff[0]);
-    }
-#endif
-
-    // internally, the umachine makes a copy of the start PC value
-    // since memory read and write are done relative to that state
-    // in the case that the instruction modifies PH or PL itself.
-    m_cpu.orig_pc = m_cpu.pc;
+    switch (OP) {
 
-#if NO_LINT_WARNINGS
-    a_op = a_op2 = b_op = b_op2 = 0;
-#endif
+    case OP_PECM:
+        // 1) set SH6 = 1
+        m_cpu.sh |= SH_MASK_PARITY;
+        if ((~m_cpu.sh & SH_MASK_DPRTY) != 0) {
+            // data parity trap is enabled
+            // 2) instruction addr+1 is pushed on subroutine return stack
+            m_cpu.icstack[m_cpu.icsp] = static_cast<uint16>(m_cpu.ic + 1);
+            DEC_ICSP;
+            // 3) trap to location 0x8000
+            m_cpu.ic = TRAP_PECM;
+        }
+        break;
 
-    if ((uop & FETCH_CY) != 0) {
-        // set or clear carry
-        // we must do this before FETCH_A/B because it can affect SH state
-        switch ((uop >> 14) & 3) {
-            case 2: m_cpu.sh &= ~SH_MASK_CARRY; break;    // clear
-            case 3: m_cpu.sh |=  SH_MASK_CARRY; break;    // set
-            case 0:     // no change, but this shouldn't be called then
-            default:
-                assert(false);
-                break;
+    case OP_ILLEGAL:
+        {
+            char buff[200];
+            dasmOneVpOp(&buff[0], m_cpu.ic, m_ucode[m_cpu.ic].ucode);
+            UI_error("%s\nIllegal op at ic=%04X", &buff[0], m_cpu.ic);
         }
-    }
+        m_status = CPU_HALTED;
+        return EXEC_ERR;
 
-    // fetch argA and argB as required
-    if ((uop & FETCH_B) != 0) {
+    case OP_LPI:
+        m_cpu.pc = puop->p16;
+        m_cpu.orig_pc = m_cpu.pc;       // LPI is a special case where change
+                                        //    of PC is seen by R and W
+        perform_dd_op(dd_uop, 0x00);       // force B field to pick 0
+        ++m_cpu.ic;
+        ns = 1100;  // 1.1us
+        break;
 
-        b_field = uop & 0xF;
-        switch (b_field) {
-            case 0: case 1: case 2: case 3:
-            case 4: case 5: case 6: case 7:
-                b_op = m_cpu.reg[b_field];
-                break;
-            case  8: b_op = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF); break; // PL
-            case  9: b_op = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF); break; // PH
-            case 10: b_op = m_cpu.cl; break;
-            case 11: b_op = m_cpu.ch; break;
-            case 12: b_op = m_cpu.sl; break;
-            case 13: b_op = m_cpu.sh; break;
-            case 14: b_op = m_cpu.k; break;
-            case 15: b_op = 0x00; break; // dummy
-            default:
-                assert(false);
-                b_op = 0x00;
-                break;
-        }
+    case OP_TAP:
+        perform_dd_op(dd_uop, b_op);
+        idx = (uop >> 4) & 0x1F;
+        m_cpu.pc = m_cpu.aux[idx];
+        ++m_cpu.ic;
+        break;
 
-        // A is fetched only if B is fetched as well
-        if ((uop & FETCH_A) != 0) {
-            a_field = (uop >> 4) & 0xF;
-            switch (a_field) {
-                case 0: case 1: case 2: case 3:
-                case 4: case 5: case 6: case 7:
-                    a_op = m_cpu.reg[a_field];
-                    break;
-                case  8: case 10: case 12:
-                    a_op = m_cpu.cl;
-                    break;
-                case  9: case 11: case 13:
-                    a_op = m_cpu.ch;
-                    break;
-                case 14: case 15:
-                    a_op = 0;
-                    break;
-                default:
-                    assert(false);
-                    a_op = 0;
-                    break;
-            }
-            a_op2 = 0;  // keep lint happy
-        }
+    case OP_TPA:
+        perform_dd_op(dd_uop, b_op);
+        idx = (uop >> 4) & 0x1F;
+        m_cpu.aux[idx] = static_cast<uint16>(m_cpu.pc + static_cast<int16>(puop->p16));
+        ++m_cpu.ic;
+        break;
 
-    } else if ((uop & FETCH_X) != 0) {
-
-        b_field = uop & 0xF;
-        switch (b_field) {
-            case 0: case 1: case 2: case 3:
-            case 4: case 5: case 6:
-                b_op  = m_cpu.reg[b_field];
-                b_op2 = m_cpu.reg[b_field+1];
-                break;
-            case 7:
-                b_op  = m_cpu.reg[7];
-                b_op2 = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF);  // PL
-                break;
-            case  8:
-                b_op  = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF);  // PL
-                b_op2 = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF);  // PH
-                break;
-            case  9:
-                b_op  = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF);  // PH
-                b_op2 = m_cpu.cl;
-                break;
-            case 10:
-                b_op  = m_cpu.cl;
-                b_op2 = m_cpu.ch;
-                break;
-            case 11:
-                b_op  = m_cpu.ch;
-                b_op2 = m_cpu.sl;
-                break;
-            case 12:
-                b_op  = m_cpu.sl;
-                b_op2 = m_cpu.sh;
-                break;
-            case 13:
-                b_op  = m_cpu.sh;
-                b_op2 = m_cpu.k;
-                break;
-            case 14:
-                b_op  = m_cpu.k;
-                b_op2 = 0x00; // dummy
-                break;
-            case 15:
-                b_op  = 0x00; // dummy
-                b_op2 = m_cpu.reg[0];
-                break;
-            default:
-                assert(false);
-                b_op = b_op2 = 0;
-                break;
-        }
-
-        a_field = (uop >> 4) & 0xF;
-        switch (a_field) {
-            case 0: case 1: case 2: case 3:
-            case 4: case 5: case 6:
-                a_op  = m_cpu.reg[a_field];
-                a_op2 = m_cpu.reg[a_field+1];
-                break;
-            case 7:
-                a_op  = m_cpu.reg[7];
-                a_op2 = m_cpu.cl;
-                break;
-            case  8:
-            case 10:
-            case 12:
-                a_op  = m_cpu.cl;
-                a_op2 = m_cpu.ch;
-                break;
-            case  9:
-            case 11:
-                a_op  = m_cpu.ch;
-                a_op2 = m_cpu.cl;
-                break;
-            case 13:
-                a_op  = m_cpu.ch;
-                a_op2 = 0;
-                break;
-            case 14:
-                a_op  = 0;
-                a_op2 = 0;
-                break;
-            case 15:
-                a_op  = 0;
-                a_op2 = m_cpu.reg[0];
-                break;
-            default:
-                assert(false);
-                a_op = a_op2 = 0;
-                break;
-        }
-    }
-
-
-    // carry out the instruction
-    switch (puop->op) {
-
-    case OP_PECM:
-        // 1) set SH6 = 1
-        m_cpu.sh |= SH_MASK_PARITY;
-        if ((~m_cpu.sh & SH_MASK_DPRTY) != 0) {
-            // data parity trap is enabled
-            // 2) instruction addr+1 is pushed on subroutine return stack
-            m_cpu.icstack[m_cpu.icsp] = static_cast<uint16>(m_cpu.ic + 1);
-            DEC_ICSP;
-            // 3) trap to location 0x8000
-            m_cpu.ic = TRAP_PECM;
-        }
-        break;
-
-    case OP_ILLEGAL:
-        {
-            char buff[200];
-            dasmOneVpOp(&buff[0], m_cpu.ic, m_ucode[m_cpu.ic].ucode);
-            UI_error("%s\nIllegal op at ic=%04X", &buff[0], m_cpu.ic);
-        }
-        m_status = CPU_HALTED;
-        return EXEC_ERR;
-
-    case OP_LPI:
-        m_cpu.pc = puop->p16;
-        m_cpu.orig_pc = m_cpu.pc;       // LPI is a special case where change
-                                        //    of PC is seen by R and W
-        perform_dd_op(uop, 0x00);       // force B field to pick 0
-        ++m_cpu.ic;
-        ns = 1100;  // 1.1us
-        break;
-
-    case OP_TAP:
-        perform_dd_op(uop, b_op);
-        idx = (uop >> 4) & 0x1F;
-        m_cpu.pc = m_cpu.aux[idx];
-        ++m_cpu.ic;
-        break;
-
-    case OP_TPA:
-        perform_dd_op(uop, b_op);
-        idx = (uop >> 4) & 0x1F;
-        m_cpu.aux[idx] = static_cast<uint16>(m_cpu.pc + static_cast<int16>(puop->p16));
-        ++m_cpu.ic;
-        break;
-
-    case OP_XPA:
-        perform_dd_op(uop, b_op);
-        idx = (uop >> 4) & 0x1F;
-        tmp16 = m_cpu.aux[idx];
-        m_cpu.aux[idx] = static_cast<uint16>(m_cpu.pc + static_cast<int16>(puop->p16));
-        m_cpu.pc = tmp16;
-        ++m_cpu.ic;
-        break;
+    case OP_XPA:
+        perform_dd_op(dd_uop, b_op);
+        idx = (uop >> 4) & 0x1F;
+        tmp16 = m_cpu.aux[idx];
+        m_cpu.aux[idx] = static_cast<uint16>(m_cpu.pc + static_cast<int16>(puop->p16));
+        m_cpu.pc = tmp16;
+        ++m_cpu.ic;
+        break;
 
     case OP_TPS:
-        perform_dd_op(uop, b_op);
+        perform_dd_op(dd_uop, b_op);
         m_cpu.icstack[m_cpu.icsp] = static_cast<uint16>(m_cpu.pc + static_cast<int16>(puop->p16));
         DEC_ICSP;
         ++m_cpu.ic;
         break;
 
     case OP_TSP:
-        perform_dd_op(uop, b_op);
+        perform_dd_op(dd_uop, b_op);
         INC_ICSP;
         m_cpu.pc = m_cpu.icstack[m_cpu.icsp];
         ++m_cpu.ic;
@@ -1228,6 +1452,7 @@ Cpu2200vp::execOneOp()
 #endif
             !((tmp16 >= 0x8000) && (tmp16 < 0x9000))) {
             writeUcode(tmp16, ((~m_cpu.k & 0xFF) << 16) | m_cpu.pc);
+            ++m_stores;
         }
         // perform subroutine return
         INC_ICSP;
@@ -1237,7 +1462,7 @@ Cpu2200vp::execOneOp()
 
     case OP_SR:
         // perform subroutine return
-        perform_dd_op(uop, b_op);
+        perform_dd_op(dd_uop, b_op);
         INC_ICSP;
         m_cpu.ic = m_cpu.icstack[m_cpu.icsp];
         ns = 800;
@@ -1258,9 +1483,9 @@ Cpu2200vp::execOneOp()
                     dbglog("-ABS with AB=%02X, ic=0x%04X\n", m_cpu.ab_sel, m_cpu.ic);
                 }
                 //UI_info("CPU:ABS when AB=%02X", m_cpu.ab);
-                system2200::dispatchAbsStrobe(m_cpu.ab_sel);  // address bus strobe
+                m_sys.dispatchAbsStrobe(m_cpu.ab_sel);  // address bus strobe
                 // we might have changed card selection; tell it cpb status
-                system2200::dispatchCpuBusy((m_cpu.sh & SH_MASK_CPB) != 0);
+                m_sys.dispatchCpuBusy((m_cpu.sh & SH_MASK_CPB) != 0);
                 break;
             case 0x20: // OBS
                 if (m_dbg) {
@@ -1278,7 +1503,7 @@ Cpu2200vp::execOneOp()
                     setBSR(m_cpu.k);
                 } else {
                     setDevRdy(false);  // (M)VP cpus do this, but not 2200T
-                    system2200::dispatchObsStrobe(m_cpu.k);  // output data bus strobe
+                    m_sys.dispatchObsStrobe(m_cpu.k);  // output data bus strobe
                 }
                 break;
             case 0x10: // CBS
@@ -1291,7 +1516,7 @@ Cpu2200vp::execOneOp()
                 }
                 //UI_info("CPU:CBS when AB=%02X, AB_SEL=%02X, K=%02X", m_cpu.ab, m_cpu.ab_sel, m_cpu.k);
                 setDevRdy(false);  // (M)VP cpus do this, but not 2200T
-                system2200::dispatchCbsStrobe(m_cpu.k);    // control bus strobe
+                m_sys.dispatchCbsStrobe(m_cpu.k);    // control bus strobe
                 break;
             case 0x08: // status request
                 // although the 2600 arch manual doesn't describe this op,
@@ -1302,12 +1527,12 @@ Cpu2200vp::execOneOp()
                 //     978080 : CIO       ??? (ILLEGAL)
                 // this corresponds to a mask of 0x08.
 //UI_info("doing CIO STATUS_REQUEST, AB=%02x, IC=%04X", m_cpu.ab, m_cpu.ic);
-                m_cpu.k = static_cast<uint8>(system2200::cpuPollIB());
+                m_cpu.k = static_cast<uint8>(m_sys.cpuPollIB());
                 // Paul Szudzik's SDS_Wang2200.pdf arch manual says
                 //    Fire internal IBS one shot (SRS).  Sets CPB.  Basically
                 //    used for Status Requests from MUXD.
                 m_cpu.sh |= SH_MASK_CPB;    // CPU busy; inhibit IBS
-                system2200::dispatchCpuBusy(true);  // we are busy now
+                m_sys.dispatchCpuBusy(true);  // we are busy now
                 break;
             case 0x00: // no strobe
                 break;
@@ -1327,21 +1552,19 @@ Cpu2200vp::execOneOp()
                 // in the MVP CPU schematic.  if ucode bits 3:2 are both one,
                 // the 30 ms one shot gets retriggered.
                 m_cpu.sh |= SH_MASK_30MS;     // one shot output rises
-                // kill pending timer before starting a new one
-                m_tmr_30ms = nullptr;
+                // restarting the timer replaces any pending expiration.
                 // BPMVP14A says
                 //    CLOCK SPECIFICATIONS:
                 //         20 MS. MIN.
                 //         27 MS. AVE.
                 //         35 MS. MAX.
-                m_tmr_30ms = m_scheduler->createTimer(TIMER_MS(27),
-                                                       [&](){ oneShot30msCallback(); });
+                m_tmr_30ms->rearm(TIMER_MS(27));
             } else {
-                if (!g_30ms_warning) {
+                if (!m_30ms_warning) {
                     UI_warn("Your system is configured with a 2200VP CPU,\n"
                             "but the operating system appears to be MVP.\n"
                             "Configure your system for an MVP or MicroVP for this OS.");
-                    g_30ms_warning = true;
+                    m_30ms_warning = true;
                 }
             }
         }
@@ -1353,8 +1576,8 @@ Cpu2200vp::execOneOp()
         c_field = (uop >> 8) & 0xF
 
 #define POSTAMBLE1      \
-        store_c(c_field, rslt);                                        \
-        perform_dd_op(uop, rslt);       /* mem rd/wr */                \
+        STORE_RSLT(0, rslt);                                           \
+        perform_dd_op(dd_uop, rslt);       /* mem rd/wr */                \
         m_cpu.pc = static_cast<uint16>(m_cpu.pc + (int16)(puop->p16)); \
         ++m_cpu.ic
 
@@ -1423,9 +1646,9 @@ Cpu2200vp::execOneOp()
         c_field = (uop >> 8) & 0xF
 
 #define POSTAMBLE2                                              \
-        store_c(c_field, rslt);                                 \
-        store_c((c_field+1) & 0xF, rslt2);                      \
-        perform_dd_op(uop, rslt2);      /* mem rd/wr */         \
+        STORE_RSLT(0, rslt);                                    \
+        STORE_RSLT(1, rslt2);                                   \
+        perform_dd_op(dd_uop, rslt2);      /* mem rd/wr */         \
         ++m_cpu.ic
 
     case OP_ORX:
@@ -1504,8 +1727,8 @@ Cpu2200vp::execOneOp()
         imm = IMM8(uop)
 
 #define POSTAMBLE3                      \
-        store_c(c_field, rslt);         \
-        perform_dd_op(uop, rslt);       \
+        STORE_RSLT(0, rslt);            \
+        perform_dd_op(dd_uop, rslt);       \
         ++m_cpu.ic
 
     case OP_ORI:        // or immediate
@@ -1652,6 +1875,850 @@ Cpu2200vp::execOneOp()
 }
 
 
+// threaded interpreter handler for one op.  CY is 2 to clear carry,
+// 3 to set carry, and 0 to leave it alone before fetching operands.
+// DD is the D field, which selects the memory operation.
+template <int OP, int CY, int DD, bool BANKED>
+int
+Cpu2200vp::execUop(Cpu2200vp &cpu, const ucode_t *puop)
+{
+    // internally, the umachine makes a copy of the start PC value
+    // since memory read and write are done relative to that state
+    // in the case that the instruction modifies PH or PL itself.
+    cpu.m_cpu.orig_pc = cpu.m_cpu.pc;
+
+    // we must do this before fetching operands because it can affect SH state
+    if (CY == 2) {
+        cpu.m_cpu.sh &= ~SH_MASK_CARRY;
+    } else if (CY == 3) {
+        cpu.m_cpu.sh |= SH_MASK_CARRY;
+    }
+
+    const uint8 * const regs = reinterpret_cast<const uint8*>(&cpu.m_cpu);
+    const int uses = opOperands(OP);
+
+    const int b_op  = ((uses & USES_B) != 0) ? regs[puop->b_off[0]] : 0;
+    const int a_op  = ((uses & USES_A) != 0) ? regs[puop->a_off[0]] : 0;
+    const int b_op2 = ((uses & USES_X) != 0) ? regs[puop->b_off[1]] : 0;
+    const int a_op2 = ((uses & USES_X) != 0) ? regs[puop->a_off[1]] : 0;
+
+    return cpu.execOp<OP, DD, BANKED>(puop, a_op, b_op, a_op2, b_op2);
+}
+
+
+// return the handler for the given op, carry mode, D field, and banking.
+// cy is bits [15:14] of the ucode word, or 0 if there is no carry op.
+Cpu2200vp::uop_handler_t
+Cpu2200vp::getUopHandler(int op, int cy, int dd, bool banked) noexcept
+{
+    // only instantiate variants which can make a difference
+    #define UOP_HANDLER(op, cy, dd, bk)                                 \
+        &execUop<op, (opHasCarryOp(op) ? (cy) : 0),                     \
+                     (opHasMemoryOp(op) ? (dd) : 0),                    \
+                     (opHasMemoryOp(op) && ((dd) != 0) && (bk))>
+    #define UOP_HANDLERS_DD(op, cy, bk)                                 \
+        { UOP_HANDLER(op, cy, 0, bk), UOP_HANDLER(op, cy, 1, bk),       \
+          UOP_HANDLER(op, cy, 2, bk), UOP_HANDLER(op, cy, 3, bk) }
+    #define UOP_HANDLERS_CY(op, bk)                                     \
+        { UOP_HANDLERS_DD(op, 0, bk), UOP_HANDLERS_DD(op, 0, bk),       \
+          UOP_HANDLERS_DD(op, 2, bk), UOP_HANDLERS_DD(op, 3, bk) }
+    #define UOP_HANDLERS(op)                                            \
+        { UOP_HANDLERS_CY(op, false), UOP_HANDLERS_CY(op, true) },
+    static const uop_handler_t handlers[][2][4][4] = { FOR_EACH_OP(UOP_HANDLERS) };
+    #undef UOP_HANDLERS
+    #undef UOP_HANDLERS_CY
+    #undef UOP_HANDLERS_DD
+    #undef UOP_HANDLER
+
+    static_assert(sizeof(handlers)/sizeof(handlers[0]) == OP_B+1,
+                  "FOR_EACH_OP doesn't match op_t");
+    assert(op >= 0 && op <= OP_B);
+    assert(cy >= 0 && cy <= 3);
+    assert(dd >= 0 && dd <= 3);
+    return handlers[op][(banked) ? 1 : 0][cy][dd];
+}
+
+
+// reference interpreter: perform one instruction, decoding it as we go.
+// returns the number of ns the instruction took,
+// or EXEC_ERR if we hit an illegal op.
+int
+Cpu2200vp::execOneOpSwitch(const ucode_t *puop)
+{
+    const uint32 uop = puop->ucode;
+
+    int a_field, b_field;
+    int a_op, b_op, a_op2, b_op2;
+
+    // internally, the umachine makes a copy of the start PC value
+    // since memory read and write are done relative to that state
+    // in the case that the instruction modifies PH or PL itself.
+    m_cpu.orig_pc = m_cpu.pc;
+
+#if NO_LINT_WARNINGS
+    a_op = a_op2 = b_op = b_op2 = 0;
+#endif
+
+    if ((uop & FETCH_CY) != 0) {
+        // set or clear carry
+        // we must do this before FETCH_A/B because it can affect SH state
+        switch ((uop >> 14) & 3) {
+            case 2: m_cpu.sh &= ~SH_MASK_CARRY; break;    // clear
+            case 3: m_cpu.sh |=  SH_MASK_CARRY; break;    // set
+            case 0:     // no change, but this shouldn't be called then
+            default:
+                assert(false);
+                break;
+        }
+    }
+
+    // fetch argA and argB as required
+    if ((uop & FETCH_B) != 0) {
+
+        b_field = uop & 0xF;
+        switch (b_field) {
+            case 0: case 1: case 2: case 3:
+            case 4: case 5: case 6: case 7:
+                b_op = m_cpu.reg[b_field];
+                break;
+            case  8: b_op = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF); break; // PL
+            case  9: b_op = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF); break; // PH
+            case 10: b_op = m_cpu.cl; break;
+            case 11: b_op = m_cpu.ch; break;
+            case 12: b_op = m_cpu.sl; break;
+            case 13: b_op = m_cpu.sh; break;
+            case 14: b_op = m_cpu.k; break;
+            case 15: b_op = 0x00; break; // dummy
+            default:
+                assert(false);
+                b_op = 0x00;
+                break;
+        }
+
+        // A is fetched only if B is fetched as well
+        if ((uop & FETCH_A) != 0) {
+            a_field = (uop >> 4) & 0xF;
+            switch (a_field) {
+                case 0: case 1: case 2: case 3:
+                case 4: case 5: case 6: case 7:
+                    a_op = m_cpu.reg[a_field];
+                    break;
+                case  8: case 10: case 12:
+                    a_op = m_cpu.cl;
+                    break;
+                case  9: case 11: case 13:
+                    a_op = m_cpu.ch;
+                    break;
+                case 14: case 15:
+                    a_op = 0;
+                    break;
+                default:
+                    assert(false);
+                    a_op = 0;
+                    break;
+            }
+            a_op2 = 0;  // keep lint happy
+        }
+
+    } else if ((uop & FETCH_X) != 0) {
+
+        b_field = uop & 0xF;
+        switch (b_field) {
+            case 0: case 1: case 2: case 3:
+            case 4: case 5: case 6:
+                b_op  = m_cpu.reg[b_field];
+                b_op2 = m_cpu.reg[b_field+1];
+                break;
+            case 7:
+                b_op  = m_cpu.reg[7];
+                b_op2 = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF);  // PL
+                break;
+            case  8:
+                b_op  = static_cast<uint8>((m_cpu.pc >> 0) & 0xFF);  // PL
+                b_op2 = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF);  // PH
+                break;
+            case  9:
+                b_op  = static_cast<uint8>((m_cpu.pc >> 8) & 0xFF);  // PH
+                b_op2 = m_cpu.cl;
+                break;
+            case 10:
+                b_op  = m_cpu.cl;
+                b_op2 = m_cpu.ch;
+                break;
+            case 11:
+                b_op  = m_cpu.ch;
+                b_op2 = m_cpu.sl;
+                break;
+            case 12:
+                b_op  = m_cpu.sl;
+                b_op2 = m_cpu.sh;
+                break;
+            case 13:
+                b_op  = m_cpu.sh;
+                b_op2 = m_cpu.k;
+                break;
+            case 14:
+                b_op  = m_cpu.k;
+                b_op2 = 0x00; // dummy
+                break;
+            case 15:
+                b_op  = 0x00; // dummy
+                b_op2 = m_cpu.reg[0];
+                break;
+            default:
+                assert(false);
+                b_op = b_op2 = 0;
+                break;
+        }
+
+        a_field = (uop >> 4) & 0xF;
+        switch (a_field) {
+            case 0: case 1: case 2: case 3:
+            case 4: case 5: case 6:
+                a_op  = m_cpu.reg[a_field];
+                a_op2 = m_cpu.reg[a_field+1];
+                break;
+            case 7:
+                a_op  = m_cpu.reg[7];
+                a_op2 = m_cpu.cl;
+                break;
+            case  8:
+            case 10:
+            case 12:
+                a_op  = m_cpu.cl;
+                a_op2 = m_cpu.ch;
+                break;
+            case  9:
+            case 11:
+                a_op  = m_cpu.ch;
+                a_op2 = m_cpu.cl;
+                break;
+            case 13:
+                a_op  = m_cpu.ch;
+                a_op2 = 0;
+                break;
+            case 14:
+                a_op  = 0;
+                a_op2 = 0;
+                break;
+            case 15:
+                a_op  = 0;
+                a_op2 = m_cpu.reg[0];
+                break;
+            default:
+                assert(false);
+                a_op = a_op2 = 0;
+                break;
+        }
+    }
+
+
+    // carry out the instruction
+    switch (puop->op) {
+        #define OP_CASE(op) \
+            case op: return execOp<op, -1, true>(puop, a_op, b_op, a_op2, b_op2);
+        FOR_EACH_OP(OP_CASE)
+        #undef OP_CASE
+        default:
+            assert(false);
+            return EXEC_ERR;
+    }
+}
+
+
+// ------------------------------------------------------------------------
+// translation cache
+//
+// The microstore hardly changes once the OS has been loaded, so each
+// straight-line run of ops is found once, then later run back to back
+// without returning to the scheduler loop between ops.  A block ends with
+// its first branch, or just before any op which interacts with the world
+// outside the cpu: CIO, RCM, WCM, or a store to SH, which may signal CPB
+// to the selected card.  It is also capped at MAX_BLOCK_NS.
+//
+// The time a block takes is known before it starts, and it is run only if
+// no timer can expire before it completes.  That way, device callbacks
+// happen at exactly the same point in the instruction stream as they would
+// when stepping.  Otherwise the first op of the block is run by itself.
+//
+// writeUcode() discards any block which includes a word it changes.
+// ------------------------------------------------------------------------
+
+// find the block which starts at addr
+void
+Cpu2200vp::translateBlock(uint16 addr) noexcept
+{
+    int num_ops = 0;
+    int ns = 0;
+    for (int a=addr; (a < MAX_UCODE) && (num_ops < MAX_BLOCK_OPS); a++) {
+        const ucode_t &uc = m_ucode[a];
+        const int op = uc.op;
+
+        const bool ok = (   ((op >= OP_OR)  && (op <= OP_MI))
+                         || ((op >= OP_TAP) && (op <= OP_TSP))
+                         ||  (op == OP_LPI)
+                         ||  opIsBranch(op))
+                     && !uc.io_op;
+        if (!ok || (ns + opNs(op) > MAX_BLOCK_NS)) {
+            break;
+        }
+
+        num_ops++;
+        ns += opNs(op);
+        if (opIsBranch(op)) {
+            break;
+        }
+    }
+
+    m_blocks[addr].num_ops = static_cast<uint16>(std::max(num_ops, 1));
+    m_blocks[addr].ns      = static_cast<uint16>(ns);
+    m_blocks[addr].hits    = 0;
+    m_blocks[addr].code    = nullptr;
+}
+
+
+// discard any block which includes addr
+void
+Cpu2200vp::invalidateBlocks(uint16 addr) noexcept
+{
+    const int first = std::max(0, addr - (MAX_BLOCK_OPS-1));
+    for (int a=first; a <= addr; a++) {
+        m_blocks[a].num_ops = 0;
+        m_blocks[a].code    = nullptr;
+    }
+}
+
+
+// run the block starting at the current ic and return the time it took.
+// only the last op of a block can branch, so the ops are consecutive.
+int
+Cpu2200vp::execBlock(int num_ops, int block_ns)
+{
+    const ucode_t *puop = &m_ucode[m_cpu.ic];
+    int ns = 0;
+    for (int n=0; n < num_ops; n++, puop++) {
+        ns += (puop->handler)(*this, puop);
+    }
+    assert(ns == block_ns);
+    (void)ns;
+    return block_ns;
+}
+
+
+// ------------------------------------------------------------------------
+// native code generation
+//
+// Once a block has been run JIT_THRESHOLD times, it is compiled to x86-64
+// code in an mmap'd arena.  The common simple ops are generated inline:
+// the binary ALU ops and their immediate forms (including any CH/CL memory
+// read), the mask and register compare branches, and B.  Every other op in
+// the block -- decimal arithmetic, multiply, shift, memory writes, the X
+// forms, the mini ops and SR -- becomes a direct call to its threaded
+// handler.  As with blocks, CIO, RCM, WCM and stores to SH never appear in
+// compiled code; execOneOp() steps them one at a time.
+//
+// Compiled code returns the time computed when the block was translated,
+// so timing is exactly that of the interpreter.  writeUcode() invalidates
+// blocks as before, which drops their compiled code; that space in the
+// arena is reclaimed by flushing everything once the arena fills up.
+//
+// Compiled code is called with "this" as its argument.  It keeps it in rbx,
+// which the System V ABI preserves across the calls to handlers, and all
+// state is addressed relative to it.
+// ------------------------------------------------------------------------
+
+#if VP_JIT
+
+namespace {
+
+// x86-64 register numbers
+enum { RAX=0, RCX=1, RDX=2, RBX=3, RSI=6, RDI=7 };
+
+// ALU operations, as encoded in the reg field of opcodes 0x80/0x81
+enum { ALU_ADD=0, ALU_OR=1, ALU_AND=4, ALU_SUB=5, ALU_XOR=6, ALU_CMP=7 };
+
+// condition codes, as encoded in jcc and cmovcc
+enum { CC_B=0x2, CC_AE=0x3, CC_E=0x4, CC_NE=0x5, CC_BE=0x6, CC_GE=0xD };
+
+// a minimal x86-64 assembler, just enough for the code jitCompile() makes.
+// unless noted, memory operands are [rbx+disp32], ie, a member of the cpu.
+class JitEmitter
+{
+public:
+    std::vector<uint8> m_code;
+
+    void byte(int b)      { m_code.push_back(static_cast<uint8>(b)); }
+    void word(int w)      { byte(w); byte(w >> 8); }
+    void dword(uint32 d)  { word(static_cast<int>(d)); word(static_cast<int>(d >> 16)); }
+    void qword(uint64 q)  { dword(static_cast<uint32>(q)); dword(static_cast<uint32>(q >> 32)); }
+
+    // modrm and displacement for [rbx+disp32]
+    void mem(int reg, int disp) { byte(0x80 | ((reg & 7) << 3) | RBX); dword(disp); }
+
+    // movzx r32, byte [mem]
+    void loadByte(int reg, int disp)  { byte(0x0F); byte(0xB6); mem(reg, disp); }
+    // movzx r32, word [mem]
+    void loadWord(int reg, int disp)  { byte(0x0F); byte(0xB7); mem(reg, disp); }
+    // mov r32, dword [mem]
+    void loadDword(int reg, int disp) { byte(0x8B); mem(reg, disp); }
+    // mov byte [mem], r8 -- only al, cl, dl and bl are addressable this way
+    void storeByte(int reg, int disp) { assert(reg <= RBX); byte(0x88); mem(reg, disp); }
+    // mov word [mem], r16
+    void storeWord(int reg, int disp) { byte(0x66); byte(0x89); mem(reg, disp); }
+    // mov word [mem], imm16
+    void storeWordImm(int disp, int imm) { byte(0x66); byte(0xC7); mem(0, disp); word(imm); }
+    // add word [mem], imm16
+    void addWordImm(int disp, int imm)   { byte(0x66); byte(0x81); mem(ALU_ADD, disp); word(imm); }
+    // alu byte [mem], imm8
+    void aluByteImm(int alu, int disp, int imm) { byte(0x80); mem(alu, disp); byte(imm); }
+
+    // alu r32, imm32
+    void aluImm(int alu, int reg, uint32 imm) { byte(0x81); byte(0xC0 | (alu << 3) | reg); dword(imm); }
+    // alu dst32, src32
+    void aluReg(int alu, int dst, int src)    { byte((alu << 3) | 0x01); byte(0xC0 | (src << 3) | dst); }
+    // mov r32, imm32
+    void movImm(int reg, uint32 imm)          { byte(0xB8 + reg); dword(imm); }
+    // mov dst32, src32
+    void movReg(int dst, int src)             { byte(0x89); byte(0xC0 | (src << 3) | dst); }
+    // shr r32, n
+    void shrImm(int reg, int n)               { byte(0xC1); byte(0xE8 | reg); byte(n); }
+    // cmovcc dst32, src32
+    void cmov(int cc, int dst, int src)       { byte(0x0F); byte(0x40 | cc); byte(0xC0 | (dst << 3) | src); }
+    // mov r64, imm64
+    void movImm64(int reg, uint64 imm)        { byte(0x48); byte(0xB8 + reg); qword(imm); }
+    // movzx r32, byte [rbx+rax+disp32]
+    void loadIndexed(int reg, int disp)       { byte(0x0F); byte(0xB6); byte(0x84 | (reg << 3)); byte(0x03); dword(disp); }
+
+    // forward jcc/jmp with an 8b displacement; bind() resolves it
+    int  jcc(int cc) { byte(0x70 | cc); byte(0); return static_cast<int>(m_code.size()); }
+    void bind(int patch)
+    {
+        const int rel = static_cast<int>(m_code.size()) - patch;
+        assert(rel < 128);
+        m_code[patch-1] = static_cast<uint8>(rel);
+    }
+
+    // rbx <- the cpu pointer argument
+    void prologue()
+    {
+        byte(0x53);                     // push rbx
+        byte(0x48); byte(0x89); byte(0xFB);     // mov rbx, rdi
+    }
+
+    // return the given value
+    void epilogue(int rv)
+    {
+        movImm(RAX, static_cast<uint32>(rv));
+        byte(0x5B);                     // pop rbx
+        byte(0xC3);                     // ret
+    }
+
+    // call handler(*cpu, puop); the stack is 16B aligned after the prologue
+    void callHandler(uintptr_t handler, uintptr_t puop)
+    {
+        byte(0x48); byte(0x89); byte(0xDF);     // mov rdi, rbx
+        movImm64(RSI, puop);
+        movImm64(RAX, handler);
+        byte(0xFF); byte(0xD0);                 // call rax
+    }
+};
+
+} // namespace
+
+
+// compile the block starting at addr; returns false on failure
+bool
+Cpu2200vp::jitCompile(uint16 addr) noexcept
+{
+    if (m_jit_arena == nullptr) {
+        return false;
+    }
+
+    // locations of things relative to "this"
+    const uint8 * const self = reinterpret_cast<const uint8*>(this);
+    const int CPU      = static_cast<int>(reinterpret_cast<const uint8*>(&m_cpu) - self);
+    const int RAM      = static_cast<int>(&m_ram[0] - self);
+    const int PC       = CPU + offsetof(cpu2200vp_t, pc);
+    const int ORIG_PC  = CPU + offsetof(cpu2200vp_t, orig_pc);
+    const int IC       = CPU + offsetof(cpu2200vp_t, ic);
+    const int CH       = CPU + offsetof(cpu2200vp_t, ch);
+    const int CL       = CPU + offsetof(cpu2200vp_t, cl);
+    const int SH       = CPU + offsetof(cpu2200vp_t, sh);
+    const int BSR_MODE = CPU + offsetof(cpu2200vp_t, bsr_mode);
+    const int BANK_OFF = CPU + offsetof(cpu2200vp_t, bank_offset);
+
+    block_t &blk = m_blocks[addr];
+    assert(blk.num_ops > 1);
+
+    JitEmitter e;
+    e.prologue();
+
+    bool ic_stale = false;      // m_cpu.ic hasn't been updated yet
+    for (int n=0; n < blk.num_ops; n++) {
+        const int a = addr + n;
+        const ucode_t &uc = m_ucode[a];
+        const uint32 uop = uc.ucode;
+        const int op = uc.op;
+        const int dd = (uop >> 12) & 3;
+
+        const bool reg_alu = (op == OP_OR) || (op == OP_XOR) || (op == OP_AND)
+                          || (op == OP_SC) || (op == OP_AC);
+        const bool imm_alu = (op == OP_ORI) || (op == OP_XORI) || (op == OP_ANDI)
+                          || (op == OP_AI)  || (op == OP_ACI);
+        const bool mask_br = (op >= OP_BT) && (op <= OP_BNE);
+        const bool reg_br  = (op == OP_BLR) || (op == OP_BLER)
+                          || (op == OP_BER) || (op == OP_BNR);
+
+        if ((reg_alu || imm_alu) && (dd <= 1) &&
+            (uc.c_off[0] < offsetof(cpu2200vp_t, sl))) {
+
+            // carry set/clear happens before operands are fetched
+            const int cy = ((uop & FETCH_CY) != 0) ? ((uop >> 14) & 3) : 0;
+            if (cy == 2) {
+                e.aluByteImm(ALU_AND, SH, ~SH_MASK_CARRY & 0xFF);
+            } else if (cy == 3) {
+                e.aluByteImm(ALU_OR, SH, SH_MASK_CARRY);
+            }
+            e.loadWord(RAX, PC);
+            e.storeWord(RAX, ORIG_PC);
+
+            // eax = A operand (or immediate), edx = B operand
+            e.loadByte(RDX, CPU + uc.b_off[0]);
+            if (imm_alu) {
+                e.movImm(RAX, IMM8(uop));
+            } else {
+                e.loadByte(RAX, CPU + uc.a_off[0]);
+            }
+
+            const bool uses_carry = (op == OP_SC) || (op == OP_AC) || (op == OP_ACI);
+            switch (op) {
+                case OP_OR:  case OP_ORI:  e.aluReg(ALU_OR,  RAX, RDX); break;
+                case OP_XOR: case OP_XORI: e.aluReg(ALU_XOR, RAX, RDX); break;
+                case OP_AND: case OP_ANDI: e.aluReg(ALU_AND, RAX, RDX); break;
+                case OP_SC:
+                    e.aluImm(ALU_XOR, RDX, 0xFF);
+                    e.aluReg(ALU_ADD, RAX, RDX);
+                    break;
+                default:    // AC, AI, ACI
+                    e.aluReg(ALU_ADD, RAX, RDX);
+                    break;
+            }
+            if (uses_carry) {
+                // add in the carry, then carry out of bit 8 replaces it
+                e.loadByte(RCX, SH);
+                e.aluImm(ALU_AND, RCX, SH_MASK_CARRY);
+                e.aluReg(ALU_ADD, RAX, RCX);
+                e.movReg(RCX, RAX);
+                e.shrImm(RCX, 8);
+                e.loadByte(RDX, SH);
+                e.aluImm(ALU_AND, RDX, ~SH_MASK_CARRY & 0xFF);
+                e.aluReg(ALU_OR, RDX, RCX);
+                e.storeByte(RDX, SH);
+            }
+            e.storeByte(RAX, CPU + uc.c_off[0]);
+
+            if (dd == 1) {
+                // CH/CL <- memory at orig_pc, as INLINE_MAP_ADDRESS does it
+                e.loadWord(RAX, ORIG_PC);
+                e.aluImm(ALU_CMP, RAX, 8192);
+                const int hi_mem = e.jcc(CC_AE);
+                e.aluByteImm(ALU_CMP, BSR_MODE, 0);
+                const int bank0 = e.jcc(CC_E);
+                e.bind(hi_mem);
+                e.loadDword(RCX, BANK_OFF);
+                e.aluReg(ALU_ADD, RCX, RAX);
+                e.aluReg(ALU_XOR, RAX, RAX);
+                e.aluImm(ALU_CMP, RCX, static_cast<uint32>(m_mem_size));
+                const int too_big = e.jcc(CC_GE);
+                e.movReg(RAX, RCX);
+                e.bind(bank0);
+                e.bind(too_big);
+                e.loadIndexed(RCX, RAM);
+                e.storeByte(RCX, CH);
+                e.aluImm(ALU_XOR, RAX, 1);
+                e.loadIndexed(RCX, RAM);
+                e.storeByte(RCX, CL);
+            }
+
+            if (reg_alu && (uc.p16 != 0)) {
+                e.addWordImm(PC, uc.p16);
+            }
+            ic_stale = true;
+
+        } else if (mask_br || reg_br) {
+
+            e.loadWord(RAX, PC);
+            e.storeWord(RAX, ORIG_PC);
+
+            int cc;
+            if (mask_br) {
+                const int imm = (uop >> 4) & 0xF;
+                e.loadByte(RAX, CPU + uc.b_off[0]);
+                if (((uop >> 18) & 1) != 0) {
+                    e.shrImm(RAX, 4);
+                }
+                e.aluImm(ALU_AND, RAX, 0xF);
+                switch (op) {
+                    case OP_BT:
+                        e.aluImm(ALU_AND, RAX, imm);
+                        e.aluImm(ALU_CMP, RAX, imm);
+                        cc = CC_E;
+                        break;
+                    case OP_BF:
+                        e.aluImm(ALU_AND, RAX, imm);
+                        cc = CC_E;
+                        break;
+                    case OP_BEQ:
+                        e.aluImm(ALU_CMP, RAX, imm);
+                        cc = CC_E;
+                        break;
+                    default:    // BNE
+                        e.aluImm(ALU_CMP, RAX, imm);
+                        cc = CC_NE;
+                        break;
+                }
+            } else {
+                e.loadByte(RAX, CPU + uc.a_off[0]);
+                e.loadByte(RDX, CPU + uc.b_off[0]);
+                if (uc.p8 != 0) {
+                    e.addWordImm(PC, static_cast<int8>(uc.p8) & 0xFFFF);
+                }
+                e.aluReg(ALU_CMP, RAX, RDX);
+                cc = (op == OP_BLR)  ? CC_B
+                   : (op == OP_BLER) ? CC_BE
+                   : (op == OP_BER)  ? CC_E
+                                     : CC_NE;
+            }
+
+            // ic = (taken) ? target : ic+1
+            e.movImm(RCX, static_cast<uint16>(a + 1));
+            e.movImm(RDX, uc.p16);
+            e.cmov(cc, RCX, RDX);
+            e.storeWord(RCX, IC);
+            ic_stale = false;
+
+        } else if (op == OP_B) {
+
+            e.loadWord(RAX, PC);
+            e.storeWord(RAX, ORIG_PC);
+            e.storeWordImm(IC, uc.p16);
+            ic_stale = false;
+
+        } else {
+
+            // handlers expect ic to point at their op
+            if (ic_stale) {
+                e.storeWordImm(IC, a);
+            }
+            e.callHandler(reinterpret_cast<uintptr_t>(uc.handler),
+                          reinterpret_cast<uintptr_t>(&uc));
+            ic_stale = false;
+        }
+    }
+
+    if (ic_stale) {
+        e.storeWordImm(IC, addr + blk.num_ops);
+    }
+    e.epilogue(blk.ns);
+
+    // copy it to the arena, making room if needed
+    const int size = (static_cast<int>(e.m_code.size()) + 15) & ~15;
+    if (size > JIT_ARENA_SIZE) {
+        return false;
+    }
+    if (m_jit_used + size > JIT_ARENA_SIZE) {
+        jitFlush();
+    }
+    if (mprotect(m_jit_arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    uint8 * const code = m_jit_arena + m_jit_used;
+    memcpy(code, &e.m_code[0], e.m_code.size());
+    if (mprotect(m_jit_arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        // the host doesn't let us run generated code; stop trying
+        UI_warn("Unable to run compiled microcode; using the interpreter");
+        jitFlush();
+        munmap(m_jit_arena, JIT_ARENA_SIZE);
+        m_jit_arena = nullptr;
+        return false;
+    }
+    m_jit_used += size;
+
+    blk.code = reinterpret_cast<jit_fn_t>(code);
+    return true;
+}
+
+
+// discard all compiled code
+void
+Cpu2200vp::jitFlush() noexcept
+{
+    for (auto &blk : m_blocks) {
+        blk.code = nullptr;
+        blk.hits = 0;
+    }
+    m_jit_used = 0;
+}
+
+#endif // VP_JIT
+
+
+// perform the op at ic, or the block starting there if it completes
+// before event_ns elapses, and return the number of ns it took.
+// returns EXEC_ERR if we hit an illegal op.
+inline int
+Cpu2200vp::execNext(int64 event_ns)
+{
+#if defined(_DEBUG)
+    if (g_dbg_trace) {
+        static int g_num_ops = 0;
+        g_num_ops++;
+        char buff[200];
+        dumpState(true);
+        /*bool illegal =*/ dasmOneVpOp(&buff[0], m_cpu.ic, m_ucode[m_cpu.ic].ucode);
+        dbglog("cycle %5d: %s", g_num_ops, &buff[0]);
+    }
+#endif
+
+#if BLOCK_CACHE
+  #if defined(_DEBUG)
+    // when tracing, step one op at a time so each one gets logged
+    if (!g_dbg_trace)
+  #endif
+    {
+        block_t &blk = m_blocks[m_cpu.ic];
+        if (blk.num_ops == 0) {
+            translateBlock(m_cpu.ic);
+        }
+        if ((blk.num_ops > 1) && (blk.ns <= event_ns)) {
+            m_op_count += blk.num_ops;
+#if VP_JIT
+            if ((blk.code != nullptr) ||
+                ((++blk.hits == JIT_THRESHOLD) && jitCompile(m_cpu.ic))) {
+                return (blk.code)(this);
+            }
+#endif
+            return execBlock(blk.num_ops, blk.ns);
+        }
+    }
+#endif
+
+    m_op_count++;
+
+    const ucode_t * const puop = &m_ucode[m_cpu.ic];
+#if THREADED_DISPATCH
+    return (puop->handler)(*this, puop);
+#else
+    return execOneOpSwitch(puop);
+#endif
+}
+
+
+// perform one instruction and return the number of ns the instruction took.
+// if a block starts at the current ic, the whole block may be performed.
+int
+Cpu2200vp::execOneOp()
+{
+    return execNext(m_scheduler->nsUntilEvent());
+}
+
+
+// ------------------------------------------------------------------------
+// idle detection
+//
+// When BASIC is waiting for a key, or for the disk, the microcode spins in
+// a short loop testing a status bit, eg "BFL 2,SH,*".  Nothing inside a
+// batch can change that bit: only a timer callback or an i/o op can, and
+// execFor() never runs either in the middle of a batch.  So if one trip
+// around a loop leaves every register exactly as it found it, and nothing
+// was stored to memory or the control store along the way, every later
+// trip will do the same until the batch ends.
+//
+// execFor() watches for the first backwards branch target in a window of
+// IDLE_LOOP_NS.  Each time the loop returns there, the first 16 bytes of
+// the cpu state (the file registers, PC, CH/CL, K, and status) are checked
+// first, as they nearly always differ in a loop doing real work; only if
+// they match is the whole state compared.  Once a trip is seen to change
+// nothing, the batch is advanced by as many whole trips as fit before it
+// must end.  Because only whole trips are skipped, the cpu ends the batch
+// in the same state and at the same time it would have had it run them.
+//
+// Keystrokes come from the host between timeslices, which also end the
+// batch, so they are never missed.
+// ------------------------------------------------------------------------
+
+// run ops until budget_ns has elapsed, or until next_event_ns has elapsed
+// and a timer comes due.  an op which can signal other devices only runs
+// first in a batch, and it ends the batch: the scheduler's sense of time
+// must be current when it happens, and it may start a new timer.
+// returns the number of ns consumed.
+int64
+Cpu2200vp::execFor(int64 budget_ns, int64 next_event_ns)
+{
+    const int64 stop_ns = std::min(budget_ns, next_event_ns);
+    int64 done_ns = 0;
+
+#if IDLE_DETECT
+    const int KEY_BYTES = 16;           // reg[], pc, ch, cl, k, zero, sink, sl
+    static_assert(offsetof(cpu2200vp_t, sl) + 1 == KEY_BYTES,
+                  "idle detection key doesn't match cpu2200vp_t");
+    int         loop_ic   = -1;         // where the loop we are watching starts
+    int64       loop_ns   = 0;          // when we last arrived there
+    uint32      loop_st   = 0;          // m_stores at that time
+    bool        loop_full = false;      // loop_cpu holds all of the state
+    cpu2200vp_t loop_cpu;               // cpu state when we last arrived
+#endif
+
+    do {
+        const uint16 ic = m_cpu.ic;
+        const bool io_op = m_ucode[ic].io_op;
+        if (io_op && (done_ns > 0)) {
+            break;
+        }
+        const int op_ns = execNext(next_event_ns - done_ns);
+        if (m_status != CPU_RUNNING) {
+            break;  // illegal op
+        }
+        done_ns += op_ns;
+        if (io_op) {
+            break;
+        }
+#if IDLE_DETECT
+        if (m_cpu.ic <= ic) {
+            // we branched backwards; it may be to the top of a loop
+            const int64 trip_ns = done_ns - loop_ns;
+            if ((loop_ic < 0) || (trip_ns > IDLE_LOOP_NS)) {
+                // start watching the loop which starts here
+                loop_ic = m_cpu.ic;
+                loop_ns = done_ns;
+                loop_st = m_stores;
+                loop_full = false;
+                memcpy(&loop_cpu, &m_cpu, KEY_BYTES);
+            } else if (m_cpu.ic == loop_ic) {
+                // we made a trip around the loop
+                const bool same_key = (memcmp(&loop_cpu, &m_cpu, KEY_BYTES) == 0);
+                if (same_key && loop_full && (loop_st == m_stores) &&
+                    (memcmp(&loop_cpu, &m_cpu, sizeof(m_cpu)) == 0)) {
+                    // nothing changed, so nothing will until the batch ends
+                    done_ns += ((stop_ns - done_ns) / trip_ns) * trip_ns;
+                } else if (same_key) {
+                    memcpy(&loop_cpu, &m_cpu, sizeof(m_cpu));
+                    loop_full = true;
+                } else {
+                    memcpy(&loop_cpu, &m_cpu, KEY_BYTES);
+                    loop_full = false;
+                }
+                loop_ns = done_ns;
+                loop_st = m_stores;
+            }
+        }
+#endif
+    } while (done_ns < stop_ns);
+
+    return done_ns;
+}
+
+
 // ------------------------------------------------------------------------
 //  misc utilities
 // ------------------------------------------------------------------------
@@ -3,6 +3,7 @@
 #include "Ui.h"                 // for UI_Alert
 #include "host.h"
 
+#include <algorithm>
 #include <sstream>
 
 // ------------------------------------------------------------------------
@@ -21,6 +22,10 @@ DiskCtrlCfgState::operator=(const DiskCtrlCfgState &rhs) noexcept
         m_num_drives    = rhs.m_num_drives;
         m_intelligence  = rhs.m_intelligence;
         m_warn_mismatch = rhs.m_warn_mismatch;
+        m_sync          = rhs.m_sync;
+        m_flush_ms      = rhs.m_flush_ms;
+        m_flush_writes  = rhs.m_flush_writes;
+        m_flush_idle    = rhs.m_flush_idle;
         m_initialized   = true;
     }
 
@@ -35,6 +40,10 @@ DiskCtrlCfgState::DiskCtrlCfgState(const DiskCtrlCfgState &obj) noexcept
     m_num_drives    = obj.m_num_drives;
     m_intelligence  = obj.m_intelligence;
     m_warn_mismatch = obj.m_warn_mismatch;
+    m_sync          = obj.m_sync;
+    m_flush_ms      = obj.m_flush_ms;
+    m_flush_writes  = obj.m_flush_writes;
+    m_flush_idle    = obj.m_flush_idle;
     m_initialized   = true;
 }
 
@@ -50,7 +59,11 @@ DiskCtrlCfgState::operator==(const CardCfgState &rhs) const noexcept
 
     return (getNumDrives()    == rrhs.getNumDrives())    &&
            (getIntelligence() == rrhs.getIntelligence()) &&
-           (getWarnMismatch() == rrhs.getWarnMismatch()) ;
+           (getWarnMismatch() == rrhs.getWarnMismatch()) &&
+           (getSync()         == rrhs.getSync())         &&
+           (getFlushMs()      == rrhs.getFlushMs())      &&
+           (getFlushWrites()  == rrhs.getFlushWrites())  &&
+           (getFlushIdle()    == rrhs.getFlushIdle())    ;
 }
 
 bool
@@ -67,6 +80,10 @@ DiskCtrlCfgState::setDefaults() noexcept
     setNumDrives(2);
     setIntelligence(DISK_CTRL_INTELLIGENT);
     setWarnMismatch(true);
+    setSync(DISK_SYNC_CACHE);
+    setFlushMs(1000);
+    setFlushWrites(0);
+    setFlushIdle(false);
 }
 
 
@@ -95,6 +112,22 @@ DiskCtrlCfgState::loadIni(const std::string &subgroup)
     host::configReadBool(subgroup, "warnMismatch", &bval, true);
     setWarnMismatch(bval);
 
+    setSync(DISK_SYNC_CACHE);  // default
+    b = host::configReadStr(subgroup, "sync", &sval);
+    if (b) {
+             if (sval == "cache") { setSync(DISK_SYNC_CACHE); }
+        else if (sval == "async") { setSync(DISK_SYNC_ASYNC); }
+        else if (sval == "write") { setSync(DISK_SYNC_WRITE); }
+        else if (sval == "background") { setSync(DISK_SYNC_BACKGROUND); }
+    }
+
+    host::configReadInt(subgroup, "flushMs", &ival, 1000);
+    setFlushMs(ival);
+    host::configReadInt(subgroup, "flushWrites", &ival, 0);
+    setFlushWrites(ival);
+    host::configReadBool(subgroup, "flushIdle", &bval, false);
+    setFlushIdle(bval);
+
     m_initialized = true;
 }
 
@@ -117,6 +150,19 @@ DiskCtrlCfgState::saveIni(const std::string &subgroup) const
     host::configWriteStr(subgroup, "intelligence", foo);
 
     host::configWriteBool(subgroup, "warnMismatch", getWarnMismatch());
+
+    switch (m_sync) {
+        case DISK_SYNC_CACHE: foo = "cache"; break;
+        case DISK_SYNC_ASYNC: foo = "async"; break;
+        case DISK_SYNC_WRITE: foo = "write"; break;
+        case DISK_SYNC_BACKGROUND: foo = "background"; break;
+        default: assert(false); foo = "cache"; break;
+    }
+    host::configWriteStr(subgroup, "sync", foo);
+
+    host::configWriteInt(subgroup,  "flushMs",     getFlushMs());
+    host::configWriteInt(subgroup,  "flushWrites", getFlushWrites());
+    host::configWriteBool(subgroup, "flushIdle",   getFlushIdle());
 }
 
 
@@ -145,6 +191,36 @@ DiskCtrlCfgState::setWarnMismatch(bool warn) noexcept
     m_initialized = true;
 }
 
+void
+DiskCtrlCfgState::setSync(disk_sync_t sync) noexcept
+{
+    assert(sync == DISK_SYNC_CACHE ||
+           sync == DISK_SYNC_ASYNC ||
+           sync == DISK_SYNC_WRITE ||
+           sync == DISK_SYNC_BACKGROUND );
+
+    m_sync = sync;
+}
+
+// out of range values are clamped to something sensible
+void
+DiskCtrlCfgState::setFlushMs(int ms) noexcept
+{
+    m_flush_ms = std::max(10, std::min(ms, 600000));
+}
+
+void
+DiskCtrlCfgState::setFlushWrites(int count) noexcept
+{
+    m_flush_writes = std::max(0, count);
+}
+
+void
+DiskCtrlCfgState::setFlushIdle(bool sync) noexcept
+{
+    m_flush_idle = sync;
+}
+
 int
 DiskCtrlCfgState::getNumDrives() const noexcept
 {
@@ -163,6 +239,30 @@ DiskCtrlCfgState::getWarnMismatch() const noexcept
     return m_warn_mismatch;
 }
 
+DiskCtrlCfgState::disk_sync_t
+DiskCtrlCfgState::getSync() const noexcept
+{
+    return m_sync;
+}
+
+int
+DiskCtrlCfgState::getFlushMs() const noexcept
+{
+    return m_flush_ms;
+}
+
+int
+DiskCtrlCfgState::getFlushWrites() const noexcept
+{
+    return m_flush_writes;
+}
+
+bool
+DiskCtrlCfgState::getFlushIdle() const noexcept
+{
+    return m_flush_idle;
+}
+
 
 // return a copy of self
 std::shared_ptr<CardCfgState>
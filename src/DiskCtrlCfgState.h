@@ -3,7 +3,8 @@
 // with the controller (1-4), whether the controller is dumb or intelligent,
 // and whether the controller's intelligence is not suitable for use with
 // a given virtual disk image (eg, dumb controllers can access only the first
-// platter of disks that have more than one).
+// platter of disks that have more than one), and how eagerly writes to the
+// disk images are pushed out to the host's disk.
 
 #ifndef _INCLUDE_DISK_CONTROLLER_CFG_H_
 #define _INCLUDE_DISK_CONTROLLER_CFG_H_
@@ -49,12 +50,39 @@ public:
     void setWarnMismatch(bool warn) noexcept;
     bool getWarnMismatch() const noexcept;
 
+    // set/get how soon writes to the disk images reach the host's disk.
+    // it takes effect the next time a disk is inserted.
+    enum disk_sync_t {
+        DISK_SYNC_CACHE,             // leave it to the host's file cache
+        DISK_SYNC_ASYNC,             // start writing each sector at once
+        DISK_SYNC_WRITE,             // wait for each sector to be written
+        DISK_SYNC_BACKGROUND         // a background thread writes them in batches
+    };
+    void setSync(disk_sync_t sync) noexcept;
+    disk_sync_t getSync() const noexcept;
+
+    // tuning for DISK_SYNC_BACKGROUND: how long a written sector may wait
+    // before it is written out, how many may pile up before they all are
+    // (0=no limit), and whether to sync the whole image once writes stop.
+    // there is no dialog for these; they are set in the ini file.
+    void setFlushMs(int ms) noexcept;
+    int  getFlushMs() const noexcept;
+    void setFlushWrites(int count) noexcept;
+    int  getFlushWrites() const noexcept;
+    void setFlushIdle(bool sync) noexcept;
+    bool getFlushIdle() const noexcept;
+
 private:
     bool m_initialized = false;    // for debugging and sanity checking
     int  m_num_drives = 0;         // number of associated disk drives
     disk_ctrl_intelligence_t
          m_intelligence = DISK_CTRL_INTELLIGENT; // dumb, smart, or automatically decide
     bool m_warn_mismatch = true;   // warn if media mismatches controller intelligence
+    disk_sync_t
+         m_sync = DISK_SYNC_CACHE; // when disk image writes reach the disk
+    int  m_flush_ms = 1000;        // background flush interval
+    int  m_flush_writes = 0;       // background flush after this many dirty sectors
+    bool m_flush_idle = false;     // sync the image once writes stop
 };
 
 #endif // _INCLUDE_DISK_CONTROLLER_CFG_H_
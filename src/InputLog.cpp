@@ -0,0 +1,240 @@
+// Input log reading and writing.
+//
+// The log is a text file, so it can be read, and edited, by hand:
+//
+//     W2200 input log 1
+//     start <ns>
+//     <ns> key <io_addr> <term_num> <keycode>
+//     <ns> script <io_addr> <term_num> <filename>
+//     <ns> insert <slot> <drive> <filename>
+//     <ns> remove <slot> <drive>
+//     <ns> reset cold|warm
+//     <ns> speed regulated|unregulated
+//     <ns> disk realtime|fast
+//     end <ns>
+//
+// Times are scheduler time in ns, io_addr and keycode are in hex, and
+// filenames run to the end of the line.  The "end" line is written when
+// recording stops; if it is missing, the session is taken to end with the
+// last event.
+//
+// Events from the UI only ever arrive between timeslices, so each one was
+// stamped at a timeslice boundary.  The replayer ends a timeslice exactly at
+// the next event's time, which is where the recording session ended one
+// too, and so the machine sees the same input at the same point in the
+// instruction stream.
+//
+// The speed settings are part of the log because the display and disk
+// controllers time things differently when running at real speed.  A replay
+// keeps them as they were recorded, but doesn't wait on the host clock.
+
+#include "InputLog.h"
+#include "Ui.h"
+
+#include <sstream>
+
+static const char * const LOG_MAGIC = "W2200 input log 1";
+
+// ======================================================================
+// InputRecorder
+// ======================================================================
+
+InputRecorder::~InputRecorder()
+{
+    if (m_ofs.is_open()) {
+        m_ofs.close();
+    }
+}
+
+
+bool
+InputRecorder::open(const std::string &filename, int64 start_ns)
+{
+    m_ofs.open(filename, std::ofstream::out | std::ofstream::trunc);
+    if (!m_ofs) {
+        UI_error("Couldn't write '%s'", filename.c_str());
+        return false;
+    }
+    m_ofs << LOG_MAGIC << '\n'
+          << "start " << start_ns << '\n';
+    m_ofs.flush();
+    return true;
+}
+
+
+void
+InputRecorder::record(const input_event_t &ev)
+{
+    m_ofs << ev.ns << ' ';
+    switch (ev.kind) {
+        case input_event_t::KEY:
+            m_ofs << "key " << std::hex << ev.io_addr << ' '
+                  << std::dec << ev.term_num << ' '
+                  << std::hex << ev.keycode << std::dec;
+            break;
+        case input_event_t::SCRIPT:
+            m_ofs << "script " << std::hex << ev.io_addr << std::dec << ' '
+                  << ev.term_num << ' ' << ev.filename;
+            break;
+        case input_event_t::INSERT:
+            m_ofs << "insert " << ev.slot << ' ' << ev.drive << ' ' << ev.filename;
+            break;
+        case input_event_t::REMOVE:
+            m_ofs << "remove " << ev.slot << ' ' << ev.drive;
+            break;
+        case input_event_t::RESET:
+            m_ofs << "reset " << ((ev.flag) ? "cold" : "warm");
+            break;
+        case input_event_t::SPEED:
+            m_ofs << "speed " << ((ev.flag) ? "regulated" : "unregulated");
+            break;
+        case input_event_t::DISK_SPEED:
+            m_ofs << "disk " << ((ev.flag) ? "realtime" : "fast");
+            break;
+        default:
+            assert(false);
+            break;
+    }
+    m_ofs << '\n';
+    m_ofs.flush();
+}
+
+
+void
+InputRecorder::close(int64 end_ns)
+{
+    m_ofs << "end " << end_ns << '\n';
+    m_ofs.close();
+}
+
+// ======================================================================
+// InputReplayer
+// ======================================================================
+
+// parse the word naming a setting; returns false if it is neither
+static bool
+parseSetting(std::istream &is, const char *on, const char *off, bool *flag)
+{
+    std::string word;
+    is >> word;
+    *flag = (word == on);
+    return *flag || (word == off);
+}
+
+
+// parse one event line; returns false if it is malformed
+static bool
+parseEvent(const std::string &line, input_event_t *ev)
+{
+    std::istringstream iss(line);
+    std::string kind;
+    iss >> ev->ns >> kind;
+    if (kind == "key") {
+        ev->kind = input_event_t::KEY;
+        iss >> std::hex >> ev->io_addr >> std::dec >> ev->term_num
+            >> std::hex >> ev->keycode;
+    } else if (kind == "script") {
+        ev->kind = input_event_t::SCRIPT;
+        iss >> std::hex >> ev->io_addr >> std::dec >> ev->term_num >> std::ws;
+        std::getline(iss, ev->filename);
+    } else if (kind == "insert") {
+        ev->kind = input_event_t::INSERT;
+        iss >> ev->slot >> ev->drive >> std::ws;
+        std::getline(iss, ev->filename);
+    } else if (kind == "remove") {
+        ev->kind = input_event_t::REMOVE;
+        iss >> ev->slot >> ev->drive;
+    } else if (kind == "reset") {
+        ev->kind = input_event_t::RESET;
+        if (!parseSetting(iss, "cold", "warm", &ev->flag)) {
+            return false;
+        }
+    } else if (kind == "speed") {
+        ev->kind = input_event_t::SPEED;
+        if (!parseSetting(iss, "regulated", "unregulated", &ev->flag)) {
+            return false;
+        }
+    } else if (kind == "disk") {
+        ev->kind = input_event_t::DISK_SPEED;
+        if (!parseSetting(iss, "realtime", "fast", &ev->flag)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return !iss.fail() && (ev->ns >= 0);
+}
+
+
+bool
+InputReplayer::open(const std::string &filename)
+{
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        UI_error("Couldn't open '%s'", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(ifs, line) || (line != LOG_MAGIC)) {
+        UI_error("'%s' isn't an input log", filename.c_str());
+        return false;
+    }
+
+    m_events.clear();
+    m_next = 0;
+    bool have_end = false;
+    int line_num = 1;
+    while (std::getline(ifs, line)) {
+        line_num++;
+        if (line.empty()) {
+            continue;
+        }
+        bool ok = true;
+        std::istringstream iss(line);
+        std::string word;
+        iss >> word;
+        if (word == "start") {
+            iss >> m_start_ns;
+            ok = !iss.fail();
+        } else if (word == "end") {
+            iss >> m_end_ns;
+            ok = !iss.fail();
+            have_end = true;
+        } else {
+            input_event_t ev;
+            ok = parseEvent(line, &ev) &&
+                 (m_events.empty() || (ev.ns >= m_events.back().ns));
+            m_events.push_back(ev);
+        }
+        if (!ok) {
+            UI_error("%s:%d: bad input log entry", filename.c_str(), line_num);
+            return false;
+        }
+    }
+
+    if (!have_end) {
+        m_end_ns = (m_events.empty()) ? m_start_ns : m_events.back().ns;
+    }
+    return true;
+}
+
+
+int64
+InputReplayer::nextNs() const noexcept
+{
+    return (m_next < m_events.size()) ? m_events[m_next].ns : m_end_ns;
+}
+
+
+bool
+InputReplayer::next(input_event_t *ev)
+{
+    if (m_next >= m_events.size()) {
+        return false;
+    }
+    *ev = m_events[m_next++];
+    return true;
+}
+
+// vim: ts=8:et:sw=4:smarttab
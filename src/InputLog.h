@@ -0,0 +1,84 @@
+// An input log is a record of everything done to a machine from outside:
+// keystrokes, scripts, disk changes, resets and speed settings, each stamped
+// with the scheduler time at which it happened.  Replaying it against the same
+// starting machine reproduces the session exactly, however fast the host
+// happens to be.  See the corresponding .cpp for the file format.
+
+#ifndef _INCLUDE_INPUT_LOG_H_
+#define _INCLUDE_INPUT_LOG_H_
+
+#include "w2200.h"
+
+#include <fstream>
+
+struct input_event_t {
+    enum kind_t { KEY, SCRIPT, INSERT, REMOVE, RESET, SPEED, DISK_SPEED };
+    int64       ns       = 0;      // scheduler time it happened
+    kind_t      kind     = KEY;
+    int         io_addr  = 0;      // KEY, SCRIPT: the keyboard
+    int         term_num = 0;      // KEY, SCRIPT: terminal on that keyboard
+    int         keycode  = 0;      // KEY
+    int         slot     = 0;      // INSERT, REMOVE: disk controller
+    int         drive    = 0;      // INSERT, REMOVE
+    bool        flag     = false;  // RESET: cold, SPEED: regulated,
+                                   // DISK_SPEED: realtime
+    std::string filename;          // SCRIPT, INSERT
+};
+
+// ======================================================================
+// InputRecorder appends each event to the log file as it happens, so the
+// log is good up to the last event even if the emulator dies.
+
+class InputRecorder
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(InputRecorder);
+    InputRecorder() = default;
+    ~InputRecorder();
+
+    // start a new log; returns false on failure
+    bool open(const std::string &filename, int64 start_ns);
+
+    void record(const input_event_t &ev);
+
+    // note when the session ended and close the log
+    void close(int64 end_ns);
+
+private:
+    std::ofstream m_ofs;
+};
+
+
+// ======================================================================
+// InputReplayer reads a whole log, then hands back the events in order.
+
+class InputReplayer
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(InputReplayer);
+    InputReplayer() = default;
+
+    // read the log; returns false, after complaining, on failure
+    bool open(const std::string &filename);
+
+    // scheduler time of the start and end of the recorded session
+    int64 startNs() const noexcept { return m_start_ns; }
+    int64 endNs()   const noexcept { return m_end_ns; }
+
+    // scheduler time of the next event, or the end of the session
+    // once there are no more
+    int64 nextNs() const noexcept;
+
+    // return false if there are no events left, else return the next one
+    bool next(input_event_t *ev);
+
+private:
+    std::vector<input_event_t> m_events;
+    size_t m_next     = 0;   // index of the next event to hand back
+    int64  m_start_ns = 0;
+    int64  m_end_ns   = 0;
+};
+
+#endif // _INCLUDE_INPUT_LOG_H_
+
+// vim: ts=8:et:sw=4:smarttab
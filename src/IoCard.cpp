@@ -33,12 +33,13 @@ const IoCard::card_t IoCard::card_types[IoCard::NUM_CARDTYPES] = {
 
 // create an instance of the specified card
 std::unique_ptr<IoCard>
-IoCard::makeCard(std::shared_ptr<Scheduler> scheduler,
+IoCard::makeCard(System2200                &sys,
+                 std::shared_ptr<Scheduler> scheduler,
                  std::shared_ptr<Cpu2200>   cpu,
                  card_t type,
                  int base_addr, int card_slot, const CardCfgState *cfg)
 {
-    return makeCardImpl(scheduler, cpu, type, base_addr, card_slot, cfg);
+    return makeCardImpl(&sys, scheduler, cpu, type, base_addr, card_slot, cfg);
 }
 
 
@@ -51,7 +52,8 @@ IoCard::makeTmpCard(card_t type, int base_addr)
     std::shared_ptr<Cpu2200t>  dummy_cpu{nullptr};
     CardCfgState const * const dummy_config{nullptr};
 
-    return makeCardImpl(dummy_scheduler,
+    return makeCardImpl(nullptr,
+                        dummy_scheduler,
                         dummy_cpu,
                         type, base_addr, -1,
                         dummy_config);
@@ -60,7 +62,8 @@ IoCard::makeTmpCard(card_t type, int base_addr)
 
 // this is the shared implementation that the other make*Card functions use
 std::unique_ptr<IoCard>
-IoCard::makeCardImpl(std::shared_ptr<Scheduler> scheduler,
+IoCard::makeCardImpl(System2200                *sys,
+                     std::shared_ptr<Scheduler> scheduler,
                      std::shared_ptr<Cpu2200>   cpu,
                      card_t type, int base_addr, int card_slot,
                      const CardCfgState *cfg)
@@ -70,28 +73,28 @@ IoCard::makeCardImpl(std::shared_ptr<Scheduler> scheduler,
     switch (type) {
         case card_t::keyboard:
             crd = std::make_unique<IoCardKeyboard>(
-                            scheduler, cpu, base_addr, card_slot);
+                            sys, scheduler, cpu, base_addr, card_slot);
             break;
         case card_t::disp_64x16:
             crd = std::make_unique<IoCardDisplay>(
-                            scheduler, cpu,
+                            sys, scheduler, cpu,
                             base_addr, card_slot, UI_SCREEN_64x16);
             break;
         case card_t::disp_80x24:
             crd = std::make_unique<IoCardDisplay>(
-                            scheduler, cpu,
+                            sys, scheduler, cpu,
                             base_addr, card_slot, UI_SCREEN_80x24);
             break;
         case card_t::term_mux:
             crd = std::make_unique<IoCardTermMux>(
-                            scheduler, cpu, base_addr, card_slot, cfg);
+                            sys, scheduler, cpu, base_addr, card_slot, cfg);
             break;
         case card_t::printer:
-            crd = std::make_unique<IoCardPrinter>(cpu, base_addr, card_slot);
+            crd = std::make_unique<IoCardPrinter>(sys, cpu, base_addr, card_slot);
             break;
         case card_t::disk:
             crd = std::make_unique<IoCardDisk>(
-                            scheduler, cpu, base_addr, card_slot, cfg);
+                            sys, scheduler, cpu, base_addr, card_slot, cfg);
             break;
         default:
             assert(false);
@@ -26,6 +26,9 @@ class CardInfo;
 class CardCfgState;
 class Cpu2200;
 class Scheduler;
+class StateReader;
+class StateWriter;
+class System2200;
 
 class IoCard
 {
@@ -99,6 +102,15 @@ public:
     // ioCardCbIbs() to supply the IBS data to the CPU.
     virtual void setCpuBusy(bool busy) = 0;
 
+    // ------------------------ machine state ------------------------
+
+    // save or restore everything about the card which changes as it runs.
+    // the card configuration isn't part of it; state is only ever restored
+    // to a card configured the same way as the one it was saved from.
+    // problems are reported through the reader (see StateFile.h).
+    virtual void saveState(StateWriter &sw) const = 0;
+    virtual void loadState(StateReader &sr) = 0;
+
     // --------------- static member functions ---------------
 
     // the types of cards that may by plugged into a slot
@@ -130,6 +142,7 @@ public:
     // create an instance of the specified card; the card configuration,
     // if it has one, will come from the ini file
     static std::unique_ptr<IoCard> makeCard(
+                            System2200                &sys,
                             std::shared_ptr<Scheduler> scheduler,
                             std::shared_ptr<Cpu2200>   cpu,
                             card_t type, int base_addr, int card_slot,
@@ -159,12 +172,13 @@ protected:  // these are used by the CardInfo class
 
 private:
     // shared implementation the other make*Card function use.
-    // if card_slot is -1, this is a temp card that is incompletely
+    // if card_slot is -1 (and sys is nullptr), this is a temp card that is incompletely
     // initialized simply so we can use the methods to look up card
     // properties (ugly).  finally, if we provide real card_slot
     // information and existing_card is false, we return a new card
     // that has default state associated with it.
     static std::unique_ptr<IoCard> makeCardImpl(
+                                System2200                *sys,
                                 std::shared_ptr<Scheduler> scheduler,
                                 std::shared_ptr<Cpu2200>   cpu,
                                 card_t type, int base_addr, int card_slot,
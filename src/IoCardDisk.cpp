@@ -122,8 +122,10 @@
 
 #include "Cpu2200.h"
 #include "DiskCtrlCfgState.h"
+#include "InputLog.h"
 #include "IoCardDisk.h"
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "SysCfgState.h"
 #include "Ui.h"                // for UI_warn()
 #include "Wvd.h"
@@ -154,9 +156,11 @@ const int64 DISK_MIN_TICKS = TIMER_US(20);
 // =====================================================
 
 // instance constructor
-IoCardDisk::IoCardDisk(std::shared_ptr<Scheduler> scheduler,
+IoCardDisk::IoCardDisk(System2200                *sys,
+                       std::shared_ptr<Scheduler> scheduler,
                        std::shared_ptr<Cpu2200>   cpu,
                        int base_addr, int card_slot, const CardCfgState *cfg) :
+    m_sys(sys),
     m_scheduler(scheduler),
     m_cpu(cpu),
     m_base_addr(base_addr),
@@ -274,7 +278,7 @@ IoCardDisk::reset(bool /*hard_reset*/)
     m_acting_intelligent = false;
 
     // reset drive state
-    m_tmr_motor_off = nullptr;
+    m_tmr_motor_off->cancel();
 
     for (int drive=0; drive < numDrives(); drive++) {
         stopMotor(drive);
@@ -389,6 +393,174 @@ IoCardDisk::setCpuBusy(bool busy)
     checkDiskReady();
 }
 
+
+// the disk image contents aren't part of the machine state, just which
+// image is in which drive.  the image is reopened on restore if it isn't
+// already mounted, so whatever was written to it since the save remains.
+void
+IoCardDisk::saveState(StateWriter &sw) const
+{
+    sw.putU8(numDrives());
+    for (int drive=0; drive < numDrives(); drive++) {
+        const drive_t &d = m_d[drive];
+        sw.putStr((d.state != DRIVE_EMPTY) ? d.wvd->getPath() : "");
+        sw.putU8(static_cast<int>(d.state));
+        sw.putI32(d.track);
+        sw.putI32(d.sector);
+        sw.putI32(d.secwait);
+        sw.putI32(d.idle_cnt);
+        d.tmr_track->saveState(sw);
+        d.tmr_sector->saveState(sw);
+    }
+    m_tmr_motor_off->saveState(sw);
+
+    sw.putBool(m_selected);
+    sw.putBool(m_cpb);
+    sw.putBool(m_card_busy);
+    sw.putBool(m_compare_err);
+    sw.putBool(m_acting_intelligent);
+    sw.putBool(m_abs_hog);
+    sw.putBool(m_cbs_hog);
+
+    sw.putI32(m_host_type);
+    sw.putI32(m_command);
+    sw.putI32(m_special_command);
+    sw.putBool(m_primary);
+    sw.putI32(m_drive);
+    sw.putI32(m_platter);
+    sw.putI32(m_lastdrive);
+    sw.putI32(m_secaddr);
+    sw.putI32(m_byte_to_send);
+
+    sw.putBytes(&m_buffer[0], sizeof(m_buffer));
+    sw.putI32(m_bufptr);
+    sw.putBytes(&m_header[0], sizeof(m_header));
+    sw.putI32(m_state_cnt);
+    sw.putI32(m_xfer_length);
+
+    sw.putU8(static_cast<int>(m_state));
+    sw.putU8(static_cast<int>(m_calling_state));
+    sw.putU8(static_cast<int>(m_return_state));
+    sw.putI32(m_byte_count);
+    for (int n=0; n < 300; n++) {
+        sw.putI32(m_get_bytes[n]);
+    }
+    for (int n=0; n < 300; n++) {
+        sw.putI32(m_send_bytes[n]);
+    }
+    sw.putI32(m_get_bytes_ptr);
+    sw.putI32(m_send_bytes_ptr);
+
+    sw.putBool(m_copy_pending);
+    sw.putI32(m_range_drive);
+    sw.putI32(m_range_platter);
+    sw.putI32(m_range_start);
+    sw.putI32(m_range_end);
+    sw.putI32(m_dest_drive);
+    sw.putI32(m_dest_platter);
+    sw.putI32(m_dest_start);
+}
+
+
+void
+IoCardDisk::loadState(StateReader &sr)
+{
+    if (sr.getU8() != numDrives()) {
+        sr.fail("the disk controller has a different number of drives");
+        return;
+    }
+
+    for (int drive=0; drive < numDrives(); drive++) {
+        drive_t &d = m_d[drive];
+        const std::string filename = sr.getStr();
+        if (!sr.ok()) {
+            return;
+        }
+        const std::string mounted = (d.state != DRIVE_EMPTY) ? d.wvd->getPath() : "";
+        if (filename != mounted) {
+            if (d.state != DRIVE_EMPTY) {
+                // forced: whatever the drive was doing is about to be replaced
+                d.wvd->close();
+                d.state = DRIVE_EMPTY;
+            }
+            if (!filename.empty() && !iwvdInsertDisk(drive, filename)) {
+                sr.fail("couldn't open disk image '" + filename + "'");
+                return;
+            }
+        }
+        const int state = sr.getU8();
+        if ((state == DRIVE_EMPTY) != filename.empty() || (state > DRIVE_SPINNING)) {
+            sr.fail("bad disk drive state");
+            return;
+        }
+        d.state    = static_cast<state_t>(state);
+        d.track    = sr.getI32();
+        d.sector   = sr.getI32();
+        d.secwait  = sr.getI32();
+        d.idle_cnt = sr.getI32();
+        d.tmr_track->loadState(sr);
+        d.tmr_sector->loadState(sr);
+        UI_diskEvent(m_slot, drive);
+    }
+    m_tmr_motor_off->loadState(sr);
+
+    m_selected           = sr.getBool();
+    m_cpb                = sr.getBool();
+    m_card_busy          = sr.getBool();
+    m_compare_err        = sr.getBool();
+    m_acting_intelligent = sr.getBool();
+    m_abs_hog            = sr.getBool();
+    m_cbs_hog            = sr.getBool();
+
+    m_host_type       = sr.getI32();
+    m_command         = sr.getI32();
+    m_special_command = sr.getI32();
+    m_primary         = sr.getBool();
+    m_drive           = sr.getI32();
+    m_platter         = sr.getI32();
+    m_lastdrive       = sr.getI32();
+    m_secaddr         = sr.getI32();
+    m_byte_to_send    = sr.getI32();
+
+    sr.getBytes(&m_buffer[0], sizeof(m_buffer));
+    m_bufptr = sr.getI32();
+    sr.getBytes(&m_header[0], sizeof(m_header));
+    m_state_cnt   = sr.getI32();
+    m_xfer_length = sr.getI32();
+
+    m_state         = static_cast<disk_sm_t>(sr.getU8());
+    m_calling_state = static_cast<disk_sm_t>(sr.getU8());
+    m_return_state  = static_cast<disk_sm_t>(sr.getU8());
+    m_byte_count    = sr.getI32();
+    for (int n=0; n < 300; n++) {
+        m_get_bytes[n] = sr.getI32();
+    }
+    for (int n=0; n < 300; n++) {
+        m_send_bytes[n] = sr.getI32();
+    }
+    m_get_bytes_ptr  = sr.getI32();
+    m_send_bytes_ptr = sr.getI32();
+
+    m_copy_pending  = sr.getBool();
+    m_range_drive   = sr.getI32();
+    m_range_platter = sr.getI32();
+    m_range_start   = sr.getI32();
+    m_range_end     = sr.getI32();
+    m_dest_drive    = sr.getI32();
+    m_dest_platter  = sr.getI32();
+    m_dest_start    = sr.getI32();
+
+    // everything below is used as an array index
+    const auto in_range = [](int v, int lo, int hi) { return (lo <= v) && (v <= hi); };
+    if (!in_range(m_drive, 0, 3)       || !in_range(m_range_drive, 0, 3) ||
+        !in_range(m_dest_drive, 0, 3)  || !in_range(m_bufptr, 0, 257) ||
+        !in_range(m_get_bytes_ptr, 0, 300) || !in_range(m_send_bytes_ptr, 0, 300) ||
+        (m_state > CTRL_VERIFY_RANGE5) || (m_calling_state > CTRL_VERIFY_RANGE5) ||
+        (m_return_state > CTRL_VERIFY_RANGE5)) {
+        sr.fail("bad disk controller state");
+    }
+}
+
 // ==========================================================
 // IO card interface
 // ==========================================================
@@ -405,8 +577,8 @@ IoCardDisk::stopMotor(int drive)
     m_d[drive].sector     = 0;    // which sector is being read
     m_d[drive].idle_cnt   = 0;    // number of operations done w/o this drive
     m_d[drive].secwait    = -1;
-    m_d[drive].tmr_track  = nullptr;
-    m_d[drive].tmr_sector = nullptr;
+    m_d[drive].tmr_track->cancel();
+    m_d[drive].tmr_sector->cancel();
 
     UI_diskEvent(m_slot, drive);        // let UI know things have changed
 }
@@ -416,7 +588,9 @@ IoCardDisk::stopMotor(int drive)
 void
 IoCardDisk::createDiskController()
 {
-    m_tmr_motor_off = nullptr;
+    // the timers are created once, then rearmed as needed
+    m_tmr_motor_off = m_scheduler->createTimer([&](){ tcbMotorOff(m_drive); },
+                                               "disk motor");
 
     for (int drive=0; drive < 4; drive++) {
         m_d[drive].wvd = (drive < numDrives()) ? std::make_unique<Wvd>()
@@ -424,8 +598,12 @@ IoCardDisk::createDiskController()
         m_d[drive].state = DRIVE_EMPTY;
         // timing emulation:
         m_d[drive].track      = 0;    // which track head is on
-        m_d[drive].tmr_track  = nullptr;
-        m_d[drive].tmr_sector = nullptr;
+        m_d[drive].tmr_track  = m_scheduler->createTimer(
+                                    [&, drive](){ tcbTrack(drive); },
+                                    "disk track");
+        m_d[drive].tmr_sector = m_scheduler->createTimer(
+                                    [&, drive](){ tcbSector(drive); },
+                                    "disk sector");
     }
 
     reset(true);
@@ -477,9 +655,9 @@ IoCardDisk::setBusyState(bool busy)
 
 // true=same timing as real disk, false=going fast
 bool
-IoCardDisk::realtimeDisk() noexcept
+IoCardDisk::realtimeDisk() const noexcept
 {
-    return system2200::config().getDiskRealtime();
+    return m_sys->config().getDiskRealtime();
 }
 
 
@@ -496,8 +674,7 @@ IoCardDisk::wvdTickleMotorOffTimer()
     const int disktype = m_d[m_drive].wvd->getDiskType();
     if ((disktype == Wvd::DISKTYPE_FD5)    || (disktype == Wvd::DISKTYPE_FD5_DD) ||
         (disktype == Wvd::DISKTYPE_FD5_HD) || (disktype == Wvd::DISKTYPE_FD8)) {
-        m_tmr_motor_off = m_scheduler->createTimer(TEN_SECONDS,
-                                                   [&](){ tcbMotorOff(m_drive); });
+        m_tmr_motor_off->rearm(TEN_SECONDS);
     }
 }
 
@@ -592,7 +769,7 @@ IoCardDisk::wvdSeekTrack(int64 nominal_ns)
     const bool empty = (m_d[m_drive].state == DRIVE_EMPTY);
 
     // this shouldn't already be in use
-    assert(m_d[m_drive].tmr_track == nullptr);
+    assert(!m_d[m_drive].tmr_track->armed());
 
     // the disk controller counts how many times a command has been
     // issued without accessing a given drive.  if that count exceeds 32,
@@ -622,7 +799,7 @@ IoCardDisk::wvdSeekTrack(int64 nominal_ns)
         switch (m_d[m_drive].state) {
             case DRIVE_EMPTY:
             case DRIVE_IDLE:
-                assert(m_d[m_drive].tmr_sector == nullptr);
+                assert(!m_d[m_drive].tmr_sector->armed());
                 ns += ONE_SECOND;
                 break;
             case DRIVE_SPINNING:
@@ -633,10 +810,8 @@ IoCardDisk::wvdSeekTrack(int64 nominal_ns)
     }
 
     // start sector timer
-    if (!empty && (m_d[m_drive].tmr_sector == nullptr)) {
-        m_d[m_drive].tmr_sector = m_scheduler->createTimer(
-                                    m_d[m_drive].ns_per_sector,
-                                    [&](){ tcbSector(m_drive); });
+    if (!empty && !m_d[m_drive].tmr_sector->armed()) {
+        m_d[m_drive].tmr_sector->rearm(m_d[m_drive].ns_per_sector);
     }
 
     if (ns <= 0) {
@@ -646,8 +821,7 @@ IoCardDisk::wvdSeekTrack(int64 nominal_ns)
         ns = DISK_MIN_TICKS;
     }
 
-    m_d[m_drive].tmr_track =
-        m_scheduler->createTimer(ns, [&](){ tcbTrack(m_drive); });
+    m_d[m_drive].tmr_track->rearm(ns);
 }
 
 
@@ -708,9 +882,6 @@ IoCardDisk::tcbTrack(int arg)
         dbglog("TRACK SEEK timer fired\n");
     }
 
-    assert(m_d[m_drive].tmr_track != nullptr);
-    m_d[m_drive].tmr_track = nullptr;
-
     if (m_d[m_drive].state == DRIVE_IDLE) {
         m_d[m_drive].state = DRIVE_SPINNING;
     }
@@ -741,9 +912,6 @@ IoCardDisk::tcbTrack(int arg)
 void
 IoCardDisk::tcbMotorOff(int /*arg*/)
 {
-    assert(m_tmr_motor_off != nullptr);
-    m_tmr_motor_off = nullptr;
-
     if (DBG > 1) {
         dbglog("MOTOR OFF timer fired\n");
     }
@@ -762,17 +930,12 @@ IoCardDisk::tcbSector(int arg)
     int drive = arg;
 
     assert(drive >= 0 && drive < numDrives());
-    assert(m_d[drive].tmr_sector != nullptr);
-
     if (false && (NOISY > 2)) {
         dbglog("Drive %d SECTOR timer fired: sector %d\n", drive, m_d[drive].sector);
     }
 
     // retrigger the timer
-    m_d[drive].tmr_sector = m_scheduler->createTimer(
-                                    m_d[drive].ns_per_sector,
-                                    [&, drive](){ tcbSector(drive); });
-    assert(m_d[drive].tmr_sector != nullptr);
+    m_d[drive].tmr_sector->rearm(m_d[drive].ns_per_sector);
 
     // advance to next sector, mod sectors per track
     const int prev_sec = m_d[drive].sector;
@@ -848,15 +1011,66 @@ IoCardDisk::wvdGetFilename(const int slot,
         dynamic_cast<IoCardDisk*>(system2200::getInstFromSlot(slot));
     assert(tthis != nullptr);
 
+    return tthis->getFilename(drive, filename);
+}
+
+
+bool
+IoCardDisk::getFilename(int drive, std::string *filename) const
+{
+    assert(filename != nullptr);
+    ASSERT_VALID_DRIVE(drive);
+
+    if (m_d[drive].state == DRIVE_EMPTY) {
+        return false;
+    }
+
+    *filename = m_d[drive].wvd->getPath();
+    return true;
+}
+
+
+// returns true and the write-behind statistics of the disk in given
+// (slot,drive) if occupied, otherwise it returns false.
+bool
+IoCardDisk::wvdGetFlushStats(const int slot,
+                             const int drive,
+                             Wvd::flush_stats_t *stats)
+{
+    assert(stats != nullptr);
+    ASSERT_VALID_SLOT(slot);
+    ASSERT_VALID_DRIVE(drive);
+
+    const IoCardDisk *tthis =
+        dynamic_cast<IoCardDisk*>(system2200::getInstFromSlot(slot));
+    assert(tthis != nullptr);
+
     if (tthis->m_d[drive].state == DRIVE_EMPTY) {
         return false;
     }
 
-    *filename = tthis->m_d[drive].wvd->getPath();
+    *stats = tthis->m_d[drive].wvd->getFlushStats();
     return true;
 }
 
 
+// returns true if the disk in given (slot,drive) is occupied and
+// writes to it can't be seen outside this process
+bool
+IoCardDisk::wvdWritesArePrivate(const int slot, const int drive)
+{
+    ASSERT_VALID_SLOT(slot);
+    ASSERT_VALID_DRIVE(drive);
+
+    const IoCardDisk *tthis =
+        dynamic_cast<IoCardDisk*>(system2200::getInstFromSlot(slot));
+    assert(tthis != nullptr);
+
+    return (tthis->m_d[drive].state != DRIVE_EMPTY) &&
+           tthis->m_d[drive].wvd->writesArePrivate();
+}
+
+
 // given a slot and a drive number, return drive status
 // returns a bitwise 'or' of the WVD_STAT_DRIVE_* enums
 int
@@ -873,25 +1087,34 @@ IoCardDisk::wvdDriveStatus(int slot, int drive) noexcept
         return 0;       // !EXISTENT, !OCCUPIED, !RUNNING, !SELECTED
     }
 
+    return tthis->driveStatus(drive);
+}
+
+
+int
+IoCardDisk::driveStatus(int drive) const noexcept
+{
+    ASSERT_VALID_DRIVE(drive);
+
     int rv = 0; // default return value
 
-    if (drive < tthis->numDrives()) {
+    if (drive < numDrives()) {
         rv |= WVD_STAT_DRIVE_EXISTENT;
     }
 
-    if ((rv != 0) && tthis->m_d[drive].state != DRIVE_EMPTY) {
+    if ((rv != 0) && m_d[drive].state != DRIVE_EMPTY) {
         rv |= WVD_STAT_DRIVE_OCCUPIED;
     }
 
-    if ((rv != 0) && tthis->m_selected && (tthis->m_drive == drive)) {
+    if ((rv != 0) && m_selected && (m_drive == drive)) {
         rv |= WVD_STAT_DRIVE_SELECTED;
     }
 
-    if ((rv != 0) && !tthis->inIdleState()) {
+    if ((rv != 0) && !inIdleState()) {
         rv |= WVD_STAT_DRIVE_BUSY;
     }
 
-    if ((rv != 0) && tthis->m_d[drive].state != DRIVE_IDLE) {
+    if ((rv != 0) && m_d[drive].state != DRIVE_IDLE) {
         rv |= WVD_STAT_DRIVE_RUNNING;
     }
 
@@ -911,12 +1134,28 @@ IoCardDisk::wvdInsertDisk(int slot,
         dynamic_cast<IoCardDisk*>(system2200::getInstFromSlot(slot));
     assert(tthis != nullptr);
 
-    const bool ok = tthis->iwvdInsertDisk(drive, filename);
+    const bool ok = tthis->insertDisk(drive, filename);
+    if (ok) {
+        input_event_t ev;
+        ev.kind     = input_event_t::INSERT;
+        ev.slot     = slot;
+        ev.drive    = drive;
+        ev.filename = filename;
+        system2200::recordInput(ev);
+    }
     UI_diskEvent(slot, drive);
     return ok;
 }
 
 
+bool
+IoCardDisk::insertDisk(int drive, const std::string &filename)
+{
+    ASSERT_VALID_DRIVE(drive);
+    return iwvdInsertDisk(drive, filename);
+}
+
+
 // remove the disk from the specified drive
 // returns true if removed, or false if canceled.
 bool
@@ -929,6 +1168,13 @@ IoCardDisk::wvdRemoveDisk(int slot, int drive)
     assert(tthis != nullptr);
 
     const bool ok = tthis->iwvdRemoveDisk(drive);
+    if (ok) {
+        input_event_t ev;
+        ev.kind  = input_event_t::REMOVE;
+        ev.slot  = slot;
+        ev.drive = drive;
+        system2200::recordInput(ev);
+    }
     UI_diskEvent(slot, drive);
     return ok;
 }
@@ -1004,7 +1250,17 @@ IoCardDisk::iwvdInsertDisk(int drive,
     const int addr_off = ((drive & 2) != 0) ? 0x40 : 0x00;
     sprintf(&disk_loc[0], "%c/3%02X",
                 (drive_r ? 'R' : 'F'), m_base_addr + addr_off);
-    const bool ok = m_d[drive].wvd->open(filename);
+    Wvd::sync_t sync = Wvd::SYNC_CACHE;
+    switch (diskSync()) {
+        case DiskCtrlCfgState::DISK_SYNC_CACHE: sync = Wvd::SYNC_CACHE; break;
+        case DiskCtrlCfgState::DISK_SYNC_ASYNC: sync = Wvd::SYNC_ASYNC; break;
+        case DiskCtrlCfgState::DISK_SYNC_WRITE: sync = Wvd::SYNC_WRITE; break;
+        case DiskCtrlCfgState::DISK_SYNC_BACKGROUND: sync = Wvd::SYNC_BACKGROUND; break;
+        default: assert(false); break;
+    }
+    m_d[drive].wvd->setFlushOpts(m_cfg.getFlushMs(), m_cfg.getFlushWrites(),
+                                 m_cfg.getFlushIdle());
+    const bool ok = m_d[drive].wvd->open(filename, sync);
     if (!ok) {
         return false;
     }
@@ -1030,8 +1286,8 @@ IoCardDisk::iwvdInsertDisk(int drive,
     const int  num_sectors  = m_d[drive].wvd->getNumSectors();
     const int  num_platters = m_d[drive].wvd->getNumPlatters();
     const bool large_disk   = (num_sectors > max_sectors) || (num_platters > 1);
-    const bool first_gen    = (system2200::config().getCpuType() == Cpu2200::CPUTYPE_2200B)
-                           || (system2200::config().getCpuType() == Cpu2200::CPUTYPE_2200T);
+    const bool first_gen    = (m_sys->config().getCpuType() == Cpu2200::CPUTYPE_2200B)
+                           || (m_sys->config().getCpuType() == Cpu2200::CPUTYPE_2200T);
     const bool dumb_ctrl    = (intelligence() == DiskCtrlCfgState::DISK_CTRL_DUMB);
     const bool warn         = warnMismatch();
 
@@ -1068,8 +1324,8 @@ IoCardDisk::iwvdInsertDisk(int drive,
     }
 
     m_d[drive].state = DRIVE_IDLE;
-    m_d[drive].tmr_track  = nullptr;
-    m_d[drive].tmr_sector = nullptr;
+    m_d[drive].tmr_track->cancel();
+    m_d[drive].tmr_sector->cancel();
     m_d[drive].secwait    = -1;
     m_d[drive].idle_cnt   = 0;
 
@@ -1105,8 +1361,8 @@ IoCardDisk::iwvdRemoveDisk(int drive)
         m_d[drive].wvd->close();
         m_d[drive].state      = DRIVE_EMPTY;
         m_d[drive].secwait    = -1;
-        m_d[drive].tmr_track  = nullptr;
-        m_d[drive].tmr_sector = nullptr;
+        m_d[drive].tmr_track->cancel();
+        m_d[drive].tmr_sector->cancel();
         return true;
     }
 
@@ -7,10 +7,10 @@
 
 #include "DiskCtrlCfgState.h"
 #include "IoCard.h"
+#include "Wvd.h"
 
 class Cpu2200;
 class Scheduler;
-class Wvd;
 class Timer;
 
 class IoCardDisk : public IoCard
@@ -20,7 +20,8 @@ public:
     CANT_ASSIGN_OR_COPY_CLASS(IoCardDisk);
 
     // ----- common IoCard functions -----
-    IoCardDisk(std::shared_ptr<Scheduler> scheduler,
+    IoCardDisk(System2200                *sys,
+               std::shared_ptr<Scheduler> scheduler,
                std::shared_ptr<Cpu2200>   cpu,
                int base_addr,        // eg 0x310, 0x320, 0x330
                int card_slot,        // which backplane slot this card is in
@@ -37,6 +38,8 @@ public:
     void  strobeOBS(int val) override;
     void  strobeCBS(int val) noexcept override;
     void  setCpuBusy(bool busy) override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
     // ----- IoCardDisk specific functions -----
 
@@ -64,6 +67,16 @@ public:
                                int drive,
                                std::string *filename);
 
+    // returns true and the write-behind statistics of the disk in given
+    // (slot,drive) if occupied, otherwise it returns false.
+    static bool wvdGetFlushStats(int slot,
+                                 int drive,
+                                 Wvd::flush_stats_t *stats);
+
+    // returns true if the disk in given (slot,drive) is occupied and
+    // writes to it can't be seen outside this process (see Wvd.h)
+    static bool wvdWritesArePrivate(int slot, int drive);
+
     // given a slot and a drive number, return drive status
     // returns a bitwise 'or' of the WVD_STAT_DRIVE_* enums
     static int wvdDriveStatus(int slot, int drive) noexcept;
@@ -85,6 +98,12 @@ public:
     // returns true if successful
     static bool wvdFormatFile(const std::string &filename);
 
+    // the same as the wvd* functions above, but for this controller rather
+    // than the one in the given slot of the machine the UI is attached to
+    int  driveStatus(int drive) const noexcept;
+    bool getFilename(int drive, std::string *filename) const;
+    bool insertDisk(int drive, const std::string &filename);
+
     // get disk drive geometry from the disk type
     // return params are allowed to be nullptr
     static void getDiskGeometry(int disktype,
@@ -166,8 +185,12 @@ private:
     // issue warnings on media mismatch?
     bool warnMismatch() noexcept
         { return m_cfg.getWarnMismatch(); }
+    // how soon disk image writes reach the disk
+    DiskCtrlCfgState::disk_sync_t diskSync() noexcept
+        { return m_cfg.getSync(); }
 
     DiskCtrlCfgState           m_cfg;             // current configuration
+    System2200 * const         m_sys;             // the machine we are plugged into
     std::shared_ptr<Scheduler> m_scheduler;       // system event scheduler
     std::shared_ptr<Cpu2200>   m_cpu;             // associated CPU
     std::shared_ptr<Timer>     m_tmr_motor_off;   // turn off both drives after a period of inactivity
@@ -299,7 +322,7 @@ private:
     };
 
     // true=same timing as real disk, false=going fast
-    static bool realtimeDisk() noexcept;
+    bool realtimeDisk() const noexcept;
 
     // return true if this was a sw reset command and set state appropriately,
     // otherwise return false
@@ -344,6 +367,11 @@ private:
     int        m_state_cnt = 0;      // how many bytes of the have been processed
     int        m_xfer_length;        // number of bytes in this part of transaction
 
+    // each unsupported command is only complained about once
+    bool       m_special_reported[256] = {};      // by special command byte
+    bool       m_read_status_reported = false;
+    bool       m_no_error_checks_reported = false;
+
     // stuff for state machine subroutines
     disk_sm_t  m_state = CTRL_WAKEUP; // the current controller state
     disk_sm_t  m_calling_state;       // who performed call
@@ -38,6 +38,7 @@
 #include "host.h"         // for dbglog()
 
 #include <algorithm>      // for std::min, std::max
+#include <cstring>        // for memset
 
 #ifdef _DEBUG
     extern int iodisk_noisy;
@@ -509,8 +510,7 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
                         break;
 #endif
                 default: {
-                    static bool reported[256] = { false };
-                    if (!reported[m_special_command]) {
+                    if (!m_special_reported[m_special_command]) {
                         std::string msg = unsupportedExtendedCommandName(m_special_command);
                         if (msg.empty()) {
                             UI_warn("ERROR: disk controller received unimplemented special command 0x%02x (%s)\n"
@@ -520,7 +520,7 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
                             UI_warn("ERROR: disk controller received unknown special command 0x%02x",
                                      m_special_command);
                         }
-                        reported[m_special_command] = true;
+                        m_special_reported[m_special_command] = true;
                     }
                     m_state = CTRL_COMMAND_ECHO_BAD;
                     }
@@ -1030,15 +1030,17 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
             uint8 data[256];
 
             for (int n=0; ok && (n < count); n++) {
-                ok = m_d[m_range_drive].wvd->readSector
+                // straight out of the source image, if it is mapped
+                const uint8 *src = m_d[m_range_drive].wvd->sectorData
                                     (m_range_platter, m_range_start+n, &data[0]);
+                ok = (src != nullptr);
                 if (!ok) {
                     m_byte_to_send = 0x02;  // generic error
                 } else if (m_d[m_drive].wvd->getWriteProtect()) {
                     m_byte_to_send = 0x01;  // write protect
                 } else {
                     ok = m_d[m_dest_drive].wvd->writeSector
-                                    (m_dest_platter, m_dest_start+n, &data[0]);
+                                    (m_dest_platter, m_dest_start+n, src);
                     if (!ok) {
                         m_byte_to_send = 0x02;  // generic error
                     }
@@ -1375,7 +1377,8 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
             uint8 data[256];
 
             for (m_secaddr = first; ok && (m_secaddr <= last); m_secaddr++) {
-                ok = m_d[m_drive].wvd->readSector(m_range_platter, m_secaddr, &data[0]);
+                ok = (m_d[m_drive].wvd->sectorData(m_range_platter, m_secaddr,
+                                                   &data[0]) != nullptr);
             }
             if (!ok) {
                 m_byte_to_send = 0x01;  // seek error
@@ -1426,9 +1429,8 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
     // protocol level, and microprogram release fields should be is unknown.
     case CTRL_READ_STATUS:
         {
-            static bool reported = false;
-            if (!reported) {
-                reported = true;
+            if (!m_read_status_reported) {
+                m_read_status_reported = true;
                 UI_warn("Unimplemented special command: READ STATUS");
             }
         }
@@ -1470,9 +1472,8 @@ IoCardDisk::advanceStateInt(disk_event_t event, const int val)
     //     (which is a CBS/IMM=01) clears this condition.
     // case CTRL_NO_ERROR_CHECKS:
         {
-            static bool reported = false;
-            if (!reported) {
-                reported = true;
+            if (!m_no_error_checks_reported) {
+                m_no_error_checks_reported = true;
                 UI_warn("Unimplemented special command: NO_ERROR_CHECKS");
             }
         }
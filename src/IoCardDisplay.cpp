@@ -52,6 +52,7 @@
 #include "Cpu2200.h"
 #include "IoCardDisplay.h"
 #include "Scheduler.h"        // for Timer...() functions
+#include "StateFile.h"
 #include "Terminal.h"
 #include "Ui.h"
 #include "host.h"             // for dbglog
@@ -93,10 +94,12 @@ static const int num_scanlines = 256;
 //     the m_tmr_hsync timer event.
 
 // instance constructor
-IoCardDisplay::IoCardDisplay(std::shared_ptr<Scheduler> scheduler,
+IoCardDisplay::IoCardDisplay(System2200                *sys,
+                             std::shared_ptr<Scheduler> scheduler,
                              std::shared_ptr<Cpu2200>   cpu,
                              int base_addr, int card_slot,
                              ui_screen_t screen_type) :
+    m_sys(sys),
     m_scheduler(scheduler),
     m_cpu(cpu),
     m_base_addr(base_addr),
@@ -108,9 +111,12 @@ IoCardDisplay::IoCardDisplay(std::shared_ptr<Scheduler> scheduler,
         return;
     }
 
+    m_tmr_hsync = m_scheduler->createTimer(
+                        std::bind(&IoCardDisplay::tcbHsync, this, 0),
+                        "display hsync");
     reset(true);
 
-    m_terminal = std::make_unique<Terminal>(scheduler, nullptr,
+    m_terminal = std::make_unique<Terminal>(*m_sys, scheduler, nullptr,
                                             base_addr, 0, screen_type, false);
     assert(m_terminal);
 }
@@ -121,6 +127,7 @@ IoCardDisplay::~IoCardDisplay()
 {
     if (m_slot >= 0) {
         reset(true);    // turns off handshakes in progress
+        m_tmr_hsync->cancel();
         m_terminal = nullptr;
     }
 }
@@ -176,7 +183,6 @@ IoCardDisplay::reset(bool hard_reset)
     }
 
     // get the horizontal sync timer going
-    m_tmr_hsync = nullptr;
     m_hsync_count = 0;
     tcbHsync(0);
 }
@@ -220,7 +226,7 @@ IoCardDisplay::strobeOBS(int val)
 
     m_terminal->processChar(val8);
 
-    if (system2200::isCpuSpeedRegulated()) {
+    if (m_sys->isCpuSpeedRegulated()) {
         if (val8 == 0x03) {
             m_busy_state = busy_state::CLEAR1;
             m_card_busy = true;
@@ -277,11 +283,46 @@ IoCardDisplay::setCpuBusy(bool busy)
 }
 
 
+// save everything which changes as the card runs
+void
+IoCardDisplay::saveState(StateWriter &sw) const
+{
+    sw.putBool(m_selected);
+    sw.putBool(m_card_busy);
+    sw.putU16(m_hsync_count);
+    sw.putU8(static_cast<int>(m_busy_state));
+    m_tmr_hsync->saveState(sw);
+    m_terminal->saveState(sw);
+}
+
+
+void
+IoCardDisplay::loadState(StateReader &sr)
+{
+    m_selected    = sr.getBool();
+    m_card_busy   = sr.getBool();
+    m_hsync_count = sr.getU16();
+    m_busy_state  = static_cast<busy_state>(sr.getU8());
+    if (m_busy_state > busy_state::ROLL2) {
+        sr.fail("bad display controller state");
+    }
+    m_tmr_hsync->loadState(sr);
+    m_terminal->loadState(sr);
+}
+
+
+void
+IoCardDisplay::clearDisplay() noexcept
+{
+    m_terminal->clearDisplay();
+}
+
+
 // horizontal sync timer callback
 void
-IoCardDisplay::tcbHsync(int arg)
+IoCardDisplay::tcbHsync(int /*arg*/)
 {
-    const bool regulated = system2200::isCpuSpeedRegulated();
+    const bool regulated = m_sys->isCpuSpeedRegulated();
 
     m_hsync_count++;
 
@@ -293,13 +334,7 @@ IoCardDisplay::tcbHsync(int arg)
     }
 
     // retrigger the timer
-#if 0
-    m_tmr_hsync = m_scheduler->createTimer(new_period,
-                                            [&](){ tcbHsync(arg); });
-#else
-    m_tmr_hsync = m_scheduler->createTimer(new_period,
-                            std::bind(&IoCardDisplay::tcbHsync, this, arg));
-#endif
+    m_tmr_hsync->rearm(new_period);
 
     // advance state machine
     switch (m_busy_state) {
@@ -19,7 +19,8 @@ public:
     CANT_ASSIGN_OR_COPY_CLASS(IoCardDisplay);
 
     // ----- common IoCard functions -----
-    IoCardDisplay(std::shared_ptr<Scheduler> scheduler,
+    IoCardDisplay(System2200                *sys,
+                  std::shared_ptr<Scheduler> scheduler,
                   std::shared_ptr<Cpu2200>   cpu,
                   int base_addr, int card_slot, ui_screen_t screen_type);
     ~IoCardDisplay() override;
@@ -33,6 +34,11 @@ public:
     void  strobeCBS(int val) override;
     int   getIB() const noexcept override;
     void  setCpuBusy(bool busy) override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
+
+    // blank the screen (see Terminal::clearDisplay())
+    void  clearDisplay() noexcept;
 
 private:
     // ---- card properties ----
@@ -40,6 +46,7 @@ private:
     std::string       getName() const override;
     std::vector<int>  getBaseAddresses() const override;
 
+    System2200 * const         m_sys;       // the machine we are plugged into
     std::shared_ptr<Scheduler> m_scheduler; // shared system event scheduler
     std::shared_ptr<Cpu2200>   m_cpu;       // associated CPU
     const int  m_base_addr;     // the address the card is mapped to
@@ -3,6 +3,7 @@
 #include "Cpu2200.h"
 #include "IoCardKeyboard.h"
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "Ui.h"
 #include "system2200.h"
 
@@ -13,17 +14,21 @@
 #endif
 
 // instance constructor
-IoCardKeyboard::IoCardKeyboard(std::shared_ptr<Scheduler> scheduler,
+IoCardKeyboard::IoCardKeyboard(System2200                *sys,
+                               std::shared_ptr<Scheduler> scheduler,
                                std::shared_ptr<Cpu2200>   cpu,
                                int base_addr, int card_slot) :
+    m_sys(sys),
     m_scheduler(scheduler),
     m_cpu(cpu),
     m_base_addr(base_addr),
     m_slot(card_slot)
 {
     if (m_slot >= 0) {
+        m_tmr_script = m_scheduler->createTimer([&](){ tcbScript(); },
+                                                "kb script");
         reset(true);
-        system2200::registerKb(
+        m_sys->registerKb(
             m_base_addr, 0,
             std::bind(&IoCardKeyboard::receiveKeystroke, this, std::placeholders::_1)
         );
@@ -36,7 +41,7 @@ IoCardKeyboard::~IoCardKeyboard()
 {
     if (m_slot >= 0) {
         reset(true);  // turns off handshakes in progress
-        system2200::unregisterKb(m_base_addr, 0);
+        m_sys->unregisterKb(m_base_addr, 0);
     }
 }
 
@@ -78,7 +83,7 @@ IoCardKeyboard::getAddresses() const
 void
 IoCardKeyboard::reset(bool /*hard_reset*/) noexcept
 {
-    m_tmr_script = nullptr;
+    m_tmr_script->cancel();
 
     // reset card state
     m_selected  = false;
@@ -148,6 +153,29 @@ IoCardKeyboard::setCpuBusy(bool busy)
 }
 
 
+// save everything which changes as the card runs
+void
+IoCardKeyboard::saveState(StateWriter &sw) const
+{
+    sw.putBool(m_selected);
+    sw.putBool(m_cpb);
+    sw.putBool(m_key_ready);
+    sw.putU16(m_key_code);
+    m_tmr_script->saveState(sw);
+}
+
+
+void
+IoCardKeyboard::loadState(StateReader &sr)
+{
+    m_selected  = sr.getBool();
+    m_cpb       = sr.getBool();
+    m_key_ready = sr.getBool();
+    m_key_code  = sr.getU16();
+    m_tmr_script->loadState(sr);
+}
+
+
 // ================== keyboard specific public functions =================
 
 void
@@ -157,7 +185,7 @@ IoCardKeyboard::receiveKeystroke(int keycode)
 
     if (keycode == KEYCODE_RESET) {
         // warm reset
-        system2200::reset(false);
+        m_sys->reset(false);
     } else if (keycode == KEYCODE_HALT) {
         // halt/step
         m_key_ready = false;
@@ -183,8 +211,6 @@ IoCardKeyboard::tcbScript()
         }
         m_cpu->setDevRdy(m_key_ready);
     }
-
-    m_tmr_script = nullptr;
 }
 
 
@@ -201,16 +227,14 @@ void
 IoCardKeyboard::checkKeyReady()
 {
     if (!m_key_ready) {
-        system2200::pollScriptInput(m_base_addr, 0);
+        m_sys->pollScriptInput(m_base_addr, 0);
     }
     if (m_selected) {
         if (m_key_ready && !m_cpb) {
             // we can't return IBS right away -- apparently there
             // must be some delay otherwise the handshake breaks
-            if (m_tmr_script == nullptr) {
-                m_tmr_script = m_scheduler->createTimer(
-                        TIMER_US(50),     // 30 is OK, 20 is too little
-                        [&](){ tcbScript(); });
+            if (!m_tmr_script->armed()) {
+                m_tmr_script->rearm(TIMER_US(50));  // 30 is OK, 20 is too little
             }
         }
         m_cpu->setDevRdy(m_key_ready);
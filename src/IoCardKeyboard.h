@@ -14,7 +14,8 @@ public:
     CANT_ASSIGN_OR_COPY_CLASS(IoCardKeyboard);
 
     // ----- common IoCard functions -----
-    IoCardKeyboard(std::shared_ptr<Scheduler> scheduler,
+    IoCardKeyboard(System2200                *sys,
+                   std::shared_ptr<Scheduler> scheduler,
                    std::shared_ptr<Cpu2200>   cpu,
                    int base_addr, int card_slot);
     ~IoCardKeyboard() override;
@@ -27,6 +28,8 @@ public:
     void  strobeOBS(int val) override;
     void  strobeCBS(int val) noexcept override;
     void  setCpuBusy(bool busy) override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
     // ----- IoCardKeyboard specific functions -----
 
@@ -52,6 +55,7 @@ private:
     // test if any key is ready to accept
     void checkKeyReady();
 
+    System2200 * const         m_sys;        // the machine we are plugged into
     std::shared_ptr<Scheduler> m_scheduler;  // shared event scheduler
     std::shared_ptr<Cpu2200>   m_cpu;        // associated CPU
     std::shared_ptr<Timer>     m_tmr_script; // keystrokes are sent a few 10s of uS after !CPB
@@ -2,6 +2,7 @@
 
 #include "Cpu2200.h"
 #include "IoCardPrinter.h"
+#include "StateFile.h"
 #include "Ui.h"
 #include "system2200.h"
 
@@ -12,15 +13,17 @@
 #endif
 
 
-IoCardPrinter::IoCardPrinter(std::shared_ptr<Cpu2200> cpu,
+IoCardPrinter::IoCardPrinter(System2200              *sys,
+                             std::shared_ptr<Cpu2200> cpu,
                              int base_addr, int card_slot) :
+    m_sys(sys),
     m_cpu(cpu),
     m_base_addr(base_addr),
     m_slot(card_slot)
 {
     if (m_slot >= 0) {
         int io_addr;
-        const bool ok = system2200::getSlotInfo(card_slot, nullptr, &io_addr);
+        const bool ok = m_sys->getSlotInfo(card_slot, nullptr, &io_addr);
         assert(ok);
         m_wndhnd = UI_printerInit(io_addr);
         reset(true);
@@ -146,6 +149,24 @@ IoCardPrinter::setCpuBusy(bool busy)
 }
 
 
+// save everything which changes as the card runs.
+// what has been printed so far belongs to the UI, not to the machine.
+void
+IoCardPrinter::saveState(StateWriter &sw) const
+{
+    sw.putBool(m_selected);
+    sw.putBool(m_cpb);
+}
+
+
+void
+IoCardPrinter::loadState(StateReader &sr)
+{
+    m_selected = sr.getBool();
+    m_cpb      = sr.getBool();
+}
+
+
 // ---- accessor of opaque gui pointer ----
 
 PrinterFrame *
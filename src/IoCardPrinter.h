@@ -13,7 +13,8 @@ public:
     CANT_ASSIGN_OR_COPY_CLASS(IoCardPrinter);
 
     // ----- common IoCard functions -----
-    IoCardPrinter(std::shared_ptr<Cpu2200> cpu,
+    IoCardPrinter(System2200              *sys,
+                  std::shared_ptr<Cpu2200> cpu,
                   int base_addr, int card_slot);
     ~IoCardPrinter() override;
 
@@ -25,6 +26,8 @@ public:
     void  strobeOBS(int val) override;
     void  strobeCBS(int val) override;
     void  setCpuBusy(bool busy) override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
     // give access to associated gui window
     PrinterFrame *getGuiPtr() const noexcept;
@@ -35,6 +38,7 @@ private:
     std::string       getName() const override;
     std::vector<int>  getBaseAddresses() const override;
 
+    System2200 * const            m_sys;     // the machine we are plugged into
     std::shared_ptr<Cpu2200>      m_cpu;     // associated CPU
     std::shared_ptr<PrinterFrame> m_wndhnd;  // opaque handle to UI window
     const int     m_base_addr;    // the address the card is mapped to
@@ -14,6 +14,8 @@
 #include "IoCardKeyboard.h"   // for key encodings
 #include "IoCardTermMux.h"
 #include "Scheduler.h"
+#include "StateFile.h"
+#include "SysCfgState.h"
 #include "TermMuxCfgState.h"
 #include "Terminal.h"
 #include "Ui.h"
@@ -71,10 +73,12 @@ static const int OUT_RBI       = 0x07;  // 0=ready/1=busy; bit n=addr (n+1); bit
 static const int OUT_UART_CMD  = 0x0E;  // write to selected uart command reg
 
 // instance constructor
-IoCardTermMux::IoCardTermMux(std::shared_ptr<Scheduler> scheduler,
+IoCardTermMux::IoCardTermMux(System2200                *sys,
+                             std::shared_ptr<Scheduler> scheduler,
                              std::shared_ptr<Cpu2200> cpu,
                              int base_addr, int card_slot,
                              const CardCfgState *cfg) :
+    m_sys(sys),
     m_scheduler(scheduler),
     m_cpu(cpu),
     m_base_addr(base_addr),
@@ -102,13 +106,27 @@ IoCardTermMux::IoCardTermMux(std::shared_ptr<Scheduler> scheduler,
 
         t.tx_ready = true;
         t.tx_byte  = 0x00;
+        t.tx_shift = 0x00;
         t.tx_tmr   = nullptr;
     }
 
     int io_addr = 0;
-    const bool ok = system2200::getSlotInfo(card_slot, nullptr, &io_addr);
+    const bool ok = m_sys->getSlotInfo(card_slot, nullptr, &io_addr);
     assert(ok);
 
+    // in parallel mode, the board keeps time on its own
+    m_parallel = (m_sys->config().getMxdWindowNs() > 0);
+    if (m_parallel) {
+        m_scheduler = std::make_shared<Scheduler>();
+    }
+
+    // the uart timers are created once, then rearmed as needed
+    for (int n=0; n < MAX_TERMINALS; n++) {
+        m_terms[n].tx_tmr = m_scheduler->createTimer(
+                                [this, n](){ mxdToTermCallback(n); },
+                                "mux uart");
+    }
+
     m_i8080 = i8080_new(IoCardTermMux::i8080_rd_func,
                         IoCardTermMux::i8080_wr_func,
                         IoCardTermMux::i8080_in_func,
@@ -118,8 +136,15 @@ IoCardTermMux::IoCardTermMux(std::shared_ptr<Scheduler> scheduler,
     i8080_reset(static_cast<i8080*>(m_i8080));
 
     // register the i8080 for clock callback
-    clkCallback cb = std::bind(&IoCardTermMux::execOneOp, this);
-    system2200::registerClockedDevice(cb);
+    if (m_parallel) {
+        m_sys->registerParallelDevice(this,
+                        [this](int64 window_ns) { runWindow(window_ns); },
+                        [this]() { syncWindow(); });
+    } else {
+        clkCallback cb = [this](int64 budget_ns, int64 next_event_ns)
+                         { return execFor(budget_ns, next_event_ns); };
+        m_sys->registerClockedDevice(cb);
+    }
 
     // create all the terminals
     auto const cpu_type = m_cpu->getCpuType();
@@ -127,7 +152,7 @@ IoCardTermMux::IoCardTermMux(std::shared_ptr<Scheduler> scheduler,
                       && (cpu_type != Cpu2200::CPUTYPE_2200T);
     for(int n=0; n<m_num_terms; n++) {
         m_terms[n].terminal =
-            std::make_unique<Terminal>(scheduler, this,
+            std::make_unique<Terminal>(*m_sys, m_scheduler, this,
                                        io_addr, n, UI_SCREEN_2236DE, vp_mode);
     }
 }
@@ -138,10 +163,14 @@ IoCardTermMux::~IoCardTermMux()
 {
     if (m_slot >= 0) {
         // not just a temp object, so clean up
+        if (m_parallel) {
+            m_sys->unregisterParallelDevice(this);
+        }
         i8080_destroy(static_cast<i8080*>(m_i8080));
         m_i8080 = nullptr;
         for (auto &t : m_terms) {
             t.terminal = nullptr;
+            t.tx_tmr->cancel();
         }
     }
 }
@@ -224,6 +253,10 @@ IoCardTermMux::setConfiguration(const CardCfgState &cfg) noexcept
 void
 IoCardTermMux::reset(bool /*hard_reset*/) noexcept
 {
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::PRIME, 0 });
+        return;
+    }
     m_prime_seen = true;
 }
 
@@ -231,12 +264,22 @@ IoCardTermMux::reset(bool /*hard_reset*/) noexcept
 void
 IoCardTermMux::select()
 {
-    m_io_offset = (m_cpu->getAB() & 7);
+    const int io_offset = (m_cpu->getAB() & 7);
 
     if (do_dbg) {
-        dbglog("TermMux/%02x +ABS %02x\n", m_base_addr, m_base_addr+m_io_offset);
+        dbglog("TermMux/%02x +ABS %02x\n", m_base_addr, m_base_addr+io_offset);
     }
 
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::SELECT, io_offset });
+        m_cpu_io_offset = io_offset;
+        m_cpu_selected = (io_offset != 0);
+        cpuUpdateRbi();
+        return;
+    }
+
+    m_io_offset = io_offset;
+
     // offset 0 is not handled
     if (m_io_offset == 0) {
         return;
@@ -255,6 +298,13 @@ IoCardTermMux::deselect()
     }
     m_cpu->setDevRdy(false);
 
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::DESELECT, 0 });
+        m_cpu_selected = false;
+        m_cpu_cpb      = true;
+        return;
+    }
+
     m_selected = false;
     m_cpb      = true;
 }
@@ -268,6 +318,13 @@ IoCardTermMux::strobeOBS(int val)
         dbglog("TermMux/%02x OBS: byte 0x%02x\n", m_base_addr, val);
     }
 
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::OBS, val });
+        m_cpu_obscbs_seen = true;
+        cpuUpdateRbi();
+        return;
+    }
+
     // any previous obs or cbs should have been serviced before we see another
     assert(!m_obs_seen && !m_cbs_seen);
 
@@ -292,6 +349,13 @@ IoCardTermMux::strobeCBS(int val)
         dbglog("TermMux/%02x CBS: byte 0x%02x\n", m_base_addr, val);
     }
 
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::CBS, val });
+        m_cpu_obscbs_seen = true;
+        cpuUpdateRbi();
+        return;
+    }
+
     // any previous obs or cbs should have been serviced before we see another
     assert(!m_obs_seen && !m_cbs_seen);
 
@@ -317,7 +381,8 @@ IoCardTermMux::getIB() const noexcept
     // !IB5 low (logically, the byte is or'd with 0x10). Looking at
     // the MVP microcode, it only ever looks at bit 5.  However, the
     // "CIO SRS" command is exposed via $GIO 760r (Status Request Strobe).
-    return (m_io_offset == 5) ? 0x10 : 0x00;
+    const int io_offset = (m_parallel) ? m_cpu_io_offset : m_io_offset;
+    return (io_offset == 5) ? 0x10 : 0x00;
 }
 
 
@@ -330,6 +395,11 @@ IoCardTermMux::setCpuBusy(bool busy)
     if (do_dbg) {
         dbglog("TermMux/%02x CPB%c\n", m_base_addr, busy ? '+' : '-');
     }
+    if (m_parallel) {
+        m_to_mxd.push_back({ bus_msg_t::CPB, busy ? 1 : 0 });
+        m_cpu_cpb = busy;
+        return;
+    }
     m_cpb = busy;
 }
 
@@ -352,22 +422,79 @@ IoCardTermMux::execOneOp() noexcept
 }
 
 
+// perform instructions until budget_ns has elapsed, or until next_event_ns
+// has elapsed and a timer comes due, and return the number of ns consumed.
+// IN and OUT instructions are where the 8080 reaches the rest of the board
+// and the 2200; like the cpu's CIO, each one is run first in a batch and
+// ends it, so the scheduler is current when it happens.
+int64
+IoCardTermMux::execFor(int64 budget_ns, int64 next_event_ns) noexcept
+{
+    const i8080 * const cpu = static_cast<i8080*>(m_i8080);
+    const int64 stop_ns = std::min(budget_ns, next_event_ns);
+    int64 done_ns = 0;
+
+    do {
+        // a pending interrupt vectors to 0x0038 before the next op runs
+        const int pc = (m_interrupt_pending && (cpu->inte != 0)) ? 0x0038 : cpu->pc.w;
+        const uint8 opcode = i8080_rd_func(pc, this);
+        const bool io_op = (opcode == 0xD3) || (opcode == 0xDB);  // OUT, IN
+        if (io_op && (done_ns > 0)) {
+            break;
+        }
+        done_ns += execOneOp();
+        if (io_op) {
+            break;
+        }
+    } while (done_ns < stop_ns);
+
+    return done_ns;
+}
+
+
+// true if the board reports busy at the given address offset
+bool
+IoCardTermMux::isBusy(int rbi, bool obscbs_seen, int io_offset) noexcept
+{
+    return (obscbs_seen && (io_offset >= 4))
+        || (((rbi >> (io_offset-1)) & 1) != 0);
+}
+
+
 // update the board's !ready/busy status (if selected)
 void
 IoCardTermMux::updateRbi() noexcept
 {
+    // in parallel mode, the cpu sees the change at the end of the window
+    if (m_parallel) {
+        return;
+    }
+
     // don't drive !rbi if the board isn't selected
     if (m_io_offset == 0 || !m_selected) {
         return;
     }
 
-    const bool busy = ((m_obs_seen || m_cbs_seen) && (m_io_offset >= 4))
-                   || (((m_rbi >> (m_io_offset-1)) & 1) != 0);
-
+    const bool busy = isBusy(m_rbi, m_obs_seen || m_cbs_seen, m_io_offset);
     m_cpu->setDevRdy(!busy);
 }
 
 
+// drive IB and strobe IBS
+void
+IoCardTermMux::sendIbs(int byte)
+{
+    if (m_parallel) {
+        // the cpu receives it at the end of the window.  meanwhile, the
+        // 8080 sees the cpu go busy, just as it will when it gets the byte.
+        m_to_cpu.push_back({ bus_msg_t::IBS, byte });
+        m_cpb = true;
+        return;
+    }
+    m_cpu->ioCardCbIbs(byte);
+}
+
+
 void
 IoCardTermMux::updateInterrupt() noexcept
 {
@@ -378,6 +505,15 @@ IoCardTermMux::updateInterrupt() noexcept
 }
 
 
+void
+IoCardTermMux::clearDisplays() noexcept
+{
+    for (int n=0; n < m_num_terms; n++) {
+        m_terms[n].terminal->clearDisplay();
+    }
+}
+
+
 // a character has come in from the serial port
 void
 IoCardTermMux::receiveKeystroke(int term_num, int keycode)
@@ -405,18 +541,15 @@ IoCardTermMux::checkTxBuffer(int term_num)
     assert((0 <= term_num) && (term_num < MAX_TERMINALS));
     m_term_t &term = m_terms[term_num];
 
-    if (term.tx_ready || term.tx_tmr) {
+    if (term.tx_ready || term.tx_tmr->armed()) {
         // nothing to do or serial channel is in use
         return;
     }
 
-    term.tx_tmr = m_scheduler->createTimer(
-                      Terminal::serial_char_delay,
-                      std::bind(&IoCardTermMux::mxdToTermCallback, this, term_num, term.tx_byte)
-                  );
-
     // the byte in the tx register is moved to the serializer,
     // making room for the next tx byte
+    term.tx_shift = term.tx_byte;
+    term.tx_tmr->rearm(Terminal::serial_char_delay);
     term.tx_ready = true;
 }
 
@@ -425,16 +558,299 @@ IoCardTermMux::checkTxBuffer(int term_num)
 // more than the latency, it is intended to rate limit the channel to match
 // that of a real serial terminal.
 void
-IoCardTermMux::mxdToTermCallback(int term_num, int byte)
+IoCardTermMux::mxdToTermCallback(int term_num)
 {
     assert((0 <= term_num) && (term_num < MAX_TERMINALS));
     m_term_t &term = m_terms[term_num];
-    term.tx_tmr = nullptr;
 
-    term.terminal->processChar(static_cast<uint8>(byte));
+    term.terminal->processChar(static_cast<uint8>(term.tx_shift));
     checkTxBuffer(term_num);
 }
 
+// ============================================================================
+// parallel mode
+//
+// Each window, the worker thread runs the 8080 and the terminals for
+// window_ns, with timers from a scheduler of their own, while the cpu runs
+// the same window on the emulation thread.  Neither side touches the other's
+// state; bus activity is queued and passed across in syncWindow(), once
+// both have stopped.  So the MXD sees strobes, and the cpu sees IBS and
+// ready/busy changes, up to a window late.
+// ============================================================================
+
+// this runs on the worker thread
+void
+IoCardTermMux::runWindow(int64 window_ns)
+{
+    int64 left_ns = window_ns - m_overshoot_ns;
+    while (left_ns > 0) {
+        const int64 op_ns = execFor(left_ns, m_scheduler->nsUntilEvent());
+        m_scheduler->timerTick(static_cast<int>(op_ns));
+        left_ns -= op_ns;
+    }
+    m_overshoot_ns = -left_ns;
+}
+
+
+// this runs on the emulation thread, while the worker is stopped
+void
+IoCardTermMux::syncWindow()
+{
+    // first, what the 8080 did to the cpu
+    for (auto const &ev : m_to_cpu) {
+        switch (ev.msg) {
+        case bus_msg_t::IBS:
+            // the 8080 believes the byte was taken, so if the cpu
+            // isn't ready for it yet, it waits until the cpu is
+            m_cpu_ibs_held.push_back(ev.val);
+            break;
+        case bus_msg_t::HALT_STEP:
+            m_cpu->halt();
+            break;
+        case bus_msg_t::PRIME_OUT:
+            m_sys->reset(false);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+    m_to_cpu.clear();
+    cpuDeliverIbs();
+
+    // then what the cpu did to the board, in order
+    for (auto const &ev : m_to_mxd) {
+        switch (ev.msg) {
+        case bus_msg_t::SELECT:
+            m_io_offset = ev.val;
+            m_selected  = (ev.val != 0);
+            break;
+        case bus_msg_t::DESELECT:
+            m_selected = false;
+            m_cpb      = true;
+            break;
+        case bus_msg_t::OBS:
+        case bus_msg_t::CBS:
+            if (do_dbg && (m_obs_seen || m_cbs_seen)) {
+                dbglog("TermMux/%02x strobe overran the previous one\n", m_base_addr);
+            }
+            m_obs_seen      = m_obs_seen || (ev.msg == bus_msg_t::OBS);
+            m_cbs_seen      = m_cbs_seen || (ev.msg == bus_msg_t::CBS);
+            m_obscbs_offset = m_io_offset;
+            m_obscbs_data   = ev.val;
+            break;
+        case bus_msg_t::CPB:
+            m_cpb = (ev.val != 0);
+            break;
+        case bus_msg_t::PRIME:
+            m_prime_seen = true;
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+    m_to_mxd.clear();
+
+    // and let the cpu see where the 8080 has gotten to
+    m_cpu_obscbs_seen = m_obs_seen || m_cbs_seen;
+    m_cpu_rbi         = m_rbi;
+    cpuUpdateRbi();
+}
+
+
+// this is done only between windows, rather than as soon as the cpu
+// selects the board or drops CPB, because the handshake needs some delay
+// between the cpu becoming ready and the IBS (see IoCardKeyboard).
+// delivering the byte raises CPB, so at most one goes per window.
+void
+IoCardTermMux::cpuDeliverIbs()
+{
+    if (m_cpu_ibs_held.empty() || !m_cpu_selected || m_cpu_cpb) {
+        return;
+    }
+    if (do_dbg && (m_cpu_ibs_held.size() > 1)) {
+        dbglog("TermMux/%02x %d IBS bytes held\n", m_base_addr,
+               static_cast<int>(m_cpu_ibs_held.size()));
+    }
+    const int byte = m_cpu_ibs_held.front();
+    m_cpu_ibs_held.pop_front();
+    m_cpu->ioCardCbIbs(byte);
+}
+
+
+// updateRbi(), using the cpu side's view of the board
+void
+IoCardTermMux::cpuUpdateRbi() noexcept
+{
+    if (!m_cpu_selected) {
+        return;
+    }
+    const bool busy = isBusy(m_cpu_rbi, m_cpu_obscbs_seen, m_cpu_io_offset);
+    m_cpu->setDevRdy(!busy);
+}
+
+// ============================================================================
+// machine state
+// ============================================================================
+
+void
+IoCardTermMux::saveState(StateWriter &sw) const
+{
+    sw.putBool(m_parallel);
+    if (m_parallel) {
+        // the board has a scheduler of its own, which must be saved
+        // before any of the timers which run off of it
+        m_scheduler->saveState(sw);
+    }
+
+    const i8080 * const cpu = static_cast<const i8080*>(m_i8080);
+    sw.putU16(cpu->sp.w);
+    sw.putU16(cpu->pc.w);
+    sw.putU16(cpu->af.w);
+    sw.putU16(cpu->bc.w);
+    sw.putU16(cpu->de.w);
+    sw.putU16(cpu->hl.w);
+    sw.putU8(cpu->f.carry_flag);
+    sw.putU8(cpu->f.parity_flag);
+    sw.putU8(cpu->f.half_carry_flag);
+    sw.putU8(cpu->f.zero_flag);
+    sw.putU8(cpu->f.sign_flag);
+    sw.putU8(cpu->inte);
+    sw.putU8(cpu->halt);
+    sw.putBytes(&m_ram[0], sizeof(m_ram));
+
+    sw.putBool(m_selected);
+    sw.putBool(m_cpb);
+    sw.putU8(m_io_offset);
+    sw.putBool(m_prime_seen);
+    sw.putBool(m_obs_seen);
+    sw.putBool(m_cbs_seen);
+    sw.putU8(m_obscbs_offset);
+    sw.putU8(m_obscbs_data);
+    sw.putU8(m_rbi);
+    sw.putU8(m_uart_sel);
+    sw.putBool(m_interrupt_pending);
+
+    if (m_parallel) {
+        sw.putI64(m_overshoot_ns);
+        for (auto const *queue : { &m_to_mxd, &m_to_cpu }) {
+            sw.putU32(static_cast<uint32>(queue->size()));
+            for (auto const &ev : *queue) {
+                sw.putU8(static_cast<int>(ev.msg));
+                sw.putU16(ev.val);
+            }
+        }
+        sw.putBool(m_cpu_selected);
+        sw.putBool(m_cpu_cpb);
+        sw.putU8(m_cpu_io_offset);
+        sw.putBool(m_cpu_obscbs_seen);
+        sw.putU8(m_cpu_rbi);
+        sw.putU32(static_cast<uint32>(m_cpu_ibs_held.size()));
+        for (const int byte : m_cpu_ibs_held) {
+            sw.putU16(byte);
+        }
+    }
+
+    sw.putU8(m_num_terms);
+    for (int n=0; n < MAX_TERMINALS; n++) {
+        const m_term_t &term = m_terms[n];
+        sw.putBool(term.rx_ready);
+        sw.putU16(term.rx_byte);
+        sw.putBool(term.tx_ready);
+        sw.putU8(term.tx_byte);
+        sw.putU8(term.tx_shift);
+        term.tx_tmr->saveState(sw);
+        if (n < m_num_terms) {
+            term.terminal->saveState(sw);
+        }
+    }
+}
+
+
+void
+IoCardTermMux::loadState(StateReader &sr)
+{
+    if (sr.getBool() != m_parallel) {
+        sr.fail("the MXD window setting doesn't match");
+        return;
+    }
+    if (m_parallel) {
+        m_scheduler->loadState(sr);
+    }
+
+    i8080 * const cpu = static_cast<i8080*>(m_i8080);
+    cpu->sp.w = sr.getU16();
+    cpu->pc.w = sr.getU16();
+    cpu->af.w = sr.getU16();
+    cpu->bc.w = sr.getU16();
+    cpu->de.w = sr.getU16();
+    cpu->hl.w = sr.getU16();
+    cpu->f.carry_flag      = sr.getU8();
+    cpu->f.parity_flag     = sr.getU8();
+    cpu->f.half_carry_flag = sr.getU8();
+    cpu->f.zero_flag       = sr.getU8();
+    cpu->f.sign_flag       = sr.getU8();
+    cpu->inte = sr.getU8();
+    cpu->halt = sr.getU8();
+    sr.getBytes(&m_ram[0], sizeof(m_ram));
+
+    m_selected          = sr.getBool();
+    m_cpb               = sr.getBool();
+    m_io_offset         = sr.getU8();
+    m_prime_seen        = sr.getBool();
+    m_obs_seen          = sr.getBool();
+    m_cbs_seen          = sr.getBool();
+    m_obscbs_offset     = sr.getU8();
+    m_obscbs_data       = sr.getU8();
+    m_rbi               = sr.getU8();
+    m_uart_sel          = sr.getU8();
+    m_interrupt_pending = sr.getBool();
+    if ((m_io_offset > 7) || (m_uart_sel >= MAX_TERMINALS)) {
+        sr.fail("bad MXD state");
+    }
+
+    if (m_parallel) {
+        m_overshoot_ns = sr.getI64();
+        for (auto *queue : { &m_to_mxd, &m_to_cpu }) {
+            queue->clear();
+            const uint32 size = sr.getU32();
+            for (uint32 n=0; (n < size) && sr.ok(); n++) {
+                const auto msg = static_cast<bus_msg_t>(sr.getU8());
+                const int  val = sr.getU16();
+                queue->push_back({ msg, val });
+            }
+        }
+        m_cpu_selected    = sr.getBool();
+        m_cpu_cpb         = sr.getBool();
+        m_cpu_io_offset   = sr.getU8();
+        m_cpu_obscbs_seen = sr.getBool();
+        m_cpu_rbi         = sr.getU8();
+        m_cpu_ibs_held.clear();
+        const uint32 held = sr.getU32();
+        for (uint32 n=0; (n < held) && sr.ok(); n++) {
+            m_cpu_ibs_held.push_back(sr.getU16());
+        }
+    }
+
+    if (sr.getU8() != m_num_terms) {
+        sr.fail("the number of MXD terminals doesn't match");
+        return;
+    }
+    for (int n=0; n < MAX_TERMINALS; n++) {
+        m_term_t &term = m_terms[n];
+        term.rx_ready = sr.getBool();
+        term.rx_byte  = sr.getU16();
+        term.tx_ready = sr.getBool();
+        term.tx_byte  = sr.getU8();
+        term.tx_shift = sr.getU8();
+        term.tx_tmr->loadState(sr);
+        if (n < m_num_terms) {
+            term.terminal->loadState(sr);
+        }
+    }
+}
+
 // ============================================================================
 // i8080 CPU modeling
 // ============================================================================
@@ -538,7 +954,7 @@ IoCardTermMux::i8080_in_func(int addr, void *user_data) noexcept
 
     case IN_UART_STATUS:
         {
-        const bool tx_empty = term.tx_ready && !term.tx_tmr;
+        const bool tx_empty = term.tx_ready && !term.tx_tmr->armed();
         const bool dsr = (term_num < tthis->m_num_terms);
         rv = (term.tx_ready ? 0x01 : 0x00)  // [0] = tx fifo empty
            | (term.rx_ready ? 0x02 : 0x00)  // [1] = rx fifo has a byte
@@ -577,7 +993,7 @@ IoCardTermMux::i8080_out_func(int addr, int byte, void *user_data)
         if (do_dbg) {
             dbglog("TermMux/%02x IB=%02x\n", tthis->m_base_addr, byte);
         }
-        tthis->m_cpu->ioCardCbIbs(byte);
+        tthis->sendIbs(byte);
         break;
 
     case OUT_IB9_N:
@@ -585,7 +1001,7 @@ IoCardTermMux::i8080_out_func(int addr, int byte, void *user_data)
         if (do_dbg) {
             dbglog("TermMux/%02x IB=%03x\n", tthis->m_base_addr, 0x100 | byte);
         }
-        tthis->m_cpu->ioCardCbIbs(0x100 | byte);
+        tthis->sendIbs(0x100 | byte);
         break;
 
     case OUT_PRIME:
@@ -594,11 +1010,19 @@ IoCardTermMux::i8080_out_func(int addr, int byte, void *user_data)
         //     R=330K & C=470pf = (0.34ns)*Rx*Cx*(1+1/Rx) = 
         //                      = 0.34*33*470*(1+1/33) = 5000ns = 5ms
         // but it shouldn't matter for this emulation.
-        system2200::reset(false);
+        if (tthis->m_parallel) {
+            tthis->m_to_cpu.push_back({ bus_msg_t::PRIME_OUT, 0 });
+        } else {
+            tthis->m_sys->reset(false);
+        }
         break;
 
     case OUT_HALT_STEP:
-        tthis->m_cpu->halt();
+        if (tthis->m_parallel) {
+            tthis->m_to_cpu.push_back({ bus_msg_t::HALT_STEP, 0 });
+        } else {
+            tthis->m_cpu->halt();
+        }
         break;
 
     case OUT_UART_SEL:
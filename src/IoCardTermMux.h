@@ -6,6 +6,8 @@
 #include "IoCard.h"
 #include "TermMuxCfgState.h"
 
+#include <deque>
+
 class Cpu2200;
 class Scheduler;
 class Timer;
@@ -18,7 +20,8 @@ public:
     CANT_ASSIGN_OR_COPY_CLASS(IoCardTermMux);
 
     // ----- common IoCard functions -----
-    IoCardTermMux(std::shared_ptr<Scheduler> scheduler,
+    IoCardTermMux(System2200                *sys,
+                  std::shared_ptr<Scheduler> scheduler,
                   std::shared_ptr<Cpu2200> cpu,
                   int base_addr, int card_slot,
                   const CardCfgState *cfg);
@@ -35,10 +38,15 @@ public:
     void  strobeCBS(int val) override;
     int   getIB() const noexcept override;
     void  setCpuBusy(bool busy) override;
+    void  saveState(StateWriter &sw) const override;
+    void  loadState(StateReader &sr) override;
 
     // a keyboard event has happened
     void receiveKeystroke(int term_num, int keycode);
 
+    // blank the screen of every terminal (see Terminal::clearDisplay())
+    void clearDisplays() noexcept;
+
 private:
 
     static const int MAX_TERMINALS = 4;
@@ -59,18 +67,41 @@ private:
     // perform one i8080 instruction
     int execOneOp() noexcept;
 
+    // perform i8080 instructions for up to budget_ns, or until a timer is due
+    int64 execFor(int64 budget_ns, int64 next_event_ns) noexcept;
+
     // update the board's !ready/busy status (if selected)
     void updateRbi() noexcept;
 
+    // true if the board reports busy at the given address offset
+    static bool isBusy(int rbi, bool obscbs_seen, int io_offset) noexcept;
+
+    // drive IB and strobe IBS
+    void sendIbs(int byte);
+
+    // ---- parallel mode ----
+    // run the 8080 and its terminals for window_ns (on a worker thread)
+    void runWindow(int64 window_ns);
+
+    // exchange bus traffic with the cpu between windows
+    void syncWindow();
+
+    // pass the cpu the oldest IBS byte it wasn't ready for, if it now is
+    void cpuDeliverIbs();
+
+    // updateRbi(), using the cpu side's view of the board
+    void cpuUpdateRbi() noexcept;
+
     // raise an interrupt if any uart has an rx char ready
     void updateInterrupt() noexcept;
 
     void checkTxBuffer(int term_num);
-    void mxdToTermCallback(int term_num, int byte);
+    void mxdToTermCallback(int term_num);
 
     // ---- board state ----
     TermMuxCfgState            m_cfg;       // current configuration
-    std::shared_ptr<Scheduler> m_scheduler; // shared event scheduler
+    System2200 * const         m_sys;       // the machine we are plugged into
+    std::shared_ptr<Scheduler> m_scheduler; // event scheduler, private in parallel mode
     std::shared_ptr<Cpu2200>   m_cpu;       // associated CPU
     const int   m_base_addr;         // the address the card is mapped to
     const int   m_slot;              // which slot the card is plugged into
@@ -90,6 +121,32 @@ private:
     int  m_uart_sel          = 0;     // currently addressed uart, 0..3
     bool m_interrupt_pending = false; // one of the uarts has an rx byte
 
+    // ---- parallel mode state ----
+    // the 8080 runs on a worker thread, and the cpu side and the 8080 side
+    // of the bus each keep their own copy of the board state.  bus events
+    // are queued and handed across between windows.
+    enum class bus_msg_t {
+        // cpu to 8080
+        SELECT, DESELECT, OBS, CBS, CPB, PRIME,
+        // 8080 to cpu
+        IBS, HALT_STEP, PRIME_OUT
+    };
+    struct bus_event_t {
+        bus_msg_t msg;
+        int       val;
+    };
+
+    bool  m_parallel         = false; // running on a worker thread
+    int64 m_overshoot_ns     = 0;     // how far the 8080 ran past the last window
+    std::vector<bus_event_t> m_to_mxd;  // only touched by the cpu side
+    std::vector<bus_event_t> m_to_cpu;  // only touched by the 8080 side
+    bool  m_cpu_selected     = false; // cpu side: m_selected
+    bool  m_cpu_cpb          = true;  // cpu side: m_cpb
+    int   m_cpu_io_offset    = 0;     // cpu side: m_io_offset
+    bool  m_cpu_obscbs_seen  = false; // cpu side: m_obs_seen || m_cbs_seen
+    int   m_cpu_rbi          = 0xff;  // cpu side: m_rbi, as of the last window
+    std::deque<int> m_cpu_ibs_held;   // cpu side: IBS bytes it wasn't ready for
+
     // ---- per terminal state ----
     struct m_term_t {
         // display related:
@@ -100,6 +157,7 @@ private:
         // uart transmit state
         bool                   tx_ready;    // room to accept a byte (1 deep FIFO)
         int                    tx_byte;     // value of tx byte
+        int                    tx_shift;    // byte being serialized
         std::shared_ptr<Timer> tx_tmr;      // model uart rate & delay
     } m_terms[MAX_TERMINALS];
 };
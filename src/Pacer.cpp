@@ -0,0 +1,143 @@
+// Pacing of simulated time against real time.
+//
+// Each timeslice, Pacer says how much simulated time to run, and once that
+// has been done, when the host should wake up to start the next one.  The
+// deadlines are absolute: slice n+1 is due at the real time the pacer
+// synced up, plus the simulated time of slices 0..n.  Sleeping until an
+// absolute deadline, rather than for some number of ms, means oversleeping
+// in one slice is made up for in the next rather than accumulating.
+//
+// If the host falls far behind (it is too slow, or emulation was paused for
+// a dialog box), there is no attempt to catch up, which would just have the
+// emulator run flat out for a while; instead the deadline is reset to now.
+//
+// The difference between when a slice should have started and when it did
+// is its lateness.  A history of recent lateness is kept, and summarized as
+// p50 and p99 figures for the status bar.
+//
+// The slice length adapts.  Short slices mean keystrokes are picked up and
+// the screen is published more often, which makes for a snappy terminal,
+// but every slice has some fixed overhead, and wakeups are never exact.  So
+// every so often, the slices get longer if the host is struggling to meet
+// the deadlines, or is busy most of the time, and get shorter if neither.
+// When the speed isn't regulated, the slices are long and there is no sleep.
+
+#include "Pacer.h"
+
+#include <algorithm>
+#include <vector>
+
+
+// forget the past, eg, after regulation is switched on
+void
+Pacer::reset() noexcept
+{
+    m_synced   = false;
+    m_late_len = 0;
+    m_late_ptr = 0;
+    m_busy_ns  = 0;
+    m_load     = 0.0f;
+}
+
+
+// called at the start of each timeslice.  it returns how many ns to simulate.
+int64
+Pacer::startSlice(int64 now_ns, bool regulated)
+{
+    if (regulated != m_regulated) {
+        m_regulated = regulated;
+        m_slice_ns  = (regulated) ? INITIAL_SLICE_NS : MAX_SLICE_NS;
+        reset();
+    }
+
+    m_slice_start_ns = now_ns;
+
+    if (!m_regulated) {
+        return m_slice_ns;
+    }
+
+    if (!m_synced) {
+        m_synced         = true;
+        m_deadline_ns    = now_ns;
+        m_adapt_start_ns = now_ns;
+    }
+
+    int64 late_ns = now_ns - m_deadline_ns;
+    if (late_ns > MAX_LAG_NS) {
+        // give up on catching up
+        m_deadline_ns = now_ns;
+        late_ns = MAX_LAG_NS;
+    }
+    m_late_ns[m_late_ptr] = std::max(late_ns, int64(0));
+    m_late_ptr = (m_late_ptr + 1) % LATE_HIST_SIZE;
+    m_late_len = std::min(m_late_len + 1, int(LATE_HIST_SIZE));
+
+    if (now_ns - m_adapt_start_ns >= ADAPT_PERIOD_NS) {
+        adapt(now_ns);
+    }
+
+    return m_slice_ns;
+}
+
+
+// called once the timeslice has been simulated.  it returns the host
+// time to sleep until before the next slice, or 0 for no sleep.
+int64
+Pacer::endSlice(int64 now_ns) noexcept
+{
+    if (!m_regulated) {
+        return 0;
+    }
+
+    m_busy_ns     += now_ns - m_slice_start_ns;
+    m_deadline_ns += m_slice_ns;
+    return (m_deadline_ns > now_ns) ? m_deadline_ns : 0;
+}
+
+
+// recompute m_slice_ns based on the load and lateness
+void
+Pacer::adapt(int64 now_ns)
+{
+    m_load = static_cast<float>(m_busy_ns)
+           / static_cast<float>(now_ns - m_adapt_start_ns);
+    m_adapt_start_ns = now_ns;
+    m_busy_ns = 0;
+
+    const int64 p99_ns = latePercentile(99);
+    if ((m_load > 0.75f) || (p99_ns > m_slice_ns/2)) {
+        m_slice_ns = std::min(2*m_slice_ns, int64(MAX_SLICE_NS));
+    } else if ((m_load < 0.35f) && (p99_ns < m_slice_ns/8)) {
+        m_slice_ns = std::max(m_slice_ns/2, int64(MIN_SLICE_NS));
+    }
+}
+
+
+// return the given percentile of the recorded lateness samples
+int64
+Pacer::latePercentile(int pct) const
+{
+    if (m_late_len == 0) {
+        return 0;
+    }
+    std::vector<int64> v(m_late_ns.begin(), m_late_ns.begin() + m_late_len);
+    const int n = std::min((m_late_len * pct) / 100, m_late_len - 1);
+    std::nth_element(v.begin(), v.begin() + n, v.end());
+    return v[n];
+}
+
+
+// how things have gone lately
+pace_stats_t
+Pacer::getStats() const
+{
+    pace_stats_t stats;
+    stats.regulated   = m_regulated;
+    stats.late_p50_ms = static_cast<float>(latePercentile(50)) * 1.0e-6f;
+    stats.late_p99_ms = static_cast<float>(latePercentile(99)) * 1.0e-6f;
+    stats.load        = m_load;
+    stats.slice_us    = static_cast<int>(m_slice_ns / 1000);
+    return stats;
+}
+
+// vim: ts=8:et:sw=4:smarttab
@@ -0,0 +1,83 @@
+// When the cpu speed is regulated, Pacer keeps simulated time in step with
+// real time.  It picks how long each timeslice is, says how long to sleep
+// after it, and keeps track of how late slices start.
+// See the corresponding .cpp for more details.
+
+#ifndef _INCLUDE_PACER_H_
+#define _INCLUDE_PACER_H_
+
+#include "w2200.h"
+
+#include <array>
+
+// a summary of how well pacing has been going lately
+struct pace_stats_t {
+    bool  regulated   = false; // the rest is meaningless if false
+    float late_p50_ms = 0.0f;  // median amount slices started late
+    float late_p99_ms = 0.0f;  // 99th percentile of the same
+    float load        = 0.0f;  // fraction of real time spent simulating
+    int   slice_us    = 0;     // current timeslice length
+};
+
+class Pacer
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(Pacer);
+    Pacer() = default;
+
+    // forget the past, eg, after regulation is switched on
+    void reset() noexcept;
+
+    // called at the start of each timeslice, with the current host time
+    // from host::getTimeNs().  it returns how many ns to simulate.
+    int64 startSlice(int64 now_ns, bool regulated);
+
+    // called once the timeslice has been simulated.  it returns the host
+    // time to sleep until before the next slice, or 0 for no sleep.
+    int64 endSlice(int64 now_ns) noexcept;
+
+    // how things have gone lately
+    pace_stats_t getStats() const;
+
+private:
+    // unregulated, slices are long to keep the overhead down; regulated,
+    // they are short so keystrokes are seen and echoed promptly
+    static const int64 MIN_SLICE_NS     =   1000000;
+    static const int64 MAX_SLICE_NS     =  30000000;
+    static const int64 INITIAL_SLICE_NS =   2000000;
+
+    // if we fall further behind than this, don't try to catch up.
+    // it is also the most lateness one slice is charged with, so the
+    // statistics don't get skewed by, say, a modal dialog.
+    static const int64 MAX_LAG_NS = 100000000;
+
+    // how often the slice length is reconsidered
+    static const int64 ADAPT_PERIOD_NS = 250000000;
+
+    // recompute m_slice_ns based on the load and lateness
+    void adapt(int64 now_ns);
+
+    // return the given percentile of the recorded lateness samples
+    int64 latePercentile(int pct) const;
+
+    bool  m_regulated      = false;
+    bool  m_synced         = false;  // m_deadline_ns is meaningful
+    int64 m_deadline_ns    = 0;      // host time the next slice is due
+    int64 m_slice_ns       = MAX_SLICE_NS;
+    int64 m_slice_start_ns = 0;      // host time the current slice began
+
+    // for adapting the slice length
+    int64 m_adapt_start_ns = 0;      // start of the current adapt period
+    int64 m_busy_ns        = 0;      // time spent simulating in the period
+    float m_load           = 0.0f;   // m_busy_ns fraction of the last period
+
+    // the lateness of the most recent slices
+    static const int LATE_HIST_SIZE = 1024;
+    std::array<int64, LATE_HIST_SIZE> m_late_ns;
+    int   m_late_len       = 0;      // number of valid entries
+    int   m_late_ptr       = 0;      // next entry to write
+};
+
+#endif // _INCLUDE_PACER_H_
+
+// vim: ts=8:et:sw=4:smarttab
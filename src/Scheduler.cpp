@@ -11,6 +11,11 @@
 // an argument for each parameter in the called function.
 //
 // A timer can be canceled early simply by setting it to nullptr.
+//
+// A device which restarts the same timer over and over should instead
+// create it once, unarmed, with createTimer(fcn), then call tmr->rearm(ns)
+// and tmr->cancel() as needed.  This moves the timer in place and doesn't
+// leave a dead timer behind for the scheduler to clean up.
 
 // History:
 //    2000-2001: originally developed Solace, a sol-20 emulator for win32
@@ -19,18 +24,43 @@
 //         2008: adapted for a new revision of the wang 2200 emulator
 //         2015: replaced Callback.h with std::function/std::bind
 //         2018: switched to a ns resolution, 64b absolute time model
+//         2026: pooled timers kept in a binary heap
 // All revisions, Jim Battle.
 
+// Active timers are kept in a binary min-heap ordered by expiration time,
+// so creating a timer costs O(log n) and finding the next one is O(1).
+// Timers expiring at the same time fire in the order they were created.
+//
 // When m_time_ns has incremented past the threashold of the earliest timer,
-// all timers are checked as more than one might expire. All expiring timers
-// are put on a retirement list, then all retired timers perform their
-// callbacks. This retirement list is to prevent confusing reentrancy issues,
-// as a callback may result in a call to createTimer().
+// all expiring timers are popped off the heap and put on a retirement list,
+// then all retired timers perform their callbacks. This retirement list is
+// to prevent confusing reentrancy issues, as a callback may result in a call
+// to createTimer().
+//
+// Each timer knows its slot in the heap, so rearm() and cancel() adjust the
+// heap directly in O(log n).  A timer whose handle was dropped stays on the
+// heap until it reaches the top, at which point it is discarded.  Such
+// timers are also swept out whenever the heap gets large.
+//
+// Devices re-arm timers constantly (once per disk sector, once per display
+// scanline, on every CIO for the MVP one-shot).  Most do it via rearm(), but
+// timers are still created often enough that they are not allocated from
+// the heap.  std::allocate_shared() puts the shared_ptr control block and
+// the Timer together in one fixed size block from a TimerPool, which
+// recycles blocks through a free list.  The vectors holding the heap are
+// reserved up front, so in steady state no memory is allocated at all.
+// (A callback with a large capture may still make std::function allocate.)
+//
+// Each timer is tagged with the name of its owner.  Counts of timer churn,
+// how late callbacks were, and the host time spent in them, are kept per
+// owner so it is possible to see which device is driving scheduler overhead.
 
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "Ui.h"         // needed for UI_error()
 
-#include <algorithm>    // for std::sort
+#include <algorithm>    // for std::remove_if
+#include <chrono>       // for statistics
 
 // ======================================================================
 // minimal scheduler test
@@ -89,21 +119,134 @@ timerTest(void)
     auto t2 = test_scheduler.createTimer(10, std::bind(&TimerTestFoo::report1, &foo, 2));
     auto t3 = test_scheduler.createTimer(50, std::bind(&TimerTestFoo::report2, &foo, 3));
 
+    // method 3: create an idle timer, then start it later
+    auto t4 = test_scheduler.createTimer(std::bind(&TimerTestFoo::report2, &foo, 4));
+
     for (int n=0; n < 100; n++) {
         if (n == 5) {
             t1 = nullptr;
         }
+        if (n == 20) {
+            t3->rearm(40);  // fires at 60, not 50
+            t4->rearm(30);  // fires at 50
+        }
         test_scheduler.timerTick(1);
     }
 }
 #endif
 
+// ======================================================================
+// timer storage
+// ======================================================================
+
+// fixed size blocks, handed out from a free list
+class TimerPool
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(TimerPool);
+    TimerPool() = default;
+    ~TimerPool()
+    {
+        for (auto *chunk : m_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    static const size_t BLOCK_SIZE   = 128;  // bytes per block
+    static const int    CHUNK_BLOCKS = 64;   // blocks obtained at a time
+
+    void *alloc()
+    {
+        if (m_free == nullptr) {
+            grow();
+        }
+        node_t *node = m_free;
+        m_free = node->next;
+        m_live++;
+        return node;
+    }
+
+    void release(void *p) noexcept
+    {
+        node_t *node = static_cast<node_t*>(p);
+        node->next = m_free;
+        m_free = node;
+        m_live--;
+    }
+
+    // number of blocks in use
+    int live() const noexcept { return m_live; }
+
+private:
+    struct node_t {
+        node_t *next;
+    };
+
+    void grow()
+    {
+        char *chunk = static_cast<char*>(::operator new(BLOCK_SIZE*CHUNK_BLOCKS));
+        m_chunks.push_back(chunk);
+        for (int n=0; n < CHUNK_BLOCKS; n++) {
+            node_t *node = reinterpret_cast<node_t*>(chunk + n*BLOCK_SIZE);
+            node->next = m_free;
+            m_free = node;
+        }
+    }
+
+    node_t             *m_free = nullptr;  // list of unused blocks
+    int                 m_live = 0;        // blocks in use
+    std::vector<void*>  m_chunks;          // everything obtained from new
+};
+
+
+// lets std::allocate_shared() take its block from a TimerPool
+template <typename T>
+class TimerAllocator
+{
+public:
+    using value_type = T;
+
+    explicit TimerAllocator(TimerPool *pool) noexcept : m_pool(pool) { }
+
+    template <typename U>
+    TimerAllocator(const TimerAllocator<U> &other) noexcept : m_pool(other.m_pool) { }
+
+    T *allocate(std::size_t n)
+    {
+        if (n*sizeof(T) <= TimerPool::BLOCK_SIZE) {
+            return static_cast<T*>(m_pool->alloc());
+        }
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        if (n*sizeof(T) <= TimerPool::BLOCK_SIZE) {
+            m_pool->release(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const TimerAllocator<U> &other) const noexcept
+        { return m_pool == other.m_pool; }
+    template <typename U>
+    bool operator!=(const TimerAllocator<U> &other) const noexcept
+        { return m_pool != other.m_pool; }
+
+    TimerPool *m_pool;
+};
+
+
 // ======================================================================
 // Scheduler implementation
 // ======================================================================
 
-Scheduler::Scheduler()
+Scheduler::Scheduler() :
+    m_pool(new TimerPool)
 {
+    m_timer.reserve(2*MAX_TIMERS);
 #if TEST_TIMER
     if (this == &test_scheduler) {
         timerTest();
@@ -112,112 +255,404 @@ Scheduler::Scheduler()
 };
 
 
+Scheduler::~Scheduler()
+{
+    for (auto &t : m_timer) {
+        t->m_heap_idx = -1;
+    }
+    m_timer.clear();
+    if (m_pool->live() > 0) {
+        // some device still holds a timer handle, and the pool owns the
+        // memory behind it.  let the pool leak rather than free it early.
+        (void)m_pool.release();
+    }
+}
+
+
 // return a timer object; the caller doesn't destroy this object,
 // but sets it to nullptr when it is done with it (early or not).
 // 'ns' is the number of nanoseconds in the future when the callback fires.
 std::shared_ptr<Timer>
-Scheduler::createTimer(int64 ns, const sched_callback_t &fcn)
+Scheduler::createTimer(int64 ns, const sched_callback_t &fcn,
+                       const char *owner)
 {
     // catch dumb bugs
     assert(ns >= 1);
     assert(ns <= 12E9);      // 12 seconds
 
-    // make sure we don't leak timers
-    // the one tricky case that pushed the limit above 30 (max 37 seen)
-    // is the SNAKE220 game on the "more_games.wvd" disk. for whatever
-    // reason, the way it is written causes a lot of blocking events that
-    // cause the 27ms time slice one-shot to be retriggered frequently.
-    // each touch creates a new event on the callback queue, but the zombie
-    // ones don't retired until their own 27ms window completes. eventually
-    // that happens, but there can be me as many zombies as the scheduler
-    // touches the one-shot in a given 27ms window.
-#if 1
-    static unsigned int max_timers = MAX_TIMERS;
-    if (m_timer.size() > max_timers) {
-        max_timers = m_timer.size();
-        UI_warn("now at %d timers", max_timers);
-    }
-#else
-    assert(m_timer.size() < MAX_TIMERS);
-#endif
+    auto tmr = createTimer(fcn, owner);
+    armTimer(*tmr, ns);
 
-    int64 event_ns = m_time_ns + ns;
-    auto tmr = std::make_shared<Timer>(event_ns, fcn);
+    // return timer handle
+    return tmr;
+}
 
-    m_timer.push_back(tmr);
-    m_trigger_ns = firstEvent();
 
-    // return timer handle
+std::shared_ptr<Timer>
+Scheduler::createTimer(const sched_callback_t &fcn, const char *owner)
+{
+    auto tmr = std::allocate_shared<Timer>(TimerAllocator<Timer>(m_pool.get()),
+                                           this, fcn);
+
+    // there are only a handful of owners, and timers are rarely created
+    int idx = 0;
+    const int num_owners = m_stats.owner.size();
+    while ((idx < num_owners) && (m_stats.owner[idx].name != owner)) {
+        idx++;
+    }
+    if (idx == num_owners) {
+        m_stats.owner.emplace_back();
+        m_stats.owner.back().name = owner;
+    }
+    tmr->m_owner = idx;
+    m_stats.owner[idx].created++;
+    m_stats.created++;
+
     return tmr;
 }
 
 
-int64
-Scheduler::firstEvent() noexcept
+void
+Scheduler::armTimer(Timer &tmr, int64 ns)
+{
+    tmr.m_expires_ns = m_time_ns + ns;
+    tmr.m_seq        = m_seq++;
+    m_stats.owner[tmr.m_owner].armed++;
+    m_stats.armed++;
+
+    if (tmr.armed()) {
+        // the pending expiration is canceled
+        m_stats.canceled++;
+        // restore heap order; at most one of these moves it
+        siftUp(tmr.m_heap_idx);
+        siftDown(tmr.m_heap_idx);
+    } else {
+        // make sure we don't leak timers.
+        // the one tricky case that used to push the limit above 30 (max 37
+        // seen) is the SNAKE220 game on the "more_games.wvd" disk, which
+        // retriggers the 27ms time slice one-shot very frequently. each
+        // touch created a new timer and left a zombie behind until its own
+        // 27ms window completed. the one-shot is now rearmed in place, but
+        // any device which drops and recreates timers can still do this.
+        if (m_timer.size() >= MAX_TIMERS) {
+            sweepTimers();
+        }
+#if 0
+        assert(m_timer.size() < MAX_TIMERS);
+#endif
+        heapPush(tmr.shared_from_this());
+        if (static_cast<int>(m_timer.size()) > m_stats.max_depth) {
+            m_stats.max_depth = m_timer.size();
+            if (m_stats.max_depth > MAX_TIMERS) {
+                UI_warn("now at %d timers", m_stats.max_depth);
+            }
+        }
+    }
+
+    m_trigger_ns = m_timer.front()->m_expires_ns;
+}
+
+
+void
+Scheduler::disarmTimer(Timer &tmr)
+{
+    if (tmr.armed()) {
+        m_stats.canceled++;
+        (void)heapRemove(tmr.m_heap_idx);
+        m_trigger_ns = (m_timer.empty()) ? MAX_TIME : m_timer.front()->m_expires_ns;
+    }
+}
+
+
+// drop timers where the scheduler holds the only reference,
+// then restore the heap order
+void
+Scheduler::sweepTimers()
 {
-    int64 rv = MAX_TIME;
     for (auto &t : m_timer) {
-        if (t->m_expires_ns < rv) {
-            rv = t->m_expires_ns;
+        if (t.use_count() == 1) {
+            t->m_heap_idx = -1;
+            m_stats.canceled++;
         }
     }
-    return rv;
+    m_timer.erase(std::remove_if(begin(m_timer), end(m_timer),
+                                 [](const std::shared_ptr<Timer> &t) {
+                                     return !t->armed();
+                                 }),
+                  end(m_timer));
+    const int size = m_timer.size();
+    for (int idx=0; idx < size; idx++) {
+        m_timer[idx]->m_heap_idx = idx;
+    }
+    for (int idx=size/2-1; idx >= 0; idx--) {
+        siftDown(idx);
+    }
+    m_trigger_ns = (m_timer.empty()) ? MAX_TIME : m_timer.front()->m_expires_ns;
 }
 
 
-// the m_trigger_ns threshold has been exceeded.  check all timers and invoke
-// callback all those which have expired.
+// the m_trigger_ns threshold has been exceeded.  invoke the callback of
+// each timer which has expired, in the order they expire.
 // this shouldn't need to be called very frequently.
 void Scheduler::creditTimer()
 {
-    if (m_timer.empty()) {
-        // don't trigger this fcn again until there is real work to do
-        m_trigger_ns = MAX_TIME;
-        return; // no timers
+    // a callback may create or rearm timers.  those must wait until the
+    // next tick even if they are due now, just as if they had been created
+    // in the middle of the cpu timeslice.
+    const uint64 seq_limit = m_seq;
+
+    using clock = std::chrono::steady_clock;
+    const auto credit_start = clock::now();
+    auto callback_start = credit_start;
+
+    while (!m_timer.empty()) {
+        const Timer &first = *m_timer.front();
+        const bool dead = (m_timer.front().use_count() == 1);
+        if (!dead && ((first.m_expires_ns > m_time_ns) ||
+                      (first.m_seq >= seq_limit))) {
+            break;
+        }
+        // the local reference keeps the timer alive during its callback,
+        // even if the callback drops the handle
+        std::shared_ptr<Timer> tmr = heapRemove(0);
+        if (dead) {
+            m_stats.canceled++;
+        } else {
+            sched_owner_stats_t &owner = m_stats.owner[tmr->m_owner];
+            const int64 late_ns = m_time_ns - tmr->m_expires_ns;
+            owner.fired++;
+            owner.late_ns += late_ns;
+            owner.max_late_ns = std::max(owner.max_late_ns, late_ns);
+            m_stats.fired++;
+            (tmr->m_callback)();
+            const auto callback_end = clock::now();
+            owner.host_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   callback_end - callback_start).count();
+            callback_start = callback_end;
+        }
     }
 
-    // scan each active timer, moving expired ones to the retired list.
-    std::vector<std::shared_ptr<Timer>> retired;
-    const int active_before = m_timer.size();
-    int active_after = 0;
-    for (int s=0; s < active_before; s++) {
-        if (m_timer[s].unique()) {
-            // the timer is dead: the scheduler holds the only reference to it
-            ;
-        } else {
-            if (m_timer[s]->m_expires_ns <= m_time_ns) {
-                // a timer has expired; move it to the retired list
-                retired.push_back(m_timer[s]);
-            } else {
-                // this timer hasn't expired
-                m_timer[active_after++] = m_timer[s];  // keep it in the active list
-            }
+    m_stats.credits++;
+    m_stats.credit_host_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  clock::now() - credit_start).count();
+
+    // find the next event; if there are no timers, don't trigger this
+    // fcn again until there is real work to do
+    m_trigger_ns = (m_timer.empty()) ? MAX_TIME : m_timer.front()->m_expires_ns;
+}
+
+
+// ----------------------------------------------------------------------
+// machine state
+// ----------------------------------------------------------------------
+
+// the sequence number is saved too, so timers which expire at the same
+// time still fire in the same order after a restore
+void
+Scheduler::saveState(StateWriter &sw) const
+{
+    sw.putI64(m_time_ns);
+    sw.putI64(static_cast<int64>(m_seq));
+}
+
+
+void
+Scheduler::loadState(StateReader &sr)
+{
+    for (auto &t : m_timer) {
+        t->m_heap_idx = -1;
+    }
+    m_timer.clear();
+    m_time_ns    = sr.getI64();
+    m_seq        = static_cast<uint64>(sr.getI64());
+    m_trigger_ns = MAX_TIME;
+}
+
+
+void
+Scheduler::restoreTimer(Timer &tmr, int64 expires_ns, uint64 seq)
+{
+    if (tmr.armed()) {
+        (void)heapRemove(tmr.m_heap_idx);
+    }
+    tmr.m_expires_ns = expires_ns;
+    tmr.m_seq        = seq;
+    heapPush(tmr.shared_from_this());
+    m_trigger_ns = m_timer.front()->m_expires_ns;
+}
+
+
+// ----------------------------------------------------------------------
+// statistics
+// ----------------------------------------------------------------------
+
+std::string
+Scheduler::statsReport(const sched_stats_t &before, const sched_stats_t &after)
+{
+    char buff[200];
+    std::string rv;
+
+    snprintf(&buff[0], sizeof(buff),
+             "sched: created %llu, armed %llu, canceled %llu, fired %llu; "
+             "max depth %d; %llu credits took %lld us\n",
+             static_cast<unsigned long long>(after.created  - before.created),
+             static_cast<unsigned long long>(after.armed    - before.armed),
+             static_cast<unsigned long long>(after.canceled - before.canceled),
+             static_cast<unsigned long long>(after.fired    - before.fired),
+             after.max_depth,
+             static_cast<unsigned long long>(after.credits  - before.credits),
+             static_cast<long long>((after.credit_host_ns - before.credit_host_ns) / 1000));
+    rv += &buff[0];
+
+    const int num_before = before.owner.size();
+    const int num_after  = after.owner.size();
+    for (int n=0; n < num_after; n++) {
+        // owners are only ever appended, so they line up
+        const sched_owner_stats_t  zero;
+        const sched_owner_stats_t &b = (n < num_before) ? before.owner[n] : zero;
+        const sched_owner_stats_t &a = after.owner[n];
+        const uint64 fired = a.fired - b.fired;
+        if ((a.armed == b.armed) && (fired == 0)) {
+            continue;
+        }
+        snprintf(&buff[0], sizeof(buff),
+                 "    %-14s armed %8llu, fired %8llu, avg late %6lld ns, "
+                 "callbacks took %lld us\n",
+                 a.name.c_str(),
+                 static_cast<unsigned long long>(a.armed - b.armed),
+                 static_cast<unsigned long long>(fired),
+                 static_cast<long long>((fired > 0) ? (a.late_ns - b.late_ns)/static_cast<int64>(fired) : 0),
+                 static_cast<long long>((a.host_ns - b.host_ns) / 1000));
+        rv += &buff[0];
+    }
+
+    return rv;
+}
+
+
+// ----------------------------------------------------------------------
+// heap maintenance
+// ----------------------------------------------------------------------
+
+void
+Scheduler::heapPush(std::shared_ptr<Timer> tmr)
+{
+    m_timer.push_back(nullptr);
+    heapMove(m_timer.size()-1, std::move(tmr));
+    siftUp(m_timer.size()-1);
+}
+
+
+// take the timer in slot idx off the heap and return it
+std::shared_ptr<Timer>
+Scheduler::heapRemove(int idx)
+{
+    std::shared_ptr<Timer> tmr = std::move(m_timer[idx]);
+    tmr->m_heap_idx = -1;
+
+    const int last = m_timer.size() - 1;
+    if (idx < last) {
+        heapMove(idx, std::move(m_timer[last]));
+        m_timer.pop_back();
+        siftUp(idx);
+        siftDown(idx);
+    } else {
+        m_timer.pop_back();
+    }
+    return tmr;
+}
+
+
+void
+Scheduler::heapMove(int idx, std::shared_ptr<Timer> tmr)
+{
+    tmr->m_heap_idx = idx;
+    m_timer[idx] = std::move(tmr);
+}
+
+
+void
+Scheduler::siftUp(int idx)
+{
+    std::shared_ptr<Timer> tmr = std::move(m_timer[idx]);
+    while (idx > 0) {
+        const int parent = (idx-1) / 2;
+        if (!firesBefore(*tmr, *m_timer[parent])) {
+            break;
         }
+        heapMove(idx, std::move(m_timer[parent]));
+        idx = parent;
     }
+    heapMove(idx, std::move(tmr));
+}
+
 
-    // delete any expired timers
-    if (active_after < active_before) {
-        // shrink active list, but null out pointers so resize doesn't
-        // free them, as they now live on the retired list
-        for (int i=active_after; i < active_before; i++) {
-            m_timer[i] = nullptr;
+void
+Scheduler::siftDown(int idx)
+{
+    const int size = m_timer.size();
+    std::shared_ptr<Timer> tmr = std::move(m_timer[idx]);
+    for (;;) {
+        int child = 2*idx + 1;
+        if (child >= size) {
+            break;
+        }
+        if ((child+1 < size) && firesBefore(*m_timer[child+1], *m_timer[child])) {
+            child++;
         }
-        m_timer.resize(active_after);
+        if (!firesBefore(*m_timer[child], *tmr)) {
+            break;
+        }
+        heapMove(idx, std::move(m_timer[child]));
+        idx = child;
     }
+    heapMove(idx, std::move(tmr));
+}
+
+
+// ======================================================================
+// Timer implementation
+// ======================================================================
+
+void
+Timer::rearm(int64 ns)
+{
+    // catch dumb bugs
+    assert(ns >= 1);
+    assert(ns <= 12E9);      // 12 seconds
+    m_scheduler->armTimer(*this, ns);
+}
 
-    // find the next event
-    m_trigger_ns = firstEvent();
 
-    // sort retired events in order they expire
-    std::sort(begin(retired), end(retired),
-              [](const std::shared_ptr<Timer> &a,
-                 const std::shared_ptr<Timer> &b) {
-                    return (a->m_expires_ns < b->m_expires_ns);
-               });
+void
+Timer::cancel()
+{
+    m_scheduler->disarmTimer(*this);
+}
 
-    // scan through the retired list and perform callbacks
-    for (auto &t : retired) {
-        (t->m_callback)();
+
+void
+Timer::saveState(StateWriter &sw) const
+{
+    sw.putBool(armed());
+    if (armed()) {
+        sw.putI64(m_expires_ns);
+        sw.putI64(static_cast<int64>(m_seq));
+    }
+}
+
+
+void
+Timer::loadState(StateReader &sr)
+{
+    if (!sr.getBool()) {
+        cancel();
+        return;
+    }
+    const int64  expires_ns = sr.getI64();
+    const uint64 seq        = static_cast<uint64>(sr.getI64());
+    if (sr.ok()) {
+        m_scheduler->restoreTimer(*this, expires_ns, seq);
     }
 }
 
@@ -17,8 +17,11 @@ using sched_callback_t = std::function<void()>;
 
 // fwd reference
 class Scheduler;
+class TimerPool;
+class StateWriter;
+class StateReader;
 
-class Timer
+class Timer : public std::enable_shared_from_this<Timer>
 {
     // actually I think it would be safe, but there is no need to do this
     CANT_ASSIGN_OR_COPY_CLASS(Timer);
@@ -26,13 +29,59 @@ class Timer
     friend class Scheduler;
 
 public:
-    // ticks is at what absolute time, in ns, to invoke the callback
-    Timer(int64 time_ns, sched_callback_t cb) :
-            m_expires_ns(time_ns), m_callback(cb) { };
+    // the timer isn't running until it is armed
+    Timer(Scheduler *scheduler, const sched_callback_t &cb) :
+            m_scheduler(scheduler), m_callback(cb) { };
+
+    // (re)start the timer to fire 'ns' nanoseconds from now.  if it was
+    // already running, the old expiration time is forgotten.
+    void rearm(int64 ns);
+
+    // stop the timer without firing it; harmless if it isn't running
+    void cancel();
+
+    // true if the timer is running
+    bool armed() const noexcept { return (m_heap_idx >= 0); }
+
+    // save or restore whether the timer is running, and if so, when it
+    // expires.  the scheduler state must be restored first.
+    void saveState(StateWriter &sw) const;
+    void loadState(StateReader &sr);
 
 private:
-    int64             m_expires_ns; // tick count until expiration
-    sched_callback_t  m_callback;   // registered callback function
+    Scheduler        *m_scheduler;       // owner
+    int64             m_expires_ns = 0;  // tick count until expiration
+    uint64            m_seq = 0;         // order of arming, to break ties
+    int               m_heap_idx = -1;   // slot in scheduler heap, or -1
+    int               m_owner = 0;       // index into Scheduler stats
+    sched_callback_t  m_callback;        // registered callback function
+};
+
+
+// ======================================================================
+// scheduler statistics.  all counts are since the scheduler was created;
+// a caller wanting rates takes two snapshots and subtracts.
+
+// activity of the timers belonging to one owner, eg, "disk sector"
+struct sched_owner_stats_t {
+    std::string name;            // as passed to createTimer()
+    uint64      created = 0;     // timers created
+    uint64      armed = 0;       // times a timer was started or restarted
+    uint64      fired = 0;       // callbacks performed
+    int64       late_ns = 0;     // sum of simulated time callbacks were late
+    int64       max_late_ns = 0; // worst case of that
+    int64       host_ns = 0;     // host time spent in callbacks
+};
+
+struct sched_stats_t {
+    uint64 created = 0;          // timers created
+    uint64 armed = 0;            // times a timer was started or restarted
+    uint64 canceled = 0;         // armed timers stopped without firing
+    uint64 fired = 0;            // callbacks performed
+    int    max_depth = 0;        // most timers on the heap at once
+    uint64 credits = 0;          // calls to creditTimer()
+    int64  credit_host_ns = 0;   // host time spent in creditTimer()
+    std::vector<sched_owner_stats_t> owner;
 };
 
 
@@ -44,10 +93,12 @@ private:
 
 class Scheduler
 {
-    friend class Timer;  // so timer can see killTimer()
+    friend class Timer;  // so timer can see armTimer(), etc
 
 public:
      Scheduler();
+    ~Scheduler();
+    CANT_ASSIGN_OR_COPY_CLASS(Scheduler);
 
     // create a new timer
     // ticks is the number of clock ticks before the callback fires,
@@ -60,7 +111,23 @@ public:
     //                          std::bind(&TimerTestFoo:report, &foo, 33));
     //
     // After 100 clocks, foo.report(33) is called.
-    std::shared_ptr<Timer> createTimer(int64 ns, const sched_callback_t &fcn);
+    //
+    // 'owner' names the device for the purpose of statistics.
+    std::shared_ptr<Timer> createTimer(int64 ns, const sched_callback_t &fcn,
+                                       const char *owner = "other");
+
+    // create a timer which isn't running yet.  a device which restarts
+    // a timer often should create it once, then use rearm() and cancel().
+    std::shared_ptr<Timer> createTimer(const sched_callback_t &fcn,
+                                       const char *owner = "other");
+
+    // activity counters
+    const sched_stats_t &getStats() const noexcept { return m_stats; }
+
+    // describe the change between two snapshots of getStats(), one line
+    // for the scheduler and one per owner which was active
+    static std::string statsReport(const sched_stats_t &before,
+                                   const sched_stats_t &after);
 
     // let 'ns' nanoseconds of simulated time go past
     inline void timerTick(int ns)
@@ -71,6 +138,21 @@ public:
         }
     }
 
+    // simulated absolute time
+    int64 getTimeNs() const noexcept { return m_time_ns; }
+
+    // how many ns can pass before the next timer fires.
+    // it may be pessimistic, as canceled timers are counted until retired.
+    inline int64 nsUntilEvent() const noexcept
+    {
+        return m_trigger_ns - m_time_ns;
+    }
+
+    // save or restore the current time.  restoring stops every timer;
+    // each owner then restores its own timers.
+    void saveState(StateWriter &sw) const;
+    void loadState(StateReader &sr);
+
 private:
     // not strictly necesssary to place a limit, but it is useful to
     // detect runaway conditions
@@ -80,19 +162,50 @@ private:
     // a concern anymore now that we're using int64.
     static const int64 MAX_TIME = (1LL << 62);
 
-    // transfer accumulated timer deficit to each active timer.
-    // n is added to the already elapsed time.
+    // perform the callbacks of all timers which have expired.
     // this shouldn't need to be called very frequently.
     void creditTimer();
 
-    // returns, in absolute ns, the time of the soonest event on the timer list
-    int64 firstEvent() noexcept;
+    // set the timer to expire 'ns' from now, and put it on the heap
+    // if it isn't there already
+    void armTimer(Timer &tmr, int64 ns);
+
+    // take the timer off the heap
+    void disarmTimer(Timer &tmr);
+
+    // put the timer back on the heap as it was when its state was saved
+    void restoreTimer(Timer &tmr, int64 expires_ns, uint64 seq);
+
+    // drop timers whose handle has been dropped
+    void sweepTimers();
+
+    // heap maintenance; each keeps Timer::m_heap_idx up to date
+    void heapPush(std::shared_ptr<Timer> tmr);
+    std::shared_ptr<Timer> heapRemove(int idx);
+    void heapMove(int idx, std::shared_ptr<Timer> tmr);
+    void siftUp(int idx);
+    void siftDown(int idx);
+
+    // heap order: true if timer a fires before timer b
+    static bool firesBefore(const Timer &a, const Timer &b) noexcept
+    {
+        return (a.m_expires_ns != b.m_expires_ns)
+             ? (a.m_expires_ns  < b.m_expires_ns)
+             : (a.m_seq         < b.m_seq);
+    }
+
+    int64  m_time_ns    = 0LL;       // simulated absolute time (in ns)
+    int64  m_trigger_ns = MAX_TIME;  // time next event expires
+    uint64 m_seq        = 0;         // number of timers armed
+
+    // storage for timers, which is recycled
+    std::unique_ptr<TimerPool> m_pool;
 
-    int64 m_time_ns    = 0LL;       // simulated absolute time (in ns)
-    int64 m_trigger_ns = MAX_TIME;  // time next event expires
+    // activity counters
+    sched_stats_t m_stats;
 
-    // list of callbacks to invoke when m_time_ns exceeds the expiration time
-    // embedded in the timer.
+    // callbacks to invoke when m_time_ns exceeds the expiration time
+    // embedded in the timer, as a binary min-heap in order of expiration.
     std::vector<std::shared_ptr<Timer>> m_timer;
 };
 
@@ -14,6 +14,7 @@
 #include "tokens.h"             // predigested keyword tokens
 
 #include <cctype>
+#include <cstring>
 #include <sstream>
 
 // =========================================================================
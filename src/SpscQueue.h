@@ -0,0 +1,64 @@
+// A fixed size, lock-free, single-producer/single-consumer ring buffer.
+//
+// Exactly one thread may call push() and exactly one (other) thread may call
+// pop().  It is used to hand keystrokes from the UI thread to the emulation
+// thread without either side ever blocking on the other.
+
+#ifndef _INCLUDE_SPSC_QUEUE_H_
+#define _INCLUDE_SPSC_QUEUE_H_
+
+#include "w2200.h"
+
+#include <array>
+#include <atomic>
+
+template <typename T, unsigned int N>
+class SpscQueue
+{
+    static_assert((N & (N-1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(SpscQueue);
+    SpscQueue() = default;
+
+    // producer side: returns false if the queue is full
+    bool push(const T &item) noexcept
+    {
+        const unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        m_buf[tail & (N-1)] = item;
+        m_tail.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: returns false if the queue is empty
+    bool pop(T *item) noexcept
+    {
+        const unsigned int head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = m_buf[head & (N-1)];
+        m_head.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: discard anything pending
+    void clear() noexcept
+    {
+        m_head.store(m_tail.load(std::memory_order_acquire),
+                     std::memory_order_release);
+    }
+
+private:
+    std::array<T, N> m_buf;
+    // the indices run freely and wrap; only the low bits index m_buf[]
+    std::atomic<unsigned int> m_head { 0 };  // next slot to pop
+    std::atomic<unsigned int> m_tail { 0 };  // next slot to push
+};
+
+#endif // _INCLUDE_SPSC_QUEUE_H_
+
+// vim: ts=8:et:sw=4:smarttab
@@ -0,0 +1,370 @@
+// Machine state file reading and writing.
+//
+// The file starts with a 16 byte header:
+//
+//     "W2200STA"     8 byte magic
+//     version        32b
+//     reserved       32b, 0
+//
+// followed by a series of sections, one per device, in a fixed order:
+//
+//     tag            4 characters, eg "CPU "
+//     length         32b, bytes of payload
+//     payload
+//
+// Everything is little endian.  Each device writes and reads its own
+// payload, and the section length is only used to check that the reader
+// consumed exactly what the writer produced.  Any change to what a device
+// saves must bump STATE_VERSION; there is no attempt to read old files.
+//
+// Large blocks, namely RAM, are padded out so they start on a 4 KB boundary
+// in the file.  The reader maps the whole file rather than reading it, so
+// restoring main memory is a single copy straight out of the page cache,
+// and only the pages actually in the image are touched.
+
+#include "StateFile.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+static const char   STATE_MAGIC[8] = { 'W','2','2','0','0','S','T','A' };
+static const uint32 STATE_VERSION  = 2;
+static const int    BLOB_ALIGN     = 4096;
+
+// ======================================================================
+// StateWriter
+// ======================================================================
+
+StateWriter::StateWriter()
+{
+    m_buf.reserve(1024*1024);
+    putBytes(&STATE_MAGIC[0], sizeof(STATE_MAGIC));
+    putU32(STATE_VERSION);
+    putU32(0);
+}
+
+
+void
+StateWriter::beginSection(const char *tag)
+{
+    assert(strlen(tag) == 4);
+    assert(m_section < 0);
+    putBytes(tag, 4);
+    m_section = static_cast<int>(m_buf.size());
+    putU32(0);  // patched by endSection()
+}
+
+
+void
+StateWriter::endSection()
+{
+    assert(m_section >= 0);
+    const uint32 len = static_cast<uint32>(m_buf.size() - m_section - 4);
+    for (int n=0; n < 4; n++) {
+        m_buf[m_section+n] = static_cast<uint8>(len >> (8*n));
+    }
+    m_section = -1;
+}
+
+
+void
+StateWriter::putU8(int val)
+{
+    m_buf.push_back(static_cast<uint8>(val));
+}
+
+
+void
+StateWriter::putU16(int val)
+{
+    putU8(val);
+    putU8(val >> 8);
+}
+
+
+void
+StateWriter::putU32(uint32 val)
+{
+    for (int n=0; n < 4; n++) {
+        putU8(static_cast<int>(val >> (8*n)));
+    }
+}
+
+
+void
+StateWriter::putI64(int64 val)
+{
+    const uint64 uval = static_cast<uint64>(val);
+    putU32(static_cast<uint32>(uval));
+    putU32(static_cast<uint32>(uval >> 32));
+}
+
+
+void
+StateWriter::putBytes(const void *data, int len)
+{
+    const uint8 *p = static_cast<const uint8*>(data);
+    m_buf.insert(m_buf.end(), p, p+len);
+}
+
+
+void
+StateWriter::putStr(const std::string &str)
+{
+    putU32(static_cast<uint32>(str.size()));
+    putBytes(str.data(), static_cast<int>(str.size()));
+}
+
+
+void
+StateWriter::putBlob(const void *data, int len)
+{
+    putU32(static_cast<uint32>(len));
+    const size_t pad = (BLOB_ALIGN - (m_buf.size() % BLOB_ALIGN)) % BLOB_ALIGN;
+    m_buf.resize(m_buf.size() + pad, 0x00);
+    putBytes(data, len);
+}
+
+
+bool
+StateWriter::writeFile(const std::string &filename) const
+{
+    assert(m_section < 0);
+    std::ofstream ofs(filename, std::ofstream::binary | std::ofstream::trunc);
+    if (!ofs) {
+        return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(m_buf.data()), m_buf.size());
+    ofs.close();
+    return !ofs.fail();
+}
+
+// ======================================================================
+// StateReader
+// ======================================================================
+
+StateReader::~StateReader()
+{
+    if (m_data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(static_cast<HANDLE>(m_map_handle));
+#else
+    munmap(const_cast<uint8*>(m_data), m_size);
+#endif
+}
+
+
+bool
+StateReader::open(const std::string &filename)
+{
+    assert(m_data == nullptr);
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE) {
+        fail("Couldn't open '" + filename + "'");
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mh = nullptr;
+    if (GetFileSizeEx(fh, &size) && (size.QuadPart > 0)) {
+        mh = CreateFileMappingA(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(fh);
+    if (mh == nullptr) {
+        fail("Couldn't map '" + filename + "'");
+        return false;
+    }
+    void *p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (p == nullptr) {
+        CloseHandle(mh);
+        fail("Couldn't map '" + filename + "'");
+        return false;
+    }
+    m_map_handle = mh;
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fail("Couldn't open '" + filename + "'");
+        return false;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);  // the mapping keeps the file open
+    if (p == MAP_FAILED) {
+        fail("Couldn't map '" + filename + "'");
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+#endif
+    m_data = static_cast<const uint8*>(p);
+    m_pos  = 0;
+
+    char magic[sizeof(STATE_MAGIC)];
+    getBytes(&magic[0], sizeof(magic));
+    const uint32 version = getU32();
+    (void)getU32();
+    if (!ok() || (memcmp(&magic[0], &STATE_MAGIC[0], sizeof(magic)) != 0)) {
+        m_error.clear();
+        fail("'" + filename + "' isn't a machine state file");
+        return false;
+    }
+    if (version != STATE_VERSION) {
+        fail("'" + filename + "' is version " + std::to_string(version) +
+             ", but version " + std::to_string(STATE_VERSION) + " is required");
+        return false;
+    }
+    return true;
+}
+
+
+void
+StateReader::beginSection(const char *tag)
+{
+    assert(strlen(tag) == 4);
+    assert(m_section_end == 0);
+    char file_tag[4];
+    getBytes(&file_tag[0], 4);
+    const uint32 len = getU32();
+    if (!ok()) {
+        return;
+    }
+    if (memcmp(&file_tag[0], tag, 4) != 0) {
+        fail(std::string("expected section '") + tag + "', found '" +
+             std::string(&file_tag[0], 4) + "'");
+        return;
+    }
+    if (len > m_size - m_pos) {
+        fail(std::string("section '") + tag + "' is truncated");
+        return;
+    }
+    m_section_end = m_pos + len;
+}
+
+
+void
+StateReader::endSection()
+{
+    if (ok() && (m_pos != m_section_end)) {
+        fail("section length doesn't match its contents");
+    }
+    m_section_end = 0;
+}
+
+
+const uint8 *
+StateReader::take(int len)
+{
+    const size_t limit = (m_section_end > 0) ? m_section_end : m_size;
+    if (!ok() || (len < 0) || (static_cast<size_t>(len) > limit - m_pos)) {
+        fail("unexpected end of data");
+        return nullptr;
+    }
+    const uint8 *p = m_data + m_pos;
+    m_pos += len;
+    return p;
+}
+
+
+uint8
+StateReader::getU8()
+{
+    const uint8 *p = take(1);
+    return (p != nullptr) ? p[0] : 0;
+}
+
+
+uint16
+StateReader::getU16()
+{
+    const uint8 *p = take(2);
+    return (p != nullptr) ? static_cast<uint16>(p[0] | (p[1] << 8)) : 0;
+}
+
+
+uint32
+StateReader::getU32()
+{
+    const uint8 *p = take(4);
+    if (p == nullptr) {
+        return 0;
+    }
+    return (static_cast<uint32>(p[0])      )
+         | (static_cast<uint32>(p[1]) <<  8)
+         | (static_cast<uint32>(p[2]) << 16)
+         | (static_cast<uint32>(p[3]) << 24);
+}
+
+
+int64
+StateReader::getI64()
+{
+    const uint64 lo = getU32();
+    const uint64 hi = getU32();
+    return static_cast<int64>(lo | (hi << 32));
+}
+
+
+void
+StateReader::getBytes(void *data, int len)
+{
+    const uint8 *p = take(len);
+    if (p != nullptr) {
+        memcpy(data, p, len);
+    } else {
+        memset(data, 0, len);
+    }
+}
+
+
+std::string
+StateReader::getStr()
+{
+    const int len = static_cast<int>(getU32());
+    const uint8 *p = take(len);
+    return (p != nullptr) ? std::string(reinterpret_cast<const char*>(p), len)
+                          : std::string();
+}
+
+
+const uint8 *
+StateReader::getBlob(int len)
+{
+    if (getU32() != static_cast<uint32>(len)) {
+        fail("block size doesn't match the configuration");
+        return nullptr;
+    }
+    const size_t pad = (BLOB_ALIGN - (m_pos % BLOB_ALIGN)) % BLOB_ALIGN;
+    if (take(static_cast<int>(pad)) == nullptr) {
+        return nullptr;
+    }
+    return take(len);
+}
+
+
+void
+StateReader::fail(const std::string &why)
+{
+    if (m_error.empty()) {
+        m_error = why;
+    }
+}
+
+// vim: ts=8:et:sw=4:smarttab
@@ -0,0 +1,101 @@
+// A machine state file holds everything needed to pick up emulation from
+// where it was saved: cpu registers, microstore and RAM, scheduler time and
+// pending timers, and the state of every card and terminal.
+// See the corresponding .cpp for the file format.
+
+#ifndef _INCLUDE_STATE_FILE_H_
+#define _INCLUDE_STATE_FILE_H_
+
+#include "w2200.h"
+
+// ======================================================================
+// StateWriter collects the state in memory, then writes it out in one go.
+
+class StateWriter
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(StateWriter);
+    StateWriter();
+
+    // a section is a tagged run of data belonging to one device.
+    // the tag is four characters; sections don't nest.
+    void beginSection(const char *tag);
+    void endSection();
+
+    // primitives, all stored little endian
+    void putU8(int val);
+    void putU16(int val);
+    void putU32(uint32 val);
+    void putI32(int val) { putU32(static_cast<uint32>(val)); }
+    void putI64(int64 val);
+    void putBool(bool val) { putU8(val ? 1 : 0); }
+    void putBytes(const void *data, int len);
+    void putStr(const std::string &str);
+
+    // a large block of bytes, eg, RAM.  it is placed at a page boundary
+    // in the file so the reader can use it straight from the mapping.
+    void putBlob(const void *data, int len);
+
+    // write it all to a file; returns false on failure
+    bool writeFile(const std::string &filename) const;
+
+private:
+    std::vector<uint8> m_buf;
+    int m_section = -1;     // offset of the open section's length field
+};
+
+
+// ======================================================================
+// StateReader maps a state file and hands back what was put there, in
+// the same order.  rather than checking each call, the caller checks ok()
+// once it is done; after the first problem, every get returns zero.
+
+class StateReader
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(StateReader);
+    StateReader() = default;
+    ~StateReader();
+
+    // map the file and check the header; returns false on failure
+    bool open(const std::string &filename);
+
+    // the next section must have the given tag, and when it is done,
+    // all of it must have been read
+    void beginSection(const char *tag);
+    void endSection();
+
+    uint8  getU8();
+    uint16 getU16();
+    uint32 getU32();
+    int    getI32() { return static_cast<int>(getU32()); }
+    int64  getI64();
+    bool   getBool() { return (getU8() != 0); }
+    void   getBytes(void *data, int len);
+    std::string getStr();
+
+    // return a pointer into the mapped file, valid until the reader
+    // is destroyed, or nullptr if there is a problem
+    const uint8 *getBlob(int len);
+
+    // note a problem with the contents; only the first is kept
+    void fail(const std::string &why);
+
+    bool ok() const noexcept { return m_error.empty(); }
+    const std::string &error() const noexcept { return m_error; }
+
+private:
+    // return a pointer to the next len bytes, or nullptr
+    const uint8 *take(int len);
+
+    const uint8 *m_data = nullptr;  // the mapped file
+    size_t       m_size = 0;        // its length
+    size_t       m_pos  = 0;        // next byte to read
+    size_t       m_section_end = 0; // end of the current section, or 0
+    void        *m_map_handle = nullptr;  // for unmapping, on windows
+    std::string  m_error;
+};
+
+#endif // _INCLUDE_STATE_FILE_H_
+
+// vim: ts=8:et:sw=4:smarttab
@@ -11,6 +11,7 @@
 #include "host.h"
 #include "system2200.h"
 
+#include <algorithm>
 #include <sstream>
 
 // ------------------------------------------------------------------------
@@ -64,6 +65,8 @@ SysCfgState::operator=(const SysCfgState &rhs)
     regulateCpuSpeed(rhs.isCpuSpeedRegulated());
     setDiskRealtime(rhs.getDiskRealtime());
     setWarnIo(rhs.getWarnIo());
+    setClockSkewNs(rhs.getClockSkewNs());
+    setMxdWindowNs(rhs.getMxdWindowNs());
 
     return *this;
 }
@@ -90,6 +93,8 @@ SysCfgState::SysCfgState(const SysCfgState &obj)
     m_speed_regulated = obj.m_speed_regulated;
     m_disk_realtime   = obj.m_disk_realtime;
     m_warn_io         = obj.m_warn_io;
+    m_clock_skew_ns   = obj.m_clock_skew_ns;
+    m_mxd_window_ns   = obj.m_mxd_window_ns;
     m_initialized     = true;
 }
 
@@ -125,7 +130,9 @@ SysCfgState::operator==(const SysCfgState &rhs) const
            (m_ramsize         == rhs.m_ramsize)         &&
            (m_speed_regulated == rhs.m_speed_regulated) &&
            (m_disk_realtime   == rhs.m_disk_realtime)   &&
-           (m_warn_io         == rhs.m_warn_io)         ;
+           (m_warn_io         == rhs.m_warn_io)         &&
+           (m_clock_skew_ns   == rhs.m_clock_skew_ns)   &&
+           (m_mxd_window_ns   == rhs.m_mxd_window_ns)   ;
 }
 
 
@@ -144,6 +151,8 @@ SysCfgState::setDefaults()
     setRamKB(32);
     setDiskRealtime(true);
     setWarnIo(true);
+    setClockSkewNs(0);
+    setMxdWindowNs(0);
 
     // wipe out all cards
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
@@ -259,6 +268,13 @@ SysCfgState::loadIni()
 
         host::configReadBool(subgroup, "warnio", &bval, true);
         setWarnIo(bval);  // default
+
+        int ival;
+        host::configReadInt(subgroup, "clock_skew_ns", &ival, 0);
+        setClockSkewNs(ival);
+
+        host::configReadInt(subgroup, "mxd_window_ns", &ival, 0);
+        setMxdWindowNs(ival);
     }
 
     m_initialized = true;
@@ -314,6 +330,8 @@ SysCfgState::saveIni() const
         const std::string subgroup("misc");
         host::configWriteBool(subgroup, "disk_realtime", getDiskRealtime());
         host::configWriteBool(subgroup, "warnio",        getWarnIo());
+        host::configWriteInt(subgroup,  "clock_skew_ns", getClockSkewNs());
+        host::configWriteInt(subgroup,  "mxd_window_ns", getMxdWindowNs());
     }
 }
 
@@ -358,6 +376,25 @@ SysCfgState::setWarnIo(bool warn) noexcept
 }
 
 
+void
+SysCfgState::setClockSkewNs(int ns) noexcept
+{
+    // more than a millisecond would be noticeably unfaithful
+    m_clock_skew_ns = std::max(0, std::min(ns, 1000000));
+    m_initialized = true;
+}
+
+
+void
+SysCfgState::setMxdWindowNs(int ns) noexcept
+{
+    // the MXD can't see the cpu strobes any sooner than this, so
+    // much past a millisecond and the terminals feel sluggish
+    m_mxd_window_ns = std::max(0, std::min(ns, 1000000));
+    m_initialized = true;
+}
+
+
 // set the card type.  if the card type is configurable, set up a card_cfg
 // object of the appropriate type, discarding whatever was there before.
 void
@@ -418,6 +455,20 @@ SysCfgState::getWarnIo() const noexcept
 }
 
 
+int
+SysCfgState::getClockSkewNs() const noexcept
+{
+    return m_clock_skew_ns;
+}
+
+
+int
+SysCfgState::getMxdWindowNs() const noexcept
+{
+    return m_mxd_window_ns;
+}
+
+
 IoCard::card_t
 SysCfgState::getSlotCardType(int slot) const noexcept
 {
@@ -572,6 +623,11 @@ SysCfgState::needsReboot(const SysCfgState &other) const
         return true;
     }
 
+    // the MXD cards are built differently in parallel mode
+    if ((m_mxd_window_ns > 0) != (other.m_mxd_window_ns > 0)) {
+        return true;
+    }
+
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
 
         if (m_slot[slot].type != other.m_slot[slot].type) {
@@ -70,6 +70,17 @@ public:
     void setWarnIo(bool warn) noexcept;
     bool getWarnIo() const noexcept;
 
+    // how far, in ns, a clocked device (cpu, MXD 8080) may run ahead of the
+    // others before it yields.  0 keeps them in lockstep.
+    void setClockSkewNs(int ns) noexcept;
+    int  getClockSkewNs() const noexcept;
+
+    // if non-zero, each MXD card runs on a thread of its own, and it and
+    // the cpu exchange bus traffic only every mxd_window_ns.  0 runs them
+    // all on the emulation thread, interleaved as other clocked devices.
+    void setMxdWindowNs(int ns) noexcept;
+    int  getMxdWindowNs() const noexcept;
+
     // retrieve the pointer to the per-card configuration state
     std::shared_ptr<CardCfgState> getCardConfig(int slot) const noexcept;
 
@@ -107,6 +118,8 @@ private:
     bool m_speed_regulated = true;  // emulation speed throttling
     bool m_disk_realtime   = true;  // boolean whether disk emulation is realtime or not
     bool m_warn_io         = true;  // boolean whether to warn on access to invalid IO device
+    int  m_clock_skew_ns   = 0;     // how far clocked devices may drift apart
+    int  m_mxd_window_ns   = 0;     // MXD sync interval when run in parallel
 };
 
 #endif // _INCLUDE_SYS_CONFIG_STATE_H_
@@ -27,11 +27,14 @@
 #include "IoCardKeyboard.h"
 #include "IoCardTermMux.h"
 #include "Scheduler.h"
+#include "StateFile.h"
 #include "Terminal.h"
 #include "Ui.h"
 #include "host.h"              // for dbglog()
 #include "system2200.h"
 
+#include <cstring>
+
 bool do_debug = false;
 
 // ----------------------------------------------------------------------------
@@ -40,10 +43,12 @@ bool do_debug = false;
 
 static char id_string[] = "*2236DE R2016 19200BPS 8+O (USA)";
 
-Terminal::Terminal(std::shared_ptr<Scheduler> scheduler,
+Terminal::Terminal(System2200 &sys,
+                   std::shared_ptr<Scheduler> scheduler,
                    IoCardTermMux *muxd,
                    int io_addr, int term_num, ui_screen_t screen_type,
                    bool vp_cpu) :
+    m_sys(sys),
     m_scheduler(scheduler),
     m_muxd(muxd),
     m_vp_cpu(vp_cpu),
@@ -55,26 +60,35 @@ Terminal::Terminal(std::shared_ptr<Scheduler> scheduler,
     m_disp.chars_h  = (screen_type == UI_SCREEN_64x16)  ? 16 : 24;
     m_disp.chars_h2 = (screen_type == UI_SCREEN_2236DE) ? 25 : m_disp.chars_h;
 
+    // the timers are created once, then rearmed as needed
+    m_init_tmr    = m_scheduler->createTimer(std::bind(&Terminal::sendInitSeq, this),
+                                             "term init");
+    m_tx_tmr      = m_scheduler->createTimer([this](){ termToMxdCallback(m_tx_byte); },
+                                             "term uart");
+    m_selectp_tmr = m_scheduler->createTimer(std::bind(&Terminal::selectPCallback, this),
+                                             "term select");
+
     reset(true);
 
-    m_wndhnd = UI_displayInit(screen_type, m_io_addr, m_term_num, &m_disp);
+    m_snapshot = std::make_shared<CrtStateSnapshot>();
+    publishDisplay();
+    m_sys.registerPublisher(this, std::bind(&Terminal::publishDisplay, this));
+
+    m_wndhnd = UI_displayInit(screen_type, m_io_addr, m_term_num, m_snapshot);
     assert(m_wndhnd);
 
     const bool smart_term = (screen_type == UI_SCREEN_2236DE);
     if (smart_term) {
         // in dumb systems, the IoCardKeyboard will establish the callback
         // we use 0x01 as that corresponds to the vp-mode keyboard offset
-        system2200::registerKb(
+        m_sys.registerKb(
             m_io_addr+0x01, m_term_num,
             std::bind(&Terminal::receiveKeystroke, this, std::placeholders::_1)
         );
 
         // A real 2336 sends the sequence E4 F8 about a second after
         // it powers up (the second is to run self tests).
-        m_init_tmr = m_scheduler->createTimer(
-                       TIMER_MS(700),
-                       std::bind(&Terminal::sendInitSeq, this)
-                     );
+        m_init_tmr->rearm(TIMER_MS(700));
     }
 }
 
@@ -84,15 +98,16 @@ Terminal::~Terminal()
 {
     const bool smart_term = (m_disp.screen_type == UI_SCREEN_2236DE);
     if (smart_term) {
-        system2200::unregisterKb(m_io_addr+0x01, m_term_num);
+        m_sys.unregisterKb(m_io_addr+0x01, m_term_num);
     }
 
-    m_init_tmr    = nullptr;
-    m_tx_tmr      = nullptr;
+    m_init_tmr->cancel();
+    m_tx_tmr->cancel();
     m_crt_tmr     = nullptr;
     m_prt_tmr     = nullptr;
-    m_selectp_tmr = nullptr;
+    m_selectp_tmr->cancel();
 
+    m_sys.unregisterPublisher(this);
     UI_displayDestroy(m_wndhnd.get());
 }
 
@@ -161,7 +176,7 @@ Terminal::resetCrt(bool attr_only)
         // the terminal is sent a "reset crt" sequence, but actually wiping
         // these out would break the script processing.
         if (!m_script_active) {
-            m_tx_tmr = nullptr;
+            m_tx_tmr->cancel();
             m_kb_buff = {};
             m_kb_recent = {};
         }
@@ -170,7 +185,7 @@ Terminal::resetCrt(bool attr_only)
         m_crt_buff       = {};
         m_crt_flow_state = flow_state_t::START;
         m_crt_tmr        = nullptr;
-        m_selectp_tmr    = nullptr;
+        m_selectp_tmr->cancel();
     }
 
     // on reset, the unit defaults to all attributes off, but the saved
@@ -206,7 +221,6 @@ Terminal::resetPrt()
 void
 Terminal::sendInitSeq()
 {
-    m_init_tmr = nullptr;
 //  m_kb_buff.push(static_cast<uint8>(0xE4));
     m_kb_buff.push(static_cast<uint8>(0xF8));
     checkKbBuffer();
@@ -273,7 +287,7 @@ Terminal::receiveKeystroke(int keycode)
 void
 Terminal::checkKbBuffer()
 {
-    if (m_tx_tmr) {
+    if (m_tx_tmr->armed()) {
         // serial channel is in use
         return;
     }
@@ -325,7 +339,7 @@ Terminal::checkKbBuffer()
     // another complication: if two terminals are doing script processing
     // at the same time, it slows down the MXD response time, and we again
     // get overruns.
-    const int active_scripts = system2200::numActiveScripts(m_io_addr+0x01);
+    const int active_scripts = m_sys.numActiveScripts(m_io_addr+0x01);
     if (active_scripts > 1) {
         delay *= active_scripts;
     }
@@ -360,10 +374,8 @@ Terminal::checkKbBuffer()
         }
     }
 
-    m_tx_tmr = m_scheduler->createTimer(
-                   delay,
-                   std::bind(&Terminal::termToMxdCallback, this, byte)
-               );
+    m_tx_byte = byte;
+    m_tx_tmr->rearm(delay);
 }
 
 
@@ -371,12 +383,11 @@ Terminal::checkKbBuffer()
 void
 Terminal::termToMxdCallback(int key)
 {
-    m_tx_tmr = nullptr;
     m_muxd->receiveKeystroke(m_term_num, key);
 
     // poll for script input, but don't let it overrun the key buffer
     if (m_kb_buff.size() < 5) {
-        m_script_active = system2200::pollScriptInput(m_io_addr+0x01, m_term_num);
+        m_script_active = m_sys.pollScriptInput(m_io_addr+0x01, m_term_num);
     }
 
     // see if any other chars are pending
@@ -428,6 +439,14 @@ Terminal::clearScreen() noexcept
 }
 
 
+void
+Terminal::clearDisplay() noexcept
+{
+    clearScreen();
+    m_disp.dirty = true;
+}
+
+
 // scroll the contents of the screen up one row, and fill the new
 // row with blanks.
 void
@@ -528,9 +547,9 @@ Terminal::processChar(uint8 byte)
             // TODO: LDMOD#40 says of E4 "SET RSD FLAG IN MXD"
             // then F8 every three seconds while not throttled.
             // if I include this, the emulator thinks it got the INIT atom (E4)
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xE4);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xE4);
 #endif
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
             // TODO: then F8 every 3 seconds if not throttled
             break;
 
@@ -540,12 +559,12 @@ Terminal::processChar(uint8 byte)
             // a real 2336 sends E9 (crt stop flow control),
             // then F8 (crt go flow control), then another F8, then E4,
             // then F8 every three seconds while not throttled.
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF9);
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF9);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xF8);
 #if 0
             // if I include this, the emulator thinks it got the INIT atom (E4)
-            system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xE4);
+            m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0xE4);
 #endif
             // TODO: then F8 every 3 seconds if not throttled
             break;
@@ -560,6 +579,161 @@ Terminal::processChar(uint8 byte)
     m_escape_seen = false;
 }
 
+// the UI renders from a snapshot of m_disp, not m_disp itself
+void
+Terminal::publishDisplay()
+{
+    if (m_disp.dirty) {
+        m_snapshot->publish(m_disp);
+        m_disp.dirty = false;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// machine state
+// ----------------------------------------------------------------------------
+
+template <typename T>
+static void
+putFifo(StateWriter &sw, const T &fifo)
+{
+    T copy(fifo);
+    sw.putU16(static_cast<int>(copy.size()));
+    while (!copy.empty()) {
+        sw.putU8(copy.front());
+        copy.pop_front();
+    }
+}
+
+
+template <typename T>
+static void
+getFifo(StateReader &sr, T *fifo, unsigned int max_size)
+{
+    *fifo = {};
+    const unsigned int size = sr.getU16();
+    if (size > max_size) {
+        sr.fail("terminal buffer is too large");
+        return;
+    }
+    for (unsigned int n=0; n < size; n++) {
+        fifo->push_back(sr.getU8());
+    }
+}
+
+
+// std::queue doesn't have pop_front() and push_back(), so go via a deque
+static void
+putFifo(StateWriter &sw, const std::queue<uint8> &fifo)
+{
+    std::queue<uint8> copy(fifo);
+    std::deque<uint8> dq;
+    while (!copy.empty()) {
+        dq.push_back(copy.front());
+        copy.pop();
+    }
+    putFifo(sw, dq);
+}
+
+
+static void
+getFifo(StateReader &sr, std::queue<uint8> *fifo, unsigned int max_size)
+{
+    std::deque<uint8> dq;
+    getFifo(sr, &dq, max_size);
+    *fifo = std::queue<uint8>(dq);
+}
+
+
+void
+Terminal::saveState(StateWriter &sw) const
+{
+    sw.putU8(m_disp.screen_type);
+    sw.putBytes(&m_disp.display[0], sizeof(m_disp.display));
+    sw.putBytes(&m_disp.attr[0],    sizeof(m_disp.attr));
+    sw.putU8(m_disp.curs_x);
+    sw.putU8(m_disp.curs_y);
+    sw.putU8(m_disp.curs_attr);
+
+    sw.putU8(m_attrs);
+    sw.putBool(m_attr_on);
+    sw.putBool(m_attr_temp);
+    sw.putBool(m_attr_under);
+    sw.putBool(m_box_bottom);
+
+    sw.putBool(m_escape_seen);
+    sw.putBool(m_crt_sink);
+    sw.putU8(m_raw_cnt);
+    sw.putBytes(&m_raw_buf[0], sizeof(m_raw_buf));
+    sw.putU8(m_input_cnt);
+    sw.putBytes(&m_input_buf[0], sizeof(m_input_buf));
+    sw.putU8(static_cast<int>(m_ignore));
+
+    putFifo(sw, m_kb_buff);
+    putFifo(sw, m_kb_recent);
+    sw.putU8(m_tx_byte);
+    putFifo(sw, m_crt_buff);
+    sw.putU8(static_cast<int>(m_crt_flow_state));
+    putFifo(sw, m_prt_buff);
+    sw.putU8(static_cast<int>(m_prt_flow_state));
+
+    m_init_tmr->saveState(sw);
+    m_tx_tmr->saveState(sw);
+    m_selectp_tmr->saveState(sw);
+}
+
+
+// keyboard scripts aren't part of the saved state, so any script which was
+// running when the state was saved doesn't resume
+void
+Terminal::loadState(StateReader &sr)
+{
+    if (sr.getU8() != m_disp.screen_type) {
+        sr.fail("the terminal type doesn't match");
+        return;
+    }
+    sr.getBytes(&m_disp.display[0], sizeof(m_disp.display));
+    sr.getBytes(&m_disp.attr[0],    sizeof(m_disp.attr));
+    m_disp.curs_x    = sr.getU8();
+    m_disp.curs_y    = sr.getU8();
+    m_disp.curs_attr = static_cast<cursor_attr_t>(sr.getU8());
+    m_disp.dirty     = true;
+
+    m_attrs       = sr.getU8();
+    m_attr_on     = sr.getBool();
+    m_attr_temp   = sr.getBool();
+    m_attr_under  = sr.getBool();
+    m_box_bottom  = sr.getBool();
+
+    m_escape_seen = sr.getBool();
+    m_crt_sink    = sr.getBool();
+    m_raw_cnt     = sr.getU8();
+    sr.getBytes(&m_raw_buf[0], sizeof(m_raw_buf));
+    m_input_cnt   = sr.getU8();
+    sr.getBytes(&m_input_buf[0], sizeof(m_input_buf));
+    m_ignore      = static_cast<ignore_t>(sr.getU8());
+    if ((m_disp.curs_x >= m_disp.chars_w) || (m_disp.curs_y >= m_disp.chars_h2) ||
+        (m_raw_cnt > static_cast<int>(sizeof(m_raw_buf))) ||
+        (m_input_cnt > static_cast<int>(sizeof(m_input_buf)))) {
+        sr.fail("bad terminal state");
+    }
+
+    getFifo(sr, &m_kb_buff, 2*KB_BUFF_MAX);
+    getFifo(sr, &m_kb_recent, KB_BUFF_MAX);
+    m_tx_byte = sr.getU8();
+    getFifo(sr, &m_crt_buff, 2*CRT_BUFF_MAX);
+    m_crt_flow_state = static_cast<flow_state_t>(sr.getU8());
+    getFifo(sr, &m_prt_buff, 2*PRT_BUFF_MAX);
+    m_prt_flow_state = static_cast<flow_state_t>(sr.getU8());
+    m_script_active = false;
+
+    m_init_tmr->loadState(sr);
+    m_tx_tmr->loadState(sr);
+    m_selectp_tmr->loadState(sr);
+
+    publishDisplay();
+}
+
 // ----------------------------------------------------------------------------
 // crt byte stream parsing
 // ----------------------------------------------------------------------------
@@ -592,7 +766,7 @@ void
 Terminal::checkCrtFifo()
 {
     while (!m_crt_buff.empty()) {
-        if (m_selectp_tmr) {
+        if (m_selectp_tmr->armed()) {
             return;  // waiting on SELECT Pn timeout
         }
         const uint8 byte = m_crt_buff.front();
@@ -612,6 +786,8 @@ Terminal::checkCrtFifo()
 void
 Terminal::processCrtChar1(uint8 byte)
 {
+    m_disp.dirty = true;  // not every path ends in processCrtChar3()
+
     if ((m_raw_cnt == 0) && (byte == 0xFB)) {
         // start a FB ... sequence
         m_raw_buf[0] = 0xFB;
@@ -666,14 +842,10 @@ Terminal::processCrtChar1(uint8 byte)
     // check for delay sequence: FB Cn
     if ((0xC1 <= m_raw_buf[1]) && (m_raw_buf[1] <= 0xC9)) {
         const int delay_ms = 1000 * (m_raw_buf[1] - 0xC0) / 6;
-        assert(m_selectp_tmr == nullptr);
+        assert(!m_selectp_tmr->armed());
         if (delay_ms > 0) {
 //UI_info("Got FB Cn, delay=%d ms", delay_ms);
-            m_selectp_tmr = m_scheduler->createTimer(
-                                   TIMER_MS(delay_ms),
-                                   std::bind(&Terminal::selectPCallback, this)
-                                 );
-            assert(m_selectp_tmr != nullptr);
+            m_selectp_tmr->rearm(TIMER_MS(delay_ms));
         }
         if (do_debug) {
             dbglog("Delay sequence: cnt=%d\n", m_raw_buf[1]);
@@ -863,10 +1035,10 @@ Terminal::processCrtChar2(uint8 byte)
             if  (m_input_buf[2] == 0x09 && m_input_buf[3] == 0x0F) {
                 char *idptr = &id_string[1];  // skip the leading asterisk
                 while (*idptr != '\0') {
-                    system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, *idptr);
+                    m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, *idptr);
                     idptr++;
                 }
-                system2200::dispatchKeystroke(m_io_addr+0x01, m_term_num, 0x0D);
+                m_sys.dispatchKeystroke(m_io_addr+0x01, m_term_num, 0x0D);
             }
             m_input_cnt = 0;
         }
@@ -1088,7 +1260,6 @@ Terminal::processCrtChar3(uint8 byte)
 void
 Terminal::selectPCallback()
 {
-    m_selectp_tmr = nullptr;
     checkCrtFifo();
 }
 
@@ -11,6 +11,9 @@
 
 class CrtFrame;
 class Scheduler;
+class StateReader;
+class StateWriter;
+class System2200;
 class Timer;
 class IoCardTermMux;
 enum ui_screen_t : int;
@@ -20,7 +23,8 @@ class Terminal
 public:
     CANT_ASSIGN_OR_COPY_CLASS(Terminal);
 
-    Terminal(std::shared_ptr<Scheduler> scheduler,
+    Terminal(System2200 &sys,
+             std::shared_ptr<Scheduler> scheduler,
              IoCardTermMux *muxd,
              int io_addr, int term_num, ui_screen_t screen_type,
              bool vp_cpu);
@@ -32,6 +36,18 @@ public:
     // send a character to the display controller
     void processChar(uint8 byte);
 
+    // blank the screen and home the cursor.  the headless batch runner
+    // uses it so that a test only sees what it puts on the screen itself.
+    void clearDisplay() noexcept;
+
+    // hand the display state to the UI if it has changed.
+    // this is called at the end of each emulated timeslice.
+    void publishDisplay();
+
+    // save or restore the terminal state, screen contents included
+    void saveState(StateWriter &sw) const;
+    void loadState(StateReader &sr);
+
     // character transmission time, in nanoseconds
     static const int64 serial_char_delay =
             TIMER_US(  11.0              /* bits per character */
@@ -116,6 +132,7 @@ private:
     void adjustCursorX(int delta) noexcept;  // move cursor left or right
 
     // ---- state ----
+    System2200    &m_sys;           // the machine we are attached to
     std::shared_ptr<Scheduler> m_scheduler; // shared event scheduler
     IoCardTermMux *m_muxd;          // nullptr if dumb term
     const bool     m_vp_cpu;        // scripting throttle needs this info
@@ -125,6 +142,7 @@ private:
     const int     m_io_addr;        // associated I/O address
     const int     m_term_num;       // associated terminal number
     crt_state_t   m_disp;           // contents of display memory
+    std::shared_ptr<CrtStateSnapshot> m_snapshot;  // m_disp as seen by the UI
     std::shared_ptr<Timer> m_init_tmr;  // send init sequence from terminal
     bool          m_script_active = false;  // a script is feeding us keystrokes
 
@@ -153,6 +171,7 @@ private:
     std::queue<uint8>      m_kb_buff;           // pending input
     std::deque<uint8>      m_kb_recent;         // recent history
     std::shared_ptr<Timer> m_tx_tmr;            // model uart rate & delay
+    int                    m_tx_byte = 0;       // byte m_tx_tmr delivers
 
     // crt receive buffer and flow control state
     std::queue<uint8>      m_crt_buff;
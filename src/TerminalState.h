@@ -6,6 +6,8 @@
 
 #include "w2200.h"
 
+#include <mutex>
+
 enum ui_screen_t : int;  // defined in Ui.h
 
 // state used only in smart terminal mode (eg 2236DE)
@@ -40,7 +42,51 @@ struct crt_state_t
     int           curs_y;         // cursor location
     cursor_attr_t curs_attr;      // cursor state
 
-    bool          dirty;          // something has changed since last refresh
+    bool          dirty;          // something has changed since last publish
+};
+
+// The emulation thread owns the working crt_state_t and copies it here at
+// the end of any timeslice in which it changed.  The UI never looks at the
+// working copy; it pulls the most recently published copy into a buffer of
+// its own, so neither side ever sees a half-updated screen.
+class CrtStateSnapshot
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(CrtStateSnapshot);
+    CrtStateSnapshot() = default;
+
+    // make a new copy of the screen state visible
+    void publish(const crt_state_t &state)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state = state;
+        m_seq++;
+    }
+
+    // copy out the published state if it is newer than *seq, in which case
+    // *seq is updated and true is returned.
+    bool fetch(crt_state_t *state, uint32 *seq) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (*seq == m_seq) {
+            return false;
+        }
+        *state = m_state;
+        *seq   = m_seq;
+        return true;
+    }
+
+    // return a copy of the published state
+    crt_state_t get() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_state;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    crt_state_t        m_state {};
+    uint32             m_seq = 0;   // bumped on each publish
 };
 
 #endif // _INCLUDE_TERMINAL_STATE_H_
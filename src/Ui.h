@@ -4,6 +4,9 @@
 // in the cases where the core needs to talk to the gui, we have a
 // non-member function that the core can call, and that function is
 // just a thunk into the GUI-verse.
+//
+// the core may call these from the emulation thread.  it is up to the UI
+// to get the work done on whatever thread it needs to be done on.
 
 #ifndef _INCLUDE_UI_H_
 #define _INCLUDE_UI_H_
@@ -13,7 +16,8 @@
 class CardCfgState;
 class CrtFrame;
 class PrinterFrame;
-struct crt_state_t;
+class CrtStateSnapshot;
+struct pace_stats_t;
 
 // =============================================================
 // exported by UI
@@ -25,9 +29,10 @@ enum ui_screen_t : int {
     UI_SCREEN_80x24,
     UI_SCREEN_2236DE
 };
+// the display renders whatever the terminal last published to crt_state.
 std::shared_ptr<CrtFrame>
     UI_displayInit(int screen_type, int io_addr, int term_num,
-                   crt_state_t *crt_state);
+                   std::shared_ptr<CrtStateSnapshot> crt_state);
 
 // called before the display gets shut down
 void UI_displayDestroy(CrtFrame *wnd);
@@ -35,8 +40,10 @@ void UI_displayDestroy(CrtFrame *wnd);
 // create a bell (0x07) sound for the given terminal
 void UI_displayDing(CrtFrame *wnd);
 
-// inform the UI how far along the simulation is in emulated time
-void UI_setSimSeconds(unsigned long seconds, float relative_speed);
+// inform the UI how far along the simulation is in emulated time,
+// how fast it is running, and if regulated, how well it is keeping pace
+void UI_setSimSeconds(unsigned long seconds, float relative_speed,
+                      const pace_stats_t &pacing);
 
 // the state of the specified disk drive has changed
 void UI_diskEvent(int slot, int drive);
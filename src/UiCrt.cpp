@@ -21,11 +21,13 @@ enum {
     Timer_Beep = 100,
 };
 
-Crt::Crt(CrtFrame *parent, crt_state_t *crt_state) :
+Crt::Crt(CrtFrame *parent, std::shared_ptr<CrtStateSnapshot> crt_state) :
     wxWindow(parent, -1, wxDefaultPosition, wxDefaultSize),
     m_parent(parent),
-    m_crt_state(crt_state)
+    m_snapshot(crt_state)
 {
+    m_snapshot->fetch(&m_crt_state, &m_crt_seq);
+
     createBeep();
 #if 0
     if (!m_beep) {
@@ -113,7 +115,10 @@ Crt::setColor(const wxColor &FG, const wxColor &BG)
 void
 Crt::refreshWindow()
 {
-    if (isDirty() || m_crt_state->dirty) {
+    // pick up whatever the emulator has published since last time
+    const bool changed = m_snapshot->fetch(&m_crt_state, &m_crt_seq);
+
+    if (isDirty() || changed) {
 #if USE_STRETCH_BLIT
         // FIXME: needed for stretchblit mode until I redo border stuff
         invalidateAll();
@@ -256,10 +261,10 @@ Crt::OnLeftDClick(wxMouseEvent &event)
     const int cell_x = (pos.x - m_screen_rc.GetX()) / m_charcell_w;
     const int cell_y = (pos.y - m_screen_rc.GetY()) / m_charcell_h;
 
-    if (cell_x < 0 || cell_x > m_crt_state->chars_w) {
+    if (cell_x < 0 || cell_x > m_crt_state.chars_w) {
         return;
     }
-    if (cell_y < 0 || cell_y > m_crt_state->chars_h) {
+    if (cell_y < 0 || cell_y > m_crt_state.chars_h) {
         return;
     }
 
@@ -272,9 +277,9 @@ Crt::OnLeftDClick(wxMouseEvent &event)
     // the appearance of the "^ERR ..." string.
 
     // first char of row
-    char *p = reinterpret_cast<char *>(&m_crt_state->display[cell_y * m_crt_state->chars_w]);
+    char *p = reinterpret_cast<char *>(&m_crt_state.display[cell_y * m_crt_state.chars_w]);
     // one past final char of row
-    const char *e = (p + m_crt_state->chars_w);
+    const char *e = (p + m_crt_state.chars_w);
 
     // scan entire line looking for first appearance of one of these forms.
     // Wang BASIC:
@@ -389,8 +394,8 @@ void
 Crt::recalcBorders()
 {
     // figure out where the active drawing area is
-    const int width  = m_charcell_w*m_crt_state->chars_w;
-    const int height = m_charcell_h*m_crt_state->chars_h2;
+    const int width  = m_charcell_w*m_crt_state.chars_w;
+    const int height = m_charcell_h*m_crt_state.chars_h2;
     const int orig_x = (width  < m_screen_pix_w) ? (m_screen_pix_w-width)/2  : 0;
     const int orig_y = (height < m_screen_pix_h) ? (m_screen_pix_h-height)/2 : 0;
 
@@ -505,8 +510,8 @@ Crt::createBeep()
 #if USE_FILE_BEEPS
     m_beep = std::make_unique<wxSound>();
     wxString sound_file =
-        (m_crt_state->screen_type == UI_SCREEN_2236DE) ? "sounds/beep_1940.wav"
-                                                       : "sounds/beep_1100.wav";
+        (m_crt_state.screen_type == UI_SCREEN_2236DE) ? "sounds/beep_1940.wav"
+                                                      : "sounds/beep_1100.wav";
     const bool success = m_beep->Create(sound_file);
     if (!success) {
         m_beep = nullptr;
@@ -518,8 +523,8 @@ Crt::createBeep()
     // the schematics for the dumb terminal seem to show about a 1100 Hz tone,
     // while the 2336 I have on hand seems to be about 1940 Hz
     const float target_freq =
-        (m_crt_state->screen_type == UI_SCREEN_2236DE) ? 1940.0f  // 2336
-                                                       : 1100.0f; // dumb crt schematics indicate this
+        (m_crt_state.screen_type == UI_SCREEN_2236DE) ? 1940.0f  // 2336
+                                                      : 1100.0f; // dumb crt schematics indicate this
 
     // we want the buffer to have an integral number of complete cycles
     // so fudge the buffer size to make that happen
@@ -4,19 +4,19 @@
 #ifndef _INCLUDE_UI_CRT_H_
 #define _INCLUDE_UI_CRT_H_
 
+#include "TerminalState.h"
 #include "w2200.h"
 #include "wx/wx.h"
 
 class wxSound;
 class CrtFrame;
-struct crt_state_t;
 
 class Crt: public wxWindow
 {
 public:
     CANT_ASSIGN_OR_COPY_CLASS(Crt);
 
-    Crt(CrtFrame *parent, crt_state_t *crt_state);
+    Crt(CrtFrame *parent, std::shared_ptr<CrtStateSnapshot> crt_state);
 
     // ---- setters/getters ----
 
@@ -98,7 +98,9 @@ private:
     // ---- state ----
 
     CrtFrame     * const m_parent;      // who owns us
-    crt_state_t  * const m_crt_state;   // contents of display memory
+    const std::shared_ptr<CrtStateSnapshot> m_snapshot;  // published by Terminal
+    crt_state_t    m_crt_state;         // our copy of the display memory
+    uint32         m_crt_seq = 0;       // snapshot sequence # of m_crt_state
 
     wxBitmap  m_scrbits;            // image of the display
     int       m_frame_count = 0;    // for tracking refresh fps
@@ -5,6 +5,7 @@
 #include "IoCardDisk.h"
 #include "IoCardKeyboard.h"     // to pick up core_* keyboard interface
 #include "IoCardPrinter.h"
+#include "Pacer.h"              // for pace_stats_t
 #include "TerminalState.h"
 #include "Ui.h"                 // emulator interface
 #include "UiCrt.h"
@@ -38,12 +39,16 @@ enum
     // menu items
     File_Script = 1,
     File_Snapshot,
+    File_SaveState,
+    File_LoadState,
+    File_RecordInput,
+    File_ReplayInput,
 #if HAVE_FILE_DUMP
     File_Dump,
 #endif
     File_Quit = wxID_EXIT,
 
-    CPU_HardReset = File_Snapshot+3,
+    CPU_HardReset = File_Snapshot+8,
     CPU_WarmReset,
     CPU_ActualSpeed,
     CPU_UnregulatedSpeed,
@@ -148,14 +153,14 @@ CrtFrame* CrtFrame::m_primary_frame = nullptr;
 CrtFrame::CrtFrame(const wxString& title,
                    const int io_addr,
                    const int term_num,
-                   crt_state_t *crt_state) :
+                   std::shared_ptr<CrtStateSnapshot> crt_state) :
        wxFrame(static_cast<wxFrame *>(nullptr), -1, title,
                wxDefaultPosition, wxDefaultSize,
                wxDEFAULT_FRAME_STYLE | wxNO_FULL_REPAINT_ON_RESIZE),
     m_crt_addr(io_addr),
     m_term_num(term_num),
-    m_smart_term(crt_state->screen_type == UI_SCREEN_2236DE),
-    m_small_crt(crt_state->chars_w == 64),
+    m_smart_term(crt_state->get().screen_type == UI_SCREEN_2236DE),
+    m_small_crt(crt_state->get().chars_w == 64),
     m_primary_crt(m_smart_term ? ((m_crt_addr == 0x00) && (m_term_num == 0))
                                :  (m_crt_addr == 0x05))
 {
@@ -213,6 +218,10 @@ CrtFrame::CrtFrame(const wxString& title,
     // event routing table
     Bind(wxEVT_MENU, &CrtFrame::OnScript,   this, File_Script);
     Bind(wxEVT_MENU, &CrtFrame::OnSnapshot, this, File_Snapshot);
+    Bind(wxEVT_MENU, &CrtFrame::OnSaveState, this, File_SaveState);
+    Bind(wxEVT_MENU, &CrtFrame::OnLoadState, this, File_LoadState);
+    Bind(wxEVT_MENU, &CrtFrame::OnRecordInput, this, File_RecordInput);
+    Bind(wxEVT_MENU, &CrtFrame::OnReplayInput, this, File_ReplayInput);
 #if HAVE_FILE_DUMP
     Bind(wxEVT_MENU, &CrtFrame::OnDump,     this, File_Dump);
 #endif
@@ -281,6 +290,12 @@ CrtFrame::makeMenubar()
         menu_file->Append(File_Script,   "&Script...", "Redirect keyboard from a file");
     }
     menu_file->Append(File_Snapshot, "Screen &Grab...\t" ALT "-G", "Save an image of the screen to a file");
+    if (m_primary_crt) {
+        menu_file->Append(File_SaveState, "Save Machine State...", "Save the state of the whole machine to a file");
+        menu_file->Append(File_LoadState, "Restore Machine State...", "Pick up where a saved machine state left off");
+        menu_file->Append(File_RecordInput, "Record Input...", "Log all input, with when it happened, to a file", wxITEM_CHECK);
+        menu_file->Append(File_ReplayInput, "Replay Input...", "Feed the machine input logged earlier, as fast as possible", wxITEM_CHECK);
+    }
 #if HAVE_FILE_DUMP
     if (m_primary_crt) {
         menu_file->Append(File_Dump,     "Dump Memory...", "Save an image of the system memory to a file");
@@ -389,6 +404,10 @@ CrtFrame::setMenuChecks(const wxMenu *menu)
     // ----- file --------------------------------------
     const bool script_running = system2200::isScriptModeActive(m_assoc_kb_addr, m_term_num);
     m_menubar->Enable(File_Script, !script_running);
+    if (isPrimaryCrt()) {
+        m_menubar->Check(File_RecordInput, system2200::isRecording());
+        m_menubar->Check(File_ReplayInput, system2200::isReplaying());
+    }
 
     // ----- cpu ---------------------------------------
     if (isPrimaryCrt()) {
@@ -897,7 +916,8 @@ CrtFrame::refocus()
 
 // set simulation time for informative display
 void
-CrtFrame::setSimSeconds(int secs, float relative_speed)
+CrtFrame::setSimSeconds(int secs, float relative_speed,
+                        const pace_stats_t &pacing)
 {
     CrtFrame *pf = getPrimaryFrame();
     if (pf == nullptr) {
@@ -917,6 +937,11 @@ CrtFrame::setSimSeconds(int secs, float relative_speed)
                     : "Sim time: %d seconds, %3.1fx";
     str.Printf(format, secs, relative_speed);
 #endif
+    if (pacing.regulated) {
+        // how late timeslices have been starting: typical, worst case
+        str += wxString::Format(", lag %.1f/%.1f ms",
+                                pacing.late_p50_ms, pacing.late_p99_ms);
+    }
     if (pf->getShowStatistics()) {
         pf->m_statusbar->SetStatusMessage(std::string(str));
     } else {
@@ -987,6 +1012,62 @@ CrtFrame::OnSnapshot(wxCommandEvent& WXUNUSED(event))
 }
 
 
+// save the state of the whole machine
+void
+CrtFrame::OnSaveState(wxCommandEvent& WXUNUSED(event))
+{
+    std::string full_path;
+    const int r = host::fileReq(host::FILEREQ_STATE, "Save machine state to", false, &full_path);
+    if (r == host::FILEREQ_OK) {
+        (void)system2200::saveState(full_path);
+    }
+}
+
+
+// replace the state of the whole machine with one saved earlier
+void
+CrtFrame::OnLoadState(wxCommandEvent& WXUNUSED(event))
+{
+    std::string full_path;
+    const int r = host::fileReq(host::FILEREQ_STATE, "Machine state to restore", true, &full_path);
+    if (r == host::FILEREQ_OK) {
+        (void)system2200::loadState(full_path);
+    }
+}
+
+
+// start, or stop, logging input for replaying later
+void
+CrtFrame::OnRecordInput(wxCommandEvent& WXUNUSED(event))
+{
+    if (system2200::isRecording()) {
+        system2200::stopRecording();
+        return;
+    }
+    std::string full_path;
+    const int r = host::fileReq(host::FILEREQ_INPUT, "Record input to", false, &full_path);
+    if (r == host::FILEREQ_OK) {
+        (void)system2200::startRecording(full_path);
+    }
+}
+
+
+// start, or stop, feeding in input logged earlier
+void
+CrtFrame::OnReplayInput(wxCommandEvent& WXUNUSED(event))
+{
+    if (system2200::isReplaying()) {
+        system2200::stopReplay();
+        return;
+    }
+    std::string full_path;
+    const int r = host::fileReq(host::FILEREQ_INPUT, "Input log to replay", true, &full_path);
+    if (r == host::FILEREQ_OK) {
+        (void)system2200::startReplay(full_path);
+    }
+}
+
+
 #if HAVE_FILE_DUMP
 // do a screen capture to a named filed
 void
@@ -1023,8 +1104,8 @@ CrtFrame::OnReset(wxCommandEvent &event)
         case CPU_WarmReset:
             // route it through the keyboard handler because the MXD
             // filters out resets which aren't from terminal #1
-            system2200::dispatchKeystroke(getTiedAddr(), m_term_num,
-                                          IoCardKeyboard::KEYCODE_RESET);
+            system2200::queueKeystroke(getTiedAddr(), m_term_num,
+                                       IoCardKeyboard::KEYCODE_RESET);
             break;
     }
 }
@@ -1359,7 +1440,7 @@ CrtFrame::OnToolBarButton(wxCommandEvent &event)
                       : (shift)         ? (sf | (id - TB_SF0 + 16))
                                         : (sf | (id - TB_SF0));
 
-    system2200::dispatchKeystroke(getTiedAddr(), m_term_num, keycode);
+    system2200::queueKeystroke(getTiedAddr(), m_term_num, keycode);
 }
 
 
@@ -10,7 +10,8 @@
 
 class Crt;
 class CrtStatusBar;
-struct crt_state_t;
+class CrtStateSnapshot;
+struct pace_stats_t;
 
 // Define a new frame type: this is going to be our main frame
 class CrtFrame : public wxFrame
@@ -21,7 +22,7 @@ public:
     CrtFrame(const wxString &title,
              int io_addr,
              int term_num,     // 0 if dumb, 1-4 if term mux
-             crt_state_t *crt_state);
+             std::shared_ptr<CrtStateSnapshot> crt_state);
 
     // make CRT the focus of further keyboard events
     void refocus();
@@ -43,7 +44,8 @@ public:
     static void diskEvent(int slot, int drive);
 
     // set simulation time for informative display
-    static void setSimSeconds(int secs, float relative_speed);
+    static void setSimSeconds(int secs, float relative_speed,
+                              const pace_stats_t &pacing);
 
     // create a bell (0x07) sound
     void ding();
@@ -87,6 +89,10 @@ private:
 
     void OnScript(wxCommandEvent &event);
     void OnSnapshot(wxCommandEvent &event);
+    void OnSaveState(wxCommandEvent &event);
+    void OnLoadState(wxCommandEvent &event);
+    void OnRecordInput(wxCommandEvent &event);
+    void OnReplayInput(wxCommandEvent &event);
     void OnDump(wxCommandEvent &event);
     void OnQuit(wxCommandEvent &event);
     void OnMenuOpen(wxMenuEvent &event);
@@ -335,7 +335,7 @@ Crt::OnChar(wxKeyEvent &event)
 
     if (!found_map) {
         const bool keyword_mode = m_parent->getKeywordMode();
-        const bool smart_term = (m_crt_state->screen_type == UI_SCREEN_2236DE);
+        const bool smart_term = (m_crt_state.screen_type == UI_SCREEN_2236DE);
         if (smart_term) {
             // the 2236 doesn't support keyword mode, just caps lock
             if (keyword_mode && ('a' <= baseKey && baseKey <= 'z')) {
@@ -392,15 +392,15 @@ Crt::OnChar(wxKeyEvent &event)
     }
 	// Keycode for Underlining, non functioning, spells out atom. (PRINT i.e. A0) 
 	/*if (wxKey == '_') {
-		system2200::dispatchKeystroke(m_parent->getTiedAddr(),
+		system2200::queueKeystroke(m_parent->getTiedAddr(),
 			m_parent->getTermNum(),
 			0x01A0);
 	}
 	else */ 
 	if (found_map) {
-        system2200::dispatchKeystroke(m_parent->getTiedAddr(),
-                                      m_parent->getTermNum(),
-                                      key);
+        system2200::queueKeystroke(m_parent->getTiedAddr(),
+                                   m_parent->getTermNum(),
+                                   key);
     } else {
         // percolate the event up to the parent
         event.Skip();
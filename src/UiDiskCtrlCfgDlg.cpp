@@ -142,6 +142,33 @@ DiskCtrlCfgHelpDlg::DiskCtrlCfgHelpDlg(wxWindow *parent)
         "automatically clearing these extraneous bits."
         "\n\n");
 
+    txt->SetDefaultStyle(section_attr);
+    txt->AppendText("Disk Image Writes\n");
+
+    txt->SetDefaultStyle(body_attr);
+    txt->AppendText(
+        "\n"
+        "This controls how soon a sector written by the emulated machine "
+        "makes it from the host's file cache to the host's disk.  Either "
+        "way, the write is safe if the emulator crashes; this is about "
+        "the host losing power or crashing."
+        "\n\n"
+        "\"Cached\" leaves it to the host to write the sector when it "
+        "sees fit, which is the fastest.  \"Started\" has the host begin "
+        "writing each sector as soon as it is written.  \"Waited for\" "
+        "holds up emulation until each sector is safely on the disk, which "
+        "can be very slow.  \"Written behind\" collects written sectors "
+        "and has a background thread write them to disk in batches, "
+        "within a second by default, so emulation doesn't wait "
+        "and a crash of the host loses little.  A change takes effect the "
+        "next time a disk is inserted."
+        "\n\n"
+        "For \"Written behind\", the ini file settings flushMs, flushWrites "
+        "and flushIdle set how long a sector may wait, how many sectors "
+        "may pile up before they are written (0 for no limit), and whether "
+        "the whole disk image is synced once the writes stop."
+        "\n\n");
+
     // make sure the start of text is at the top
     txt->SetInsertionPoint(0);
     txt->ShowPosition(0);
@@ -161,6 +188,7 @@ enum
     ID_RB_NUM_DRIVES = 100,             // radio box
     ID_RB_INTELLIGENCE,                 // radio box
     ID_CHK_WARN_MISMATCH,               // check box
+    ID_RB_SYNC,                         // radio box
 
     ID_BTN_HELP   = 300,
     ID_BTN_REVERT
@@ -173,6 +201,7 @@ enum
 //      +-- num drives radiobox (H)
 //      +-- disk intelligence radiobox (H)
 //      +-- warn on mismatch checkbox
+//      +-- disk image writes radiobox (H)
 //      +-- button_sizer (H)
 //          |
 //          +-- m_btn_help
@@ -234,6 +263,22 @@ DiskCtrlCfgDlg::DiskCtrlCfgDlg(wxFrame *parent, CardCfgState &cfg) :
                 "Dumb drives ignore this bit, but smart drives don't and\n"
                 "can cause problems.");
 
+    const wxString sync_choices[] = { "Cached", "Started", "Waited for",
+                                      "Written behind" };
+    m_rb_sync = new wxRadioBox(this, ID_RB_SYNC,
+                               "Disk image writes",
+                               wxDefaultPosition, wxDefaultSize,
+                               4, &sync_choices[0],
+                               1, wxRA_SPECIFY_ROWS);
+    m_rb_sync->SetItemToolTip(0, "The host writes sectors to disk\n"
+                                 "when it sees fit");
+    m_rb_sync->SetItemToolTip(1, "The host starts writing each sector\n"
+                                 "to disk as soon as it is written");
+    m_rb_sync->SetItemToolTip(2, "Emulation waits until each sector\n"
+                                 "is written to disk");
+    m_rb_sync->SetItemToolTip(3, "A background thread writes sectors\n"
+                                 "to disk in batches");
+
     // put three buttons side by side
     m_btn_help   = new wxButton(this, ID_BTN_HELP,   "Help");
     m_btn_revert = new wxButton(this, ID_BTN_REVERT, "Revert");
@@ -256,6 +301,7 @@ DiskCtrlCfgDlg::DiskCtrlCfgDlg(wxFrame *parent, CardCfgState &cfg) :
     top_sizer->Add(m_rb_num_drives,   0, wxALIGN_LEFT | wxALL, 5);
     top_sizer->Add(m_rb_intelligence, 0, wxALIGN_LEFT | wxALL, 5);
     top_sizer->Add(m_warn_mismatch,   0, wxALIGN_LEFT | wxALL, 5);
+    top_sizer->Add(m_rb_sync,         0, wxALIGN_LEFT | wxALL, 5);
     top_sizer->AddStretchSpacer();
     top_sizer->Add(button_sizer,      0, wxALIGN_RIGHT | wxALL, 5);
 
@@ -271,6 +317,7 @@ DiskCtrlCfgDlg::DiskCtrlCfgDlg(wxFrame *parent, CardCfgState &cfg) :
     Bind(wxEVT_RADIOBOX, &DiskCtrlCfgDlg::OnNumDrives,    this, ID_RB_NUM_DRIVES);
     Bind(wxEVT_RADIOBOX, &DiskCtrlCfgDlg::OnIntelligence, this, ID_RB_INTELLIGENCE);
     Bind(wxEVT_CHECKBOX, &DiskCtrlCfgDlg::OnWarnMismatch, this, ID_CHK_WARN_MISMATCH);
+    Bind(wxEVT_RADIOBOX, &DiskCtrlCfgDlg::OnSync,         this, ID_RB_SYNC);
     Bind(wxEVT_BUTTON,   &DiskCtrlCfgDlg::OnButton,       this, -1);
 }
 
@@ -292,6 +339,17 @@ DiskCtrlCfgDlg::updateDlg()
         default: assert(false);
     }
     m_warn_mismatch->SetValue(m_cfg.getWarnMismatch());
+    switch (m_cfg.getSync()) {
+        case DiskCtrlCfgState::DISK_SYNC_CACHE:
+                m_rb_sync->SetSelection(0); break;
+        case DiskCtrlCfgState::DISK_SYNC_ASYNC:
+                m_rb_sync->SetSelection(1); break;
+        case DiskCtrlCfgState::DISK_SYNC_WRITE:
+                m_rb_sync->SetSelection(2); break;
+        case DiskCtrlCfgState::DISK_SYNC_BACKGROUND:
+                m_rb_sync->SetSelection(3); break;
+        default: assert(false);
+    }
 }
 
 
@@ -333,6 +391,20 @@ DiskCtrlCfgDlg::OnWarnMismatch(wxCommandEvent& WXUNUSED(event))
 }
 
 
+void
+DiskCtrlCfgDlg::OnSync(wxCommandEvent& WXUNUSED(event))
+{
+    switch (m_rb_sync->GetSelection()) {
+        case 0: m_cfg.setSync(DiskCtrlCfgState::DISK_SYNC_CACHE); break;
+        case 1: m_cfg.setSync(DiskCtrlCfgState::DISK_SYNC_ASYNC); break;
+        case 2: m_cfg.setSync(DiskCtrlCfgState::DISK_SYNC_WRITE); break;
+        case 3: m_cfg.setSync(DiskCtrlCfgState::DISK_SYNC_BACKGROUND); break;
+        default: assert(false); break;
+    }
+    m_btn_revert->Enable(m_cfg != m_old_cfg);
+}
+
+
 // used for all dialog button presses
 void
 DiskCtrlCfgDlg::OnButton(wxCommandEvent &event)
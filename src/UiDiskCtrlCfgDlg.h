@@ -3,6 +3,7 @@
 //    the number of drives associated with the controller
 //    whether the controller is dumb or intelligent
 //    whether or not to warn when the disk type doesn't match the intelligence
+//    how soon writes to the disk images reach the host's disk
 
 #ifndef _INCLUDE_UI_DISK_CONTROLLER_CFG_DLG_H_
 #define _INCLUDE_UI_DISK_CONTROLLER_CFG_DLG_H_
@@ -22,11 +23,13 @@ private:
     void OnNumDrives(wxCommandEvent &event);
     void OnIntelligence(wxCommandEvent &event);
     void OnWarnMismatch(wxCommandEvent &event);
+    void OnSync(wxCommandEvent &event);
     void OnButton(wxCommandEvent &event);
 
     wxRadioBox *m_rb_num_drives   = nullptr;  // number of attached disk drives
     wxRadioBox *m_rb_intelligence = nullptr;  // dumb, smart, auto intelligence
     wxCheckBox *m_warn_mismatch   = nullptr;  // warn if media & intelligence don't match
+    wxRadioBox *m_rb_sync         = nullptr;  // when disk image writes reach the disk
     wxButton   *m_btn_revert      = nullptr;
     wxButton   *m_btn_ok          = nullptr;
     wxButton   *m_btn_cancel      = nullptr;
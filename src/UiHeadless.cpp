@@ -0,0 +1,1178 @@
+// ============================================================================
+// UiHeadless.cpp
+//
+// This file contains the entry point for the headless build of the emulator,
+// along with a stub implementation of the core-to-UI interface (Ui.h).
+// It allows the emulator core to be built and run with nothing more than
+// a C++14 compiler: no wxWidgets, no windows, no event loop.  It is meant
+// for automated regression runs, benchmarking, and profiling.
+//
+// Displays and printers are modeled by small stand-in classes which keep a
+// pointer to the core's state so it can be dumped as plain text at the end
+// of a run.  Error, warning and info messages are sent to stderr.  Requests
+// for confirmation are answered with "no".
+//
+// The emulator is driven by a plain loop calling system2200::onIdle(),
+// which is exactly what the wx GUI does from its idle event handler.
+//
+// For regression runs of many programs, -batch boots the machine once (by
+// restoring a saved state and/or running a boot script), then forks one
+// child per test script.  Each child inherits the booted machine, RAM and
+// all, copy-on-write, so a test costs nothing to start.  The disk images
+// are mapped copy-on-write too, so the tests can't see each other's writes.
+// At most -jobs children run at a time, by default one per host core.
+//
+// For measuring how well the emulator scales, -machines builds that many
+// independent copies of the configured machine in this one process, and a
+// pool of -jobs threads steps them all, a timeslice at a time, until each
+// has run the script for the given emulated time.
+//
+// -record logs the keystrokes, scripts and resets of a run, and -replay
+// feeds them back at the same simulated times.  A replayed session doesn't
+// depend on the host at all, so it makes for a fixed workload to time.
+//
+// -stats reports how fast a run went as one JSON object on stdout, so a
+// benchmark script (see bench/) can collect and compare the figures.
+//
+// -overlay, -commit-overlay and -discard-overlay manage overlay disk images
+// (see Wvd.h), so a test farm can give each emulator its own small overlay
+// on one shared, read-only base image.  -compress and -expand convert disk
+// images to and from the compressed format.  They run on their own and exit.
+// ============================================================================
+
+#include "IoCardDisk.h"      // for wvdFlush(), wvdGetFlushStats()
+#include "IoCardDisplay.h"   // for clearDisplay()
+#include "IoCardKeyboard.h"  // for KEYCODE_RESET
+#include "IoCardTermMux.h"   // for clearDisplays()
+#include "Scheduler.h"        // for sched_stats_t
+#include "SysCfgState.h"
+#include "TerminalState.h"
+#include "Ui.h"
+#include "Wvd.h"             // for the disk image commands
+#include "host.h"
+#include "system2200.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdarg>      // for var args
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ============================================================================
+// stand-ins for the GUI display and printer windows
+// ============================================================================
+
+class CrtFrame
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(CrtFrame);
+    CrtFrame(int io_addr, int term_num,
+             std::shared_ptr<CrtStateSnapshot> crt_state) noexcept :
+        m_io_addr(io_addr),
+        m_term_num(term_num),
+        m_crt_state(crt_state)
+    { }
+
+    const int m_io_addr;    // display controller (or mux) address
+    const int m_term_num;   // terminal number on mux, else 0
+    const std::shared_ptr<CrtStateSnapshot> m_crt_state;  // published by Terminal
+};
+
+
+class PrinterFrame
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(PrinterFrame);
+    explicit PrinterFrame(int io_addr) : m_io_addr(io_addr) { }
+
+    const int   m_io_addr;  // printer address
+    std::string m_text;     // everything which has been printed
+};
+
+
+// all live displays and printers, in order of creation
+static std::vector<CrtFrame*>     displays;
+static std::vector<PrinterFrame*> printers;
+
+
+// return the contents of the given display as lines of text,
+// with trailing blanks removed
+static std::vector<std::string>
+getScreenText(const crt_state_t &crt)
+{
+    std::vector<std::string> rows;
+    for (int row=0; row < crt.chars_h2; row++) {
+        std::string line;
+        for (int col=0; col < crt.chars_w; col++) {
+            const int ch = crt.display[row*crt.chars_w + col] & 0x7F;
+            line += ((ch >= 0x20) && (ch < 0x7F)) ? static_cast<char>(ch) : ' ';
+        }
+        const size_t last = line.find_last_not_of(' ');
+        line.erase((last == std::string::npos) ? 0 : last+1);
+        rows.push_back(line);
+    }
+    return rows;
+}
+
+
+// returns true if any display currently shows the given text
+static bool
+screenContains(const std::string &text)
+{
+    for (auto const *disp : displays) {
+        for (auto const &row : getScreenText(disp->m_crt_state->get())) {
+            if (row.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// send the contents of all displays and printers to a file
+static void
+dumpOutputs(FILE *fp)
+{
+    for (auto const *disp : displays) {
+        if (disp->m_crt_state->get().screen_type == UI_SCREEN_2236DE) {
+            fprintf(fp, "==== MXD/%02X term #%d ====\n", disp->m_io_addr, disp->m_term_num+1);
+        } else {
+            fprintf(fp, "==== CRT /%03X ====\n", disp->m_io_addr);
+        }
+        std::vector<std::string> rows = getScreenText(disp->m_crt_state->get());
+        while (!rows.empty() && rows.back().empty()) {
+            rows.pop_back();
+        }
+        for (auto const &row : rows) {
+            fprintf(fp, "%s\n", row.c_str());
+        }
+    }
+    for (auto const *prt : printers) {
+        if (!prt->m_text.empty()) {
+            fprintf(fp, "==== printer /%03X ====\n%s\n", prt->m_io_addr, prt->m_text.c_str());
+        }
+    }
+    fflush(fp);
+}
+
+
+// ============================================================================
+// alert messages
+// ============================================================================
+
+static void
+UI_AlertMsg(const char *title, const char *fmt, va_list &args)
+{
+    char buff[1000];
+    vsnprintf(&buff[0], sizeof(buff), fmt, args);
+    fprintf(stderr, "%s: %s\n", title, &buff[0]);
+}
+
+
+void
+UI_error(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    UI_AlertMsg("Error", fmt, args);
+    va_end(args);
+}
+
+
+void
+UI_warn(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    UI_AlertMsg("Warning", fmt, args);
+    va_end(args);
+}
+
+
+void
+UI_info(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    UI_AlertMsg("Information", fmt, args);
+    va_end(args);
+}
+
+
+// nobody is there to answer, so the answer is always no
+bool
+UI_confirm(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    UI_AlertMsg("Question (answered no)", fmt, args);
+    va_end(args);
+    return false;
+}
+
+// ========================================================================
+// interface between core and UI routines
+// ========================================================================
+
+// ---- Crt wrappers ----
+
+std::shared_ptr<CrtFrame>
+UI_displayInit(const int /*screen_type*/, const int io_addr, const int term_num,
+               std::shared_ptr<CrtStateSnapshot> crt_state)
+{
+    auto wnd = std::make_shared<CrtFrame>(io_addr, term_num, crt_state);
+    displays.push_back(wnd.get());
+    return wnd;
+}
+
+
+void
+UI_displayDestroy(CrtFrame *wnd)
+{
+    assert(wnd != nullptr);
+    displays.erase(std::remove(displays.begin(), displays.end(), wnd),
+                   displays.end());
+}
+
+
+void UI_displayDing(CrtFrame * /*wnd*/)
+{
+}
+
+
+void
+UI_setSimSeconds(unsigned long /*seconds*/, float /*relative_speed*/,
+                 const pace_stats_t &/*pacing*/)
+{
+}
+
+
+void
+UI_diskEvent(int /*slot*/, int /*drive*/)
+{
+}
+
+
+// ---- printer wrappers ----
+
+std::shared_ptr<PrinterFrame>
+UI_printerInit(int io_addr)
+{
+    auto wnd = std::make_shared<PrinterFrame>(io_addr);
+    printers.push_back(wnd.get());
+    return wnd;
+}
+
+
+void
+UI_printerDestroy(PrinterFrame *wnd)
+{
+    assert(wnd != nullptr);
+    printers.erase(std::remove(printers.begin(), printers.end(), wnd),
+                   printers.end());
+}
+
+
+void
+UI_printerChar(PrinterFrame *wnd, uint8 byte)
+{
+    assert(wnd != nullptr);
+    if (byte == 0x0D) {
+        wnd->m_text += '\n';
+    } else if ((byte >= 0x20) && (byte < 0x7F)) {
+        wnd->m_text += static_cast<char>(byte);
+    }
+}
+
+// ---- system configuration wrapper ----
+
+// the configuration can only be changed via the .ini file or -set options
+void
+UI_systemConfigDlg()
+{
+}
+
+
+void
+UI_configureCard(IoCard::card_t /*card_type*/, CardCfgState * /*cfg*/)
+{
+}
+
+// ============================================================================
+// keyboard selection
+// ============================================================================
+
+// find the keyboard which gets the input when -kb isn't given: the first
+// keyboard card, or failing that, terminal #1 of the first MXD.
+// returns false if the machine has neither.
+static bool
+findDefaultKb(int *kb_addr, int *kb_term)
+{
+    *kb_term = 0;
+    *kb_addr = system2200::getKbIoAddr(0);
+    if (*kb_addr >= 0) {
+        return true;
+    }
+    const SysCfgState &cfg = system2200::config();
+    for (int slot=0; slot < NUM_IOSLOTS; slot++) {
+        if (cfg.getSlotCardType(slot) == IoCard::card_t::term_mux) {
+            // the same offset Terminal uses when it registers its keyboard
+            *kb_addr = cfg.getSlotCardAddr(slot) + 0x01;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// batch runs
+// ============================================================================
+
+// what a batch run is asked to do with each test
+struct batch_opts_t {
+    int         kb_addr;        // keyboard which receives the script
+    int         kb_term;        // terminal number of that keyboard
+    int         seconds;        // emulated time limit per test
+    std::string until_text;     // stop early once a display shows this
+};
+
+
+// flush every mounted disk image with wvdFlush(), which writes back any
+// changes, then unmaps and closes the image file.  a disk reopens its file
+// when it is next accessed.  calling this before a child exits means the
+// writes of a test to an image which isn't kept private make it to the
+// file, for the tests which follow.
+static void
+flushDiskFiles()
+{
+    int slot;
+    for (int ctrl=0; system2200::findDiskController(ctrl, &slot); ctrl++) {
+        for (int drive=0; drive < 4; drive++) {
+            const int stat = IoCardDisk::wvdDriveStatus(slot, drive);
+            if ((stat & IoCardDisk::WVD_STAT_DRIVE_OCCUPIED) != 0) {
+                IoCardDisk::wvdFlush(slot, drive);
+            }
+        }
+    }
+}
+
+
+// read the list of test scripts, one per line.  blank lines and lines
+// starting with '#' are ignored, and relative paths are taken to be
+// relative to the list file.  returns false if it can't be read.
+static bool
+readTestList(const std::string &filename, std::vector<std::string> *tests)
+{
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        return false;
+    }
+    const size_t slash = filename.find_last_of('/');
+    const std::string dir = (slash == std::string::npos) ? ""
+                          : filename.substr(0, slash+1);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && (line[0] != '#')) {
+            tests->push_back((line[0] == '/') ? line : dir + line);
+        }
+    }
+    return true;
+}
+
+
+// blank every display, so that what is left on them from booting can't
+// be mistaken for the output of a test
+static void
+clearDisplays()
+{
+    for (int slot=0; slot < NUM_IOSLOTS; slot++) {
+        IoCard *card = system2200::getInstFromSlot(slot);
+        if (auto disp = dynamic_cast<IoCardDisplay*>(card)) {
+            disp->clearDisplay();
+        } else if (auto mux = dynamic_cast<IoCardTermMux*>(card)) {
+            mux->clearDisplays();
+        }
+    }
+}
+
+
+// this runs in the child process.  feed the script to the machine, run it
+// until the time limit or the -until text shows up, and write the display
+// and printer contents to <script>.out.  returns the exit status:
+// 0=pass, 1=the -until text never appeared, 2=the script couldn't be read,
+// 3=the results couldn't be saved.
+static int
+runTest(const std::string &script, const batch_opts_t &opts)
+{
+    clearDisplays();
+    const int64 end_ms = system2200::getSimTimeMs() + 1000LL*opts.seconds;
+    system2200::invokeKbScript(opts.kb_addr, opts.kb_term, script);
+    if (!system2200::isScriptModeActive(opts.kb_addr, opts.kb_term)) {
+        UI_error("Couldn't run '%s'", script.c_str());
+        return 2;
+    }
+
+    bool found = false;
+    while (system2200::getSimTimeMs() < end_ms) {
+        system2200::onIdle();
+        if (!opts.until_text.empty() && screenContains(opts.until_text)) {
+            found = true;
+            break;
+        }
+    }
+    flushDiskFiles();
+
+    const std::string out_file = script + ".out";
+    FILE *fp = fopen(out_file.c_str(), "w");
+    if (fp == nullptr) {
+        UI_error("Couldn't write '%s'", out_file.c_str());
+        return 3;
+    }
+    dumpOutputs(fp);
+    fclose(fp);
+    return (opts.until_text.empty() || found) ? 0 : 1;
+}
+
+
+// return false, after complaining, if the writes of a test to some
+// mounted disk image would be seen by other tests
+static bool
+diskWritesArePrivate()
+{
+    bool ok = true;
+    int slot;
+    for (int ctrl=0; system2200::findDiskController(ctrl, &slot); ctrl++) {
+        for (int drive=0; drive < 4; drive++) {
+            std::string filename;
+            if (IoCardDisk::wvdGetFilename(slot, drive, &filename) &&
+                !IoCardDisk::wvdWritesArePrivate(slot, drive)) {
+                UI_warn("'%s' can't be mapped copy-on-write, so each test\n"
+                        "will see what the ones before it wrote to it",
+                        filename.c_str());
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+
+// fork one child per test from the machine as it stands, keeping up to
+// 'jobs' of them running, then report how each one did.  the disk images
+// are remapped copy-on-write first, so each test starts with the disks as
+// they are now, and no test sees what another writes.  if an image can't
+// be, eg, a compressed one, the tests run one at a time, so at least the
+// results don't depend on the order the host runs them in.
+// returns 0 if every test passed, otherwise 1.
+static int
+runBatch(const std::vector<std::string> &tests, int jobs,
+         const batch_opts_t &opts)
+{
+    flushDiskFiles();
+    Wvd::setPrivateWrites();
+    if (!diskWritesArePrivate()) {
+        jobs = 1;
+    }
+    flushDiskFiles();  // each child reopens the images for itself
+    fflush(nullptr);  // or the children would repeat anything buffered
+
+    std::vector<int> status(tests.size(), -1);
+    std::map<pid_t, int> running;   // child pid -> index into tests[]
+    size_t next = 0;
+
+    while ((next < tests.size()) || !running.empty()) {
+        if ((next < tests.size()) && (static_cast<int>(running.size()) < jobs)) {
+            const pid_t pid = fork();
+            if (pid == 0) {
+                // the child doesn't clean up; it shares everything with
+                // the parent, which does that once all children are done
+                _exit(runTest(tests[next], opts));
+            }
+            if (pid < 0) {
+                UI_error("Couldn't start a process for '%s'", tests[next].c_str());
+            } else {
+                running[pid] = static_cast<int>(next);
+            }
+            next++;
+            continue;
+        }
+
+        int wstatus = 0;
+        const pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            break;
+        }
+        auto it = running.find(pid);
+        if (it != running.end()) {
+            status[it->second] = (WIFEXITED(wstatus)) ? WEXITSTATUS(wstatus) : -1;
+            running.erase(it);
+        }
+    }
+
+    int passed = 0;
+    for (size_t n=0; n < tests.size(); n++) {
+        const char *result = (status[n] == 0) ? "PASS"
+                           : (status[n] == 1) ? "FAIL"
+                                              : "ERROR";
+        printf("%-5s %s\n", result, tests[n].c_str());
+        passed += (status[n] == 0) ? 1 : 0;
+    }
+    printf("%d of %d passed\n", passed, static_cast<int>(tests.size()));
+    fflush(stdout);
+
+    return (passed == static_cast<int>(tests.size())) ? 0 : 1;
+}
+
+// ============================================================================
+// many machines in one process
+// ============================================================================
+
+// what each machine of a -machines run is asked to do
+struct machines_opts_t {
+    int         kb_addr;        // keyboard which receives the script
+    int         kb_term;        // terminal number of that keyboard
+    int         seconds;        // emulated time to run for
+    bool        reset;          // press RESET 3 seconds in
+    std::string script;         // script to feed the keyboard, if any
+};
+
+// one of the machines of a -machines run
+struct machine_t {
+    std::unique_ptr<System2200> sys;
+    int64 start_ns      = 0;     // emulated time the run started at
+    bool  reset_pending = false; // -reset hasn't been pressed yet
+};
+
+
+// build a copy of the machine the UI is attached to, with the same disks
+// mounted.  the copies all share the disk images, so the workload shouldn't
+// write to them.
+static std::unique_ptr<System2200>
+cloneMachine()
+{
+    auto sys = std::make_unique<System2200>(system2200::config());
+    int slot;
+    for (int ctrl=0; system2200::findDiskController(ctrl, &slot); ctrl++) {
+        auto disk = dynamic_cast<IoCardDisk*>(sys->getInstFromSlot(slot));
+        assert(disk != nullptr);
+        for (int drive=0; drive < 4; drive++) {
+            const int stat = IoCardDisk::wvdDriveStatus(slot, drive);
+            std::string filename;
+            if (((stat & IoCardDisk::WVD_STAT_DRIVE_OCCUPIED) != 0) &&
+                IoCardDisk::wvdGetFilename(slot, drive, &filename)) {
+                (void)disk->insertDisk(drive, filename);
+            }
+        }
+    }
+    sys->reset(true);
+    sys->regulateCpuSpeed(false);
+    return sys;
+}
+
+
+// run one timeslice of the machine.  returns false once it is done.
+static bool
+stepMachine(machine_t *m, const machines_opts_t &opts)
+{
+    System2200 &sys = *m->sys;
+    if (m->reset_pending && (sys.getSimTimeNs() >= m->start_ns + 3000000000LL)) {
+        sys.dispatchKeystroke(opts.kb_addr, opts.kb_term,
+                              IoCardKeyboard::KEYCODE_RESET);
+        if (!opts.script.empty()) {
+            sys.invokeKbScript(opts.kb_addr, opts.kb_term, opts.script);
+        }
+        m->reset_pending = false;
+    }
+    if (sys.simulateSlice() < 0) {
+        return false;  // the cpu has stopped
+    }
+    return (sys.getSimTimeNs() < m->start_ns + 1000000000LL*opts.seconds);
+}
+
+
+// step all the machines with a pool of 'jobs' threads.  a thread takes a
+// machine from the ready list, runs one timeslice of it, and puts it back
+// on the end, so no machine gets far ahead of the rest.
+static void
+runMachines(std::vector<machine_t> &machines, int jobs,
+            const machines_opts_t &opts)
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<machine_t*> ready;
+    int remaining = static_cast<int>(machines.size());
+    for (auto &m : machines) {
+        ready.push_back(&m);
+    }
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            cv.wait(lock, [&]() { return !ready.empty() || (remaining == 0); });
+            if (remaining == 0) {
+                return;
+            }
+            machine_t *m = ready.front();
+            ready.pop_front();
+            lock.unlock();
+            const bool more = stepMachine(m, opts);
+            lock.lock();
+            if (more) {
+                ready.push_back(m);
+                cv.notify_one();
+            } else if (--remaining == 0) {
+                cv.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int n=0; n < jobs; n++) {
+        pool.emplace_back(worker);
+    }
+    for (auto &thread : pool) {
+        thread.join();
+    }
+}
+
+
+// build the machines, run them, and report how fast it all went.
+// returns 0 on success, or 2 if a state couldn't be restored.
+static int
+runManyMachines(int num_machines, int jobs, const std::string &load_file,
+                const machines_opts_t &opts)
+{
+    std::vector<machine_t> machines(num_machines);
+    int64 start_sim_ns = 0;
+    for (auto &m : machines) {
+        m.sys = cloneMachine();
+        if (!load_file.empty() && !m.sys->loadState(load_file)) {
+            return 2;
+        }
+        m.start_ns = m.sys->getSimTimeNs();
+        if (opts.reset) {
+            m.reset_pending = true;
+        } else if (!opts.script.empty()) {
+            m.sys->invokeKbScript(opts.kb_addr, opts.kb_term, opts.script);
+        }
+        start_sim_ns += m.start_ns;
+    }
+
+    const int64 start_ns = host::getTimeNs();
+    runMachines(machines, jobs, opts);
+    const double real_s = static_cast<double>(host::getTimeNs() - start_ns) * 1.0e-9;
+
+    int64 sim_ns = -start_sim_ns;
+    for (auto const &m : machines) {
+        sim_ns += m.sys->getSimTimeNs();
+    }
+    const double sim_s = static_cast<double>(sim_ns) * 1.0e-9;
+    printf("%3d machines, %2d threads: %8.1f emulated s in %6.2f real s, "
+           "%7.1fx real time in total, %6.1fx per machine\n",
+           num_machines, jobs, sim_s, real_s,
+           sim_s / real_s, sim_s / real_s / num_machines);
+    fflush(stdout);
+    return 0;
+}
+
+// ============================================================================
+// run statistics
+// ============================================================================
+
+// counters sampled at the start and end of a run
+struct run_sample_t {
+    int64         host_ns;  // host::getTimeNs()
+    int64         sim_ns;   // emulated time
+    uint64        ops;      // cpu microinstructions
+    sched_stats_t sched;    // scheduler activity, in total and per device
+};
+
+
+static run_sample_t
+sampleRun()
+{
+    const System2200 &sys = system2200::machine();
+    run_sample_t sample;
+    sample.host_ns   = host::getTimeNs();
+    sample.sim_ns    = sys.getSimTimeNs();
+    sample.ops       = sys.getCpuOpCount();
+    sample.sched     = sys.getSchedulerStats();
+    return sample;
+}
+
+
+// return str as a quoted JSON string
+static std::string
+jsonString(const std::string &str)
+{
+    std::string out("\"");
+    for (const char ch : str) {
+        if ((ch == '"') || (ch == '\\')) {
+            out += '\\';
+            out += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            char buff[8];
+            snprintf(&buff[0], sizeof(buff), "\\u%04x", ch);
+            out += &buff[0];
+        } else {
+            out += ch;
+        }
+    }
+    return out + '"';
+}
+
+
+// peak resident set size of this process, in KB
+static long
+peakRssKB()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes
+#else
+    return usage.ru_maxrss;         // KB
+#endif
+}
+
+
+// return the timer activity of each device which was active between
+// the two samples as a JSON object, keyed by the timer owner name
+static std::string
+schedOwnersJson(const sched_stats_t &before, const sched_stats_t &after)
+{
+    std::string out("{");
+    const int num_before = static_cast<int>(before.owner.size());
+    for (int n=0; n < static_cast<int>(after.owner.size()); n++) {
+        // owners are only ever appended, so they line up
+        const sched_owner_stats_t  zero;
+        const sched_owner_stats_t &b = (n < num_before) ? before.owner[n] : zero;
+        const sched_owner_stats_t &a = after.owner[n];
+        const uint64 fired = a.fired - b.fired;
+        if ((a.armed == b.armed) && (fired == 0)) {
+            continue;
+        }
+        char buff[200];
+        snprintf(&buff[0], sizeof(buff),
+                 "%s: {\"armed\": %llu, \"fired\": %llu, \"avg_late_ns\": %lld, "
+                 "\"host_us\": %lld}",
+                 jsonString(a.name).c_str(),
+                 static_cast<unsigned long long>(a.armed - b.armed),
+                 static_cast<unsigned long long>(fired),
+                 static_cast<long long>((fired > 0) ? (a.late_ns - b.late_ns)/static_cast<int64>(fired) : 0),
+                 static_cast<long long>((a.host_ns - b.host_ns) / 1000));
+        out += (out.size() > 1) ? ", " : "";
+        out += &buff[0];
+    }
+    return out + '}';
+}
+
+
+// return how write-behind (disk sync=background) has fared for each disk
+// image written since it was opened, as a JSON object keyed by file name.
+// the writes still pending are flushed first, so they are counted too.
+static std::string
+diskFlushJson()
+{
+    std::string out("{");
+    int slot;
+    for (int ctrl=0; system2200::findDiskController(ctrl, &slot); ctrl++) {
+        for (int drive=0; drive < 4; drive++) {
+            std::string filename;
+            if (!IoCardDisk::wvdGetFilename(slot, drive, &filename)) {
+                continue;
+            }
+            IoCardDisk::wvdFlush(slot, drive);
+            Wvd::flush_stats_t st;
+            if (!IoCardDisk::wvdGetFlushStats(slot, drive, &st) ||
+                (st.writes == 0)) {
+                continue;
+            }
+            const double flushes = static_cast<double>(st.flushes);
+            char buff[300];
+            snprintf(&buff[0], sizeof(buff),
+                     "%s: {\"sector_writes\": %llu, \"dirty_hit_pct\": %.1f, "
+                     "\"flushes\": %llu, \"avg_flush_sectors\": %.1f, "
+                     "\"avg_flush_runs\": %.1f}",
+                     jsonString(filename).c_str(),
+                     static_cast<unsigned long long>(st.writes),
+                     100.0 * static_cast<double>(st.absorbed)
+                           / static_cast<double>(st.writes),
+                     static_cast<unsigned long long>(st.flushes),
+                     (st.flushes > 0) ? static_cast<double>(st.sectors) / flushes : 0.0,
+                     (st.flushes > 0) ? static_cast<double>(st.runs) / flushes : 0.0);
+            out += (out.size() > 1) ? ", " : "";
+            out += &buff[0];
+        }
+    }
+    return out + '}';
+}
+
+
+// print one JSON object describing the run between the two samples.
+// the rates are per second of host time.
+static void
+printStats(FILE *fp, const run_sample_t &start, const run_sample_t &end,
+           const std::string &workload)
+{
+    const auto cpu_cfg = system2200::getCpuConfig(system2200::config().getCpuType());
+    const double real_s = static_cast<double>(end.host_ns - start.host_ns) * 1.0e-9;
+    const double sim_s  = static_cast<double>(end.sim_ns - start.sim_ns) * 1.0e-9;
+    const uint64 ops    = end.ops - start.ops;
+    const uint64 cbs    = end.sched.fired - start.sched.fired;
+    const double per_s  = (real_s > 0.0) ? (1.0 / real_s) : 0.0;
+
+    fprintf(fp, "{\"cpu\": %s, \"ram_kb\": %d, \"workload\": %s, "
+                "\"emulated_s\": %.3f, \"real_s\": %.3f, \"speed_ratio\": %.2f, "
+                "\"uops\": %llu, \"uops_per_s\": %.0f, "
+                "\"sched_callbacks\": %llu, \"sched_callbacks_per_s\": %.0f, "
+                "\"sched_owners\": %s, \"disk_flush\": %s, "
+                "\"peak_rss_kb\": %ld}\n",
+            jsonString((cpu_cfg != nullptr) ? cpu_cfg->label : "?").c_str(),
+            system2200::config().getRamKB(),
+            jsonString(workload).c_str(),
+            sim_s, real_s, sim_s * per_s,
+            static_cast<unsigned long long>(ops), static_cast<double>(ops) * per_s,
+            static_cast<unsigned long long>(cbs), static_cast<double>(cbs) * per_s,
+            schedOwnersJson(start.sched, end.sched).c_str(),
+            diskFlushJson().c_str(),
+            peakRssKB());
+    fflush(fp);
+}
+
+// ============================================================================
+// entry point
+// ============================================================================
+
+// shut down the universe
+static void
+shutDown()
+{
+    system2200::terminate();
+    while (system2200::onIdle()) {
+    }
+    host::terminate();
+}
+
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -ini <file>           seed the configuration from a wangemu.ini file\n"
+        "  -set <group/key=val>  override a configuration entry,\n"
+        "                        eg -set cpu/cpu=2200VP\n"
+        "                           -set io/slot-2/filename-0=disks/vp-boot-2.4.wvd\n"
+        "  -script <file>        feed a .w22 script file to the keyboard\n"
+        "  -kb <addr>[:<term>]   keyboard to receive the script (default: the\n"
+        "                        first keyboard, else MXD terminal #1)\n"
+        "  -reset                press RESET 3 seconds into the run, before the\n"
+        "                        script starts (eg, to boot VP microcode from disk)\n"
+        "  -seconds <n>          stop after n seconds of emulated time (default 10)\n"
+        "                        -reset and -seconds count from the start of the\n"
+        "                        run, which with -load-state is the saved time\n"
+        "  -until <text>         stop as soon as some display shows <text>\n"
+        "  -regulated            run at real 2200 speed (default: unregulated)\n"
+        "  -dump                 print display and printer contents on exit\n"
+        "  -load-state <file>    resume from a saved machine state\n"
+        "  -save-state <file>    save the machine state on exit\n"
+        "                        (with -batch, once booted, before forking)\n"
+        "  -record <file>        log the input of this run, with the simulated\n"
+        "                        time of each keystroke, script and reset\n"
+        "  -replay <file>        feed in the input logged by -record, and run\n"
+        "                        until the recorded session ends, instead of\n"
+        "                        -seconds.  start it with the same -ini and\n"
+        "                        -load-state as the recording\n"
+        "  -batch <file>         run each script listed in the file, one per\n"
+        "                        line, in a process of its own forked from the\n"
+        "                        booted machine.  -script is then a boot script,\n"
+        "                        which is run to completion before forking.\n"
+        "                        the displays are blanked before each test,\n"
+        "                        -seconds and -until apply to each test, and\n"
+        "                        the displays and printers of each test are\n"
+        "                        written to <script>.out.  a test whose\n"
+        "                        script can't be read is an ERROR.  each test\n"
+        "                        sees the disks as they were when booted, and\n"
+        "                        its writes are thrown away.  if a writable\n"
+        "                        image can't be kept private that way (eg, it\n"
+        "                        is compressed), the tests run one at a time\n"
+        "  -stats                print the speed of the run as a JSON object:\n"
+        "                        cpu microinstructions, emulated to real time\n"
+        "                        ratio, scheduler callbacks, in total and per\n"
+        "                        device, write-behind disk flushing, and peak RSS\n"
+        "  -jobs <n>             run at most n tests at once (default: #cores)\n"
+        "  -machines <n>         run n copies of the machine at once in this\n"
+        "                        process, stepped by -jobs threads, each one\n"
+        "                        unregulated and fed -script, and report the\n"
+        "                        aggregate speed.  the copies share the disk\n"
+        "                        images, so the script shouldn't write to them\n"
+        "  -overlay <file> <base>  make <file> an empty overlay on the disk image\n"
+        "                        <base>; a relative <base> is taken from the\n"
+        "                        directory of <file>\n"
+        "  -commit-overlay <file>  write the sectors held by the overlay into\n"
+        "                        its base image, and empty the overlay\n"
+        "  -discard-overlay <file> empty the overlay\n"
+        "  -compress <from> <to> write a compressed copy of a disk image\n"
+        "  -expand <from> <to>   write a plain copy of a compressed disk image\n"
+        "the overlay and conversion options can't be used with any others.\n"
+        "exit status is 0 on success, 1 if -until text never appeared\n"
+        "(or with -batch, if any test failed), and 2 for command line errors,\n"
+        "a state or input log which couldn't be used, or no keyboard\n",
+        progname);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    std::string ini_file;
+    std::vector<std::string> overrides;
+    std::string script_file;
+    std::string until_text;
+    std::string load_file;
+    std::string save_file;
+    std::string batch_file;
+    std::string record_file;
+    std::string replay_file;
+    std::string image_op;
+    std::string image_file;
+    std::string image_arg;
+    int  jobs      = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    int  machines  = 0;
+    int  kb_addr   = -1;
+    int  kb_term   = 0;
+    int  seconds   = 10;
+    bool regulated = false;
+    bool dump      = false;
+    bool reset     = false;
+    bool stats     = false;
+
+    for (int n=1; n < argc; n++) {
+        const std::string arg(argv[n]);
+        const bool has_val = (n+1 < argc);
+        if (arg == "-ini" && has_val) {
+            ini_file = argv[++n];
+        } else if (arg == "-set" && has_val) {
+            overrides.emplace_back(argv[++n]);
+        } else if (arg == "-script" && has_val) {
+            script_file = argv[++n];
+        } else if (arg == "-kb" && has_val) {
+            char *endp = nullptr;
+            kb_addr = static_cast<int>(strtol(argv[++n], &endp, 16));
+            if (*endp == ':') {
+                kb_term = static_cast<int>(strtol(endp+1, &endp, 10)) - 1;
+            }
+            if ((*endp != '\0') || (kb_term < 0) || (kb_term > 3)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "-seconds" && has_val) {
+            seconds = atoi(argv[++n]);
+        } else if (arg == "-until" && has_val) {
+            until_text = argv[++n];
+        } else if (arg == "-reset") {
+            reset = true;
+        } else if (arg == "-regulated") {
+            regulated = true;
+        } else if (arg == "-dump") {
+            dump = true;
+        } else if (arg == "-stats") {
+            stats = true;
+        } else if (arg == "-load-state" && has_val) {
+            load_file = argv[++n];
+        } else if (arg == "-save-state" && has_val) {
+            save_file = argv[++n];
+        } else if (arg == "-record" && has_val) {
+            record_file = argv[++n];
+        } else if (arg == "-replay" && has_val) {
+            replay_file = argv[++n];
+        } else if (arg == "-batch" && has_val) {
+            batch_file = argv[++n];
+        } else if (arg == "-jobs" && has_val) {
+            jobs = atoi(argv[++n]);
+        } else if (arg == "-machines" && has_val) {
+            machines = atoi(argv[++n]);
+        } else if ((arg == "-overlay" || arg == "-compress" || arg == "-expand") &&
+                   (n+2 < argc)) {
+            image_op   = arg;
+            image_file = argv[++n];
+            image_arg  = argv[++n];
+        } else if ((arg == "-commit-overlay" || arg == "-discard-overlay") &&
+                   has_val) {
+            image_op   = arg;
+            image_file = argv[++n];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // these don't need a machine
+    if (!image_op.empty()) {
+        if (argc != ((image_arg.empty()) ? 3 : 4)) {
+            usage(argv[0]);
+            return 2;
+        }
+        const bool ok = (image_op == "-overlay")  ? Wvd::createOverlay(image_file, image_arg)
+                      : (image_op == "-compress") ? Wvd::compressImage(image_file, image_arg)
+                      : (image_op == "-expand")   ? Wvd::expandImage(image_file, image_arg)
+                      : (image_op == "-commit-overlay") ? Wvd::commitOverlay(image_file)
+                                                        : Wvd::discardOverlay(image_file);
+        return (ok) ? 0 : 1;
+    }
+
+    if ((machines > 0) &&
+        (dump || stats || regulated || (jobs < 1) || !batch_file.empty() ||
+         !until_text.empty() || !save_file.empty() ||
+         !record_file.empty() || !replay_file.empty())) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!replay_file.empty() &&
+        (reset || regulated || !script_file.empty() ||
+         !batch_file.empty() || !record_file.empty())) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<std::string> tests;
+    if (!batch_file.empty()) {
+        if (dump || stats || (jobs < 1) || !record_file.empty()) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (!readTestList(batch_file, &tests)) {
+            UI_error("Couldn't read '%s'", batch_file.c_str());
+            return 2;
+        }
+    }
+
+    host::initialize();
+
+    if (!ini_file.empty() && !host::configLoadFile(ini_file)) {
+        UI_error("Couldn't read '%s'", ini_file.c_str());
+        return 2;
+    }
+    for (auto const &setting : overrides) {
+        if (!host::configSetOverride(setting)) {
+            UI_error("Malformed setting '%s'", setting.c_str());
+            return 2;
+        }
+    }
+
+    system2200::initialize();  // build the world
+    system2200::reset(true);   // cold start
+    system2200::regulateCpuSpeed(regulated);
+
+    if (!batch_file.empty() && (system2200::config().getMxdWindowNs() > 0)) {
+        // worker threads don't survive a fork
+        UI_error("-batch can't be used with misc/mxd_window_ns");
+        shutDown();
+        return 2;
+    }
+
+    if ((kb_addr < 0) && !findDefaultKb(&kb_addr, &kb_term) &&
+        (reset || !script_file.empty() || !batch_file.empty())) {
+        UI_error("There is no keyboard for -reset or -script to use");
+        shutDown();
+        return 2;
+    }
+
+    if (machines > 0) {
+        const machines_opts_t opts = { kb_addr, kb_term, seconds, reset, script_file };
+        const int status = runManyMachines(machines, jobs, load_file, opts);
+        shutDown();
+        return status;
+    }
+
+    if (!load_file.empty() && !system2200::loadState(load_file)) {
+        shutDown();
+        return 2;
+    }
+
+    // -reset and -seconds count from here, which is after the snapshot,
+    // if one was loaded, as they do for each test of a batch
+    const int64 start_ms = system2200::getSimTimeMs();
+    const run_sample_t start_sample = sampleRun();
+
+    if ((!record_file.empty() && !system2200::startRecording(record_file)) ||
+        (!replay_file.empty() && !system2200::startReplay(replay_file))) {
+        shutDown();
+        return 2;
+    }
+
+    if (reset) {
+        // route it through the keyboard handler because the MXD
+        // filters out resets which aren't from terminal #1
+        while (system2200::getSimTimeMs() < start_ms + 3000) {
+            system2200::onIdle();
+        }
+        system2200::dispatchKeystroke(kb_addr, kb_term,
+                                      IoCardKeyboard::KEYCODE_RESET);
+    }
+
+    if (!script_file.empty()) {
+        system2200::invokeKbScript(kb_addr, kb_term, script_file);
+    }
+
+    if (!batch_file.empty()) {
+        // finish booting, then run the tests from there
+        while (system2200::isScriptModeActive(kb_addr, kb_term)) {
+            system2200::onIdle();
+        }
+        if (!save_file.empty()) {
+            (void)system2200::saveState(save_file);
+        }
+        const batch_opts_t opts = { kb_addr, kb_term, seconds, until_text };
+        const int status = runBatch(tests, jobs, opts);
+        shutDown();
+        return status;
+    }
+
+    bool found = false;
+    while (replay_file.empty() ? (system2200::getSimTimeMs() < start_ms + 1000LL*seconds)
+                               : system2200::isReplaying()) {
+        system2200::onIdle();
+        if (!until_text.empty() && screenContains(until_text)) {
+            found = true;
+            break;
+        }
+    }
+
+    const run_sample_t end_sample = sampleRun();
+
+    if (!save_file.empty()) {
+        (void)system2200::saveState(save_file);
+    }
+
+    if (dump) {
+        dumpOutputs(stdout);
+    }
+
+    if (stats) {
+        const std::string &workload = (!replay_file.empty()) ? replay_file
+                                                              : script_file;
+        printStats(stdout, start_sample, end_sample, workload);
+    }
+
+    shutDown();
+
+    return (until_text.empty() || found) ? 0 : 1;
+}
+
+// vim: ts=8:et:sw=4:smarttab
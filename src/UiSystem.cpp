@@ -10,13 +10,14 @@
 // declarations
 // ============================================================================
 
-struct crt_state_t;
+class CrtStateSnapshot;
 
 // ----------------------------------------------------------------------------
 // headers
 // ----------------------------------------------------------------------------
 
 #include "Cpu2200.h"
+#include "Pacer.h"              // for pace_stats_t
 #include "Ui.h"
 #include "UiCrtFrame.h"
 #include "UiDiskCtrlCfgDlg.h"
@@ -33,6 +34,9 @@ struct crt_state_t;
 
 #include "wx/cmdline.h"         // req'd by wxCmdLineParser
 #include "wx/filename.h"
+#include "wx/thread.h"           // wxThread::IsMain()
+
+#include <future>
 
 // ============================================================================
 // implementation
@@ -76,7 +80,12 @@ TheApp::OnInit()
 
     // must call base class version to get command line processing
     // if false, the app terminates
-    return wxApp::OnInit();
+    if (!wxApp::OnInit()) {
+        return false;
+    }
+
+    system2200::startEmulationThread();
+    return true;
 }
 
 
@@ -97,6 +106,9 @@ TheApp::OnIdle(wxIdleEvent &event)
 int
 TheApp::OnExit()
 {
+    // normally this has already happened in onIdle()
+    system2200::stopEmulationThread();
+
     // clean up, which includes saving .ini file
     host::terminate();
 
@@ -104,6 +116,33 @@ TheApp::OnExit()
 }
 
 
+// every event handler runs through here.  the emulation thread is kept out
+// of the world while a handler runs, except for those events which are known
+// to touch only UI state: painting, timers which pull in published screen
+// state, and keystrokes, which are passed along via queueKeystroke().
+// idle events are excluded because onIdle() manages the lock itself.
+void
+TheApp::CallEventHandler(wxEvtHandler *handler,
+                         wxEventFunctor &functor,
+                         wxEvent &event) const
+{
+    const wxEventType type = event.GetEventType();
+    if ((type == wxEVT_PAINT)            ||
+        (type == wxEVT_ERASE_BACKGROUND) ||
+        (type == wxEVT_TIMER)            ||
+        (type == wxEVT_CHAR)             ||
+        (type == wxEVT_KEY_DOWN)         ||
+        (type == wxEVT_KEY_UP)           ||
+        (type == wxEVT_IDLE)) {
+        wxApp::CallEventHandler(handler, functor, event);
+        return;
+    }
+
+    auto lock = system2200::lockWorld();
+    wxApp::CallEventHandler(handler, functor, event);
+}
+
+
 // set the command line parsing options
 void
 TheApp::OnInitCmdLine(wxCmdLineParser& parser)
@@ -115,6 +154,7 @@ TheApp::OnInitCmdLine(wxCmdLineParser& parser)
 
     // add options specific to this app
     parser.AddOption("s", "script", "script file to load on startup", wxCMD_LINE_VAL_STRING);
+    parser.AddOption("r", "restore", "machine state to resume from", wxCMD_LINE_VAL_STRING);
 }
 
 
@@ -149,6 +189,10 @@ TheApp::OnCmdLineParsed(wxCmdLineParser& parser)
             }
         }
 #endif
+        // the world has been built, but the emulation thread hasn't started
+        if (parser.Found("r", &filename)) {
+            (void)system2200::loadState(std::string(filename.c_str()));
+        }
     }
 
     return ok;
@@ -268,25 +312,44 @@ TheApp::makeHelpMenu(wxWindow *win)
 
 // shared code
 static bool
-UI_AlertMsg(long style, const std::string &title, const char *fmt, va_list &args)
+UI_AlertMsg(long style, const std::string &title, const std::string &info)
 {
-    char buff[1000];
-    vsnprintf(&buff[0], sizeof(buff), fmt, args);
-
-    std::string info(&buff[0]);
     wxMessageDialog dialog(nullptr, info, title, style);
     const int rv = dialog.ShowModal();
     return (rv == wxID_YES);
 }
 
 
+static std::string
+UI_FormatMsg(const char *fmt, va_list &args)
+{
+    char buff[1000];
+    vsnprintf(&buff[0], sizeof(buff), fmt, args);
+    return std::string(&buff[0]);
+}
+
+
+// the emulation thread doesn't wait around for the user to acknowledge
+// a notification; the main thread puts it up when it gets around to it.
+static void
+UI_NotifyMsg(long style, const std::string &title, const char *fmt, va_list &args)
+{
+    const std::string info = UI_FormatMsg(fmt, args);
+    if (wxThread::IsMain()) {
+        UI_AlertMsg(style, title, info);
+    } else {
+        wxTheApp->CallAfter([=](){ UI_AlertMsg(style, title, info); });
+    }
+}
+
+
 // error icon
 void
 UI_error(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    UI_AlertMsg(wxICON_ERROR, "Error", fmt, args);
+    UI_NotifyMsg(wxICON_ERROR, "Error", fmt, args);
     va_end(args);
 }
 
@@ -297,7 +360,7 @@ UI_warn(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    UI_AlertMsg(wxICON_EXCLAMATION, "Warning", fmt, args);
+    UI_NotifyMsg(wxICON_EXCLAMATION, "Warning", fmt, args);
     va_end(args);
 }
 
@@ -307,7 +370,7 @@ UI_info(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    UI_AlertMsg(wxICON_INFORMATION, "Information", fmt, args);
+    UI_NotifyMsg(wxICON_INFORMATION, "Information", fmt, args);
     va_end(args);
 }
 
@@ -321,10 +384,21 @@ UI_confirm(const char *fmt, ...)
 
     va_list args;
     va_start(args, fmt);
-    const bool rv = UI_AlertMsg(style, "Question", fmt, args);
+    const std::string info = UI_FormatMsg(fmt, args);
     va_end(args);
 
-    return rv;
+    if (wxThread::IsMain()) {
+        return UI_AlertMsg(style, "Question", info);
+    }
+
+    // the emulation thread needs the answer before it can go on
+    std::promise<bool> answer;
+    std::future<bool> reply = answer.get_future();
+    wxTheApp->CallAfter([&](){
+        answer.set_value(UI_AlertMsg(style, "Question", info));
+    });
+    system2200::waitOnUi([&](){ reply.wait(); });
+    return reply.get();
 }
 
 // ========================================================================
@@ -339,7 +413,7 @@ UI_confirm(const char *fmt, ...)
 // called at the start of time to create the actual display
 std::shared_ptr<CrtFrame>
 UI_displayInit(const int screen_type, const int io_addr, const int term_num,
-               crt_state_t *crt_state)
+               std::shared_ptr<CrtStateSnapshot> crt_state)
 {
     const int cpu_type = system2200::config().getCpuType();
     const char *cpu_str = (cpu_type == Cpu2200::CPUTYPE_2200B)   ? "2200B"
@@ -388,22 +462,37 @@ UI_displayDestroy(CrtFrame *wnd)
 void UI_displayDing(CrtFrame *wnd)
 {
     assert(wnd != nullptr);
-    wnd->ding();
+    if (wxThread::IsMain()) {
+        wnd->ding();
+    } else {
+        wnd->CallAfter([wnd](){ wnd->ding(); });
+    }
 }
 
 
 // inform the UI how far along the simulation is in emulated time
 void
-UI_setSimSeconds(unsigned long seconds, float relative_speed)
+UI_setSimSeconds(unsigned long seconds, float relative_speed,
+                 const pace_stats_t &pacing)
 {
-    CrtFrame::setSimSeconds(seconds, relative_speed);
+    if (wxThread::IsMain()) {
+        CrtFrame::setSimSeconds(seconds, relative_speed, pacing);
+    } else {
+        wxTheApp->CallAfter([=](){
+            CrtFrame::setSimSeconds(seconds, relative_speed, pacing);
+        });
+    }
 }
 
 
 void
 UI_diskEvent(int slot, int drive)
 {
-    CrtFrame::diskEvent(slot, drive);
+    if (wxThread::IsMain()) {
+        CrtFrame::diskEvent(slot, drive);
+    } else {
+        wxTheApp->CallAfter([=](){ CrtFrame::diskEvent(slot, drive); });
+    }
 }
 
 
@@ -434,7 +523,12 @@ void
 UI_printerChar(PrinterFrame *wnd, uint8 byte)
 {
     assert(wnd != nullptr);
-    wnd->printChar(byte);
+    if (wxThread::IsMain()) {
+        wnd->printChar(byte);
+    } else {
+        // if the window goes away first, wx discards the pending call
+        wnd->CallAfter([wnd, byte](){ wnd->printChar(byte); });
+    }
 }
 
 // ---- system configuration wrapper ----
@@ -1,7 +1,12 @@
 // TheApp is where the emulator first "wakes up", in the OnInit() function.
-// The OnIdle() event handler is the point where the core emulation runs,
-// that is, emulated time passes.  The emulation doens't happen in this class;
-// instead the OnIdle gets reflected into the core system2200 class.
+// Emulated time passes on a thread of its own, started at the end of OnInit().
+// The OnIdle() event handler is still reflected into the core system2200
+// class, which uses it to handle reconfiguration and shutdown requests.
+//
+// Only the main thread touches wx.  Any UI_* call made from the emulation
+// thread is marshalled over to the main thread with CallAfter(), and every
+// event handler which might touch emulator state runs with the world lock
+// held (see CallEventHandler()).
 //
 // The rest of it is just a pachinko machine of events to redraw the screen
 // and handle user interaction.
@@ -48,6 +53,11 @@ private:
     // called whenever there is nothing else to do
     void OnIdle(wxIdleEvent &event);
 
+    // wrapper around every event handler invocation
+    void CallEventHandler(wxEvtHandler *handler,
+                          wxEventFunctor &functor,
+                          wxEvent &event) const override;
+
     static void getGlobalDefaults();
     static void saveGlobalDefaults();
 };
@@ -7,7 +7,27 @@
 #include "Wvd.h"
 #include "host.h"              // for dbglog()
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+// map disk images into memory, rather than using a file handle
+#define WVD_MAPPED 1
+
+// see Wvd::setPrivateWrites()
+static bool private_writes = false;
 
 #ifdef _DEBUG
     #define DBG  (0)            // turn on some debug logging
@@ -23,6 +43,214 @@
 // therefore the most platters a drive could ever have is 15 platters
 #define WVD_MAX_PLATTERS 15
 
+// =====================================================
+//   overlay files
+// =====================================================
+
+// an overlay starts with a header block:
+// bytes  0-  4: "WOVL\0"
+// bytes  5    : write format version
+// bytes  6    : read format version
+// bytes  8- 11: absolute sectors in the base image, header included
+// bytes 16-255: path to the base image; a relative path is taken from
+//               the directory holding the overlay
+// next is a bitmap, one bit per absolute sector, of the sectors held by the
+// overlay, padded to a whole number of blocks.  after that there is room
+// for every absolute sector of the base, in order.  the file is made with
+// a hole in place of the bitmap and sectors, so on most hosts the only
+// sectors which take up space are the ones which have been written.
+
+static const int OVERLAY_MAX_PATH = 240;
+
+static bool
+isOverlayHeader(const uint8 *data)
+{
+    return (memcmp(data, "WOVL", 5) == 0);
+}
+
+
+// returns false if the header is damaged or too new
+static bool
+parseOverlayHeader(const uint8 *data, int *sectors, std::string *base)
+{
+    if (!isOverlayHeader(data) || (data[6] != 0x00)) {
+        return false;
+    }
+    *sectors = static_cast<int>( (data[8] <<  0) | (data[9]  <<  8) |
+                                 (data[10] << 16) | (data[11] << 24) );
+    if ((*sectors < 2) || (*sectors > 1 + WVD_MAX_PLATTERS*WVD_MAX_SECTORS)) {
+        return false;
+    }
+    const char *path = reinterpret_cast<const char*>(&data[16]);
+    if (memchr(path, 0, OVERLAY_MAX_PATH) == nullptr) {
+        return false;
+    }
+    *base = path;
+    return !base->empty();
+}
+
+
+// bytes taken by the bitmap for an image of the given number of sectors
+static size_t
+overlayBitmapSize(int sectors)
+{
+    const size_t bytes = (static_cast<size_t>(sectors) + 7) / 8;
+    return (bytes + 255) & ~static_cast<size_t>(255);
+}
+
+
+// a relative base path is relative to the overlay's directory
+static std::string
+overlayBasePath(const std::string &overlay, const std::string &base)
+{
+    const bool absolute = (base[0] == '/') || (base[0] == '\\') ||
+                          ((base.size() > 1) && (base[1] == ':'));
+    const size_t slash = overlay.find_last_of("/\\");
+    if (absolute || (slash == std::string::npos)) {
+        return base;
+    }
+    return overlay.substr(0, slash+1) + base;
+}
+
+// =====================================================
+//   background flusher
+// =====================================================
+
+// one thread looks after every image opened with SYNC_BACKGROUND.  it is
+// started when the first such image is mapped and stopped when the last
+// one is unmapped, so it is never left running when the headless batch
+// runner forks, nor at exit.
+class WvdFlusher
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(WvdFlusher);
+    WvdFlusher() = default;
+
+    static WvdFlusher &get();
+
+    // start/stop looking after an image.  once remove() returns, the
+    // thread is done with the image.
+    void add(Wvd *wvd);
+    void remove(Wvd *wvd);
+
+    // have the thread look over the images again; m_lock must be held
+    void poke();
+
+    std::mutex m_lock;              // guards this, and each image's dirty state
+
+private:
+    // the thread body
+    void run();
+
+    std::mutex              m_life_lock;        // serializes add() and remove()
+    std::condition_variable m_wake;             // the thread waits on this
+    std::condition_variable m_done;             // remove() waits on this
+    std::vector<Wvd*>       m_wvds;             // images being looked after
+    Wvd                    *m_busy  = nullptr;  // image being flushed right now
+    bool                    m_poked = false;
+    bool                    m_quit  = false;
+    std::thread             m_thread;
+};
+
+
+WvdFlusher &
+WvdFlusher::get()
+{
+    // never destroyed, so images closed on the way out can still use it
+    static WvdFlusher * const flusher = new WvdFlusher;
+    return *flusher;
+}
+
+
+void
+WvdFlusher::add(Wvd *wvd)
+{
+    std::lock_guard<std::mutex> life(m_life_lock);
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        start = m_wvds.empty();
+        m_wvds.push_back(wvd);
+        m_quit = false;
+    }
+    if (start) {
+        m_thread = std::thread(&WvdFlusher::run, this);
+    }
+}
+
+
+void
+WvdFlusher::remove(Wvd *wvd)
+{
+    std::lock_guard<std::mutex> life(m_life_lock);
+    bool stop = false;
+    {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_wvds.erase(std::remove(m_wvds.begin(), m_wvds.end(), wvd), m_wvds.end());
+        m_done.wait(lk, [&]{ return m_busy != wvd; });
+        stop = m_wvds.empty();
+        m_quit = stop;
+    }
+    if (stop) {
+        m_wake.notify_one();
+        m_thread.join();
+    }
+}
+
+
+void
+WvdFlusher::poke()
+{
+    m_poked = true;
+    m_wake.notify_one();
+}
+
+
+// find an image which is due to be flushed, flush it with the lock
+// released, and repeat.  if none are due, sleep until the first will be.
+void
+WvdFlusher::run()
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+    while (!m_quit) {
+        const auto now = Wvd::flush_clock_t::now();
+        auto wake = now + std::chrono::seconds(60);
+        Wvd *due_wvd = nullptr;
+        bool sync_file = false;
+        for (Wvd *wvd : m_wvds) {
+            const auto interval = std::chrono::milliseconds(wvd->m_flush_ms);
+            auto due = wake;
+            if (wvd->m_num_dirty > 0) {
+                const bool full = (wvd->m_flush_max_dirty > 0) &&
+                                  (wvd->m_num_dirty >= wvd->m_flush_max_dirty);
+                due = (full) ? now : wvd->m_first_dirty + interval;
+            } else if (wvd->m_flush_sync_idle && !wvd->m_file_synced) {
+                due = wvd->m_last_write + interval;
+                sync_file = true;
+            }
+            if (due <= now) {
+                due_wvd = wvd;
+                break;
+            }
+            sync_file = false;
+            wake = std::min(wake, due);
+        }
+
+        if (due_wvd != nullptr) {
+            m_busy = due_wvd;
+            lk.unlock();
+            due_wvd->flushDirty(sync_file);
+            lk.lock();
+            m_busy = nullptr;
+            m_done.notify_all();
+            continue;
+        }
+
+        m_wake.wait_until(lk, wake, [&]{ return m_poked || m_quit; });
+        m_poked = false;
+    }
+}
+
 // =====================================================
 //   public interface
 // =====================================================
@@ -49,7 +277,7 @@ Wvd::create(int disk_type, int platters, int sectors_per_platter)
 
 // open up an existing virtual disk file
 bool
-Wvd::open(const std::string &filename)
+Wvd::open(const std::string &filename, sync_t sync)
 {
     assert(m_file == nullptr);
     assert(!m_has_path);
@@ -71,8 +299,11 @@ Wvd::open(const std::string &filename)
 
     m_has_path = true;
     m_path = filename;
+    m_sync = sync;
+    m_flush_stats = flush_stats_t();
+    m_flush_failed = false;
 
-    const bool ok = readHeader();
+    const bool ok = loadImage();
     m_metadata_stale = !ok;
 
     return ok;
@@ -83,6 +314,11 @@ Wvd::open(const std::string &filename)
 void
 Wvd::close()
 {
+    unmapImage();
+    if (m_packed != nullptr) {
+        (void)m_packed->flush();
+        m_packed = nullptr;
+    }
     if (m_file != nullptr) {
         if (m_file->is_open()) {
             m_file->close();
@@ -98,6 +334,26 @@ Wvd::close()
     setNumSectors(0);
     setWriteProtect(false);
     setModified(false);
+    m_sync = SYNC_CACHE;
+    m_chunk_shift = -1;
+}
+
+// tuning for SYNC_BACKGROUND; see Wvd.h
+void
+Wvd::setFlushOpts(int interval_ms, int max_dirty, bool sync_idle) noexcept
+{
+    assert(m_map.addr == nullptr);
+    m_flush_ms        = std::max(1, interval_ms);
+    m_flush_max_dirty = std::max(0, max_dirty);
+    m_flush_sync_idle = sync_idle;
+}
+
+
+Wvd::flush_stats_t
+Wvd::getFlushStats() const
+{
+    std::lock_guard<std::mutex> lk(WvdFlusher::get().m_lock);
+    return m_flush_stats;
 }
 
 // -------------------------------------------------------------------------
@@ -271,6 +527,26 @@ Wvd::writeSector(int platter, int sector, const uint8 *buffer)
 }
 
 
+// return a pointer to the data of a logical sector, without copying it
+// if the image is mapped.  returns nullptr on failure.
+const uint8 *
+Wvd::sectorData(int platter, int sector, uint8 *buffer)
+{
+    assert(buffer != nullptr);
+    refreshMetadata();
+
+    assert(platter >= 0 && platter < m_num_platters);
+    assert(sector  >= 0 && sector  < m_num_platter_sectors);
+    assert(m_file != nullptr);
+
+    const int abs_sector = m_num_platter_sectors*platter + sector + 1;
+    if (m_map.addr != nullptr) {
+        return mappedSector(abs_sector);
+    }
+    return rawReadSector(abs_sector, buffer) ? buffer : nullptr;
+}
+
+
 // flush any pending write and close the filehandle,
 // but keep the association (unlike close())
 // this function is called when another function wants to touch
@@ -281,6 +557,11 @@ void
 Wvd::flush()
 {
     if (m_file != nullptr) {
+        unmapImage();
+        if (m_packed != nullptr) {
+            (void)m_packed->flush();
+            m_packed = nullptr;
+        }
         if (m_file->is_open()) {
             m_file->flush();
         }
@@ -322,6 +603,21 @@ Wvd::save(const std::string &filename)
     }
 }
 
+// from here on, writable mappings are made copy-on-write
+void
+Wvd::setPrivateWrites() noexcept
+{
+    private_writes = true;
+}
+
+
+bool
+Wvd::writesArePrivate()
+{
+    refreshMetadata();
+    return getWriteProtect() || m_map.copy;
+}
+
 // -------------------------------------------------------------------------
 // private functions: absolute sector access
 // -------------------------------------------------------------------------
@@ -336,7 +632,7 @@ Wvd::rawWriteSector(const int sector, const uint8 *data)
     assert(m_has_path);
     assert(sector >= 0 && sector < m_num_platters*m_num_platter_sectors+1);
     assert(data != nullptr);
-    assert(m_file->is_open());
+    assert((m_map.addr != nullptr) || m_file->is_open());
 
     if (DBG > 0) {
         dbglog("========== writing absolute sector %d ==========\n", sector);
@@ -350,6 +646,40 @@ Wvd::rawWriteSector(const int sector, const uint8 *data)
         }
     }
 
+    if (m_map.addr != nullptr) {
+        // data may point into the mapping, eg, when copying a sector
+        uint8 * const dst = m_map.addr + m_data_off + 256LL*sector;
+        memmove(dst, data, 256);
+        // an overlay holds the sector from now on
+        uint8 *bits = nullptr;
+        if (m_bitmap != nullptr) {
+            const uint8 bit = static_cast<uint8>(1 << (sector & 7));
+            if ((m_bitmap[sector >> 3] & bit) == 0) {
+                bits = &m_bitmap[sector >> 3];
+                *bits |= bit;
+            }
+        }
+        const bool wait = (m_sync == SYNC_WRITE);
+        if (m_sync == SYNC_BACKGROUND) {
+            markDirty(sector);
+        } else if ((m_sync != SYNC_CACHE) &&
+                   (!syncMapped(dst, 256, wait) ||
+                    ((bits != nullptr) && !syncMapped(bits, 1, wait)))) {
+            UI_error("Error writing to sector %d of '%s'",
+                      sector, m_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    if ((m_packed != nullptr) && (sector > 0)) {
+        // the chunk is written out when it drops out of the cache, or on
+        // flush(), unless the sync policy wants it written right away
+        return m_packed->writeSector(sector, data) &&
+               (((m_sync != SYNC_ASYNC) && (m_sync != SYNC_WRITE)) ||
+                m_packed->flush());
+    }
+
     // go to the start of the Nth sector
     m_file->seekp(256LL*sector);
     if (!m_file->good()) {
@@ -368,7 +698,9 @@ Wvd::rawWriteSector(const int sector, const uint8 *data)
         return false;
     }
 
-    // slower, but safer in case of unexpected shutdown
+    // slower, but safer in case of unexpected shutdown.
+    // a stream has no way to wait for the disk, so this is as good as
+    // any sync policy gets without a mapping.
     m_file->flush();
 
     return true;
@@ -383,23 +715,31 @@ Wvd::rawReadSector(const int sector, const uint8 *data)
     assert(m_has_path);
     assert(sector >= 0 && sector < m_num_platters*m_num_platter_sectors+1);
     assert(data != nullptr);
-    assert(m_file->is_open());
+    assert((m_map.addr != nullptr) || m_file->is_open());
 
-    // go to the start of the Nth sector
-    m_file->seekg(256LL * sector);
-    if (!m_file->good()) {
-        UI_error("Error seeking to read sector %d of '%s'",
-                 sector, m_path.c_str());
-        m_file->close();
-        return false;
-    }
+    if (m_map.addr != nullptr) {
+        memcpy(const_cast<uint8*>(data), mappedSector(sector), 256);
+    } else if ((m_packed != nullptr) && (sector > 0)) {
+        if (!m_packed->readSector(sector, const_cast<uint8*>(data))) {
+            return false;
+        }
+    } else {
+        // go to the start of the Nth sector
+        m_file->seekg(256LL * sector);
+        if (!m_file->good()) {
+            UI_error("Error seeking to read sector %d of '%s'",
+                     sector, m_path.c_str());
+            m_file->close();
+            return false;
+        }
 
-    m_file->read((char*)data, 256);
-    if (!m_file->good()) {
-        UI_error("Error reading from sector %d of '%s'",
-                 sector, m_path.c_str());
-        m_file->close();
-        return false;
+        m_file->read((char*)data, 256);
+        if (!m_file->good()) {
+            UI_error("Error reading from sector %d of '%s'",
+                     sector, m_path.c_str());
+            m_file->close();
+            return false;
+        }
     }
 
     if (DBG > 0) {
@@ -427,7 +767,8 @@ Wvd::rawReadSector(const int sector, const uint8 *data)
 // bytes  8-  9: number of sectors per platter
 // byte  10    : disk type
 // bytes 11    : number of platters minus one
-// bytes 12- 15: unused (zeros)
+// byte  12    : log2 of the sectors per chunk, for compressed images
+// bytes 13- 15: unused (zeros)
 // bytes 16-255: disk label
 // return true on success
 bool
@@ -458,6 +799,13 @@ Wvd::writeHeader()
     // usable.
     data[5] = static_cast<uint8>(0x00);  // write format version
     data[6] = static_cast<uint8>(0x00);  // read format version
+    if (m_chunk_shift >= 0) {
+        // a compressed image, which older emulators can't read at all;
+        // see WvdCompressed.cpp
+        data[5]  = static_cast<uint8>(0x01);
+        data[6]  = static_cast<uint8>(0x01);
+        data[12] = static_cast<uint8>(m_chunk_shift);
+    }
 
     data[7] = static_cast<uint8>(m_write_protect ? 1 : 0);
 
@@ -491,7 +839,7 @@ Wvd::reopen()
             m_file = nullptr;
             return;
         }
-        const bool ok = readHeader();
+        const bool ok = loadImage();
         if (!ok) {
             m_file = nullptr;
             return;
@@ -501,6 +849,389 @@ Wvd::reopen()
 }
 
 
+// read the header through the file handle, and map the image.  an overlay
+// has to be mapped, along with its base, as that is how each sector is
+// routed to one or the other.
+// returns true on success, otherwise complain why and return false.
+bool
+Wvd::loadImage()
+{
+    uint8 data[256];
+    m_file->seekg(0);
+    m_file->read(reinterpret_cast<char*>(&data[0]), 256);
+    const bool overlay = m_file->good() && isOverlayHeader(&data[0]);
+    m_file->clear();
+
+    if (!overlay) {
+        if (!readHeader()) {
+            return false;
+        }
+        if (m_chunk_shift < 0) {
+            (void)mapImage();
+            return true;
+        }
+        // compressed images go through the file handle, a chunk at a time
+        m_packed = std::make_unique<WvdCompressed>(m_file.get(), m_path);
+        if (!m_packed->open(1 + m_num_platters*m_num_platter_sectors, m_chunk_shift)) {
+            m_packed = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    if (!mapOverlay(&data[0])) {
+        return false;
+    }
+    // the disk header comes from the base, unless it has been rewritten
+    const size_t sectors = (m_map.size - m_data_off) / 256;
+    if (!readHeader()) {
+        unmapImage();
+        return false;
+    }
+    if ((m_chunk_shift >= 0) ||
+        (sectors != 1 + static_cast<size_t>(m_num_platters)
+                      * static_cast<size_t>(m_num_platter_sectors))) {
+        UI_error("The overlay '%s' doesn't match its base image", m_path.c_str());
+        unmapImage();
+        return false;
+    }
+    return true;
+}
+
+
+// map the whole image into memory.  the header has just been read through
+// the file handle, so the geometry is known.  if the file is too short to
+// hold every sector, it isn't mapped, and accesses past the end fail with
+// an error, as they always have, rather than faulting.
+// returns true if the image was mapped.
+bool
+Wvd::mapImage()
+{
+    assert(m_map.addr == nullptr);
+#if WVD_MAPPED
+    const size_t size = 256 * (1 + static_cast<size_t>(m_num_platters)
+                                 * static_cast<size_t>(m_num_platter_sectors));
+    if (!mapFile(m_path, size, true, &m_map)) {
+        return false;
+    }
+    m_file->close();  // everything goes through the mapping from now on
+    startFlusher();
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// map an overlay and its base image
+bool
+Wvd::mapOverlay(const uint8 *header)
+{
+    assert(m_map.addr == nullptr);
+#if WVD_MAPPED
+    int sectors = 0;
+    std::string base;
+    if (!parseOverlayHeader(header, &sectors, &base)) {
+        UI_error("The overlay '%s' is damaged, or is from a more recent\n"
+                 "version of WangEmu", m_path.c_str());
+        return false;
+    }
+    base = overlayBasePath(m_path, base);
+
+    const size_t data_off = 256 + overlayBitmapSize(sectors);
+    if (!mapFile(base, 256*static_cast<size_t>(sectors), false, &m_base)) {
+        UI_error("Couldn't read '%s', the base image of '%s'",
+                 base.c_str(), m_path.c_str());
+        return false;
+    }
+    if (!mapFile(m_path, data_off + 256*static_cast<size_t>(sectors), true, &m_map)) {
+        UI_error("Couldn't map the overlay '%s'", m_path.c_str());
+        unmapFile(&m_base);
+        return false;
+    }
+    m_bitmap   = m_map.addr + 256;
+    m_data_off = data_off;
+    m_file->close();
+    startFlusher();
+    return true;
+#else
+    (void)header;
+    UI_error("This build of WangEmu can't use overlay disk images");
+    return false;
+#endif
+}
+
+
+void
+Wvd::startFlusher()
+{
+    if (m_sync == SYNC_BACKGROUND) {
+        m_dirty.assign((m_map.size - m_data_off) / 256, false);
+        m_num_dirty   = 0;
+        m_file_synced = true;
+        WvdFlusher::get().add(this);
+    }
+}
+
+
+// an overlay holds the sectors which have been written since it was made;
+// the rest are in its base image
+const uint8 *
+Wvd::mappedSector(int sector) const
+{
+    assert(m_map.addr != nullptr);
+    if ((m_bitmap != nullptr) &&
+        ((m_bitmap[sector >> 3] & (1 << (sector & 7))) == 0)) {
+        return m_base.addr + 256LL*sector;
+    }
+    return m_map.addr + m_data_off + 256LL*sector;
+}
+
+
+// map the first size bytes of a file.  if the file is shorter than that,
+// it isn't mapped, as touching the missing part would fault.  after
+// setPrivateWrites(), a writable mapping is a copy-on-write one, and the
+// file itself is only opened for reading.
+bool
+Wvd::mapFile(const std::string &filename, size_t size, bool writable,
+             mapping_t *map)
+{
+    assert(map->addr == nullptr);
+    const bool copy = writable && private_writes;
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(filename.c_str(),
+                            GENERIC_READ | ((writable && !copy) ? GENERIC_WRITE : 0),
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mh = nullptr;
+    if (GetFileSizeEx(fh, &file_size) &&
+        (static_cast<size_t>(file_size.QuadPart) >= size)) {
+        mh = CreateFileMappingA(fh, nullptr,
+                                (copy)     ? PAGE_WRITECOPY
+                              : (writable) ? PAGE_READWRITE : PAGE_READONLY,
+                                0, 0, nullptr);
+    }
+    void *p = (mh != nullptr)
+            ? MapViewOfFile(mh, (copy)     ? FILE_MAP_COPY
+                              : (writable) ? FILE_MAP_WRITE : FILE_MAP_READ,
+                            0, 0, size)
+            : nullptr;
+    if (p == nullptr) {
+        if (mh != nullptr) {
+            CloseHandle(mh);
+        }
+        CloseHandle(fh);
+        return false;
+    }
+    map->file   = fh;
+    map->handle = mh;
+#else
+    const int fd = ::open(filename.c_str(), (writable && !copy) ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (static_cast<size_t>(st.st_size) >= size)) {
+        p = mmap(nullptr, size, PROT_READ | ((writable) ? PROT_WRITE : 0),
+                 (copy) ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    }
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    map->fd = fd;  // kept for fsync
+#endif
+    map->addr = static_cast<uint8*>(p);
+    map->size = size;
+    map->copy = copy;
+    return true;
+}
+
+
+void
+Wvd::unmapFile(mapping_t *map)
+{
+    if (map->addr == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(map->addr);
+    CloseHandle(static_cast<HANDLE>(map->handle));
+    CloseHandle(static_cast<HANDLE>(map->file));
+#else
+    munmap(map->addr, map->size);
+    ::close(map->fd);
+#endif
+    *map = mapping_t();
+}
+
+
+// when the image is ejected, or flush() lets someone else at the file,
+// make sure writes have gone as far as the sync policy promises, then
+// let go of the mapping.  dirty pages which are still only cached are
+// written back by the host in due course, same as for a file handle.
+void
+Wvd::unmapImage()
+{
+    if (m_map.addr == nullptr) {
+        return;
+    }
+
+    if (m_sync == SYNC_BACKGROUND) {
+        // once the flusher lets go of the image, finish its work here
+        WvdFlusher::get().remove(this);
+        if (!flushDirty(true) || m_flush_failed) {
+            UI_error("Error writing to '%s'", m_path.c_str());
+        }
+        const flush_stats_t &st = m_flush_stats;
+        if (st.writes > 0) {
+            dbglog("%s: %llu sector writes, %.1f%% to dirty sectors; "
+                   "%llu flushes, averaging %.1f sectors in %.1f runs\n",
+                   m_path.c_str(),
+                   static_cast<unsigned long long>(st.writes),
+                   100.0 * st.absorbed / st.writes,
+                   static_cast<unsigned long long>(st.flushes),
+                   (st.flushes > 0) ? double(st.sectors) / st.flushes : 0.0,
+                   (st.flushes > 0) ? double(st.runs) / st.flushes : 0.0);
+        }
+        m_dirty.clear();
+    } else if (m_sync != SYNC_CACHE) {
+        (void)syncMapped(m_map.addr, m_map.size, true);
+    }
+
+    unmapFile(&m_map);
+    unmapFile(&m_base);
+    m_bitmap   = nullptr;
+    m_data_off = 0;
+}
+
+
+// write part of the mapping out to the disk, and if wait is set, wait for
+// it to get there.  returns false on failure.
+bool
+Wvd::syncMapped(const uint8 *addr, size_t len, bool wait)
+{
+    assert(m_map.addr != nullptr);
+    if (m_map.copy) {
+        return true;  // the writes never leave the mapping
+    }
+#ifdef _WIN32
+    return (FlushViewOfFile(addr, len) != 0) &&
+           (!wait || (FlushFileBuffers(static_cast<HANDLE>(m_map.file)) != 0));
+#else
+    // msync wants a page aligned address
+    const uintptr_t page  = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t start = reinterpret_cast<uintptr_t>(addr) & ~(page-1);
+    const size_t    skip  = reinterpret_cast<uintptr_t>(addr) - start;
+    return (msync(reinterpret_cast<void*>(start), len + skip,
+                  (wait) ? MS_SYNC : MS_ASYNC) == 0);
+#endif
+}
+
+
+// a sector has been written to the mapping; leave it for the flusher
+void
+Wvd::markDirty(int sector)
+{
+    WvdFlusher &flusher = WvdFlusher::get();
+    std::lock_guard<std::mutex> lk(flusher.m_lock);
+
+    const auto now = flush_clock_t::now();
+    m_flush_stats.writes++;
+    m_last_write  = now;
+    m_file_synced = false;
+    if (m_dirty[sector]) {
+        m_flush_stats.absorbed++;
+        return;
+    }
+
+    m_dirty[sector] = true;
+    m_num_dirty++;
+    if (m_num_dirty == 1) {
+        // the flusher may be asleep with nothing to do
+        m_first_dirty = now;
+        flusher.poke();
+    } else if (m_num_dirty == m_flush_max_dirty) {
+        flusher.poke();
+    }
+}
+
+
+// gather the dirty sectors into runs of adjacent sectors, and sync each
+// run from the mapping.  sectors dirtied while this is going on are left
+// for next time.  returns false if anything couldn't be written.
+bool
+Wvd::flushDirty(bool sync_file)
+{
+    std::vector<std::pair<int, int>> runs;  // first sector, count
+    WvdFlusher &flusher = WvdFlusher::get();
+    {
+        std::lock_guard<std::mutex> lk(flusher.m_lock);
+        const int size = static_cast<int>(m_dirty.size());
+        for (int n=0; (m_num_dirty > 0) && (n < size); n++) {
+            if (!m_dirty[n]) {
+                continue;
+            }
+            const int first = n;
+            while ((n < size) && m_dirty[n]) {
+                m_dirty[n] = false;
+                m_num_dirty--;
+                n++;
+            }
+            runs.emplace_back(first, n - first);
+        }
+        assert(m_num_dirty == 0);
+        if (sync_file) {
+            m_file_synced = true;
+        }
+    }
+
+    bool ok = true;
+    int sectors = 0;
+#ifdef _WIN32
+    // FlushViewOfFile only starts the writes; one FlushFileBuffers waits
+    // for them all, and takes care of the file metadata too
+    for (const auto &run : runs) {
+        ok = syncMapped(m_map.addr + m_data_off + 256LL*run.first,
+                        256*run.second, false) && ok;
+        sectors += run.second;
+    }
+    if ((m_bitmap != nullptr) && !runs.empty()) {
+        ok = syncMapped(m_bitmap, m_data_off - 256, false) && ok;
+    }
+    if (!runs.empty() || sync_file) {
+        ok = (FlushFileBuffers(static_cast<HANDLE>(m_map.file)) != 0) && ok;
+    }
+#else
+    for (const auto &run : runs) {
+        ok = syncMapped(m_map.addr + m_data_off + 256LL*run.first,
+                        256*run.second, true) && ok;
+        sectors += run.second;
+    }
+    if ((m_bitmap != nullptr) && !runs.empty()) {
+        ok = syncMapped(m_bitmap, m_data_off - 256, true) && ok;
+    }
+    if (sync_file) {
+        ok = (fsync(m_map.fd) == 0) && ok;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lk(flusher.m_lock);
+    if (!runs.empty()) {
+        m_flush_stats.flushes++;
+        m_flush_stats.runs    += runs.size();
+        m_flush_stats.sectors += sectors;
+    }
+    m_flush_failed = m_flush_failed || !ok;
+    return ok;
+}
+
+
 // retrieve the metadata from the virtual disk image.
 // if the file is already open, just read it;
 // if the file isn't open, open it, read the metadata, and leave it open.
@@ -530,8 +1261,8 @@ Wvd::readHeader()
         return false;
     }
 
-    // check read format
-    if (data[6] != 0x00) {
+    // check read format; 1 is a compressed image
+    if (data[6] > 0x01) {
         UI_error("This disk is from a more recent version of WangEmu.\n"
                  "Please use a more recent emulator.");
         return false;
@@ -570,6 +1301,7 @@ Wvd::readHeader()
     m_num_platters        = tmp_platters;
     m_num_platter_sectors = tmp_sectors;
     m_write_protect       = tmp_write_protect;
+    m_chunk_shift         = (data[6] == 0x01) ? data[12] : -1;
 
     return true;
 }
@@ -580,23 +1312,94 @@ Wvd::readHeader()
 bool
 Wvd::format(const int platter)
 {
+    refreshMetadata();
     assert(platter >= 0 && platter < m_num_platters);
+    assert(m_file != nullptr);
 
     // fill all non-header sectors with 0x00
-    uint8 data[256];
-    memset(&data[0], static_cast<uint8>(0x00), 256);
+    return zeroSectors(1 + m_num_platter_sectors*platter, m_num_platter_sectors);
+}
 
-    bool ok = true;
-    for (int n=0; ok && n < m_num_platter_sectors; n++) {
-        ok = writeSector(platter, n, &data[0]);
+
+// fill a run of absolute sectors with 0x00.  where the host can, the space
+// they took in the file is handed back, and sectors which are zero already
+// aren't touched, so a sparse file stays sparse.
+// returns true on success.
+bool
+Wvd::zeroSectors(const int first, const int count)
+{
+    assert(first >= 1 && count >= 0);
+    assert(first + count <= m_num_platters*m_num_platter_sectors+1);
+    static const uint8 zeros[256] = { 0 };
+
+    if (m_map.addr != nullptr) {
+        uint8 * const dst = m_map.addr + m_data_off + 256LL*first;
+        const size_t len = 256 * static_cast<size_t>(count);
+        bool punched = false;
+#ifdef __linux__
+        // the mapping sees the hole right away, unless it is a copy
+        punched = !m_map.copy &&
+                  (fallocate(m_map.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                             static_cast<off_t>(dst - m_map.addr),
+                             static_cast<off_t>(len)) == 0);
+#endif
+        if (!punched) {
+            // writing zeros over a hole would fill it in
+            for (int n=0; n < count; n++) {
+                uint8 * const p = dst + 256LL*n;
+                if (memcmp(p, &zeros[0], 256) != 0) {
+                    memset(p, 0x00, 256);
+                }
+            }
+        }
+        // an overlay holds the sectors from now on
+        uint8 *bits = nullptr;
+        size_t num_bits = 0;
+        if ((m_bitmap != nullptr) && (count > 0)) {
+            for (int s=first; s < first+count; s++) {
+                m_bitmap[s >> 3] |= static_cast<uint8>(1 << (s & 7));
+            }
+            bits = &m_bitmap[first >> 3];
+            num_bits = ((first+count-1) >> 3) - (first >> 3) + 1;
+        }
+        // this is rare enough that the flusher isn't bothered with it
+        const bool wait = (m_sync == SYNC_WRITE) || (m_sync == SYNC_BACKGROUND);
+        if ((m_sync != SYNC_CACHE) && (count > 0) &&
+            (!syncMapped(dst, len, wait) ||
+             ((bits != nullptr) && !syncMapped(bits, num_bits, wait)))) {
+            UI_error("Error writing to '%s'", m_path.c_str());
+            return false;
+        }
+        return true;
     }
 
-    return ok;
+    if (m_packed != nullptr) {
+        return m_packed->zeroSectors(first, count) &&
+               (((m_sync != SYNC_ASYNC) && (m_sync != SYNC_WRITE)) ||
+                m_packed->flush());
+    }
+
+    // a block of sectors per write, rather than one at a time
+    const int block = 256;
+    std::vector<uint8> data(256 * std::min(count, block), 0x00);
+    m_file->seekp(256LL*first);
+    for (int n=0; m_file->good() && (n < count); n += block) {
+        m_file->write(reinterpret_cast<const char*>(data.data()),
+                      256 * std::min(count-n, block));
+    }
+    m_file->flush();
+    if (!m_file->good()) {
+        UI_error("Error writing to '%s'", m_path.c_str());
+        m_file->close();
+        return false;
+    }
+
+    return true;
 }
 
 
 // create a virtual disk file if it doesn't exist, erase it if does.
-// write the header and then format all platters.
+// write the header, then extend the file with zeroed sectors.
 // returns true on success.
 bool
 Wvd::createFile(const std::string &filename)
@@ -622,13 +1425,217 @@ Wvd::createFile(const std::string &filename)
         return false;
     }
 
-    bool ok = writeHeader();
-    if (ok) {
-        for (int p=0; ok && p < m_num_platters; p++) {
-            ok = format(p);
+    if (!writeHeader()) {
+        return false;
+    }
+
+    // the file is empty, so rather than formatting every platter, writing
+    // the last byte is enough to make it read back as zeros.  on most hosts
+    // this leaves a hole, so no time or space goes into the zeros.
+    const int64 size = 256 * (1 + static_cast<int64>(m_num_platters)
+                                * m_num_platter_sectors);
+    m_file->seekp(size-1);
+    m_file->put(0x00);
+    m_file->flush();
+    if (!m_file->good()) {
+        UI_error("Error writing to '%s'", m_path.c_str());
+        m_file->close();
+        return false;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------
+// overlays
+// -------------------------------------------------------------------------
+
+// make an empty overlay on a base image.  the base only needs to be
+// readable, so it is checked by hand rather than with open().
+bool
+Wvd::createOverlay(const std::string &filename, const std::string &base)
+{
+    if (base.empty() || (base.size() >= OVERLAY_MAX_PATH)) {
+        UI_error("The path of the base image must be 1 to %d characters",
+                 OVERLAY_MAX_PATH-1);
+        return false;
+    }
+
+    const std::string base_path = overlayBasePath(filename, base);
+    if (base_path == filename) {
+        UI_error("An overlay can't be its own base image");
+        return false;
+    }
+    std::ifstream ifs(base_path.c_str(), std::ifstream::binary);
+    if (!ifs.is_open()) {
+        UI_error("Couldn't open file '%s'", base_path.c_str());
+        return false;
+    }
+    uint8 data[256];
+    ifs.read(reinterpret_cast<char*>(&data[0]), 256);
+    if (!ifs.good() || (memcmp(&data[0], "WANG", 5) != 0)) {
+        UI_error("'%s' isn't a Wang Virtual Disk", base_path.c_str());
+        return false;
+    }
+    if (data[6] != 0x00) {
+        UI_error("The base image '%s' must be a plain, uncompressed one",
+                 base_path.c_str());
+        return false;
+    }
+    const int platter_sectors = (data[9] << 8) | data[8];
+    const int sectors = 1 + (data[11] + 1) * platter_sectors;
+    if (platter_sectors == 0) {
+        UI_error("'%s' isn't a Wang Virtual Disk", base_path.c_str());
+        return false;
+    }
+    ifs.seekg(0, std::ifstream::end);
+    if (!ifs.good() || (static_cast<int64>(ifs.tellg()) < 256LL*sectors)) {
+        UI_error("The disk image '%s' is too short", base_path.c_str());
+        return false;
+    }
+
+    memset(&data[0], 0x00, 256);
+    memcpy(&data[0], "WOVL", 5);
+    data[5] = 0x00;  // write format version
+    data[6] = 0x00;  // read format version
+    data[8]  = static_cast<uint8>((sectors >>  0) & 0xFF);
+    data[9]  = static_cast<uint8>((sectors >>  8) & 0xFF);
+    data[10] = static_cast<uint8>((sectors >> 16) & 0xFF);
+    data[11] = static_cast<uint8>((sectors >> 24) & 0xFF);
+    memcpy(&data[16], base.c_str(), base.size());
+
+    // seeking past the end leaves a hole, which reads back as zeros
+    const int64 size = 256 + overlayBitmapSize(sectors) + 256LL*sectors;
+    std::ofstream ofs(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    ofs.write(reinterpret_cast<const char*>(&data[0]), 256);
+    ofs.seekp(size-1);
+    ofs.put(0);
+    ofs.close();
+    if (!ofs.good()) {
+        UI_error("Couldn't write '%s'", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// copy each sector held by the overlay into the base image, then start
+// the overlay afresh
+bool
+Wvd::commitOverlay(const std::string &filename)
+{
+    Wvd wvd;
+    if (!wvd.open(filename)) {
+        return false;
+    }
+    if (wvd.m_bitmap == nullptr) {
+        UI_error("'%s' isn't an overlay", filename.c_str());
+        return false;
+    }
+
+    int sectors = 0;
+    std::string base;
+    (void)parseOverlayHeader(wvd.m_map.addr, &sectors, &base);
+    const std::string base_path = overlayBasePath(filename, base);
+
+    // the base is mapped read-only; the mapping sees these writes
+    std::fstream fs(base_path.c_str(), std::fstream::in | std::fstream::out
+                                     | std::fstream::binary);
+    for (int n=0; fs.good() && (n < sectors); n++) {
+        if ((wvd.m_bitmap[n >> 3] & (1 << (n & 7))) != 0) {
+            fs.seekp(256LL*n);
+            fs.write(reinterpret_cast<const char*>(wvd.mappedSector(n)), 256);
         }
     }
+    fs.flush();
+    const bool ok = fs.good();
+    fs.close();
+    wvd.close();
+    if (!ok) {
+        UI_error("Couldn't write to '%s'", base_path.c_str());
+        return false;
+    }
 
+    return createOverlay(filename, base);
+}
+
+
+// start the overlay afresh, on the same base
+bool
+Wvd::discardOverlay(const std::string &filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ifstream::binary);
+    uint8 data[256];
+    ifs.read(reinterpret_cast<char*>(&data[0]), 256);
+    int sectors = 0;
+    std::string base;
+    if (!ifs.good() || !parseOverlayHeader(&data[0], &sectors, &base)) {
+        UI_error("'%s' isn't an overlay", filename.c_str());
+        return false;
+    }
+    ifs.close();
+
+    return createOverlay(filename, base);
+}
+
+// -------------------------------------------------------------------------
+// compressed images
+// -------------------------------------------------------------------------
+
+// write a compressed copy of any disk image
+bool
+Wvd::compressImage(const std::string &from, const std::string &to)
+{
+    if (from == to) {
+        UI_error("The compressed image must be a new file");
+        return false;
+    }
+    Wvd wvd;
+    if (!wvd.open(from)) {
+        return false;
+    }
+    uint8 header[256];
+    return wvd.rawReadSector(0, &header[0]) &&
+           WvdCompressed::create(to, &header[0],
+               [&wvd](int sector, uint8 *data) {
+                   return wvd.rawReadSector(sector, data);
+               });
+}
+
+
+// write a plain copy of any disk image
+bool
+Wvd::expandImage(const std::string &from, const std::string &to)
+{
+    if (from == to) {
+        UI_error("The expanded image must be a new file");
+        return false;
+    }
+    Wvd wvd;
+    if (!wvd.open(from)) {
+        return false;
+    }
+
+    std::ofstream ofs(to.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    if (!ofs.good()) {
+        UI_error("Couldn't create '%s'", to.c_str());
+        return false;
+    }
+    uint8 data[256];
+    bool ok = wvd.rawReadSector(0, &data[0]);
+    data[5]  = 0x00;  // write format version
+    data[6]  = 0x00;  // read format version
+    data[12] = 0x00;
+    const int sectors = 1 + wvd.getNumPlatters() * wvd.getNumSectors();
+    for (int n=0; ok && (n < sectors); n++) {
+        ok = (n == 0) || wvd.rawReadSector(n, &data[0]);
+        ofs.write(reinterpret_cast<const char*>(&data[0]), 256);
+    }
+    ofs.close();
+    if (ok && !ofs.good()) {
+        UI_error("Error writing to '%s'", to.c_str());
+        ok = false;
+    }
     return ok;
 }
 
@@ -49,10 +49,44 @@
 //          once the virtual disk image is no longer needed, for example, when
 //          the disk is ejected from the logical drive, wvd.close() must be
 //          called.
+//
+// an opened image is normally mapped into memory in its entirety, so a
+// sector access is a memcpy rather than a seek plus a read or write system
+// call.  the sync policy passed to open() says how soon writes are pushed
+// from the mapping out to the disk.  if the image can't be mapped, eg,
+// because it is shorter than its geometry says, the file handle is used.
+//
+// with SYNC_BACKGROUND, a write only lands in the mapping and marks the
+// sector dirty.  a thread shared by all images wakes up every so often and
+// pushes the dirty sectors out to the disk, a run of adjacent sectors at a
+// time, so the emulation never waits on the disk.  whatever is still dirty
+// is written out when the image is ejected, flushed or closed.
+//
+// an overlay is a small file which stands in for a disk image.  it records
+// which sectors have been written since it was made, and holds their data,
+// while every other sector is read from its base image, which is never
+// written.  open() recognizes an overlay and maps both files; after that
+// it behaves like any other disk image.  many emulators can each have
+// their own overlay on one base, which they all share in the host's file
+// cache.  createOverlay(), commitOverlay() and discardOverlay() manage them.
+//
+// once setPrivateWrites() is called, images are mapped copy-on-write, so
+// writes are seen only by the process which made them, and never reach the
+// file.  the headless batch runner does this before forking its tests, so
+// no test sees what another has written.
+//
+// a compressed image (see WvdCompressed.h) isn't mapped; its sectors are
+// kept in compressed chunks, which are decompressed as they are touched.
+// any sync policy other than "async" or "write" leaves modified chunks in
+// memory until they drop out of the cache, or the image is flushed or
+// closed.  compressImage() and expandImage() convert to and from them.
 
+#include <chrono>
 #include <fstream>
+#include <vector>
 
 #include "w2200.h"
+#include "WvdCompressed.h"
 
 class Wvd
 {
@@ -64,10 +98,43 @@ public:
      Wvd() = default;  // must be followed by either open() or create()
     ~Wvd();
 
+    // how soon sector writes reach the disk
+    enum sync_t {
+           SYNC_CACHE,          // whenever the host gets around to it
+           SYNC_ASYNC,          // start writing each sector right away
+           SYNC_WRITE,          // wait for each sector to be written
+           SYNC_BACKGROUND      // a background thread writes them in batches
+    };
+
+    // tuning for SYNC_BACKGROUND, which takes effect on the next open().
+    // dirty sectors are written out once the oldest has waited interval_ms,
+    // or as soon as max_dirty of them pile up (0=no limit).  if sync_idle
+    // is set, once writes stop for interval_ms the whole file is synced,
+    // including the host's file metadata.
+    void setFlushOpts(int interval_ms, int max_dirty, bool sync_idle) noexcept;
+
+    // how SYNC_BACKGROUND has fared since the image was opened
+    struct flush_stats_t {
+        uint64 writes   = 0;    // sector writes
+        uint64 absorbed = 0;    // ... to a sector which was already dirty
+        uint64 flushes  = 0;    // batches of dirty sectors written out
+        uint64 runs     = 0;    // runs of adjacent sectors in those batches
+        uint64 sectors  = 0;    // sectors in those batches
+    };
+    flush_stats_t getFlushStats() const;
+
+    // images mapped by this process from now on are mapped copy-on-write.
+    // it applies to images opened or flushed after the call.
+    static void setPrivateWrites() noexcept;
+
+    // true if writes to the image can't be seen outside this process, as
+    // it is mapped copy-on-write, or it is write protected
+    bool writesArePrivate();
+
     // new blank disk with default values
     void create(int disk_type, int platters, int sectors_per_platter);
     // initialize from named file
-    bool open(const std::string &filename);
+    bool open(const std::string &filename, sync_t sync=SYNC_CACHE);
     // forget about current file
     void close();
 
@@ -118,6 +185,12 @@ public:
     bool readSector (int platter, int sector, const uint8 *buffer);
     bool writeSector(int platter, int sector, const uint8 *buffer);
 
+    // return a pointer to the 256 bytes of a logical sector.  if the image
+    // is mapped, it points into the mapping, and is good until the next
+    // flush() or close(); if not, the sector is read into buffer, and
+    // buffer is returned.  returns nullptr on failure.
+    const uint8 *sectorData(int platter, int sector, uint8 *buffer);
+
     // flush any pending write and close the filehandle,
     // but keep the association (unlike close())
     void flush();
@@ -126,7 +199,26 @@ public:
     // returns true if successful.
     bool format(int platter);
 
+    // make an empty overlay on the given base image.  a relative base path
+    // is taken from the directory holding the overlay.
+    static bool createOverlay(const std::string &filename, const std::string &base);
+    // write the sectors held by an overlay into its base image, then empty
+    // the overlay.  nothing else may be using the base at the time.
+    static bool commitOverlay(const std::string &filename);
+    // throw away the sectors held by an overlay
+    static bool discardOverlay(const std::string &filename);
+    // each of these returns false, after complaining, on failure
+
+    // write a compressed copy of a disk image, or a plain copy of a
+    // compressed one.  either can read an overlay, flattening it.
+    // returns false, after complaining, on failure.
+    static bool compressImage(const std::string &from, const std::string &to);
+    static bool expandImage(const std::string &from, const std::string &to);
+
 private:
+    friend class WvdFlusher;
+    using flush_clock_t = std::chrono::steady_clock;
+
     // make sure metadata is up to date
     void refreshMetadata() { if (m_metadata_stale && !!m_file) { reopen(); } }
     void reopen();
@@ -137,6 +229,59 @@ private:
     // read 256 bytes from an absolute sector address
     bool rawReadSector(int sector, const uint8 *data);
 
+    // zero a run of absolute sectors, leaving holes in the file where the
+    // host allows.  returns false, after complaining, on failure.
+    bool zeroSectors(int first, int count);
+
+    // a file mapped into memory
+    struct mapping_t {
+        uint8  *addr   = nullptr;       // start of the mapping, or nullptr
+        size_t  size   = 0;             // bytes mapped
+        void   *file   = nullptr;       // file handle, on windows
+        void   *handle = nullptr;       // mapping handle, on windows
+        int     fd     = -1;            // file descriptor, elsewhere
+        bool    copy   = false;         // mapped copy-on-write
+    };
+
+    // map the first size bytes of a file; returns false if it can't be done
+    static bool mapFile(const std::string &filename, size_t size,
+                        bool writable, mapping_t *map);
+    static void unmapFile(mapping_t *map);
+
+    // read the header through the file handle, and map the image, along
+    // with the base image if it is an overlay.  returns false on failure.
+    bool loadImage();
+
+    // map the whole image into memory, and stop using the file handle.
+    // returns false if it can't be done.
+    bool mapImage();
+
+    // map an overlay, given its header, and its base image.
+    // returns false, after complaining, if it can't be done.
+    bool mapOverlay(const uint8 *header);
+
+    // once an image is mapped, have the flusher look after it if need be
+    void startFlusher();
+
+    // where an absolute sector is in the mapping(s)
+    const uint8 *mappedSector(int sector) const;
+
+    // push writes out as the sync policy requires, then unmap the image
+    void unmapImage();
+
+    // write part of the mapping out to the disk.  if wait is false, the
+    // write is only started.  returns false on failure.
+    bool syncMapped(const uint8 *addr, size_t len, bool wait);
+
+    // SYNC_BACKGROUND: note that an absolute sector is dirty
+    void markDirty(int sector);
+
+    // SYNC_BACKGROUND: write out all the dirty sectors, and if sync_file is
+    // set, sync the file as a whole.  it runs on the flusher thread, or
+    // on the emulation thread once the flusher has let go of the image.
+    // returns false if anything couldn't be written.
+    bool flushDirty(bool sync_file);
+
     // write header block for wang virtual disk
     // return true on success
     bool writeHeader();
@@ -146,12 +291,14 @@ private:
     bool readHeader();
 
     // create a virtual disk file if it doesn't exist, erase it if does.
-    // write the header and then format all platters.
+    // write the header, then extend the file with zeroed sectors.
     // returns true on success.
     bool createFile(const std::string &filename);
 
     // ----- data members -----
     std::unique_ptr<std::fstream> m_file;   // file handle
+    std::unique_ptr<WvdCompressed> m_packed;  // sectors of a compressed image
+    int           m_chunk_shift         = -1;      // compressed: log2 sectors per chunk
     bool          m_metadata_stale      = true;    // is the metadata possibly out of date?
     bool          m_metadata_modified   = false;   // metadata has been modified
     bool          m_has_path            = false;   // is m_path valid?
@@ -161,6 +308,24 @@ private:
     int           m_num_platters        = 0;       // platters in the virtual disk image
     int           m_num_platter_sectors = 0;       // sectors per platter
     bool          m_write_protect       = false;   // true=don't write
+    sync_t        m_sync                = SYNC_CACHE;  // when writes reach the disk
+    mapping_t     m_map;                           // the whole image, or an overlay
+    mapping_t     m_base;                          // an overlay's base image
+    uint8        *m_bitmap              = nullptr; // an overlay's sectors, or nullptr
+    size_t        m_data_off            = 0;       // where absolute sector 0 is in m_map
+
+    // SYNC_BACKGROUND state; everything below the options is guarded by
+    // the flusher's lock, as the flusher thread looks at it too
+    int           m_flush_ms            = 1000;    // oldest dirty sector waits this long
+    int           m_flush_max_dirty     = 0;       // flush once this many are dirty
+    bool          m_flush_sync_idle     = false;   // sync the file once writes stop
+    std::vector<bool> m_dirty;                     // by absolute sector
+    int           m_num_dirty           = 0;       // true entries in m_dirty
+    bool          m_file_synced         = true;    // no writes since the last file sync
+    flush_clock_t::time_point m_first_dirty;       // when the oldest dirty sector was written
+    flush_clock_t::time_point m_last_write;        // when the latest sector was written
+    bool          m_flush_failed        = false;   // a background write failed
+    flush_stats_t m_flush_stats;
 };
 
 #endif // _INCLUDE_WVD_H_
@@ -0,0 +1,551 @@
+// ------------------------------------------------------------------------
+//  compressed disk image implementation
+// ------------------------------------------------------------------------
+//
+// the file starts with the usual disk header block (see Wvd.cpp), with both
+// format version bytes set to 1, which earlier emulators refuse, and with
+// byte 12 giving log2 of the sectors per chunk.  then comes the index, one
+// 12 byte entry per chunk, padded to a whole number of blocks:
+//
+//     bytes 0-3: offset of the chunk in the file
+//     bytes 4-7: bytes stored there; 0 means every byte of the chunk is
+//                zero, and the chunk size means it is stored uncompressed
+//     bytes 8-11: bytes set aside at that offset for the chunk
+//
+// all little endian.  chunk 0 starts at absolute sector 1, and the last
+// chunk is padded with zeros.  a rewritten chunk goes back where it was if
+// it fits, otherwise at the end of the file, abandoning its old space;
+// converting the image to a plain one and back squeezes that out.
+//
+// the codec is a byte oriented LZ77.  each sequence is a token byte, whose
+// upper nibble is the number of literal bytes and lower nibble the match
+// length minus 4, then the literals, then a 2 byte offset back into the
+// output, from 1 to 65535.  a nibble of 15 means the length continues in
+// the bytes which follow, each adding 0-255, until one is less than 255.
+// the last sequence is only literals, and ends the data.
+
+#include "Ui.h"
+#include "WvdCompressed.h"
+
+#include <algorithm>
+#include <cstring>
+
+// chunks kept decompressed; 16 chunks of 16 KB by default
+static const int CACHE_CHUNKS = 16;
+
+// ======================================================================
+//   LZ codec
+// ======================================================================
+
+static const int LZ_MIN_MATCH = 4;
+static const int LZ_HASH_BITS = 12;
+
+static uint32
+read32(const uint8 *p)
+{
+    uint32 val;
+    memcpy(&val, p, 4);
+    return val;
+}
+
+
+// append the part of a length which didn't fit in its nibble
+static bool
+putLength(uint8 **op, const uint8 *oend, int len)
+{
+    for (; len >= 255; len -= 255) {
+        if (*op >= oend) {
+            return false;
+        }
+        *(*op)++ = 255;
+    }
+    if (*op >= oend) {
+        return false;
+    }
+    *(*op)++ = static_cast<uint8>(len);
+    return true;
+}
+
+
+// append one sequence; match_len=0 for the last one
+static bool
+putSequence(uint8 **op, const uint8 *oend,
+            const uint8 *lit, int lit_len, int offset, int match_len)
+{
+    if (*op >= oend) {
+        return false;
+    }
+    const int extra = (match_len > 0) ? (match_len - LZ_MIN_MATCH) : 0;
+    *(*op)++ = static_cast<uint8>((std::min(lit_len, 15) << 4) | std::min(extra, 15));
+    if ((lit_len >= 15) && !putLength(op, oend, lit_len - 15)) {
+        return false;
+    }
+    if (oend - *op < lit_len) {
+        return false;
+    }
+    memcpy(*op, lit, lit_len);
+    *op += lit_len;
+    if (match_len == 0) {
+        return true;
+    }
+    if (oend - *op < 2) {
+        return false;
+    }
+    *(*op)++ = static_cast<uint8>(offset & 0xFF);
+    *(*op)++ = static_cast<uint8>(offset >> 8);
+    return (extra < 15) || putLength(op, oend, extra - 15);
+}
+
+
+// compress len bytes from src into dst.  returns the compressed length,
+// or 0 if it doesn't fit in dst_cap bytes.
+static int
+lzCompress(const uint8 *src, int len, uint8 *dst, int dst_cap)
+{
+    std::vector<int> table(1 << LZ_HASH_BITS, -1);  // hash -> last position
+    const uint8 * const oend = dst + dst_cap;
+    uint8 *op = dst;
+    int anchor = 0;  // start of the literals not yet sent
+    int pos = 0;
+
+    while (pos + LZ_MIN_MATCH <= len) {
+        const uint32 seq  = read32(src + pos);
+        const uint32 hash = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        const int    cand = table[hash];
+        table[hash] = pos;
+        if ((cand < 0) || (pos - cand > 65535) || (read32(src + cand) != seq)) {
+            pos++;
+            continue;
+        }
+        int match_len = LZ_MIN_MATCH;
+        while ((pos + match_len < len) && (src[cand + match_len] == src[pos + match_len])) {
+            match_len++;
+        }
+        if (!putSequence(&op, oend, src + anchor, pos - anchor, pos - cand, match_len)) {
+            return 0;
+        }
+        pos += match_len;
+        anchor = pos;
+    }
+
+    if (!putSequence(&op, oend, src + anchor, len - anchor, 0, 0)) {
+        return 0;
+    }
+    return static_cast<int>(op - dst);
+}
+
+
+// read the part of a length which didn't fit in its nibble
+static bool
+getLength(const uint8 **ip, const uint8 *iend, int *len)
+{
+    for (;;) {
+        if (*ip >= iend) {
+            return false;
+        }
+        const int byte = *(*ip)++;
+        *len += byte;
+        if (byte < 255) {
+            return true;
+        }
+    }
+}
+
+
+// decompress len bytes from src, which must produce exactly dst_len bytes.
+// returns false if the data is damaged.
+static bool
+lzDecompress(const uint8 *src, int len, uint8 *dst, int dst_len)
+{
+    const uint8 *ip = src;
+    const uint8 * const iend = src + len;
+    uint8 *op = dst;
+    const uint8 * const oend = dst + dst_len;
+
+    while (ip < iend) {
+        const int token = *ip++;
+        int lit_len = token >> 4;
+        if ((lit_len == 15) && !getLength(&ip, iend, &lit_len)) {
+            return false;
+        }
+        if ((iend - ip < lit_len) || (oend - op < lit_len)) {
+            return false;
+        }
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend) {
+            break;  // the last sequence has no match
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        const int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        int match_len = token & 15;
+        if ((match_len == 15) && !getLength(&ip, iend, &match_len)) {
+            return false;
+        }
+        match_len += LZ_MIN_MATCH;
+        if ((offset == 0) || (offset > op - dst) || (oend - op < match_len)) {
+            return false;
+        }
+        // the match may overlap what it is producing
+        const uint8 *match = op - offset;
+        for (int n=0; n < match_len; n++) {
+            op[n] = match[n];
+        }
+        op += match_len;
+    }
+
+    return (op == oend);
+}
+
+// ======================================================================
+//   helpers
+// ======================================================================
+
+static void
+put32(uint8 *p, uint32 val)
+{
+    p[0] = static_cast<uint8>(val >>  0);
+    p[1] = static_cast<uint8>(val >>  8);
+    p[2] = static_cast<uint8>(val >> 16);
+    p[3] = static_cast<uint8>(val >> 24);
+}
+
+
+static uint32
+get32(const uint8 *p)
+{
+    return (static_cast<uint32>(p[0]) <<  0) | (static_cast<uint32>(p[1]) <<  8) |
+           (static_cast<uint32>(p[2]) << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+
+// bytes taken by the index, which starts right after the header
+static uint32
+indexSize(int chunks)
+{
+    return (12 * static_cast<uint32>(chunks) + 255) & ~255U;
+}
+
+
+// number of chunks needed for the data sectors of an image
+static int
+numChunks(int sectors, int chunk_shift)
+{
+    return ((sectors - 1) + (1 << chunk_shift) - 1) >> chunk_shift;
+}
+
+// ======================================================================
+//   public interface
+// ======================================================================
+
+WvdCompressed::WvdCompressed(std::fstream *file, const std::string &path) :
+    m_file(file),
+    m_path(path)
+{
+}
+
+
+bool
+WvdCompressed::open(int sectors, int chunk_shift)
+{
+    if ((chunk_shift < 0) || (chunk_shift > MAX_CHUNK_SHIFT) || (sectors < 2)) {
+        UI_error("The compressed disk image '%s' is damaged", m_path.c_str());
+        return false;
+    }
+    m_chunk_shift = chunk_shift;
+    m_chunk_bytes = 256 << chunk_shift;
+
+    const int chunks = numChunks(sectors, chunk_shift);
+    std::vector<uint8> raw(indexSize(chunks));
+    m_file->seekg(0, std::fstream::end);
+    const int64 file_size = m_file->tellg();
+    m_file->seekg(256);
+    m_file->read(reinterpret_cast<char*>(raw.data()), raw.size());
+    if (!m_file->good()) {
+        UI_error("Error reading the index of '%s'", m_path.c_str());
+        return false;
+    }
+
+    m_data_end = 256 + indexSize(chunks);
+    m_index.resize(chunks);
+    for (int n=0; n < chunks; n++) {
+        index_t &ent = m_index[n];
+        ent.offset = get32(&raw[12*n + 0]);
+        ent.length = get32(&raw[12*n + 4]);
+        ent.space  = get32(&raw[12*n + 8]);
+        if ((ent.space == 0) && (ent.length == 0)) {
+            continue;
+        }
+        if ((ent.length > ent.space) ||
+            (ent.length > static_cast<uint32>(m_chunk_bytes)) ||
+            (ent.offset < 256 + indexSize(chunks)) ||
+            (static_cast<int64>(ent.offset) + ent.length > file_size)) {
+            UI_error("The compressed disk image '%s' is damaged", m_path.c_str());
+            return false;
+        }
+        m_data_end = std::max(m_data_end, ent.offset + ent.space);
+    }
+
+    m_cache.clear();
+    m_cached.clear();
+    return true;
+}
+
+
+bool
+WvdCompressed::readSector(int sector, uint8 *data)
+{
+    assert(sector >= 1);
+    const chunk_t *chunk = getChunk((sector-1) >> m_chunk_shift);
+    if (chunk == nullptr) {
+        return false;
+    }
+    const int offset = ((sector-1) & ((1 << m_chunk_shift) - 1)) * 256;
+    memcpy(data, &chunk->data[offset], 256);
+    return true;
+}
+
+
+bool
+WvdCompressed::writeSector(int sector, const uint8 *data)
+{
+    assert(sector >= 1);
+    chunk_t *chunk = getChunk((sector-1) >> m_chunk_shift);
+    if (chunk == nullptr) {
+        return false;
+    }
+    const int offset = ((sector-1) & ((1 << m_chunk_shift) - 1)) * 256;
+    memcpy(&chunk->data[offset], data, 256);
+    chunk->dirty = true;
+    return true;
+}
+
+
+bool
+WvdCompressed::zeroSectors(int first, int count)
+{
+    assert(first >= 1 && count >= 0);
+    static const uint8 zeros[256] = { 0 };
+    const int chunk_sectors = 1 << m_chunk_shift;
+
+    bool ok = true;
+    for (int sector=first; ok && (sector < first+count); ) {
+        const int num = (sector-1) >> m_chunk_shift;
+        const int chunk_first = 1 + (num << m_chunk_shift);
+        if ((sector != chunk_first) || (first+count - sector < chunk_sectors)) {
+            ok = writeSector(sector, &zeros[0]);
+            sector++;
+            continue;
+        }
+        // the whole chunk goes, without reading it in
+        auto it = m_cached.find(num);
+        if (it != m_cached.end()) {
+            m_cache.erase(it->second);
+            m_cached.erase(it);
+        }
+        if (m_index[num].length != 0) {
+            m_index[num].length = 0;
+            ok = writeIndex(num);
+        }
+        sector += chunk_sectors;
+    }
+    return ok;
+}
+
+
+bool
+WvdCompressed::flush()
+{
+    bool ok = true;
+    for (auto &chunk : m_cache) {
+        if (chunk.dirty) {
+            ok = writeChunk(&chunk) && ok;
+        }
+    }
+    m_file->flush();
+    return ok && m_file->good();
+}
+
+
+bool
+WvdCompressed::create(const std::string &filename, const uint8 *header,
+                      const std::function<bool(int, uint8*)> &read_sector)
+{
+    const int chunk_shift   = DEFAULT_CHUNK_SHIFT;
+    const int chunk_sectors = 1 << chunk_shift;
+    const int chunk_bytes   = 256 << chunk_shift;
+    const int sectors = 1 + (header[11] + 1) * ((header[9] << 8) | header[8]);
+    const int chunks  = numChunks(sectors, chunk_shift);
+
+    std::ofstream ofs(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    if (!ofs.good()) {
+        UI_error("Couldn't create '%s'", filename.c_str());
+        return false;
+    }
+
+    uint8 hdr[256];
+    memcpy(&hdr[0], header, 256);
+    hdr[5]  = 0x01;  // write format version
+    hdr[6]  = 0x01;  // read format version
+    hdr[12] = static_cast<uint8>(chunk_shift);
+    ofs.write(reinterpret_cast<const char*>(&hdr[0]), 256);
+
+    // the index is filled in at the end
+    std::vector<uint8> index(indexSize(chunks), 0x00);
+    ofs.write(reinterpret_cast<const char*>(index.data()), index.size());
+
+    std::vector<uint8> data(chunk_bytes);
+    std::vector<uint8> packed(chunk_bytes);
+    uint32 offset = 256 + indexSize(chunks);
+    for (int n=0; ofs.good() && (n < chunks); n++) {
+        std::fill(data.begin(), data.end(), 0x00);
+        for (int s=0; s < chunk_sectors; s++) {
+            const int sector = 1 + n*chunk_sectors + s;
+            if ((sector < sectors) && !read_sector(sector, &data[256*s])) {
+                return false;
+            }
+        }
+        if (std::all_of(data.begin(), data.end(), [](uint8 b) { return b == 0; })) {
+            continue;
+        }
+        int len = lzCompress(data.data(), chunk_bytes, packed.data(), chunk_bytes-1);
+        const uint8 *src = packed.data();
+        if (len == 0) {
+            len = chunk_bytes;
+            src = data.data();
+        }
+        // leave some slack, so a rewritten chunk which grows a little fits
+        const uint32 space = (len + 255) & ~255U;
+        ofs.write(reinterpret_cast<const char*>(src), len);
+        static const uint8 zeros[256] = { 0 };
+        ofs.write(reinterpret_cast<const char*>(&zeros[0]), space - len);
+        put32(&index[12*n + 0], offset);
+        put32(&index[12*n + 4], len);
+        put32(&index[12*n + 8], space);
+        offset += space;
+    }
+
+    ofs.seekp(256);
+    ofs.write(reinterpret_cast<const char*>(index.data()), index.size());
+    ofs.close();
+    if (!ofs.good()) {
+        UI_error("Error writing to '%s'", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ======================================================================
+//   private functions
+// ======================================================================
+
+WvdCompressed::chunk_t *
+WvdCompressed::getChunk(int num)
+{
+    assert(num >= 0 && num < static_cast<int>(m_index.size()));
+
+    auto it = m_cached.find(num);
+    if (it != m_cached.end()) {
+        m_cache.splice(m_cache.begin(), m_cache, it->second);
+        return &m_cache.front();
+    }
+
+    if (static_cast<int>(m_cache.size()) >= CACHE_CHUNKS) {
+        chunk_t &oldest = m_cache.back();
+        if (oldest.dirty && !writeChunk(&oldest)) {
+            return nullptr;
+        }
+        m_cached.erase(oldest.num);
+        m_cache.pop_back();
+    }
+
+    chunk_t chunk;
+    chunk.num = num;
+    chunk.data.assign(m_chunk_bytes, 0x00);
+    const index_t &ent = m_index[num];
+    if (ent.length > 0) {
+        std::vector<uint8> packed(ent.length);
+        m_file->seekg(ent.offset);
+        m_file->read(reinterpret_cast<char*>(packed.data()), ent.length);
+        bool ok = m_file->good();
+        if (ok && (ent.length == static_cast<uint32>(m_chunk_bytes))) {
+            chunk.data.swap(packed);
+        } else if (ok) {
+            ok = lzDecompress(packed.data(), ent.length, chunk.data.data(), m_chunk_bytes);
+        }
+        if (!ok) {
+            UI_error("Error reading chunk %d of '%s'", num, m_path.c_str());
+            m_file->clear();
+            return nullptr;
+        }
+    }
+
+    m_cache.push_front(std::move(chunk));
+    m_cached[num] = m_cache.begin();
+    return &m_cache.front();
+}
+
+
+// the chunk data is written before its index entry, so the index never
+// points at a partly written chunk elsewhere in the file
+bool
+WvdCompressed::writeChunk(chunk_t *chunk)
+{
+    index_t &ent = m_index[chunk->num];
+    const std::vector<uint8> &data = chunk->data;
+
+    std::vector<uint8> packed(m_chunk_bytes);
+    int len = 0;
+    const uint8 *src = nullptr;
+    if (!std::all_of(data.begin(), data.end(), [](uint8 b) { return b == 0; })) {
+        len = lzCompress(data.data(), m_chunk_bytes, packed.data(), m_chunk_bytes-1);
+        src = packed.data();
+        if (len == 0) {
+            len = m_chunk_bytes;
+            src = data.data();
+        }
+    }
+
+    if (static_cast<uint32>(len) > ent.space) {
+        ent.offset  = m_data_end;
+        ent.space   = (len + 255) & ~255U;
+        m_data_end += ent.space;
+    }
+    ent.length = len;
+
+    if (len > 0) {
+        m_file->seekp(ent.offset);
+        m_file->write(reinterpret_cast<const char*>(src), len);
+    }
+    if (!writeIndex(chunk->num)) {
+        return false;
+    }
+    chunk->dirty = false;
+    return true;
+}
+
+
+bool
+WvdCompressed::writeIndex(int num)
+{
+    const index_t &ent = m_index[num];
+    uint8 raw[12];
+    put32(&raw[0], ent.offset);
+    put32(&raw[4], ent.length);
+    put32(&raw[8], ent.space);
+    m_file->seekp(256 + 12*num);
+    m_file->write(reinterpret_cast<const char*>(&raw[0]), 12);
+    if (!m_file->good()) {
+        UI_error("Error writing chunk %d of '%s'", num, m_path.c_str());
+        m_file->clear();
+        return false;
+    }
+    return true;
+}
+
+// vim: ts=8:et:sw=4:smarttab
@@ -0,0 +1,95 @@
+// A compressed disk image holds the same sectors as a plain .wvd, but in
+// chunks of consecutive sectors, each compressed on its own and found
+// through an index.  Most of a large disk is the zeros written when it was
+// formatted, and such chunks take no space at all.  A few recently used
+// chunks are kept decompressed, so sequential access only decompresses
+// each chunk once.  See the corresponding .cpp for the file format.
+//
+// Wvd uses this for the data sectors of an image whose header says it is
+// compressed; the header itself is kept uncompressed at the start of the
+// file, so Wvd reads and writes it as it does for any other image.
+
+#ifndef _INCLUDE_WVD_COMPRESSED_H_
+#define _INCLUDE_WVD_COMPRESSED_H_
+
+#include "w2200.h"
+
+#include <fstream>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+class WvdCompressed
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(WvdCompressed);
+    // file is the image's open file handle, which must outlive this.
+    // modified chunks are only written by flush(), which the owner must
+    // call before destroying this.
+    WvdCompressed(std::fstream *file, const std::string &path);
+
+    // chunk size, as log2 of the number of sectors in a chunk
+    static const int DEFAULT_CHUNK_SHIFT = 6;  // 64 sectors, 16 KB
+    static const int MAX_CHUNK_SHIFT     = 8;
+
+    // read the index.  sectors is the number of absolute sectors in the
+    // image, counting the header, and chunk_shift comes from the header.
+    // returns false, after complaining, on failure.
+    bool open(int sectors, int chunk_shift);
+
+    // access an absolute sector, 1 and up.  returns false on failure.
+    bool readSector(int sector, uint8 *data);
+    bool writeSector(int sector, const uint8 *data);
+
+    // zero a run of absolute sectors, 1 and up.  chunks which are zeroed
+    // completely give up their data right away.  returns false on failure.
+    bool zeroSectors(int first, int count);
+
+    // write out every modified chunk; returns false on failure
+    bool flush();
+
+    // write a compressed image.  header is the disk header block, whose
+    // geometry says how many sectors there are; each is fetched by calling
+    // read_sector(absolute sector, buffer).  the image gets a copy of the
+    // header marked as compressed.  returns false, after complaining, on
+    // failure.
+    static bool create(const std::string &filename, const uint8 *header,
+                       const std::function<bool(int, uint8*)> &read_sector);
+
+private:
+    struct index_t {
+        uint32 offset = 0;      // where the chunk is in the file
+        uint32 length = 0;      // bytes stored; 0=all zeros, chunk size=raw
+        uint32 space  = 0;      // bytes set aside for it at offset
+    };
+    struct chunk_t {
+        int   num   = 0;        // which chunk
+        bool  dirty = false;    // modified since it was read
+        std::vector<uint8> data;
+    };
+
+    // return the decompressed chunk, reading it in if need be, or nullptr
+    chunk_t *getChunk(int num);
+
+    // compress a chunk, and write it and its index entry
+    bool writeChunk(chunk_t *chunk);
+
+    // write the index entry of a chunk; returns false on failure
+    bool writeIndex(int num);
+
+    std::fstream * const m_file;
+    const std::string    m_path;
+    int                  m_chunk_shift = 0;
+    int                  m_chunk_bytes = 0;
+    std::vector<index_t> m_index;
+    uint32               m_data_end    = 0;  // end of the last chunk's space
+
+    // decompressed chunks, most recently used first
+    std::list<chunk_t> m_cache;
+    std::unordered_map<int, std::list<chunk_t>::iterator> m_cached;
+};
+
+#endif // _INCLUDE_WVD_COMPRESSED_H_
+
+// vim: ts=8:et:sw=4:smarttab
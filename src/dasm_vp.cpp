@@ -2,6 +2,7 @@
 
 #include "w2200.h"
 
+#include <cstring>
 #include <fstream>
 
 // ======================================================================
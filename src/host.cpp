@@ -13,6 +13,14 @@
 #include "wx/tokenzr.h"         // req'd by wxStringTokenizer
 #include "wx/utils.h"           // time/date stuff
 
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+  #include <cerrno>
+  #include <time.h>                // for clock_nanosleep
+#endif
+
 // ============================================================================
 // module state
 // ============================================================================
@@ -20,6 +28,7 @@
 static std::string                   app_home;   // path to application home directory
 static std::unique_ptr<wxFileConfig> config;     // configuration file object
 static std::unique_ptr<wxStopWatch>  stopwatch;  // time program started
+static std::chrono::steady_clock::time_point start_time;  // same, for getTimeNs()
 
 // remember where certain files are located
 struct file_group_t {
@@ -199,6 +208,7 @@ host::initialize()
     // needed so we can compute a time difference to get ms later
     stopwatch = std::make_unique<wxStopWatch>();
     stopwatch->Start(0);
+    start_time = std::chrono::steady_clock::now();
 
     // default file locations
     file_group[FILEREQ_SCRIPT] = {
@@ -238,6 +248,24 @@ host::initialize()
         "ui/printer"                        // ini_group
     };
 
+    file_group[FILEREQ_STATE] = {
+        ".",                                // dir
+        "",                                 // name
+        "machine state (*.w2s)|*.w2s"       // filter
+        "|All files (*.*)|*.*",
+        0,                                  // filter_idx
+        "ui/state"                          // ini_group
+    };
+
+    file_group[FILEREQ_INPUT] = {
+        ".",                                // dir
+        "",                                 // name
+        "input log (*.w2i)|*.w2i"           // filter
+        "|All files (*.*)|*.*",
+        0,                                  // filter_idx
+        "ui/inputlog"                       // ini_group
+    };
+
     // now try and read in defaults from ini file
     getConfigFileLocations();
 }
@@ -542,6 +570,37 @@ host::getTimeMs()
 }
 
 
+// return the time in nanoseconds as a 64b signed integer
+int64
+host::getTimeNs()
+{
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+
+// sleep until getTimeNs() reaches deadline_ns.  on linux, clock_nanosleep()
+// with an absolute deadline doesn't lose the time between computing how
+// long to sleep and actually going to sleep, nor does it round up to ms.
+void
+host::sleepUntilNs(int64 deadline_ns)
+{
+    const auto deadline = start_time + std::chrono::nanoseconds(deadline_ns);
+#ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC here
+    const int64 abs_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec  = static_cast<time_t>(abs_ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(abs_ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
+
+
 // go to sleep for approximately ms milliseconds before returning
 void
 host::sleep(unsigned int ms)
@@ -89,6 +89,13 @@ namespace host
                             const std::string &subgroup,
                             bool               client_size = true);
 
+    // these are provided only by the headless build (host_headless.cpp).
+    // the first seeds the configuration from an .ini file and returns false
+    // if it can't be read; the second overrides one "subgroup/key=value"
+    // entry and returns false if the setting is malformed.
+    bool configLoadFile(const std::string &filename);
+    bool configSetOverride(const std::string &setting);
+
     // ---- time functions ----
 
     // return the time in milliseconds as a 64b signed integer
@@ -97,6 +104,13 @@ namespace host
     // go to sleep for approximately ms milliseconds before returning
     void sleep(unsigned int ms);
 
+    // return the time in nanoseconds since initialize(), as a 64b signed
+    // integer.  it is monotonic, but not necessarily in sync with getTimeMs().
+    int64 getTimeNs();
+
+    // sleep until getTimeNs() reaches deadline_ns
+    void sleepUntilNs(int64 deadline_ns);
+
     // ---- file path functions ----
 
     // classifies the supplied filename as being either relative (false)
@@ -115,6 +129,8 @@ namespace host
            FILEREQ_GRAB,    // for screen grabs
            FILEREQ_DISK,    // for floppy disk directory
            FILEREQ_PRINTER, // for printer output
+           FILEREQ_STATE,   // for saved machine state
+           FILEREQ_INPUT,   // for recorded input logs
            FILEREQ_NUM,     // number of filereq types
          };
 
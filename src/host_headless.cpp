@@ -0,0 +1,472 @@
+// ============================================================================
+// This is a wx-free implementation of the host services declared in host.h.
+// It is linked into the headless build (see UiHeadless.cpp) in place of
+// host.cpp.
+//
+// The configuration state is kept in a simple in-memory key/value store.
+// Optionally it can be seeded from an .ini file written by the GUI build
+// (wxFileConfig format), and individual entries can be overridden from
+// the command line.  The store is never written back to disk, so that any
+// number of headless runs can share one .ini file without clobbering it.
+// ============================================================================
+
+#include "Ui.h"
+#include "host.h"
+
+#include <chrono>
+#include <cstdarg>      // for var args
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+  #include <direct.h>   // for _getcwd
+  #define getcwd _getcwd
+#else
+  #include <unistd.h>   // for getcwd
+#endif
+
+#ifdef __linux__
+  #include <cerrno>
+  #include <time.h>     // for clock_nanosleep
+#endif
+
+// ============================================================================
+// module state
+// ============================================================================
+
+// maps "/full/path/key" to value
+static std::map<std::string, std::string> config;
+
+// time program started
+static std::chrono::steady_clock::time_point start_time;
+
+// ============================================================================
+// file-local functions
+// ============================================================================
+
+// return the current working directory, or "." if it can't be determined
+static std::string
+getCurrentDir()
+{
+    char buff[4096];
+    if (getcwd(&buff[0], sizeof(buff)) == nullptr) {
+        return ".";
+    }
+    return std::string(&buff[0]);
+}
+
+
+// resolve "." and ".." path components and remove doubled slashes,
+// eg "/wangemu/config-0/../ui/disk" becomes "/wangemu/ui/disk"
+static std::string
+normalizeConfigPath(const std::string &path)
+{
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t next = path.find('/', pos);
+        if (next == std::string::npos) {
+            next = path.size();
+        }
+        const std::string part = path.substr(pos, next-pos);
+        if (part == "..") {
+            if (!parts.empty()) {
+                parts.pop_back();
+            }
+        } else if (!part.empty() && (part != ".")) {
+            parts.push_back(part);
+        }
+        pos = next + 1;
+    }
+
+    std::string rv;
+    for (auto const &part : parts) {
+        rv += "/" + part;
+    }
+    return rv;
+}
+
+
+// build the full lookup key for a subgroup/key pair
+static std::string
+configKey(const std::string &subgroup, const std::string &key)
+{
+    return normalizeConfigPath("/wangemu/config-0/" + subgroup + "/" + key);
+}
+
+
+// strip leading and trailing whitespace
+static std::string
+trim(const std::string &str)
+{
+    const size_t first = str.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return "";
+    }
+    const size_t last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last-first+1);
+}
+
+
+// wxFileConfig escapes backslashes and may quote values with leading
+// or trailing whitespace; undo both
+static std::string
+unescapeValue(const std::string &val)
+{
+    std::string str = val;
+    if ((str.size() >= 2) && (str.front() == '"') && (str.back() == '"')) {
+        str = str.substr(1, str.size()-2);
+    }
+
+    std::string rv;
+    for (size_t n=0; n < str.size(); n++) {
+        if ((str[n] == '\\') && (n+1 < str.size())) {
+            n++;
+            switch (str[n]) {
+                case 'n':  rv += '\n'; break;
+                case 't':  rv += '\t'; break;
+                case 'r':  rv += '\r'; break;
+                default:   rv += str[n]; break;
+            }
+        } else {
+            rv += str[n];
+        }
+    }
+    return rv;
+}
+
+
+// ------------------------------------------------------------------------
+// a small logging facility, not in the host namespace
+// ------------------------------------------------------------------------
+
+static std::ofstream dbg_ofs;
+static std::mutex    dbg_mutex;  // -machines logs from many threads
+
+void
+dbglog(const char *fmt, ...)
+{
+    char buff[1000];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(&buff[0], sizeof(buff), fmt, args);
+    va_end(args);
+
+    std::lock_guard<std::mutex> lock(dbg_mutex);
+    if (dbg_ofs.good()) {
+        dbg_ofs << &buff[0];
+        dbg_ofs.flush();
+    }
+}
+
+
+// ============================================================================
+// "public" functions
+// ============================================================================
+
+void
+host::initialize()
+{
+#ifdef _DEBUG
+    dbg_ofs.open("w2200dbg.log", std::ofstream::out | std::ofstream::trunc);
+#endif
+    start_time = std::chrono::steady_clock::now();
+}
+
+
+void
+host::terminate()
+{
+    config.clear();
+#ifdef _DEBUG
+    if (dbg_ofs.is_open()) {
+        dbg_ofs.close();
+    }
+#endif
+}
+
+
+// ----------------------------------------------------------------------------
+// headless-only configuration helpers
+// ----------------------------------------------------------------------------
+
+// read a wxFileConfig-style .ini file into the configuration store.
+// returns false if the file couldn't be opened.
+bool
+host::configLoadFile(const std::string &filename)
+{
+    std::ifstream ifs(filename.c_str());
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    std::string group;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line = trim(line);
+        if (line.empty() || (line[0] == ';') || (line[0] == '#')) {
+            continue;
+        }
+        if (line[0] == '[') {
+            const size_t close = line.find(']');
+            group = line.substr(1, (close == std::string::npos) ? std::string::npos
+                                                                : close-1);
+            continue;
+        }
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        const std::string key = trim(line.substr(0, eq));
+        const std::string val = unescapeValue(trim(line.substr(eq+1)));
+        config[normalizeConfigPath("/" + group + "/" + key)] = val;
+    }
+    return true;
+}
+
+
+// override one entry, given as "subgroup/key=value", where the subgroup
+// is relative to the emulator configuration, eg "cpu/cpu=2200VP".
+// returns false if the setting is malformed.
+bool
+host::configSetOverride(const std::string &setting)
+{
+    const size_t eq = setting.find('=');
+    if (eq == std::string::npos) {
+        return false;
+    }
+    const std::string path = trim(setting.substr(0, eq));
+    const size_t slash = path.rfind('/');
+    if ((slash == std::string::npos) || (slash == 0) || (slash+1 == path.size())) {
+        return false;
+    }
+    configWriteStr(path.substr(0, slash), path.substr(slash+1),
+                   trim(setting.substr(eq+1)));
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// uniform file dialog
+// ----------------------------------------------------------------------------
+
+// there is nobody to ask
+int
+host::fileReq(int requestor, const std::string & /*title*/,
+              bool /*readonly*/, std::string *fullpath)
+{
+    assert(fullpath != nullptr);
+    assert(requestor >= 0 && requestor < FILEREQ_NUM);
+    (void)requestor;
+    return FILEREQ_CANCEL;
+}
+
+
+// return the absolute path to the dir containing the app.
+// headless runs are typically launched from the top of the source tree,
+// so the current directory stands in for the app bundle.
+std::string host::getAppHome()
+{
+    return getCurrentDir();
+}
+
+
+// classifies the supplied filename as being either relative (false)
+// or absolute (returns true).
+bool
+host::isAbsolutePath(const std::string &name)
+{
+#ifdef _WIN32
+    if ((name.size() >= 2) && (name[1] == ':')) {
+        return true;
+    }
+    if (!name.empty() && (name[0] == '\\')) {
+        return true;
+    }
+#endif
+    return !name.empty() && (name[0] == '/');
+}
+
+
+// make sure the name is put in normalized format
+std::string
+host::asAbsolutePath(const std::string &name)
+{
+    if (isAbsolutePath(name)) {
+        return name;
+    }
+    return getCurrentDir() + "/" + name;
+}
+
+
+// ----------------------------------------------------------------------------
+// Application configuration storage
+// ----------------------------------------------------------------------------
+
+// fetch an association from the configuration store
+bool
+host::configReadStr(const std::string &subgroup,
+                    const std::string &key,
+                    std::string *val,
+                    const std::string *defaultval)
+{
+    assert(val != nullptr);
+    auto it = config.find(configKey(subgroup, key));
+    const bool b = (it != config.end());
+    if (b) {
+        *val = it->second;
+    } else if (defaultval != nullptr) {
+        *val = *defaultval;
+    } else {
+        *val = "";
+    }
+    return b;
+}
+
+
+bool
+host::configReadInt(const std::string &subgroup,
+                    const std::string &key,
+                    int *val,
+                    const int defaultval)
+{
+    assert(val != nullptr);
+    std::string valstr;
+    bool b = configReadStr(subgroup, key, &valstr);
+    long v = 0;
+    if (b) {
+        char *endp = nullptr;
+        v = strtol(valstr.c_str(), &endp, 0);  // 0 allows hex and octal too
+        b = !valstr.empty() && (*endp == '\0');
+    }
+    *val = (b) ? static_cast<int>(v) : defaultval;
+    return b;
+}
+
+
+void
+host::configReadBool(const std::string &subgroup,
+                     const std::string &key,
+                     bool *val,
+                     const bool defaultval)
+{
+    assert(val != nullptr);
+    int v = 0;
+    const bool b = configReadInt(subgroup, key, &v, ((defaultval) ? 1 : 0));
+    if (b && (v >= 0) && (v <= 1)) {
+        *val = (v == 1);
+    } else {
+        *val = defaultval;
+    }
+}
+
+
+// there are no windows
+void
+host::configReadWinGeom(wxWindow * /*wxwin*/,
+                        const std::string & /*subgroup*/,
+                        wxRect * const /*default_geom*/,
+                        bool /*client_size*/)
+{
+}
+
+
+// send a string association to the configuration store
+void
+host::configWriteStr(const std::string &subgroup,
+                     const std::string &key,
+                     const std::string &val)
+{
+    config[configKey(subgroup, key)] = val;
+}
+
+
+// send an integer association to the configuration store
+void
+host::configWriteInt(const std::string &subgroup,
+                     const std::string &key,
+                     const int val)
+{
+    configWriteStr(subgroup, key, std::to_string(val));
+}
+
+
+// send a boolean association to the configuration store
+void
+host::configWriteBool(const std::string &subgroup,
+                      const std::string &key,
+                      const bool val)
+{
+    const int foo = (val) ? 1 : 0;
+    configWriteInt(subgroup, key, foo);
+}
+
+
+// there are no windows
+void
+host::configWriteWinGeom(wxWindow * /*wxwin*/,
+                         const std::string & /*subgroup*/,
+                         bool /*client_size*/)
+{
+}
+
+
+// ----------------------------------------------------------------------------
+// real time functions
+// ----------------------------------------------------------------------------
+
+// return the time in milliseconds as a 64b signed integer
+int64
+host::getTimeMs()
+{
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+
+// return the time in nanoseconds as a 64b signed integer
+int64
+host::getTimeNs()
+{
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+
+// sleep until getTimeNs() reaches deadline_ns.  on linux, clock_nanosleep()
+// with an absolute deadline doesn't lose the time between computing how
+// long to sleep and actually going to sleep, nor does it round up to ms.
+void
+host::sleepUntilNs(int64 deadline_ns)
+{
+    const auto deadline = start_time + std::chrono::nanoseconds(deadline_ns);
+#ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC here
+    const int64 abs_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec  = static_cast<time_t>(abs_ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(abs_ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
+
+
+// go to sleep for approximately ms milliseconds before returning
+void
+host::sleep(unsigned int ms)
+{
+    if (ms == 0) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+// vim: ts=8:et:sw=4:smarttab
@@ -217,12 +217,6 @@
 
 #define PARITY(reg) parity_table[(reg)]
 
-static uint32_t work32;
-static uint16_t work16;
-static uint8_t work8;
-static int index;
-static uint8_t carry, add;
-
 static uint8_t parity_table[] = {
     1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
     0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
@@ -352,6 +346,14 @@ int i8080_exec_one_op(i8080 *cpu)
     int cpu_cycles;
     int opcode;
 
+    // scratch space for the opcode macros.  these are locals, not
+    // statics, so that more than one i8080 can run at a time.
+    uint32_t work32;
+    uint16_t work16;
+    uint8_t work8;
+    int index;
+    uint8_t carry, add;
+
     if (HALT) {
         return 4;
     }
@@ -3,98 +3,97 @@
 #include "CardInfo.h"
 #include "Cpu2200.h"
 #include "IoCardDisk.h"
+#include "InputLog.h"
 #include "IoCardKeyboard.h"  // for KEYCODE_HALT
+#include "Pacer.h"
 #include "Scheduler.h"
 #include "ScriptFile.h"
+#include "SpscQueue.h"
+#include "StateFile.h"
 #include "SysCfgState.h"
 #include "Ui.h"
 #include "host.h"
 #include "system2200.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <sstream>
+#include <thread>
+
+// once per simulated second, log what the scheduler has been up to.
+// the log is only open in debug builds, so don't bother otherwise;
+// the headless -stats option reports the same counts for a whole run.
+#ifdef _DEBUG
+    #define LOG_SCHED_STATS 1
+#else
+    #define LOG_SCHED_STATS 0
+#endif
+
+// a device which runs on a worker thread of its own.  the emulation thread
+// bumps go_gen to start a window, and the worker sets done_gen to match
+// once it has finished it.  if the host has only one core, there is nothing
+// to gain from the threads, only context switches, so there is no worker
+// and the emulation thread runs the window itself.  either way, the results
+// are the same.
+struct System2200::parallel_device_t {
+    const void             *owner;
+    parRunCallback          run_fn;
+    parSyncCallback         sync_fn;
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    uint64                  go_gen    = 0;
+    uint64                  done_gen  = 0;
+    int64                   window_ns = 0;
+    bool                    quit      = false;
+};
 
 // ----------------------------------------------------------------------------
 // this is the "private" state of the system2200 namespace,
 // invisible to anyone importing system2200.h
 // ----------------------------------------------------------------------------
 
-// for coordinating events in the emulator
-static std::shared_ptr<Scheduler> scheduler = nullptr;
+// the machine the UI is attached to
+static std::unique_ptr<System2200> primary = nullptr;
 
-// the central processing unit
-static std::shared_ptr<Cpu2200> cpu = nullptr;
+static uint32 sim_seconds = 0;   // simulated time elapsed, in whole seconds
 
-// active system configuration
-static std::shared_ptr<SysCfgState> current_cfg = nullptr;
+// how fast we are running is reported once per real second.  these are
+// the real and simulated time as of the previous report.
+static int64 perf_real_ns = 0;
+static int64 perf_sim_ns  = 0;
 
-// ------------------------------- I/O dispatch -------------------------------
+#if LOG_SCHED_STATS
+// scheduler stats as of the previous log entry
+static sched_stats_t sched_stats_prev;
+#endif
 
-// mapping i/o addresses to devices
-struct iomap_t {
-    int  slot;      // slot number of the device which "owns" this address
-    bool ignore;    // if false, access generates a warning message if ...
-                    // ... there is no device at that address
+// keystrokes from the UI thread wait here for the emulation thread
+struct key_event_t {
+    int io_addr;
+    int term_num;
+    int keyvalue;
 };
+static SpscQueue<key_event_t, 256> key_queue;
 
-// pointer to card in a given slot
-static std::array<std::unique_ptr<IoCard>, NUM_IOSLOTS> card_in_slot;
-
-// pointer to card responding to given address
-static std::array<iomap_t, 256> ioMap;
-
-// address of most recent ABS
-static int curIoAddr;
-
-// ----------------------------- speed regulation -----------------------------
-
-static bool  first_slice    = false; // has realtime_start been initialized?
-static int64 realtime_start = 0;     // relative wall time of when sim started
-static int   real_seconds   = 0;     // real time elapsed
-static uint32 sim_seconds   = 0;     // number of actual seconds simulated time
-
-// amount of actual simulated time elapsed, in ms
-static int64 sim_time_ns;
-
-// amount of adjusted simulated time elapsed, in ms because of user events
-// (eg, menu selection), sim time is often interrupted and we don't
-// actually desire to catch up. sim_time_ns is the actual number of
-// simulated slices, while this var has been fudged to account for those
-// violations of realtime.
-static int64 adjust_sim_time;
-
-// keep a rolling average of how fast we are running in case it is reported.
-// we want to report the running average over the last second of realtime
-// to prevent the average from updating like crazy when running many times
-// realtime.
-static const int perf_hist_size = 100;  // # of timeslices to track
-static       int perf_hist_len  = 0;    // number of entries written
-static       int perf_hist_ptr  = 0;    // next entry to write
-static     int64 perf_real_ms[100];     // realtime at start of each slice
-
-// things which get called as time advances. it is used by the
-// core 2200 CPU and any peripheral which uses a microprocessor.
-// each device has a ns resolution counter, but we keep rebasing
-// the count so the counter doesn't overflow.  all we care is the
-// difference between the devices' sense of time.
-struct clocked_device_t {
-    clkCallback callback_fn;
-    uint32      ns;          // nanoseconds
-};
-static std::vector<clocked_device_t> m_clocked_devices;
+// ---------------------------- input recording ------------------------------
 
-// ----------------------- keyboard input routing table -----------------------
+static std::unique_ptr<InputRecorder> recorder = nullptr;
+static std::unique_ptr<InputReplayer> replayer = nullptr;
+static int64 replay_offset_ns = 0;  // add to the log's times to get ours
 
-struct kb_route_t {
-    int         io_addr;
-    int         term_num;       // 0..3 for smart terms; 0 for display controllers
-    kbCallback  callback_fn;
-    // can't use unique_ptr because it doesn't allow copy assignment
-    // (only move) and std::vector requires copy assignment.
-    std::shared_ptr<ScriptFile> script_handle;
-};
+// ---------------------------- emulation thread -----------------------------
 
-static std::vector<kb_route_t> keyboard_routes;
+// The emulation thread holds world_lock for the duration of each timeslice,
+// and the UI thread holds it while it handles any event which might touch
+// emulator state.  It is recursive because UI event handlers nest, eg, when
+// a modal dialog runs its own event loop.
+static std::recursive_mutex world_lock;
+static std::thread          emu_thread;
+static std::atomic<bool>    emu_thread_quit { false };
+static std::atomic<int>     ui_lock_waiters { 0 };      // UI wants world_lock
+static std::atomic<bool>    emu_waiting_on_ui { false };  // see waitOnUi()
 
 // ----------------------------------------------------------------------------
 // initialize static class members
@@ -148,7 +147,7 @@ saveDiskMounts()
         if (isDiskController(slot)) {
             std::ostringstream subgroup;
             subgroup << "io/slot-" << slot;
-            const auto cfg = current_cfg->getCardConfig(slot);
+            const auto cfg = system2200::config().getCardConfig(slot);
             const auto dcfg = dynamic_cast<const DiskCtrlCfgState*>(cfg.get());
             assert(dcfg);
             const int num_drives = dcfg->getNumDrives();
@@ -177,7 +176,7 @@ restoreDiskMounts()
     // look for disk controllers and populate drives
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
         if (isDiskController(slot)) {
-            const auto cfg = current_cfg->getCardConfig(slot);
+            const auto cfg = system2200::config().getCardConfig(slot);
             const auto dcfg = dynamic_cast<const DiskCtrlCfgState*>(cfg.get());
             assert(dcfg);
             const int num_drives = dcfg->getNumDrives();
@@ -197,26 +196,133 @@ restoreDiskMounts()
 }
 
 
-// break down any resources currently committed
+// hand a keystroke from the UI to the machine
 static void
-breakDownCards() noexcept
+sendKeystroke(int io_addr, int term_num, int keyvalue)
 {
-    // destroy card instances
-    for (auto &card : card_in_slot) {
-        card = nullptr;
+    if (replayer) {
+        return;  // only the log gets to type
     }
+    input_event_t ev;
+    ev.kind     = input_event_t::KEY;
+    ev.io_addr  = io_addr;
+    ev.term_num = term_num;
+    ev.keycode  = keyvalue;
+    system2200::recordInput(ev);
+    primary->dispatchKeystroke(io_addr, term_num, keyvalue);
+}
 
-    // clean up mappings
-    for (auto &mapentry : ioMap) {
-        mapentry.slot   = -1;      // unoccupied
-        mapentry.ignore = false;   // restore bad I/O warning flags
+
+// do what the UI did when the input log was recorded
+static void
+replayInput(const input_event_t &ev)
+{
+    switch (ev.kind) {
+        case input_event_t::KEY:
+            primary->dispatchKeystroke(ev.io_addr, ev.term_num, ev.keycode);
+            break;
+        case input_event_t::SCRIPT:
+            primary->invokeKbScript(ev.io_addr, ev.term_num, ev.filename);
+            break;
+        case input_event_t::INSERT:
+        case input_event_t::REMOVE:
+            if ((ev.slot < 0) || (ev.slot >= NUM_IOSLOTS) ||
+                !isDiskController(ev.slot) || (ev.drive < 0) || (ev.drive > 3)) {
+                UI_warn("Input log refers to a disk drive which doesn't exist");
+            } else if (ev.kind == input_event_t::INSERT) {
+                (void)IoCardDisk::wvdInsertDisk(ev.slot, ev.drive, ev.filename);
+            } else if ((IoCardDisk::wvdDriveStatus(ev.slot, ev.drive) &
+                        IoCardDisk::WVD_STAT_DRIVE_OCCUPIED) != 0) {
+                (void)IoCardDisk::wvdRemoveDisk(ev.slot, ev.drive);
+            }
+            break;
+        case input_event_t::RESET:
+            primary->reset(ev.flag);
+            break;
+        case input_event_t::SPEED:
+            primary->regulateCpuSpeed(ev.flag);
+            break;
+        case input_event_t::DISK_SPEED:
+            primary->setDiskRealtime(ev.flag);
+            break;
+        default:
+            assert(false);
+            break;
     }
+}
+
 
-    if (cpu) {
-        cpu->setDevRdy(false);  // nobody is driving, so it floats to 0
+// feed the machine whatever logged input is now due.  it returns how
+// long the next timeslice may run before more input is due, or 0 if the
+// recorded session has just ended, so the slice shouldn't run at all.
+static int64
+replayDueInput()
+{
+    if (!replayer) {
+        return INT64_MAX;
     }
+    const int64 now_ns = primary->getSchedulerTimeNs();
+    while (replayer->nextNs() + replay_offset_ns <= now_ns) {
+        input_event_t ev;
+        if (!replayer->next(&ev)) {
+            // the recorded session is over.  the slices were cut short to
+            // land on each event, so unless the machine has gone its own
+            // way, we are exactly where the recording stopped.
+            if (now_ns != replayer->endNs() + replay_offset_ns) {
+                UI_warn("The replay ended %lld ns after the recording did",
+                        static_cast<long long>(now_ns - replayer->endNs()
+                                                      - replay_offset_ns));
+            }
+            system2200::stopReplay();
+            return 0;
+        }
+        replayInput(ev);
+    }
+    return replayer->nextNs() + replay_offset_ns - now_ns;
+}
+
 
-    curIoAddr = -1;
+// forget the speed history, eg, after the speed is changed
+static void
+resetPerfHistory()
+{
+    sim_seconds  = static_cast<uint32>(primary->getSimTimeNs() / 1000000000);
+    perf_real_ns = host::getTimeNs();
+    perf_sim_ns  = primary->getSimTimeNs();
+#if LOG_SCHED_STATS
+    sched_stats_prev = primary->getSchedulerStats();
+#endif
+}
+
+
+// once per simulated second, log the scheduler activity, and once per
+// real second, report how fast we've been running
+static void
+reportProgress()
+{
+    const int64 sim_time_ns = primary->getSimTimeNs();
+    const uint32 sim_seconds_prev = sim_seconds;
+    sim_seconds = static_cast<uint32>(sim_time_ns / 1000000000);
+#if LOG_SCHED_STATS
+    if (sim_seconds != sim_seconds_prev) {
+        const sched_stats_t &stats = primary->getSchedulerStats();
+        dbglog("%s", Scheduler::statsReport(sched_stats_prev, stats).c_str());
+        sched_stats_prev = stats;
+    }
+#else
+    (void)sim_seconds_prev;
+#endif
+
+    const int64 now_ns = host::getTimeNs();
+    if (now_ns - perf_real_ns >= 1000000000) {
+        const float relative_speed = static_cast<float>(sim_time_ns - perf_sim_ns)
+                                   / static_cast<float>(now_ns - perf_real_ns);
+        perf_real_ns = now_ns;
+        perf_sim_ns  = sim_time_ns;
+
+        // update the status bar with simulated seconds and performance
+        UI_setSimSeconds(sim_seconds, relative_speed, primary->getPaceStats());
+    }
 }
 
 // ------------------------------------------------------------------------
@@ -227,30 +333,10 @@ breakDownCards() noexcept
 void
 system2200::initialize()
 {
-    // set up IO management
-    for (auto &mapentry : ioMap) {
-        mapentry.slot   = -1;    // unoccupied
-        mapentry.ignore = false;
-    }
-    for (auto &card : card_in_slot) {
-        card = nullptr;
-    }
-    curIoAddr = -1;
-
-    // CPU speed regulation
-    first_slice = true;
-    sim_time_ns = adjust_sim_time = host::getTimeMs();
-    sim_seconds = 0;
-
-    realtime_start = 0;  // wall time of when sim started
-    real_seconds  = 0;   // real time elapsed
-
     m_do_reconfig = false;
     freezeEmu(false);
     setTerminationState(RUNNING);
 
-    scheduler = std::make_shared<Scheduler>();
-
     // attempt to load configuration from saved state
     SysCfgState ini_cfg;
     ini_cfg.loadIni();
@@ -258,7 +344,9 @@ system2200::initialize()
         UI_warn(".ini file wasn't usable -- using a default configuration");
         ini_cfg.setDefaults();
     }
-    setConfig(ini_cfg);
+    primary = std::make_unique<System2200>(ini_cfg);
+    restoreDiskMounts();
+    resetPerfHistory();
 
 #if 0
     // intentional error, to see if the leak checker finds it
@@ -273,39 +361,583 @@ system2200::initialize()
 void
 system2200::cleanup()
 {
+    stopRecording();
+    stopReplay();
     saveDiskMounts();
-    breakDownCards();
+    config().saveIni();  // save state to ini file
+    primary = nullptr;
+}
+
+
+// called from CrtFrame to signal we want to end things.
+// as such, at this point nothing has been shut down.
+// after all windows have been shut down, we receive OnExit().
+void
+system2200::terminate() noexcept
+{
+    setTerminationState(TERMINATING);
+}
+
+
+// the machine the UI is attached to
+System2200 &
+system2200::machine() noexcept
+{
+    assert(primary);
+    return *primary;
+}
+
+
+// set current system configuration -- may cause reset
+void
+system2200::setConfig(const SysCfgState &new_cfg)
+{
+    if (!primary->needsRebuild(new_cfg)) {
+        primary->setConfig(new_cfg);
+        return;
+    }
+
+    // the log can't say the machine was rebuilt
+    stopRecording();
+    stopReplay();
+
+    // remember which virtual disks are installed across the rebuild
+    saveDiskMounts();
+    primary->setConfig(new_cfg);
+    restoreDiskMounts();
+}
+
+
+// give access to components
+const SysCfgState&
+system2200::config() noexcept
+{
+    return primary->config();
+}
+
+
+// the user requests a change in configuration from the UiFrontPanel.
+// however, doing so often requires a tear down and rebuild of all the
+// components.  destroying the frontpanel instance and then returning
+// to it is uncouth.  instead, when the user wants to reconfigure, this
+// function is called and that desire is noted, and we return immediately.
+// later on, in the onIdle code, this flag is checked and the reconfiguration
+// happens then.
+void
+system2200::reconfigure() noexcept
+{
+    m_do_reconfig = true;
+}
+
+
+// reset the cpu
+void
+system2200::reset(bool cold_reset)
+{
+    input_event_t ev;
+    ev.kind = input_event_t::RESET;
+    ev.flag = cold_reset;
+    recordInput(ev);
+    primary->reset(cold_reset);
+}
+
+
+// turn cpu speed regulation on (true) or off (false)
+void
+system2200::regulateCpuSpeed(bool regulated) noexcept
+{
+    if (replayer) {
+        return;  // the log says how fast
+    }
+    input_event_t ev;
+    ev.kind = input_event_t::SPEED;
+    ev.flag = regulated;
+    recordInput(ev);
+    primary->regulateCpuSpeed(regulated);
+
+    // reset the performance monitor history
+    perf_real_ns = host::getTimeNs();
+    perf_sim_ns  = primary->getSimTimeNs();
+}
+
+
+// indicate if the CPU is throttled or not
+bool
+system2200::isCpuSpeedRegulated() noexcept
+{
+    return primary->isCpuSpeedRegulated();
+}
+
+
+void
+system2200::setDiskRealtime(bool realtime) noexcept
+{
+    if (replayer) {
+        return;  // the log says how fast
+    }
+    input_event_t ev;
+    ev.kind = input_event_t::DISK_SPEED;
+    ev.flag = realtime;
+    recordInput(ev);
+    primary->setDiskRealtime(realtime);
+}
+
+
+// indicate if the disk emulation speed is throttled or not
+bool
+system2200::isDiskRealtime() noexcept
+{
+    return primary->isDiskRealtime();
+}
+
+
+// halt emulation
+void
+system2200::freezeEmu(bool freeze) noexcept
+{
+    m_freeze_emu = freeze;
+}
+
+
+// called whenever there is free time
+bool
+system2200::onIdle()
+{
+    const bool threaded = emu_thread.joinable();
+
+    if (threaded && emu_waiting_on_ui) {
+        // the emulation thread is blocked in the middle of a timeslice
+        // waiting on a dialog; the world can't change under it
+        return false;
+    }
+
+    if (m_do_reconfig) {
+        auto lock = lockWorld();
+        m_do_reconfig = false;
+        freezeEmu(true);
+        UI_systemConfigDlg();
+        freezeEmu(false);
+    }
+
+    switch (getTerminationState()) {
+        case RUNNING:
+            // this is the normal case during emulation
+            if (threaded) {
+                return false;   // the emulation thread is doing the work
+            }
+            if (m_freeze_emu) {
+                // if we don't call sleep, we just get another onIdle event
+                // and end up pegging the host CPU
+                host::sleep(10);
+            } else {
+                emulateTimeslice();
+            }
+            return true;        // want more idle events
+        case TERMINATING:
+            // we've been signaled to shut down the universe.
+            // change the flag to know we've already cleaned up, in case
+            // we receive another onIdle call.
+            stopEmulationThread();
+            setTerminationState(TERMINATED);
+            cleanup();
+            break;
+        case TERMINATED:
+            // do nothing -- we already requested a cleanup
+            break;
+        default:
+            assert(false);
+            break;
+    }
+
+    return false;        // don't want any more idle events
+}
+
+
+// amount of emulated time since the world was built, in ms
+int64
+system2200::getSimTimeMs() noexcept
+{
+    return primary->getSimTimeNs() / 1000000;
+}
+
+
+bool
+system2200::saveState(const std::string &filename)
+{
+    return primary->saveState(filename);
+}
+
+
+bool
+system2200::loadState(const std::string &filename)
+{
+    if (!primary->loadState(filename)) {
+        return false;
+    }
+    key_queue.clear();
+    stopRecording();
+    stopReplay();
+    resetPerfHistory();
+    return true;
+}
+
+
+// simulate a few ms worth of instructions
+void
+system2200::emulateTimeslice()
+{
+    const int64 wake_ns = primary->simulateSlice(replayDueInput());
+    if (wake_ns >= 0) {
+        reportProgress();
+    }
+    primary->publish();
+    if (wake_ns > 0) {
+        host::sleepUntilNs(wake_ns);
+    }
+}
+
+// ========================================================================
+//    emulation thread
+//
+// In the GUI build the emulator runs on a thread of its own, so a slow
+// repaint or a busy event loop doesn't steal cycles from the simulation,
+// and vice versa.  The UI hands over keystrokes via key_queue, and gets
+// back screen state via the publishers called at the end of each slice.
+// Anything else the UI does to the emulator (menu commands, configuration
+// changes, disk mounts) happens while holding the world lock.
+// ========================================================================
+
+static void
+emulationThread()
+{
+    while (!emu_thread_quit) {
+        int64 wake_ns = -1;
+        {
+            std::lock_guard<std::recursive_mutex> lock(world_lock);
+            if (!m_freeze_emu && (getTerminationState() == RUNNING)) {
+                key_event_t ev;
+                while (key_queue.pop(&ev)) {
+                    sendKeystroke(ev.io_addr, ev.term_num, ev.keyvalue);
+                }
+                wake_ns = primary->simulateSlice(replayDueInput());
+                if (wake_ns >= 0) {
+                    reportProgress();
+                }
+                primary->publish();
+            }
+        }
+        // don't grab the lock again before a waiting UI event gets it
+        while (ui_lock_waiters > 0) {
+            std::this_thread::yield();
+        }
+        if (wake_ns > 0) {
+            host::sleepUntilNs(wake_ns);
+        } else if (wake_ns < 0) {
+            // nothing is running; don't spin
+            host::sleep(10);
+        }
+    }
+}
+
+
+// after this, onIdle() no longer runs timeslices
+void
+system2200::startEmulationThread()
+{
+    assert(!emu_thread.joinable());
+    key_queue.clear();
+    emu_thread_quit = false;
+    emu_thread = std::thread(emulationThread);
+}
+
+
+// called from the UI thread, which must not be holding the world lock
+void
+system2200::stopEmulationThread()
+{
+    if (emu_thread.joinable()) {
+        emu_thread_quit = true;
+        emu_thread.join();
+    }
+}
+
+
+// the UI must hold this while touching any emulator state
+std::unique_lock<std::recursive_mutex>
+system2200::lockWorld()
+{
+    ui_lock_waiters++;
+    std::unique_lock<std::recursive_mutex> lock(world_lock);
+    ui_lock_waiters--;
+    return lock;
+}
+
+
+// the emulation thread calls this when it needs an answer from the UI in
+// the middle of a timeslice.  the world lock is dropped while it waits so
+// the UI thread doesn't deadlock trying to handle events.  this is no more
+// exposed than before, when the dialog ran a nested event loop inside the
+// timeslice, and onIdle() refuses to reconfigure or shut down meanwhile.
+void
+system2200::waitOnUi(const std::function<void()> &wait_fn)
+{
+    if (!emu_thread.joinable() || (std::this_thread::get_id() != emu_thread.get_id())) {
+        wait_fn();
+        return;
+    }
+    emu_waiting_on_ui = true;
+    world_lock.unlock();
+    wait_fn();
+    world_lock.lock();
+    emu_waiting_on_ui = false;
+}
+
+// ========================================================================
+// keyboard input routing and slot manager, for the UI
+// ========================================================================
+
+// send a key event to the specified keyboard/terminal
+void
+system2200::dispatchKeystroke(int io_addr, int term_num, int keyvalue)
+{
+    sendKeystroke(io_addr, term_num, keyvalue);
+}
+
+
+// send a key event from the UI.  if the emulator is running on its own
+// thread, it picks the key up at the start of the next timeslice.
+void
+system2200::queueKeystroke(int io_addr, int term_num, int keyvalue)
+{
+    if (!emu_thread.joinable()) {
+        sendKeystroke(io_addr, term_num, keyvalue);
+        return;
+    }
+    const key_event_t ev = { io_addr, term_num, keyvalue };
+    if (!key_queue.push(ev)) {
+        dbglog("system2200::queueKeystroke() dropped key 0x%03x\n", keyvalue);
+    }
+}
+
+
+void
+system2200::invokeKbScript(int io_addr, int term_num,
+                           const std::string &filename)
+{
+    input_event_t ev;
+    ev.kind     = input_event_t::SCRIPT;
+    ev.io_addr  = io_addr;
+    ev.term_num = term_num;
+    ev.filename = filename;
+    recordInput(ev);
+    primary->invokeKbScript(io_addr, term_num, filename);
+}
+
+
+bool
+system2200::isScriptModeActive(int io_addr, int term_num)
+{
+    return primary->isScriptModeActive(io_addr, term_num);
+}
+
+// ========================================================================
+// recording and replaying input
+// ========================================================================
+
+bool
+system2200::startRecording(const std::string &filename)
+{
+    stopRecording();
+    stopReplay();
+    auto rec = std::make_unique<InputRecorder>();
+    if (!rec->open(filename, primary->getSchedulerTimeNs())) {
+        return false;
+    }
+    recorder = std::move(rec);
+
+    // the devices behave differently at real speed, so the log starts
+    // with how fast things are running
+    input_event_t ev;
+    ev.kind = input_event_t::SPEED;
+    ev.flag = primary->isCpuSpeedRegulated();
+    recordInput(ev);
+    ev.kind = input_event_t::DISK_SPEED;
+    ev.flag = primary->isDiskRealtime();
+    recordInput(ev);
+    return true;
+}
+
+
+void
+system2200::stopRecording()
+{
+    if (recorder) {
+        recorder->close(primary->getSchedulerTimeNs());
+        recorder = nullptr;
+    }
+}
+
+
+bool
+system2200::isRecording() noexcept
+{
+    return (recorder != nullptr);
+}
+
+
+bool
+system2200::startReplay(const std::string &filename)
+{
+    stopRecording();
+    stopReplay();
+    auto rep = std::make_unique<InputReplayer>();
+    if (!rep->open(filename)) {
+        return false;
+    }
+    replayer = std::move(rep);
+    replay_offset_ns = primary->getSchedulerTimeNs() - replayer->startNs();
+    key_queue.clear();
+    primary->setFreeRunning(true);
+    return true;
+}
+
+
+void
+system2200::stopReplay()
+{
+    if (replayer) {
+        replayer = nullptr;
+        primary->setFreeRunning(false);
+    }
+}
+
+
+bool
+system2200::isReplaying() noexcept
+{
+    return (replayer != nullptr);
+}
+
+
+void
+system2200::recordInput(input_event_t ev)
+{
+    if (recorder) {
+        ev.ns = primary->getSchedulerTimeNs();
+        recorder->record(ev);
+    }
+}
+
+
+bool
+system2200::getSlotInfo(int slot, int *cardtype_idx, int *addr) noexcept
+{
+    return primary->getSlotInfo(slot, cardtype_idx, addr);
+}
+
+
+int
+system2200::getKbIoAddr(int n) noexcept
+{
+    return primary->getKbIoAddr(n);
+}
+
+
+int
+system2200::getPrinterIoAddr(int n) noexcept
+{
+    return primary->getPrinterIoAddr(n);
+}
+
+
+IoCard*
+system2200::getInstFromIoAddr(int io_addr) noexcept
+{
+    return primary->getInstFromIoAddr(io_addr);
+}
+
+
+IoCard*
+system2200::getInstFromSlot(int slot) noexcept
+{
+    return primary->getInstFromSlot(slot);
+}
+
+
+bool
+system2200::findDiskController(int n, int *slot) noexcept
+{
+    return primary->findDiskController(n, slot);
+}
+
+
+bool
+system2200::findDisk(const std::string &filename,
+                     int *slot, int *drive, int *io_addr)
+{
+    return primary->findDisk(filename, slot, drive, io_addr);
+}
+
+// ========================================================================
+//    System2200
+// ========================================================================
+
+System2200::System2200(const SysCfgState &cfg) :
+    m_scheduler(std::make_shared<Scheduler>())
+{
+    // set up IO management
+    for (auto &mapentry : m_io_map) {
+        mapentry.slot   = -1;    // unoccupied
+        mapentry.ignore = false;
+    }
+
+    setConfig(cfg);
+}
 
-    cpu       = nullptr;
-    scheduler = nullptr;
 
-    current_cfg->saveIni();  // save state to ini file
-    current_cfg = nullptr;
+System2200::~System2200()
+{
+    breakDownCards();
+    m_cpu       = nullptr;
+    m_scheduler = nullptr;
 }
 
 
-// called from CrtFrame to signal we want to end things.
-// as such, at this point nothing has been shut down.
-// after all windows have been shut down, we receive OnExit().
+// break down any resources currently committed
 void
-system2200::terminate() noexcept
+System2200::breakDownCards() noexcept
 {
-    setTerminationState(TERMINATING);
+    // destroy card instances
+    for (auto &card : m_card_in_slot) {
+        card = nullptr;
+    }
+
+    // clean up mappings
+    for (auto &mapentry : m_io_map) {
+        mapentry.slot   = -1;      // unoccupied
+        mapentry.ignore = false;   // restore bad I/O warning flags
+    }
+
+    if (m_cpu) {
+        m_cpu->setDevRdy(false);  // nobody is driving, so it floats to 0
+    }
+
+    m_cur_io_addr = -1;
 }
 
 
 // unregister a callback function which advances with the clock
 void
-system2200::registerClockedDevice(const clkCallback &cb)
+System2200::registerClockedDevice(const clkCallback &cb)
 {
-    clocked_device_t cd = { cb, 0 };
+    clocked_device_t cd = { cb, m_clocked_world_ns };
     m_clocked_devices.push_back(cd);
 }
 
 
 // unregister a callback function which advances with the clock
 void
-system2200::unregisterClockedDevice(const clkCallback &/*cb*/) noexcept
+System2200::unregisterClockedDevice(const clkCallback &/*cb*/) noexcept
 {
 #if 0
 // FIXME: it is not possible to compare bound functions, so a different
@@ -324,25 +956,126 @@ system2200::unregisterClockedDevice(const clkCallback &/*cb*/) noexcept
 }
 
 
+// the body of each parallel device's worker thread
+void
+System2200::parallelWorker(parallel_device_t *dev)
+{
+    std::unique_lock<std::mutex> lock(dev->mutex);
+    uint64 gen = 0;
+    for (;;) {
+        dev->cv.wait(lock, [dev, gen]() { return dev->quit || (dev->go_gen != gen); });
+        if (dev->quit) {
+            return;
+        }
+        gen = dev->go_gen;
+        const int64 window_ns = dev->window_ns;
+        lock.unlock();
+        dev->run_fn(window_ns);
+        lock.lock();
+        dev->done_gen = gen;
+        dev->cv.notify_all();
+    }
+}
+
+
+// register a device which runs on a worker thread of its own
+void
+System2200::registerParallelDevice(const void *owner,
+                                   const parRunCallback  &run_fn,
+                                   const parSyncCallback &sync_fn)
+{
+    auto dev = std::make_unique<parallel_device_t>();
+    dev->owner   = owner;
+    dev->run_fn  = run_fn;
+    dev->sync_fn = sync_fn;
+    if (std::thread::hardware_concurrency() > 1) {
+        dev->thread = std::thread(parallelWorker, dev.get());
+    }
+    m_parallel_devices.push_back(std::move(dev));
+}
+
+
+// this is only ever called between timeslices, when the worker is idle
+void
+System2200::unregisterParallelDevice(const void *owner)
+{
+    for (auto it = begin(m_parallel_devices); it != end(m_parallel_devices); ++it) {
+        parallel_device_t *dev = it->get();
+        if (dev->owner == owner) {
+            if (dev->thread.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(dev->mutex);
+                    dev->quit = true;
+                }
+                dev->cv.notify_all();
+                dev->thread.join();
+            }
+            m_parallel_devices.erase(it);
+            return;
+        }
+    }
+    assert(false);
+}
+
+
+// register a callback which hands state to the UI after each timeslice
+void
+System2200::registerPublisher(const void *owner, const publishCallback &cb)
+{
+    publisher_t pub = { owner, cb };
+    m_publishers.push_back(pub);
+}
+
+
+void
+System2200::unregisterPublisher(const void *owner)
+{
+    for (auto it = begin(m_publishers); it != end(m_publishers); ++it) {
+        if (it->owner == owner) {
+            m_publishers.erase(it);
+            return;
+        }
+    }
+    assert(false);
+}
+
+
+// call the registered publishers
+void
+System2200::publish()
+{
+    for (auto &pub : m_publishers) {
+        pub.callback_fn();
+    }
+}
+
+
+// true if setConfig(new_cfg) would tear down and rebuild the machine
+bool
+System2200::needsRebuild(const SysCfgState &new_cfg) const
+{
+    return !m_cfg || m_cfg->needsReboot(new_cfg);
+}
+
+
 // build a system according to the spec.
 // if a system already exists, tear it down and rebuild it.
 void
-system2200::setConfig(const SysCfgState &new_cfg)
+System2200::setConfig(const SysCfgState &new_cfg)
 {
-    if (!current_cfg) {
+    if (!m_cfg) {
         // first time we don't need to tear anything down
-        current_cfg = std::make_shared<SysCfgState>();
+        m_cfg = std::make_shared<SysCfgState>();
     } else {
         // check if the change is minor, not requiring a teardown
-        const bool rebuild_required = current_cfg->needsReboot(new_cfg);
-        if (!rebuild_required) {
-            *current_cfg = new_cfg;  // make new config permanent
+        if (!needsRebuild(new_cfg)) {
+            *m_cfg = new_cfg;  // make new config permanent
             // notify all configured cards about possible new configuration
             for (int slot=0; slot < NUM_IOSLOTS; slot++) {
-                if (current_cfg->isSlotOccupied(slot)) {
-                    const IoCard::card_t ct = current_cfg->getSlotCardType(slot);
+                if (m_cfg->isSlotOccupied(slot)) {
+                    const IoCard::card_t ct = m_cfg->getSlotCardType(slot);
                     if (CardInfo::isCardConfigurable(ct)) {
-                        auto cfg = current_cfg->getCardConfig(slot);
+                        auto cfg = m_cfg->getCardConfig(slot);
                         auto card = getInstFromSlot(slot);
                         card->setConfiguration(*cfg);
                     }
@@ -352,21 +1085,18 @@ system2200::setConfig(const SysCfgState &new_cfg)
         }
 
         // the change was major, so delete existing resources
-        cpu = nullptr;
-
-        // remember which virtual disks are installed
-        saveDiskMounts();
+        m_cpu = nullptr;
 
         // throw away all existing devices
         breakDownCards();
     }
 
     // save the new system configuration state
-    *current_cfg = new_cfg;
+    *m_cfg = new_cfg;
 
     // (re)build the CPU
-    const int ram_size = (current_cfg->getRamKB()) * 1024;
-    int cpu_type = current_cfg->getCpuType();
+    const int ram_size = (m_cfg->getRamKB()) * 1024;
+    int cpu_type = m_cfg->getCpuType();
     switch (cpu_type) {
         default:
             assert(false);
@@ -374,15 +1104,15 @@ system2200::setConfig(const SysCfgState &new_cfg)
             // fall through in non-debug build if config type is invalid
         case Cpu2200::CPUTYPE_2200B:
         case Cpu2200::CPUTYPE_2200T:
-            cpu = std::make_shared<Cpu2200t>(scheduler, ram_size, cpu_type);
+            m_cpu = std::make_shared<Cpu2200t>(*this, m_scheduler, ram_size, cpu_type);
             break;
         case Cpu2200::CPUTYPE_VP:
         case Cpu2200::CPUTYPE_MVPC:
         case Cpu2200::CPUTYPE_MICROVP:
-            cpu = std::make_shared<Cpu2200vp>(scheduler, ram_size, cpu_type);
+            m_cpu = std::make_shared<Cpu2200vp>(*this, m_scheduler, ram_size, cpu_type);
             break;
     }
-    assert(cpu);
+    assert(m_cpu);
 
     // build cards that go into each slot.
     // a hack -- when a display card is made, the crtframe status bar queries
@@ -394,12 +1124,12 @@ system2200::setConfig(const SysCfgState &new_cfg)
     for (int pass=0; pass < 2; pass++) {
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
 
-        if (!current_cfg->isSlotOccupied(slot)) {
+        if (!m_cfg->isSlotOccupied(slot)) {
             continue;
         }
 
-        const IoCard::card_t cardtype = current_cfg->getSlotCardType(slot);
-        const int io_addr             = current_cfg->getSlotCardAddr(slot) & 0xFF;
+        const IoCard::card_t cardtype = m_cfg->getSlotCardType(slot);
+        const int io_addr             = m_cfg->getSlotCardAddr(slot) & 0xFF;
 
         const bool display = (cardtype == IoCard::card_t::disp_64x16)
                           || (cardtype == IoCard::card_t::disp_80x24)
@@ -409,58 +1139,42 @@ system2200::setConfig(const SysCfgState &new_cfg)
             continue;
         }
 
-        auto inst = IoCard::makeCard(scheduler, cpu, cardtype, io_addr,
-                                     slot, current_cfg->getCardConfig(slot).get());
+        auto inst = IoCard::makeCard(*this, m_scheduler, m_cpu, cardtype, io_addr,
+                                     slot, m_cfg->getCardConfig(slot).get());
         if (inst == nullptr) {
             // failed to install
             UI_warn("Configuration problem: failure to create slot %d card instance", slot);
         } else {
             std::vector<int> addresses = inst->getAddresses();
             for (auto &addr : addresses) {
-                ioMap[addr].slot = slot;
+                m_io_map[addr].slot = slot;
             }
-            card_in_slot[slot] = std::move(inst);
+            m_card_in_slot[slot] = std::move(inst);
         }
     }}
-
-    restoreDiskMounts();    // remount disks
 }
 
 
 // give access to components
 const SysCfgState&
-system2200::config() noexcept
-{
-    return *current_cfg;
-}
-
-
-// the user requests a change in configuration from the UiFrontPanel.
-// however, doing so often requires a tear down and rebuild of all the
-// components.  destroying the frontpanel instance and then returning
-// to it is uncouth.  instead, when the user wants to reconfigure, this
-// function is called and that desire is noted, and we return immediately.
-// later on, in the onIdle code, this flag is checked and the reconfiguration
-// happens then.
-void
-system2200::reconfigure() noexcept
+System2200::config() const noexcept
 {
-    m_do_reconfig = true;
+    return *m_cfg;
 }
 
 
 // reset the cpu
 void
-system2200::reset(bool cold_reset)
+System2200::reset(bool cold_reset)
 {
-    curIoAddr = -1;
+    m_cur_io_addr = -1;
 
-    cpu->reset(cold_reset);
+    m_cpu->reset(cold_reset);
 
     // reset all I/O devices
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
-        if (current_cfg->isSlotOccupied(slot)) {
-            card_in_slot[slot]->reset(cold_reset);
+        if (m_cfg->isSlotOccupied(slot)) {
+            m_card_in_slot[slot]->reset(cold_reset);
         }
     }
 }
@@ -468,330 +1182,437 @@ system2200::reset(bool cold_reset)
 
 // turn cpu speed regulation on (true) or off (false)
 void
-system2200::regulateCpuSpeed(bool regulated) noexcept
+System2200::regulateCpuSpeed(bool regulated) noexcept
 {
-    current_cfg->regulateCpuSpeed(regulated);
-
-    // reset the performance monitor history
-    perf_hist_len = 0;
-    perf_hist_ptr = 0;
+    m_cfg->regulateCpuSpeed(regulated);
+    m_pacer.reset();
 }
 
 
 // indicate if the CPU is throttled or not
 bool
-system2200::isCpuSpeedRegulated() noexcept
+System2200::isCpuSpeedRegulated() const noexcept
 {
-    return current_cfg->isCpuSpeedRegulated();
+    return m_cfg->isCpuSpeedRegulated();
 }
 
 
 void
-system2200::setDiskRealtime(bool realtime) noexcept
+System2200::setDiskRealtime(bool realtime) noexcept
 {
-    current_cfg->setDiskRealtime(realtime);
+    m_cfg->setDiskRealtime(realtime);
 }
 
 
 // indicate if the disk emulation speed is throttled or not
 bool
-system2200::isDiskRealtime() noexcept
+System2200::isDiskRealtime() const noexcept
 {
-    return current_cfg->getDiskRealtime();
+    return m_cfg->getDiskRealtime();
 }
 
 
-// halt emulation
 void
-system2200::freezeEmu(bool freeze) noexcept
+System2200::setFreeRunning(bool free_running) noexcept
 {
-    m_freeze_emu = freeze;
+    m_free_running = free_running;
+    m_pacer.reset();
 }
 
 
-// called whenever there is free time
+int64
+System2200::getSchedulerTimeNs() const noexcept
+{
+    return m_scheduler->getTimeNs();
+}
+
+
+// timer activity of the event scheduler
+const sched_stats_t &
+System2200::getSchedulerStats() const
+{
+    assert(m_scheduler);
+    return m_scheduler->getStats();
+}
+
+
+uint64
+System2200::getCpuOpCount() const noexcept
+{
+    return (m_cpu) ? m_cpu->getOpCount() : 0;
+}
+
+// ------------------------------------------------------------------------
+// machine state
+//
+// The sections come in a fixed order: the configuration, which is checked
+// before anything is touched, then the system and scheduler state, then
+// the cpu, then each occupied slot.  The scheduler is restored before any
+// device, as restoring a device's timers puts them back on its heap.
+//
+// Keyboard scripts aren't part of the state; any in progress are dropped.
+// ------------------------------------------------------------------------
+
 bool
-system2200::onIdle()
+System2200::saveState(const std::string &filename)
 {
-    if (m_do_reconfig) {
-        m_do_reconfig = false;
-        freezeEmu(true);
-        UI_systemConfigDlg();
-        freezeEmu(false);
+    StateWriter sw;
+
+    sw.beginSection("CONF");
+    sw.putU8(m_cfg->getCpuType());
+    sw.putU32(static_cast<uint32>(m_cfg->getRamKB()));
+    for (int slot=0; slot < NUM_IOSLOTS; slot++) {
+        const bool occupied = m_cfg->isSlotOccupied(slot);
+        sw.putI32(static_cast<int>(m_cfg->getSlotCardType(slot)));
+        sw.putI32((occupied) ? m_cfg->getSlotCardAddr(slot) : -1);
+    }
+    sw.endSection();
+
+    sw.beginSection("SYS ");
+    sw.putI64(m_sim_time_ns);
+    sw.putI64(m_clocked_world_ns);
+    sw.putU8(static_cast<int>(m_clocked_devices.size()));
+    for (auto const &dev : m_clocked_devices) {
+        sw.putI64(dev.ns - m_clocked_world_ns);
     }
+    sw.putI32(m_cur_io_addr);
+    sw.endSection();
 
-    // this is something that needs to be tuned.  there is some unholy
-    // interaction of this parameter with the windows scheduling due to
-    // the fact that we call sleep(0) at the end of each slice.  small
-    // changes in this value can have significant non-monotonic impact
-    // on emulator performance.
-    static const int slice_duration = 30;   // in ms
+    sw.beginSection("SCHD");
+    m_scheduler->saveState(sw);
+    sw.endSection();
 
-    switch (getTerminationState()) {
-        case RUNNING:
-            // this is the normal case during emulation
-            if (m_freeze_emu) {
-                // if we don't call sleep, we just get another onIdle event
-                // and end up pegging the host CPU
-                host::sleep(10);
-            } else {
-                emulateTimeslice(slice_duration);
-            }
-            return true;        // want more idle events
-        case TERMINATING:
-            // we've been signaled to shut down the universe.
-            // change the flag to know we've already cleaned up, in case
-            // we receive another onIdle call.
-            setTerminationState(TERMINATED);
-            cleanup();
-            break;
-        case TERMINATED:
-            // do nothing -- we already requested a cleanup
-            break;
-        default:
-            assert(false);
-            break;
+    sw.beginSection("CPU ");
+    m_cpu->saveState(sw);
+    sw.endSection();
+
+    for (int slot=0; slot < NUM_IOSLOTS; slot++) {
+        if (m_card_in_slot[slot] != nullptr) {
+            sw.beginSection("CARD");
+            m_card_in_slot[slot]->saveState(sw);
+            sw.endSection();
+        }
     }
 
-    return false;        // don't want any more idle events
+    if (!sw.writeFile(filename)) {
+        UI_error("Couldn't write machine state to '%s'", filename.c_str());
+        return false;
+    }
+    return true;
 }
 
 
-// simulate a few ms worth of instructions
-void
-system2200::emulateTimeslice(int ts_ms)
+bool
+System2200::loadState(const std::string &filename)
 {
-    const int num_devices = m_clocked_devices.size();
+    StateReader sr;
+    if (!sr.open(filename)) {
+        UI_error("Couldn't restore machine state:\n%s", sr.error().c_str());
+        return false;
+    }
+
+    // nothing is changed until the configuration is known to match
+    sr.beginSection("CONF");
+    const int cpu_type = sr.getU8();
+    const int ram_kb   = static_cast<int>(sr.getU32());
+    bool same = (cpu_type == m_cfg->getCpuType())
+             && (ram_kb   == m_cfg->getRamKB());
+    for (int slot=0; slot < NUM_IOSLOTS; slot++) {
+        const bool occupied = m_cfg->isSlotOccupied(slot);
+        const int card_type = sr.getI32();
+        const int card_addr = sr.getI32();
+        same = same
+            && (card_type == static_cast<int>(m_cfg->getSlotCardType(slot)))
+            && (card_addr == ((occupied) ? m_cfg->getSlotCardAddr(slot) : -1));
+    }
+    sr.endSection();
+
+    sr.beginSection("SYS ");
+    const int64 saved_sim_ns   = sr.getI64();
+    const int64 saved_world_ns = sr.getI64();
+    const int num_clocked      = sr.getU8();
+    std::vector<int64> clocked_ns;
+    for (int n=0; n < num_clocked; n++) {
+        clocked_ns.push_back(sr.getI64());
+    }
+    const int saved_io_addr = sr.getI32();
+    sr.endSection();
+    if ((saved_io_addr < -1) || (saved_io_addr > 0xFF)) {
+        sr.fail("bad i/o address");
+    }
 
-    // try to stae reatime within this window
-    const int64 adj_window = 10LL*ts_ms;  // look at the last 10 timeslices
+    if (!sr.ok()) {
+        UI_error("Couldn't restore machine state from '%s':\n%s",
+                 filename.c_str(), sr.error().c_str());
+        return false;
+    }
+    if (!same || (num_clocked != static_cast<int>(m_clocked_devices.size()))) {
+        UI_error("The machine state in '%s' was saved from a different "
+                 "system configuration", filename.c_str());
+        return false;
+    }
 
-    if (cpu->status() != Cpu2200::CPU_RUNNING) {
-        return;
+    // from here on, a failure leaves the machine in a mess, so it is reset
+    m_sim_time_ns      = saved_sim_ns;
+    m_clocked_world_ns = saved_world_ns;
+    for (int n=0; n < num_clocked; n++) {
+        m_clocked_devices[n].ns = saved_world_ns + clocked_ns[n];
     }
+    m_cur_io_addr = saved_io_addr;
 
-    const uint64 now_ms = host::getTimeMs();
+    sr.beginSection("SCHD");
+    m_scheduler->loadState(sr);
+    sr.endSection();
 
-    if (first_slice) {
-        first_slice = false;
-        realtime_start = now_ms;
+    sr.beginSection("CPU ");
+    m_cpu->loadState(sr);
+    sr.endSection();
+
+    for (int slot=0; slot < NUM_IOSLOTS && sr.ok(); slot++) {
+        if (m_card_in_slot[slot] != nullptr) {
+            sr.beginSection("CARD");
+            m_card_in_slot[slot]->loadState(sr);
+            sr.endSection();
+        }
     }
-    const int64 realtime_elapsed = now_ms - realtime_start;
-    int64 offset = adjust_sim_time - realtime_elapsed;
 
-    if (offset > adj_window) {
-        // we're way ahead (probably because we are running unregulated)
-        adjust_sim_time = realtime_elapsed + adj_window;
-        offset = adj_window;
-    } else if (offset < -adj_window) {
-        // we've fallen way behind; catch up so we don't
-        // run like mad after any substantial pause
-        adjust_sim_time = realtime_elapsed - adj_window;
-        offset = -adj_window;
+    for (auto &route : m_keyboard_routes) {
+        route.script_handle = nullptr;
     }
 
-    if ((offset > 0) && isCpuSpeedRegulated()) {
+    if (!sr.ok()) {
+        UI_error("Couldn't restore machine state from '%s':\n%s\n\n"
+                 "The system will be reset.",
+                 filename.c_str(), sr.error().c_str());
+        reset(true);
+        return false;
+    }
 
-        // we are running ahead of schedule; kill some time.
-        // we don't kill the full amount because the sleep function is
-        // allowed to, and very well might, sleep longer than we asked.
-        const unsigned int ioffset = static_cast<unsigned int>(offset & 0xFFFLL);  // bottom 4 sec or so
-        host::sleep(ioffset/2);
+    m_pacer.reset();
+    return true;
+}
 
-    } else {
+// ------------------------------------------------------------------------
+// clocked device co-scheduling
+//
+// Typically there is just the cpu, or the cpu and the 8080 of one MXD card,
+// but each MXD adds another 8080.  The device which is furthest behind in
+// time runs until it passes the next one behind it, then it is moved to its
+// new place in the time order.  World time, which drives the scheduler, is
+// the time of whichever device is furthest behind.  Ties go to the device
+// which registered first, ie, the cpu.
+//
+// The order is kept as a sorted list rather than a binary heap: there are
+// at most five devices, and the device which just ran usually moves only
+// one place, so one compare is typical.  Sifting down a heap needs more
+// compares, which mispredict, as devices leapfrog each other on every
+// 8080 instruction.
+//
+// The common case of the cpu plus one MXD gets a loop of its own, which
+// does exactly what the general loop would, but without keeping the order
+// list.  With two devices, that bookkeeping is a good part of the work per
+// 8080 instruction.
+//
+// A device may be allowed to run up to clock_skew_ns past the next device
+// before yielding, which means fewer, longer batches at the cost of the
+// devices seeing each other slightly out of step.  At 0, they are kept
+// in lockstep to the granularity of one instruction.
+// ------------------------------------------------------------------------
+
+// true if device a should run before device b
+inline bool
+System2200::clockedBefore(const clocked_device_t *devs, int a, int b) noexcept
+{
+    return (devs[a].ns != devs[b].ns) ? (devs[a].ns < devs[b].ns) : (a < b);
+}
+
+
+// advance world time by slice_ns
+void
+System2200::runClockedDevices(int64 slice_ns)
+{
+    const int num_devices = m_clocked_devices.size();
+    const int64 skew_ns = m_cfg->getClockSkewNs();
+
+    // devices come and go only between timeslices, so these are stable.
+    // keeping them in locals, rather than going through the vectors,
+    // matters as there can be one batch per 8080 instruction.
+    clocked_device_t * const devs = m_clocked_devices.data();
+
+    if (num_devices == 2) {
+        runTwoClockedDevices(devs, slice_ns, skew_ns);
+        return;
+    }
 
-        // keep track of when each slice started
-        perf_real_ms[perf_hist_ptr++] = now_ms;
-        if (perf_hist_ptr >= perf_hist_size) {
-            perf_hist_ptr -= perf_hist_size;
+    m_clocked_order.resize(num_devices);
+    int * const order = m_clocked_order.data();
+    for (int n=0; n < num_devices; n++) {
+        order[n] = n;
+    }
+    std::sort(order, order+num_devices,
+              [devs](int a, int b) { return clockedBefore(devs, a, b); });
+
+    int64 world_ns = m_clocked_world_ns;
+    const int64 slice_end_ns = world_ns + slice_ns;
+    while (world_ns < slice_end_ns) {
+        const int run = order[0];
+        clocked_device_t &dev = devs[run];
+        assert(dev.ns == world_ns);
+
+        int64 budget_ns = slice_end_ns - world_ns;
+        int64 next_ns = INT64_MAX;
+        if (num_devices > 1) {
+            // run until passing the next device, winning a tie if we can
+            const int next = order[1];
+            next_ns = devs[next].ns;
+            const int64 gap_ns = next_ns - world_ns + ((run < next) ? 1 : 0);
+            budget_ns = std::min(budget_ns, gap_ns + skew_ns);
         }
-        if (perf_hist_len < perf_hist_size) {
-            perf_hist_len++;
+
+        const int64 op_ns = dev.callback_fn(budget_ns, m_scheduler->nsUntilEvent());
+        dev.ns += op_ns;
+
+        // move it to its new place in line
+        int pos = 0;
+        while ((pos < num_devices-1) && clockedBefore(devs, order[pos+1], run)) {
+            order[pos] = order[pos+1];
+            pos++;
         }
+        order[pos] = run;
 
-        // simulate one timeslice's worth of instructions
-        int slice_ns = ts_ms*1000000;
-        if (num_devices == 1) {
-
-            auto cb = m_clocked_devices[0].callback_fn;
-            while (slice_ns > 0) {
-                const int op_ns = cb();
-                if (op_ns > 10000) {
-                    slice_ns = 0; // finish the timeslice
-                } else  {
-                    // the guard is to skip this if the device signals error
-                    slice_ns -= op_ns;
-                    scheduler->timerTick(op_ns);
-                }
-            }
+        const int64 new_world_ns = std::min(dev.ns, next_ns);
+        m_scheduler->timerTick(static_cast<int>(new_world_ns - world_ns));
+        world_ns = new_world_ns;
+        m_clocked_world_ns = world_ns;
 
-        } else if (num_devices == 2) {
-            // this is an important case of #0 being cpu, and #1 being
-            // the 8080 in the MXD.  the cpu is faster than the 8080,
-            // so let it run a few cycles between reevaluations of which
-            // device is ahead in time.
-
-            // at the start of a timeslice, shift time for all cards towards
-            // zero to prevent overflowing the 32b nanosecond counters
-            const uint32 rebase = std::min(m_clocked_devices[0].ns,
-                                           m_clocked_devices[1].ns);
-            m_clocked_devices[0].ns -= rebase;
-            m_clocked_devices[1].ns -= rebase;
-
-            // we try to keep the devices in time lockstep as much as we can.
-            // each device has a nanosecond counter. the list of devices is
-            // kept in sorted order of increasing time. we call entry 0, adjust
-            // its time, then move it to the right place in the list.
-            while (slice_ns > 0) {
-                const bool run_vp = (   m_clocked_devices[0].ns
-                                     <= m_clocked_devices[1].ns);
-                int op_ns_signed = 0;
-                uint32 op_ns = 0;
-                if (run_vp) {
-                    // the 2200vp executes about six instructions in the time
-                    // the 8080 does one typical instruction
-                    auto cb = m_clocked_devices[0].callback_fn;
-                    op_ns_signed  = cb();
-                    op_ns_signed += cb();
-                    op_ns_signed += cb();
-                    op_ns_signed += cb();
-                    op_ns_signed += cb();
-                    op_ns_signed += cb();
-                    op_ns = static_cast<uint32>(op_ns_signed);
-                    m_clocked_devices[0].ns += op_ns;
-                } else {
-                    auto cb = m_clocked_devices[1].callback_fn;
-                    op_ns_signed = cb();
-                    op_ns = static_cast<uint32>(op_ns_signed);
-                    m_clocked_devices[1].ns += op_ns;
-                }
+        if (m_cpu->status() != Cpu2200::CPU_RUNNING) {
+            break; // finish the timeslice
+        }
+    }
+}
 
-                if (op_ns > 50000) {
-                    // something went wrong; finish the timeslice
-                    slice_ns = 0;
-                } else {
-                    const uint32 clamp_ns =
-                        std::max(m_clocked_devices[1].ns, m_clocked_devices[0].ns)
-                      - std::min(m_clocked_devices[1].ns, m_clocked_devices[0].ns);
-                    const uint32 delta_ns = std::min(op_ns, clamp_ns);
-                    slice_ns -= delta_ns;
-                    scheduler->timerTick(delta_ns);
-                }
-            }
 
-        } else {
+// the same as runClockedDevices(), for just the cpu (#0) and one other
+// device (#1), which is the usual MXD configuration
+void
+System2200::runTwoClockedDevices(clocked_device_t *devs, int64 slice_ns,
+                                 int64 skew_ns)
+{
+    clocked_device_t &dev0 = devs[0];
+    clocked_device_t &dev1 = devs[1];
+
+    int64 world_ns = m_clocked_world_ns;
+    const int64 slice_end_ns = world_ns + slice_ns;
+    while (world_ns < slice_end_ns) {
+        // whichever is behind runs until it passes the other one;
+        // the cpu wins ties, so it runs until it is ahead
+        const bool run0 = (dev0.ns <= dev1.ns);
+        clocked_device_t &dev = (run0) ? dev0 : dev1;
+        const int64 next_ns   = (run0) ? dev1.ns : dev0.ns;
+        assert(dev.ns == world_ns);
+
+        const int64 gap_ns = next_ns - world_ns + ((run0) ? 1 : 0);
+        const int64 budget_ns = std::min(slice_end_ns - world_ns, gap_ns + skew_ns);
+        dev.ns += dev.callback_fn(budget_ns, m_scheduler->nsUntilEvent());
+
+        const int64 new_world_ns = std::min(dev.ns, next_ns);
+        m_scheduler->timerTick(static_cast<int>(new_world_ns - world_ns));
+        world_ns = new_world_ns;
+
+        if (m_cpu->status() != Cpu2200::CPU_RUNNING) {
+            break; // finish the timeslice
+        }
+    }
+    m_clocked_world_ns = world_ns;
+}
 
-            // there are multiple devices
 
-            // moving m_clocked_devices entries around it expensive,
-            // so this array is used to maintain the order of the devices
-            // where [0] is the one most behind in time.
-            std::vector<int> order;
-            for (int n=0; n < num_devices; n++) {
-                order.push_back(n);
-            }
-            // bubble sort in time order
-            for (int n=0; n < num_devices; n++) {
-                for (int k=0; k < num_devices-1; k++) {
-                    if (m_clocked_devices[order[k]].ns >
-                        m_clocked_devices[order[k+1]].ns) {
-                        std::swap(order[k], order[k+1]);
-                    }
+// when there are parallel devices, the timeslice is run as a series of
+// windows.  in each, the workers and the clocked devices all advance by the
+// window size, then anything which crossed between them is exchanged.
+// each side sees the other's bus activity up to a window late, but as the
+// exchange happens at fixed points in simulated time, the results don't
+// depend on how the host happens to schedule the threads.
+void
+System2200::runParallelDevices(int64 slice_ns)
+{
+    const int64 window_ns = m_cfg->getMxdWindowNs();
+    assert(window_ns > 0);
+
+    for (int64 done_ns = 0; done_ns < slice_ns; done_ns += window_ns) {
+        const int64 win_ns = std::min(window_ns, slice_ns - done_ns);
+
+        for (auto &dev : m_parallel_devices) {
+            if (dev->thread.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(dev->mutex);
+                    dev->window_ns = win_ns;
+                    dev->go_gen++;
                 }
+                dev->cv.notify_all();
             }
-            // double check they are sorted in time order
-            for (int k=0; k < num_devices-1; k++) {
-                assert (m_clocked_devices[order[k]].ns <=
-                        m_clocked_devices[order[k+1]].ns);
-            }
+        }
 
-            // at the start of a timeslice, shift time for all cards towards
-            // zero to prevent overflowing the 32b nanosecond counters
-            const uint32 rebase = m_clocked_devices[order[0]].ns;
-            for (auto idx : order) {
-                assert(m_clocked_devices[idx].ns >= rebase);
-                m_clocked_devices[idx].ns -= rebase;
-            }
+        runClockedDevices(win_ns);
 
-            // we try to keep the devices in time lockstep as much as we can.
-            // each device has a nanosecond counter. the list of devices is
-            // kept in sorted order of increasing time. we call entry 0, adjust
-            // its time, then move it to the right place in the list.
-            while (slice_ns > 0) {
-                auto cb = m_clocked_devices[order[0]].callback_fn;
-                const int op_ns_signed = cb();
-                const uint32 op_ns = static_cast<uint32>(op_ns_signed);
-                if (op_ns > 50000) {
-                    slice_ns = 0; // finish the timeslice
-                } else {
-                    // we can't advance world time by op_ns if the next most
-                    // oldest device would conceptually start before time
-                    // gets to where device[0] ended up after op_ns.
-                    // TODO: investigate a more efficient way to do all
-                    // of this vs min() and then later sorting the clocked devices.
-                    // at the very least, special case having two devices,
-                    // rather than all this generalized sorting for N devices.
-                    const uint32 clamp_ns = m_clocked_devices[order[1]].ns
-                                          - m_clocked_devices[order[0]].ns;
-                    const uint32 delta_ns = std::min(op_ns, clamp_ns);
-                    slice_ns -= delta_ns;
-                    scheduler->timerTick(delta_ns);
-                    const uint32 new_ns = (m_clocked_devices[order[0]].ns += op_ns);
-                    auto entry0 = order[0];
-                    int i;
-                    for (i=0; i < num_devices-1; ++i) {
-                        if (m_clocked_devices[order[i+1]].ns < new_ns) {
-                            order[i] = order[i+1];
-                        } else {
-                            break;
-                        }
-                    }
-                    order[i] = entry0;
-                }
+        for (auto &dev : m_parallel_devices) {
+            if (dev->thread.joinable()) {
+                std::unique_lock<std::mutex> lock(dev->mutex);
+                parallel_device_t *d = dev.get();
+                dev->cv.wait(lock, [d]() { return d->done_gen == d->go_gen; });
+            } else {
+                dev->run_fn(win_ns);
             }
-        } // 3 or more clocked devices
-
-        sim_time_ns     += ts_ms;
-        adjust_sim_time += ts_ms;
+        }
+        for (auto &dev : m_parallel_devices) {
+            dev->sync_fn();
+        }
 
-        if (cpu->status() != Cpu2200::CPU_RUNNING) {
-            UI_warn("CPU halted -- must reset");
-            cpu->reset(true);  // hard reset
-            return;
+        if (m_cpu->status() != Cpu2200::CPU_RUNNING) {
+            break; // finish the timeslice
         }
+    }
+}
 
-        sim_seconds = static_cast<unsigned long>(
-                            (sim_time_ns/1000) & 0xFFFFFFFF);
-
-        const int real_seconds_now = static_cast<int>(realtime_elapsed/1000);
-        if (real_seconds != real_seconds_now) {
-            real_seconds = real_seconds_now;
-            if (perf_hist_len > 10) {
-                // compute running performance average over the
-                // last real second or so
-                const int n1 = (perf_hist_ptr - 1 + perf_hist_size)
-                             % perf_hist_size;
-                int64 ms_diff = 0;
-                int slices = 0;
-                for (int n=1; n < perf_hist_len; n+=10) {
-                    const int n0 = (n1 - n + perf_hist_size) % perf_hist_size;
-                    slices = n;
-                    ms_diff = (perf_real_ms[n1] - perf_real_ms[n0]);
-                    if (ms_diff > 1000) {
-                        break;
-                    }
-                }
-                const float relative_speed = static_cast<float>(slices*ts_ms)
-                                           / static_cast<float>(ms_diff);
+// simulate one timeslice.  it returns the host time (per host::getTimeNs())
+// the caller should sleep until before the next slice, or 0 if it shouldn't
+// sleep.  if the cpu isn't running, it returns -1.  if max_ns is 0, no time
+// passes, and it returns 0.
+int64
+System2200::simulateSlice(int64 max_ns)
+{
+    if (m_cpu->status() != Cpu2200::CPU_RUNNING) {
+        return -1;
+    }
+    if (max_ns <= 0) {
+        return 0;
+    }
 
-                // update the status bar with simulated seconds and performance
-                UI_setSimSeconds(sim_seconds, relative_speed);
-            }
-        }
+    const bool paced = isCpuSpeedRegulated() && !m_free_running;
+    const int64 slice_ns = std::min(m_pacer.startSlice(host::getTimeNs(), paced),
+                                    max_ns);
+
+    // simulate one timeslice's worth of instructions.
+    // each device runs in batches, which end no later than the next
+    // timer, so scheduler callbacks happen at the same point in the
+    // instruction stream as they would if each op were ticked.
+    if (m_parallel_devices.empty()) {
+        runClockedDevices(slice_ns);
+    } else {
+        runParallelDevices(slice_ns);
+    }
 
-        // at least yield so we don't hog the whole machine
-        host::sleep(0);
+    m_sim_time_ns += slice_ns;
+
+    const int64 wake_ns = m_pacer.endSlice(host::getTimeNs());
+
+    if (m_cpu->status() != Cpu2200::CPU_RUNNING) {
+        UI_warn("CPU halted -- must reset");
+        m_cpu->reset(true);  // hard reset
+        return -1;
     }
+
+    return wake_ns;
 }
 
 // ========================================================================
@@ -800,71 +1621,71 @@ system2200::emulateTimeslice(int ts_ms)
 
 // address byte strobe
 void
-system2200::dispatchAbsStrobe(uint8 byte)
+System2200::dispatchAbsStrobe(uint8 byte)
 {
     // done if reselecting same device
-    if (byte == curIoAddr) {
+    if (byte == m_cur_io_addr) {
         return;
     }
 
     // deselect old card
-    if ((curIoAddr > 0) && (ioMap[curIoAddr].slot >= 0)) {
-        (card_in_slot[ioMap[curIoAddr].slot])->deselect();
+    if ((m_cur_io_addr > 0) && (m_io_map[m_cur_io_addr].slot >= 0)) {
+        (m_card_in_slot[m_io_map[m_cur_io_addr].slot])->deselect();
     }
-    curIoAddr = byte;
+    m_cur_io_addr = byte;
 
-    const int cpu_type = cpu->getCpuType();
+    const int cpu_type = m_cpu->getCpuType();
     const bool vp_mode = (cpu_type != Cpu2200::CPUTYPE_2200B)
                       && (cpu_type != Cpu2200::CPUTYPE_2200T);
 
     // by default, assume the device is not ready.
     // the addressed card will turn it back below if appropriate
-    if (curIoAddr == 0x00 && vp_mode) {
+    if (m_cur_io_addr == 0x00 && vp_mode) {
         // the (M)VP CPU special cases address 00 and forces ready true
-        cpu->setDevRdy(true);
+        m_cpu->setDevRdy(true);
         return;
     }
     // nobody is driving, so it defaults to 0
-    cpu->setDevRdy(false);
+    m_cpu->setDevRdy(false);
 
     // let the selected card know it has been chosen
-    if (ioMap[curIoAddr].slot >= 0) {
-        const int slot = ioMap[curIoAddr].slot;
-        card_in_slot[slot]->select();
+    if (m_io_map[m_cur_io_addr].slot >= 0) {
+        const int slot = m_io_map[m_cur_io_addr].slot;
+        m_card_in_slot[slot]->select();
         return;
     }
 
     // MVP OS probes addr 80 to test for the bank select register (BSR).
     // for non-VSLI CPUs, it would be annoying to get warned about it.
-    if (vp_mode && (curIoAddr == 0x80)) {
+    if (vp_mode && (m_cur_io_addr == 0x80)) {
         return;
     }
 
     // MVP allows extra RAM to be used as a RAM disk at /340
-    if (vp_mode && (curIoAddr == 0x40)) {
+    if (vp_mode && (m_cur_io_addr == 0x40)) {
         return;
     }
 
     // warn the user that a non-existent device has been selected
-    if (!ioMap[curIoAddr].ignore && current_cfg->getWarnIo()
-        && (curIoAddr != 0x00)  // intentionally select nothing
-        && (curIoAddr != 0x46)  // testing for mxd at 0x4n
-        && (curIoAddr != 0x86)  // testing for mxd at 0x8n
-        && (curIoAddr != 0xC6)  // testing for mxd at 0xCn
+    if (!m_io_map[m_cur_io_addr].ignore && m_cfg->getWarnIo()
+        && (m_cur_io_addr != 0x00)  // intentionally select nothing
+        && (m_cur_io_addr != 0x46)  // testing for mxd at 0x4n
+        && (m_cur_io_addr != 0x86)  // testing for mxd at 0x8n
+        && (m_cur_io_addr != 0xC6)  // testing for mxd at 0xCn
        ) {
         const bool response = UI_confirm(
                     "Warning: selected non-existent I/O device %02X\n"
                     "Should I warn you of further accesses to this device?",
-                    curIoAddr);
+                    m_cur_io_addr);
         // suppress further warnings
-        ioMap[curIoAddr].ignore = !response;
+        m_io_map[m_cur_io_addr].ignore = !response;
     }
 }
 
 
 // output byte strobe
 void
-system2200::dispatchObsStrobe(uint8 byte)
+System2200::dispatchObsStrobe(uint8 byte)
 {
 // p 6-2 of the Wang 2200 Service Manual:
 // When the controller is selected (select latch set), the Ready/Busy
@@ -874,9 +1695,9 @@ system2200::dispatchObsStrobe(uint8 byte)
 // allowing the CPU to do another I/O operation.  Normally, the device
 // being used will generate a Busy indicator after the I/O Bus (!OB1 - !OB8)
 // has been strobed by !OBS, the CPU output strobe.
-    if (curIoAddr > 0) {
-        if (ioMap[curIoAddr].slot >= 0) {
-            card_in_slot[ioMap[curIoAddr].slot]->strobeOBS(byte);
+    if (m_cur_io_addr > 0) {
+        if (m_io_map[m_cur_io_addr].slot >= 0) {
+            m_card_in_slot[m_io_map[m_cur_io_addr].slot]->strobeOBS(byte);
         }
     }
 }
@@ -884,37 +1705,37 @@ system2200::dispatchObsStrobe(uint8 byte)
 
 // handles CBS strobes
 void
-system2200::dispatchCbsStrobe(uint8 byte)
+System2200::dispatchCbsStrobe(uint8 byte)
 {
     // each card handles CBS in its own way.
     //   * many cards simply ignore it
     //   * some use it like another OBS strobe to capture some type
     //     of command word
     //   * some cards use it to trigger an IBS strobe
-    if ((curIoAddr > 0) && (ioMap[curIoAddr].slot >= 0)) {
-        card_in_slot[ioMap[curIoAddr].slot]->strobeCBS(byte);
+    if ((m_cur_io_addr > 0) && (m_io_map[m_cur_io_addr].slot >= 0)) {
+        m_card_in_slot[m_io_map[m_cur_io_addr].slot]->strobeCBS(byte);
     }
 }
 
 
 // notify selected card when CPB changes
 void
-system2200::dispatchCpuBusy(bool busy)
+System2200::dispatchCpuBusy(bool busy)
 {
-    if ((curIoAddr > 0) && (ioMap[curIoAddr].slot >= 0)) {
+    if ((m_cur_io_addr > 0) && (m_io_map[m_cur_io_addr].slot >= 0)) {
         // signal that we want to get something
-        card_in_slot[ioMap[curIoAddr].slot]->setCpuBusy(busy);
+        m_card_in_slot[m_io_map[m_cur_io_addr].slot]->setCpuBusy(busy);
     }
 }
 
 
 // the CPU can poll IB5 without any other strobe.  return that bit.
 int
-system2200::cpuPollIB()
+System2200::cpuPollIB()
 {
-    if  ((curIoAddr > 0) && (ioMap[curIoAddr].slot >= 0)) {
+    if  ((m_cur_io_addr > 0) && (m_io_map[m_cur_io_addr].slot >= 0)) {
         // signal that we want to get something
-        return card_in_slot[ioMap[curIoAddr].slot]->getIB();
+        return m_card_in_slot[m_io_map[m_cur_io_addr].slot]->getIB();
     }
     return 0;
 }
@@ -926,10 +1747,10 @@ system2200::cpuPollIB()
 
 // register a handler for a key event to a given keyboard terminal
 void
-system2200::registerKb(int io_addr, int term_num, const kbCallback &cb)
+System2200::registerKb(int io_addr, int term_num, const kbCallback &cb)
 {
     // check that it isn't already registered
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr && term_num == kb.term_num) {
             UI_warn("Attempt to register kb handler at io_addr=0x%02x, term_num=%d twice",
                     io_addr, term_num);
@@ -937,16 +1758,16 @@ system2200::registerKb(int io_addr, int term_num, const kbCallback &cb)
         }
     }
     kb_route_t kb = { io_addr, term_num, cb, nullptr };
-    keyboard_routes.push_back(kb);
+    m_keyboard_routes.push_back(kb);
 }
 
 
 void
-system2200::unregisterKb(int io_addr, int term_num)
+System2200::unregisterKb(int io_addr, int term_num)
 {
-    for (auto it = begin(keyboard_routes); it != end(keyboard_routes); ++it) {
+    for (auto it = begin(m_keyboard_routes); it != end(m_keyboard_routes); ++it) {
         if (io_addr == it->io_addr && term_num == it->term_num) {
-            keyboard_routes.erase(it);
+            m_keyboard_routes.erase(it);
             return;
         }
     }
@@ -957,9 +1778,9 @@ system2200::unregisterKb(int io_addr, int term_num)
 
 // send a key event to the specified keyboard/terminal
 void
-system2200::dispatchKeystroke(int io_addr, int term_num, int keyvalue)
+System2200::dispatchKeystroke(int io_addr, int term_num, int keyvalue)
 {
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr && term_num == kb.term_num) {
             if (kb.script_handle) {
                 // a script is running; ignore everything but HALT
@@ -981,7 +1802,7 @@ system2200::dispatchKeystroke(int io_addr, int term_num, int keyvalue)
 
 // request the contents of a file to be fed in as a keyboard stream
 void
-system2200::invokeKbScript(int io_addr, int term_num,
+System2200::invokeKbScript(int io_addr, int term_num,
                            const std::string &filename)
 {
     if (isScriptModeActive(io_addr, term_num)) {
@@ -990,7 +1811,7 @@ system2200::invokeKbScript(int io_addr, int term_num,
         return;
     }
 
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr && term_num == kb.term_num) {
             const int flags = ScriptFile::SCRIPT_META_INC
                             | ScriptFile::SCRIPT_META_HEX
@@ -1014,9 +1835,9 @@ system2200::invokeKbScript(int io_addr, int term_num,
 
 // indicates if a script is currently active on a given terminal
 bool
-system2200::isScriptModeActive(int io_addr, int term_num)
+System2200::isScriptModeActive(int io_addr, int term_num)
 {
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr && term_num == kb.term_num) {
             return (kb.script_handle != nullptr);
         }
@@ -1029,10 +1850,10 @@ system2200::isScriptModeActive(int io_addr, int term_num)
 
 // return how many terminals at this io_addr have active scripts
 int
-system2200::numActiveScripts(int io_addr) noexcept
+System2200::numActiveScripts(int io_addr) noexcept
 {
     int count = 0;
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr) {
             count++;
         }
@@ -1045,9 +1866,9 @@ system2200::numActiveScripts(int io_addr) noexcept
 // invoked with the next character from the script.  it returns true if
 // a script supplied a character.
 bool
-system2200::pollScriptInput(int io_addr, int term_num)
+System2200::pollScriptInput(int io_addr, int term_num)
 {
-    for (auto &kb : keyboard_routes) {
+    for (auto &kb : m_keyboard_routes) {
         if (io_addr == kb.io_addr && term_num == kb.term_num) {
             if (!kb.script_handle) {
                 return false;
@@ -1074,19 +1895,19 @@ system2200::pollScriptInput(int io_addr, int term_num)
 // returns false if the slot is empty, otherwise true.
 // returns card type index and io address via pointers.
 bool
-system2200::getSlotInfo(int slot, int *cardtype_idx, int *addr) noexcept
+System2200::getSlotInfo(int slot, int *cardtype_idx, int *addr) const noexcept
 {
     assert(0 <= slot && slot < NUM_IOSLOTS);
-    if (!current_cfg->isSlotOccupied(slot)) {
+    if (!m_cfg->isSlotOccupied(slot)) {
         return false;
     }
 
     if (cardtype_idx != nullptr) {
-        *cardtype_idx = static_cast<int>(current_cfg->getSlotCardType(slot));
+        *cardtype_idx = static_cast<int>(m_cfg->getSlotCardType(slot));
     }
 
     if (addr != nullptr) {
-        *addr = current_cfg->getSlotCardAddr(slot);
+        *addr = m_cfg->getSlotCardAddr(slot);
     }
 
     return true;
@@ -1096,14 +1917,14 @@ system2200::getSlotInfo(int slot, int *cardtype_idx, int *addr) noexcept
 // returns the IO address of the n-th keyboard (0-based).
 // if (n >= # of keyboards), returns -1.
 int
-system2200::getKbIoAddr(int n) noexcept
+System2200::getKbIoAddr(int n) const noexcept
 {
     int num = 0;
 
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
-        if (current_cfg->getSlotCardType(slot) == IoCard::card_t::keyboard) {
+        if (m_cfg->getSlotCardType(slot) == IoCard::card_t::keyboard) {
             if (num == n) {
-                return current_cfg->getSlotCardAddr(slot);
+                return m_cfg->getSlotCardAddr(slot);
             }
             num++;
         }
@@ -1116,14 +1937,14 @@ system2200::getKbIoAddr(int n) noexcept
 // returns the IO address of the n-th printer (0-based).
 // if (n >= # of printers), returns -1.
 int
-system2200::getPrinterIoAddr(int n) noexcept
+System2200::getPrinterIoAddr(int n) const noexcept
 {
     int num = 0;
 
     for (int slot=0; slot < NUM_IOSLOTS; slot++) {
-        if (current_cfg->getSlotCardType(slot) == IoCard::card_t::printer) {
+        if (m_cfg->getSlotCardType(slot) == IoCard::card_t::printer) {
             if (num == n) {
-                return current_cfg->getSlotCardAddr(slot);
+                return m_cfg->getSlotCardAddr(slot);
             }
             num++;
         }
@@ -1136,27 +1957,40 @@ system2200::getPrinterIoAddr(int n) noexcept
 // return the instance handle of the device at the specified IO address.
 // consumers of this function don't own the card, so a raw pointer is used.
 IoCard*
-system2200::getInstFromIoAddr(int io_addr) noexcept
+System2200::getInstFromIoAddr(int io_addr) const noexcept
 {
     assert((io_addr >= 0) && (io_addr <= 0xFFF));
-    return card_in_slot[ioMap[io_addr & 0xFF].slot].get();
+    return m_card_in_slot[m_io_map[io_addr & 0xFF].slot].get();
 }
 
 
 // given a slot, return the "this" element
 // consumers of this function don't own the card, so a raw pointer is used.
 IoCard*
-system2200::getInstFromSlot(int slot) noexcept
+System2200::getInstFromSlot(int slot) const noexcept
 {
     assert(slot >=0 && slot < NUM_IOSLOTS);
-    return card_in_slot[slot].get();
+    return m_card_in_slot[slot].get();
+}
+
+
+// returns true if the slot contains a disk controller
+bool
+System2200::isDiskController(int slot) const noexcept
+{
+    assert(slot >= 0 && slot < NUM_IOSLOTS);
+
+    int cardtype_idx;
+    const bool ok = getSlotInfo(slot, &cardtype_idx, nullptr);
+
+    return ok && (cardtype_idx == static_cast<int>(IoCard::card_t::disk));
 }
 
 
 // find slot number of disk controller #n.
 // returns true if successful.
 bool
-system2200::findDiskController(const int n, int *slot) noexcept
+System2200::findDiskController(const int n, int *slot) const noexcept
 {
     const int num_ioslots = NUM_IOSLOTS;
     int numfound = 0;
@@ -1181,8 +2015,8 @@ system2200::findDiskController(const int n, int *slot) noexcept
 // returns true if successful.
 // note: slot, drive, io_addr are optionally nullptr.
 bool
-system2200::findDisk(const std::string &filename,
-                     int *slot, int *drive, int *io_addr)
+System2200::findDisk(const std::string &filename,
+                     int *slot, int *drive, int *io_addr) const
 {
     for (int controller=0; ; controller++) {
 
@@ -1191,16 +2025,18 @@ system2200::findDisk(const std::string &filename,
             break;
         }
 
-        const auto cfg = current_cfg->getCardConfig(slt);
+        const auto cfg = m_cfg->getCardConfig(slt);
         const auto dcfg = dynamic_cast<const DiskCtrlCfgState*>(cfg.get());
         assert(dcfg);
+        const auto disk = dynamic_cast<const IoCardDisk*>(getInstFromSlot(slt));
+        assert(disk);
         const int num_drives = dcfg->getNumDrives();
         for (int d=0; d < num_drives; d++) {
-            const int stat = IoCardDisk::wvdDriveStatus(slt, d);
+            const int stat = disk->driveStatus(d);
             if ((stat & IoCardDisk::WVD_STAT_DRIVE_EXISTENT) != 0  &&
                 (stat & IoCardDisk::WVD_STAT_DRIVE_OCCUPIED) != 0) {
                 std::string fname;
-                bool ok = IoCardDisk::wvdGetFilename(slt, d, &fname);
+                bool ok = disk->getFilename(d, &fname);
                 assert(ok);
                 if (filename == fname) {
                     if (slot != nullptr) {
@@ -1222,6 +2058,7 @@ system2200::findDisk(const std::string &filename,
     return false;
 }
 
+
 // ------------------------------------------------------------------------
 // legal cpu system configurations
 // ------------------------------------------------------------------------
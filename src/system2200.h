@@ -1,74 +1,143 @@
 // ======================================================================
-// system2200 contains the various components of the system:
+// System2200 is one complete emulated machine:
 //    scheduler
-//    current cpu
+//    cpu
+//    the cards plugged into its slots
 //    config state
 //
 // It is responsible for connecting the various pieces together --
-// making sure the world gets built in proper order on start up, that
-// configuration changes cause the tear down and rebuild of the world,
-// things get torn down at the end of the world cleanly (special attention
-// for cleaning up singletons).  This unit knows what kind of card is
-// plugged into each slot and what card corresponds to which address.
-// When a CPU wants to perform I/O to a given address, this module routes
-// the requests to the right place.
+// making sure the world gets built in proper order, that configuration
+// changes cause the tear down and rebuild of the world, and that things
+// get torn down at the end of the world cleanly.  It knows what kind of
+// card is plugged into each slot and what card corresponds to which
+// address.  When its CPU wants to perform I/O to a given address, it
+// routes the requests to the right place.
+//
+// Nothing in a System2200 is shared with any other, so any number of them
+// can be built, and each can be run on a thread of its own.
+//
+// The system2200 namespace holds the parts of the emulator which there is
+// only one of per process: the machine the UI is attached to, the thread
+// which runs it, the world lock, and the bookkeeping for start up and
+// shut down.  Its functions which are about the machine forward to that
+// primary System2200.
 // ======================================================================
 
 #ifndef _INCLUDE_SYSTEM2200_H_
 #define _INCLUDE_SYSTEM2200_H_
 
+#include "Pacer.h"
 #include "w2200.h"
 
+#include <array>
+#include <mutex>
+
+class Cpu2200;
 class IoCard;
+class Scheduler;
+class ScriptFile;
 class SysCfgState;
+struct input_event_t;
+struct sched_stats_t;
 
-using clkCallback = std::function<int()>;
+// a clocked device runs for up to budget_ns, stopping early when next_event_ns
+// has elapsed, and returns how many ns it actually ran.  see Cpu2200::execFor().
+using clkCallback = std::function<int64(int64 budget_ns, int64 next_event_ns)>;
 using  kbCallback = std::function<void(int)>;
+using publishCallback = std::function<void()>;
 
-// fixed services related to the overall simulation
-namespace system2200
-{
-    // because everything is static, we have to be told when
-    // the sim is really starting and ending.
-    void initialize();  // Time=0
-    void cleanup();     // Armageddon
+// a parallel device runs window_ns at a time on a worker thread of its own,
+// while the cpu runs the same window on the emulation thread.  between
+// windows, with every worker stopped, its sync callback is called on the
+// emulation thread to exchange whatever passed between it and the cpu.
+using parRunCallback  = std::function<void(int64 window_ns)>;
+using parSyncCallback = std::function<void()>;
 
-    // shut down the application
-    void terminate() noexcept;
+// ======================================================================
+// one emulated machine
 
-    // (un)register a callback function which advances with the clock
-    void registerClockedDevice(const clkCallback &cb);
-    void unregisterClockedDevice(const clkCallback &cb) noexcept;
+class System2200
+{
+public:
+    CANT_ASSIGN_OR_COPY_CLASS(System2200);
+    explicit System2200(const SysCfgState &cfg);
+    ~System2200();
 
-    // set current system configuration -- may cause reset
+    // change the configuration.  if the change is major, the existing
+    // machine is torn down and rebuilt according to the new spec.
     void setConfig(const SysCfgState &new_cfg);
 
-    // give access to components
-    const SysCfgState& config() noexcept;
+    // true if setConfig(new_cfg) would tear down and rebuild the machine
+    bool needsRebuild(const SysCfgState &new_cfg) const;
 
-    // indicate that user wants to reconfigure the system
-    void reconfigure() noexcept;
+    // give access to components
+    const SysCfgState& config() const noexcept;
 
     // reset the whole system
     void reset(bool cold_reset);
 
     // change/query the simulation speed
     void regulateCpuSpeed(bool regulated) noexcept;
-    bool isCpuSpeedRegulated() noexcept;
+    bool isCpuSpeedRegulated() const noexcept;
 
-    // change/query the simulation speed
+    // change/query the disk emulation speed
     void setDiskRealtime(bool realtime) noexcept;
-    bool isDiskRealtime() noexcept;
+    bool isDiskRealtime() const noexcept;
 
-    // temporarily halt emulation
-    void freezeEmu(bool freeze) noexcept;
+    // run flat out, even if the speed is regulated.  the devices still
+    // time things as they do at real speed; there is just no sleeping.
+    void setFreeRunning(bool free_running) noexcept;
 
-    // called whenever there is free time.  it returns true
-    // if it wants to be called back later when idle again
-    bool onIdle();
+    // (un)register a callback function which advances with the clock
+    void registerClockedDevice(const clkCallback &cb);
+    void unregisterClockedDevice(const clkCallback &cb) noexcept;
+
+    // (un)register a callback which hands a copy of some device state
+    // (eg, a screen image) to the UI at the end of each timeslice
+    void registerPublisher(const void *owner, const publishCallback &cb);
+    void unregisterPublisher(const void *owner);
+
+    // (un)register a device which runs on a worker thread (see above).
+    // the window size is set by the mxd_window_ns configuration setting.
+    void registerParallelDevice(const void *owner,
+                                const parRunCallback  &run_fn,
+                                const parSyncCallback &sync_fn);
+    void unregisterParallelDevice(const void *owner);
+
+    // simulate one timeslice; the pacer picks its length, but it is no
+    // more than max_ns.  it returns the host time (per host::getTimeNs())
+    // to sleep until before the next slice, or 0 if there should be no
+    // sleep.  if the cpu isn't running, it returns -1.  if max_ns is 0,
+    // it does nothing and returns 0.
+    int64 simulateSlice(int64 max_ns = INT64_MAX);
+
+    // call the registered publishers
+    void publish();
+
+    // amount of emulated time since the machine was built, in ns
+    int64 getSimTimeNs() const noexcept { return m_sim_time_ns; }
 
-    // simulate a few ms worth of instructions
-    void emulateTimeslice(int ts_ms);  // timeslice in ms
+    // the scheduler's notion of the time.  the slices may overshoot a
+    // little, so it differs from getSimTimeNs(), but it is exactly the
+    // same every time the machine is run with the same input.
+    int64 getSchedulerTimeNs() const noexcept;
+
+    // how pacing has been going lately
+    pace_stats_t getPaceStats() const { return m_pacer.getStats(); }
+
+    // timer activity of the event scheduler
+    const sched_stats_t &getSchedulerStats() const;
+
+    // microinstructions the cpu has performed since the machine was built
+    uint64 getCpuOpCount() const noexcept;
+
+    // ---- machine state ----
+
+    // save the state of the whole machine to a file, or restore it from one.
+    // the configuration must be the same as when the state was saved.
+    // problems are reported to the user, and false is returned.
+    bool saveState(const std::string &filename);
+    bool loadState(const std::string &filename);
 
     // ---- I/O dispatch logic ----
 
@@ -106,29 +175,244 @@ namespace system2200
 
     // returns false if the slot is empty, otherwise true.
     // returns card type index and io address via pointers.
-    bool getSlotInfo(int slot, int *cardtype_idx, int *addr) noexcept;
+    bool getSlotInfo(int slot, int *cardtype_idx, int *addr) const noexcept;
 
     // returns the IO address of the n-th keyboard (0-based).
     // if (n >= # of keyboards), returns -1.
-    int getKbIoAddr(int n) noexcept;
+    int getKbIoAddr(int n) const noexcept;
 
     // returns the IO address of the n-th printer (0-based).
     // if (n >= # of printers), returns -1.
-    int getPrinterIoAddr(int n) noexcept;
+    int getPrinterIoAddr(int n) const noexcept;
 
     // return the instance handle of the device at the specified IO address
-    // used by IoCardKeyboard.c
-    IoCard* getInstFromIoAddr(int io_addr) noexcept;
+    IoCard* getInstFromIoAddr(int io_addr) const noexcept;
 
     // given a slot, return the "this" element
-    IoCard* getInstFromSlot(int slot) noexcept;
+    IoCard* getInstFromSlot(int slot) const noexcept;
 
     // find slot number of disk controller #n (starting with 0).
     // returns true if successful.
-    bool findDiskController(int n, int *slot) noexcept;
+    bool findDiskController(int n, int *slot) const noexcept;
 
     // find slot,drive of any disk controller with disk matching name.
     // returns true if successful.
+    bool findDisk(const std::string &filename, int *slot, int *drive, int *io_addr) const;
+
+private:
+    // returns true if the slot contains a disk controller
+    bool isDiskController(int slot) const noexcept;
+
+    // break down any resources currently committed
+    void breakDownCards() noexcept;
+
+    // advance the clocked devices, and maybe the parallel devices too
+    void runClockedDevices(int64 slice_ns);
+    void runParallelDevices(int64 slice_ns);
+
+    // for coordinating events in the emulator
+    std::shared_ptr<Scheduler> m_scheduler = nullptr;
+
+    // the central processing unit
+    std::shared_ptr<Cpu2200> m_cpu = nullptr;
+
+    // active system configuration
+    std::shared_ptr<SysCfgState> m_cfg = nullptr;
+
+    // ---- I/O dispatch ----
+
+    // mapping i/o addresses to devices
+    struct iomap_t {
+        int  slot;      // slot number of the device which "owns" this address
+        bool ignore;    // if false, access generates a warning message if ...
+                        // ... there is no device at that address
+    };
+
+    // pointer to card in a given slot
+    std::array<std::unique_ptr<IoCard>, NUM_IOSLOTS> m_card_in_slot;
+
+    // pointer to card responding to given address
+    std::array<iomap_t, 256> m_io_map;
+
+    // address of most recent ABS
+    int m_cur_io_addr = -1;
+
+    // ---- speed regulation ----
+
+    // picks the timeslice length, and when regulated, how long to sleep
+    Pacer m_pacer;
+
+    bool  m_free_running = false;  // see setFreeRunning()
+    int64 m_sim_time_ns  = 0;      // simulated time elapsed
+
+    // ---- clocked devices ----
+
+    // things which get called as time advances. it is used by the
+    // core 2200 CPU and any peripheral which uses a microprocessor.
+    // each device has its own sense of time, in ns, which is somewhere at
+    // or past m_clocked_world_ns.
+    struct clocked_device_t {
+        clkCallback callback_fn;
+        int64       ns;          // local time, in nanoseconds
+    };
+    std::vector<clocked_device_t> m_clocked_devices;
+
+    // indices into m_clocked_devices, in order of local time.
+    // [0] is the device which is furthest behind, and is the one to run next.
+    std::vector<int> m_clocked_order;
+
+    // time which all clocked devices have reached
+    int64 m_clocked_world_ns = 0;
+
+    // true if device a should run before device b
+    static bool clockedBefore(const clocked_device_t *devs, int a, int b) noexcept;
+
+    // runClockedDevices() for the cpu plus one other device
+    void runTwoClockedDevices(clocked_device_t *devs, int64 slice_ns, int64 skew_ns);
+
+    // ---- keyboard input routing table ----
+
+    struct kb_route_t {
+        int         io_addr;
+        int         term_num;       // 0..3 for smart terms; 0 for display controllers
+        kbCallback  callback_fn;
+        // can't use unique_ptr because it doesn't allow copy assignment
+        // (only move) and std::vector requires copy assignment.
+        std::shared_ptr<ScriptFile> script_handle;
+    };
+    std::vector<kb_route_t> m_keyboard_routes;
+
+    // ---- state publishing table ----
+
+    // things which hand a copy of their state to the UI after each timeslice
+    struct publisher_t {
+        const void      *owner;
+        publishCallback  callback_fn;
+    };
+    std::vector<publisher_t> m_publishers;
+
+    // ---- parallel devices ----
+
+    struct parallel_device_t;  // see the .cpp
+    std::vector<std::unique_ptr<parallel_device_t>> m_parallel_devices;
+
+    // the body of each parallel device's worker thread
+    static void parallelWorker(parallel_device_t *dev);
+};
+
+
+// fixed services related to the overall simulation
+namespace system2200
+{
+    // because everything is static, we have to be told when
+    // the sim is really starting and ending.
+    void initialize();  // Time=0
+    void cleanup();     // Armageddon
+
+    // shut down the application
+    void terminate() noexcept;
+
+    // the machine the UI is attached to
+    System2200 &machine() noexcept;
+
+    // set current system configuration -- may cause reset
+    void setConfig(const SysCfgState &new_cfg);
+
+    // give access to components
+    const SysCfgState& config() noexcept;
+
+    // indicate that user wants to reconfigure the system
+    void reconfigure() noexcept;
+
+    // reset the whole system
+    void reset(bool cold_reset);
+
+    // change/query the simulation speed
+    void regulateCpuSpeed(bool regulated) noexcept;
+    bool isCpuSpeedRegulated() noexcept;
+
+    // change/query the simulation speed
+    void setDiskRealtime(bool realtime) noexcept;
+    bool isDiskRealtime() noexcept;
+
+    // temporarily halt emulation
+    void freezeEmu(bool freeze) noexcept;
+
+    // called whenever there is free time.  it returns true
+    // if it wants to be called back later when idle again
+    bool onIdle();
+
+    // simulate a timeslice worth of instructions.  the slice length, and
+    // when regulated, how long to sleep afterward, is up to the pacer.
+    void emulateTimeslice();
+
+    // ---- emulation thread ----
+
+    // run timeslices on a dedicated thread instead of from onIdle().
+    // onIdle() must still be called to handle reconfiguration and shutdown.
+    void startEmulationThread();
+    void stopEmulationThread();
+
+    // the emulation thread holds this lock for each timeslice; the UI must
+    // hold it while it touches emulator state
+    std::unique_lock<std::recursive_mutex> lockWorld();
+
+    // let go of the world lock while the emulation thread blocks on the UI
+    void waitOnUi(const std::function<void()> &wait_fn);
+
+    // amount of emulated time since the world was built, in ms
+    int64 getSimTimeMs() noexcept;
+
+    // ---- machine state ----
+
+    // save the state of the whole machine to a file, or restore it from one.
+    // they must be called between timeslices, with the world lock held.
+    bool saveState(const std::string &filename);
+    bool loadState(const std::string &filename);
+
+    // ---- keyboard input routing ----
+
+    // send a key event to the specified keyboard/terminal
+    void dispatchKeystroke(int io_addr, int term_num, int keyvalue);
+
+    // same, but safe to call from the UI thread without the world lock
+    void queueKeystroke(int io_addr, int term_num, int keyvalue);
+
+    // request the contents of a file to be fed in as a keyboard stream
+    void invokeKbScript(int io_addr, int term_num,
+                        const std::string &filename);
+
+    // indicates if a script is currently active on a given terminal
+    bool isScriptModeActive(int io_addr, int term_num);
+
+    // ---- recording and replaying input ----
+
+    // log all input from the UI to a file, stamped with the scheduler time.
+    // it stops if the machine state is restored or the machine is rebuilt.
+    bool startRecording(const std::string &filename);
+    void stopRecording();
+    bool isRecording() noexcept;
+
+    // feed the machine the input from a log, at the same scheduler times,
+    // relative to now, as it was recorded.  the machine must start out as
+    // it was when recording began.  the cpu speed is left unregulated, and
+    // input from the UI is ignored until the end of the recorded session.
+    bool startReplay(const std::string &filename);
+    void stopReplay();
+    bool isReplaying() noexcept;
+
+    // the UI has done something to the machine; log it if recording
+    void recordInput(input_event_t ev);
+
+    // ---- slot manager ----
+
+    // see the System2200 functions of the same name
+    bool getSlotInfo(int slot, int *cardtype_idx, int *addr) noexcept;
+    int getKbIoAddr(int n) noexcept;
+    int getPrinterIoAddr(int n) noexcept;
+    IoCard* getInstFromIoAddr(int io_addr) noexcept;
+    IoCard* getInstFromSlot(int slot) noexcept;
+    bool findDiskController(int n, int *slot) noexcept;
     bool findDisk(const std::string &filename, int *slot, int *drive, int *io_addr);
 
     // ---- legal cpu system configurations ----